@@ -237,6 +237,11 @@ void main_task(void * arg)
 
         // 30mS tick used for flashing LED when USB is busy
         if (flags & FLAGS_MAIN_30MS) {
+            // Bring stale image CRCs up to date once enumeration is out of the way
+            if ((usb_state != MAIN_USB_CONNECTING) && (usb_state != MAIN_USB_CHECK_CONNECTED)) {
+                info_crc_periodic();
+            }
+
             if (msc_led_usb_activity) {
 
                 if ((msc_led_state == MAIN_LED_FLASH) || (msc_led_state == MAIN_LED_FLASH_PERMANENT)) {
@@ -19,14 +19,50 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
 #include "circ_buf.h"
 
 #include "cortex_m.h"
+#include "compiler.h"
 #include "util.h"
 
+// head and tail count every byte ever popped and pushed. Their difference is
+// the number of bytes used and the low bits give the index into buf. Each
+// side stores its own counter with release, after the data accesses it hands
+// over, and loads the other side's with acquire, before the data accesses it
+// was handed. Its own counter it reads plainly.
+
+static uint32_t count_used(circ_buf_t *circ_buf)
+{
+    uint32_t head = compiler_load_acquire(&circ_buf->head);
+    uint32_t cnt = compiler_load_acquire(&circ_buf->tail) - head;
+
+    // After circ_buf_advance_tail has dropped data
+    return MIN(cnt, circ_buf->size);
+}
+
+// Called by the consumer, which owns head, before taking data
+static uint32_t consumer_count_used(circ_buf_t *circ_buf)
+{
+    uint32_t tail = compiler_load_acquire(&circ_buf->tail);
+    uint32_t cnt = tail - circ_buf->head;
+
+    if (cnt > circ_buf->size) {
+        // Skip the bytes the producer has overwritten
+        compiler_store_release(&circ_buf->head, tail - circ_buf->size);
+        cnt = circ_buf->size;
+    }
+
+    return cnt;
+}
+
 void circ_buf_init(circ_buf_t *circ_buf, uint8_t *buffer, uint32_t size)
 {
     cortex_int_state_t state;
+
+    util_assert((size != 0) && ((size & (size - 1)) == 0));
+
     state = cortex_int_get_and_disable();
 
     circ_buf->buf = buffer;
@@ -39,84 +75,55 @@ void circ_buf_init(circ_buf_t *circ_buf, uint8_t *buffer, uint32_t size)
 
 void circ_buf_push(circ_buf_t *circ_buf, uint8_t data)
 {
-    cortex_int_state_t state;
-    state = cortex_int_get_and_disable();
-
-    circ_buf->buf[circ_buf->tail] = data;
-    circ_buf->tail += 1;
-    if (circ_buf->tail >= circ_buf->size) {
-        util_assert(circ_buf->tail == circ_buf->size);
-        circ_buf->tail = 0;
-    }
+    uint32_t tail = circ_buf->tail;
 
     // Assert no overflow
-    util_assert(circ_buf->head != circ_buf->tail);
+    util_assert(tail - compiler_load_acquire(&circ_buf->head) < circ_buf->size);
 
-    cortex_int_restore(state);
+    circ_buf->buf[tail & (circ_buf->size - 1)] = data;
+    compiler_store_release(&circ_buf->tail, tail + 1);
 }
 
 uint8_t circ_buf_pop(circ_buf_t *circ_buf)
 {
     uint8_t data;
-    cortex_int_state_t state;
-
-    state = cortex_int_get_and_disable();
+    uint32_t head;
 
     // Assert buffer isn't empty
-    util_assert(circ_buf->head != circ_buf->tail);
-
-    data = circ_buf->buf[circ_buf->head];
-    circ_buf->head += 1;
-    if (circ_buf->head >= circ_buf->size) {
-        util_assert(circ_buf->head == circ_buf->size);
-        circ_buf->head = 0;
-    }
+    util_assert(consumer_count_used(circ_buf) != 0);
 
-    cortex_int_restore(state);
+    head = circ_buf->head;
+    data = circ_buf->buf[head & (circ_buf->size - 1)];
+    compiler_store_release(&circ_buf->head, head + 1);
 
     return data;
 }
 
 uint32_t circ_buf_count_used(circ_buf_t *circ_buf)
 {
-    uint32_t cnt;
-    cortex_int_state_t state;
-
-    state = cortex_int_get_and_disable();
-
-    if (circ_buf->tail >= circ_buf->head) {
-        cnt = circ_buf->tail - circ_buf->head;
-    } else {
-        cnt = circ_buf->tail + circ_buf->size - circ_buf->head;
-    }
-
-    cortex_int_restore(state);
-    return cnt;
+    return count_used(circ_buf);
 }
 
 uint32_t circ_buf_count_free(circ_buf_t *circ_buf)
 {
-    uint32_t cnt;
-    cortex_int_state_t state;
-
-    state = cortex_int_get_and_disable();
-
-    cnt = circ_buf->size - circ_buf_count_used(circ_buf) - 1;
-
-    cortex_int_restore(state);
-    return cnt;
+    return circ_buf->size - count_used(circ_buf);
 }
 
 uint32_t circ_buf_read(circ_buf_t *circ_buf, uint8_t *data, uint32_t size)
 {
     uint32_t cnt;
-    uint32_t i;
+    uint32_t head;
+    uint32_t index;
+    uint32_t first;
 
-    cnt = circ_buf_count_used(circ_buf);
+    cnt = consumer_count_used(circ_buf);
     cnt = MIN(size, cnt);
-    for (i = 0; i < cnt; i++) {
-        data[i] = circ_buf_pop(circ_buf);
-    }
+    head = circ_buf->head;
+    index = head & (circ_buf->size - 1);
+    first = MIN(cnt, circ_buf->size - index);
+    memcpy(data, circ_buf->buf + index, first);
+    memcpy(data + first, circ_buf->buf, cnt - first);
+    compiler_store_release(&circ_buf->head, head + cnt);
 
     return cnt;
 }
@@ -124,13 +131,18 @@ uint32_t circ_buf_read(circ_buf_t *circ_buf, uint8_t *data, uint32_t size)
 uint32_t circ_buf_write(circ_buf_t *circ_buf, const uint8_t *data, uint32_t size)
 {
     uint32_t cnt;
-    uint32_t i;
+    uint32_t tail;
+    uint32_t index;
+    uint32_t first;
 
     cnt = circ_buf_count_free(circ_buf);
     cnt = MIN(size, cnt);
-    for (i = 0; i < cnt; i++) {
-        circ_buf_push(circ_buf, data[i]);
-    }
+    tail = circ_buf->tail;
+    index = tail & (circ_buf->size - 1);
+    first = MIN(cnt, circ_buf->size - index);
+    memcpy(circ_buf->buf + index, data, first);
+    memcpy(circ_buf->buf, data + first, cnt - first);
+    compiler_store_release(&circ_buf->tail, tail + cnt);
 
     return cnt;
 }
@@ -138,43 +150,69 @@ uint32_t circ_buf_write(circ_buf_t *circ_buf, const uint8_t *data, uint32_t size
 const uint8_t* circ_buf_peek(circ_buf_t *circ_buf, uint32_t* size)
 {
     uint32_t cnt;
-    uint8_t* ret;
-    cortex_int_state_t state;
+    uint32_t index;
 
-    state = cortex_int_get_and_disable();
+    cnt = consumer_count_used(circ_buf);
+    index = circ_buf->head & (circ_buf->size - 1);
 
-    if (circ_buf->tail >= circ_buf->head) {
-        cnt = circ_buf->tail - circ_buf->head;
-    } else {
-        // We can't peek all the bytes in the circular buffer in this case.
-        cnt = circ_buf->size - circ_buf->head;
+    if (size) {
+        // We can't peek past the end of the buffer memory
+        *size = MIN(cnt, circ_buf->size - index);
     }
-    ret = circ_buf->buf + circ_buf->head;
+    return circ_buf->buf + index;
+}
 
-    cortex_int_restore(state);
+void circ_buf_pop_n(circ_buf_t *circ_buf, uint32_t n)
+{
+    uint32_t head;
+
+    util_assert(consumer_count_used(circ_buf) >= n);
+
+    head = circ_buf->head;
+    // Finish reading the peeked bytes before handing them back to the producer
+    compiler_store_release(&circ_buf->head, head + n);
+}
+
+uint8_t* circ_buf_peek_free(circ_buf_t *circ_buf, uint32_t* size)
+{
+    uint32_t cnt;
+    uint32_t index;
+
+    cnt = circ_buf_count_free(circ_buf);
+    index = circ_buf->tail & (circ_buf->size - 1);
 
     if (size) {
-        *size = cnt;
+        *size = MIN(cnt, circ_buf->size - index);
     }
-    return ret;
+    return circ_buf->buf + index;
 }
 
-void circ_buf_pop_n(circ_buf_t *circ_buf, uint32_t n)
+void circ_buf_push_n(circ_buf_t *circ_buf, uint32_t n)
 {
-    cortex_int_state_t state;
+    util_assert(circ_buf_count_free(circ_buf) >= n);
 
-    state = cortex_int_get_and_disable();
+    compiler_store_release(&circ_buf->tail, circ_buf->tail + n);
+}
 
-    if (circ_buf->tail >= circ_buf->head) {
-        util_assert(circ_buf->tail - circ_buf->head >= n);
-        circ_buf->head += n;
-    } else {
-        util_assert(circ_buf->tail + circ_buf->size - circ_buf->head >= n);
-        circ_buf->head += n;
-        if (circ_buf->head >= circ_buf->size) {
-            circ_buf->head -= circ_buf->size;
-        }
+uint32_t circ_buf_advance_tail(circ_buf_t *circ_buf, uint32_t pos)
+{
+    uint32_t head;
+    uint32_t tail;
+    uint32_t used;
+    uint32_t dropped = 0;
+
+    util_assert(pos < circ_buf->size);
+
+    head = compiler_load_acquire(&circ_buf->head);
+    tail = circ_buf->tail;
+    used = tail - head;
+    tail += (pos - tail) & (circ_buf->size - 1);
+    compiler_store_release(&circ_buf->tail, tail);
+
+    // The consumer owns head and skips the overwritten bytes on its next
+    // call. Only count what was dropped since the previous call.
+    if (tail - head > circ_buf->size) {
+        dropped = tail - head - MAX(used, circ_buf->size);
     }
-
-    cortex_int_restore(state);
+    return dropped;
 }
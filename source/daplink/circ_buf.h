@@ -29,14 +29,30 @@
 extern "C" {
 #endif
 
+// Lock-free ring for a single producer and a single consumer, such as a UART
+// ISR and the CDC thread. head and tail are free running counters, only the
+// consumer writes head and only the producer writes tail, so neither side
+// needs to mask interrupts. The size must be a power of two and all of it is
+// usable.
+//
+// Producer side: circ_buf_push, circ_buf_write, circ_buf_peek_free,
+// circ_buf_push_n and circ_buf_advance_tail.
+// Consumer side: circ_buf_pop, circ_buf_read, circ_buf_peek and
+// circ_buf_pop_n.
+// circ_buf_count_used and circ_buf_count_free may be called from either side.
+// Each side must stay in one context: two threads popping the same buffer
+// (or pushing into it) need a lock around every call, which defeats the point.
+// The UART buffers are therefore only consumed and filled by the main task
+// on the USB side, DAP UART commands included.
 typedef struct {
-    uint32_t head;
-    uint32_t tail;
+    volatile uint32_t head;
+    volatile uint32_t tail;
     uint32_t size;
     uint8_t *buf;
 } circ_buf_t;
 
-// Initialize or reinitialize a circular buffer
+// Initialize or reinitialize a circular buffer. size must be a power of two.
+// Neither side may be using the buffer while it is reinitialized.
 void circ_buf_init(circ_buf_t *circ_buf, uint8_t *buffer, uint32_t size);
 
 // Push a byte into the circular buffer
@@ -66,6 +82,23 @@ const uint8_t* circ_buf_peek(circ_buf_t *circ_buf, uint32_t* size);
 // discarded.
 void circ_buf_pop_n(circ_buf_t *circ_buf, uint32_t n);
 
+// Returns a pointer to the next free byte on the circular buffer and stores in
+// the value pointed by "size" the number of bytes that can be written there
+// directly, which may be less than the total free space.
+uint8_t* circ_buf_peek_free(circ_buf_t *circ_buf, uint32_t* size);
+
+// Add n bytes written through circ_buf_peek_free to the back of the circular
+// buffer.
+void circ_buf_push_n(circ_buf_t *circ_buf, uint32_t n);
+
+// Move the tail to pos for a producer, such as DMA in circular mode, that
+// writes the buffer memory directly. pos is the index it writes next. Unread
+// bytes that were overwritten are dropped from the front so the newest data
+// is kept; the consumer moves its own head past them on its next call. Must be
+// called before the producer writes size bytes past the previous position.
+// Returns the number of bytes dropped.
+uint32_t circ_buf_advance_tail(circ_buf_t *circ_buf, uint32_t pos);
+
 #ifdef __cplusplus
 }
 #endif
@@ -35,6 +35,12 @@
 #include "DAP.h"
 #include "info.h"
 #include "dap_strings.h"
+#ifdef DAP_STATS
+#include "DAP_stats.h"
+#endif
+#ifdef DAP_ADAPTIVE_CLOCK
+#include "DAP_clock.h"
+#endif
 
 
 #if (DAP_PACKET_SIZE < 64U)
@@ -407,7 +413,19 @@ static void Set_DAP_Clock_Delay(uint32_t clock) {
 
     DAP_Data.clock_delay = delay;
   }
+#if ((DAP_SWD != 0) && (DAP_SWD_SPI != 0))
+  DAP_Data.spi_clock = (SWD_SPI_Clock(clock) != 0U) ? 1U : 0U;
+#endif
+}
+
+
+#ifdef DAP_ADAPTIVE_CLOCK
+// Change the SWJ clock on behalf of the adaptive clock control
+//   clock:  requested SWJ clock in Hz
+void DAP_SetClock(uint32_t clock) {
+  Set_DAP_Clock_Delay(clock);
 }
+#endif
 
 
 // Process SWJ Clock command and prepare response
@@ -432,6 +450,9 @@ static uint32_t DAP_SWJ_Clock(const uint8_t *request, uint8_t *response) {
 
   DAP_Data.nominal_clock = clock;
 
+#ifdef DAP_ADAPTIVE_CLOCK
+  clock = DAP_clock_request(clock);
+#endif
   Set_DAP_Clock_Delay(clock);
 
   *response = DAP_OK;
@@ -1791,6 +1812,21 @@ uint32_t DAP_ProcessCommand(const uint8_t *request, uint8_t *response) {
 }
 
 
+// Process DAP command and record its execution time in the statistics
+static uint32_t DAP_ProcessCommandTimed(const uint8_t *request, uint8_t *response) {
+#ifdef DAP_STATS
+  uint32_t start, num;
+
+  start = DAP_stats_start();
+  num = DAP_ProcessCommand(request, response);
+  DAP_stats_command(*request, start);
+  return (num);
+#else
+  return DAP_ProcessCommand(request, response);
+#endif
+}
+
+
 // Execute DAP command (process request and prepare response)
 //   request:  pointer to request data
 //   response: pointer to response data
@@ -1805,7 +1841,7 @@ uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response) {
     *response++ = (uint8_t)cnt;
     num = (2U << 16) | 2U;
     while (cnt--) {
-      n = DAP_ProcessCommand(request, response);
+      n = DAP_ProcessCommandTimed(request, response);
       num += n;
       request  += (uint16_t)(n >> 16);
       response += (uint16_t) n;
@@ -1813,7 +1849,7 @@ uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response) {
     return (num);
   }
 
-  return DAP_ProcessCommand(request, response);
+  return DAP_ProcessCommandTimed(request, response);
 }
 
 
@@ -1837,6 +1873,9 @@ void DAP_Setup(void) {
 
   // Sets DAP_Data.fast_clock and DAP_Data.clock_delay.
   Set_DAP_Clock_Delay(DAP_DEFAULT_SWJ_CLOCK);
+#ifdef DAP_ADAPTIVE_CLOCK
+  DAP_clock_init(DAP_DEFAULT_SWJ_CLOCK);
+#endif
 
   DAP_SETUP();  // Device specific setup
 }
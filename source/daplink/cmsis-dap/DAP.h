@@ -241,7 +241,8 @@
 typedef struct {
   uint8_t     debug_port;                       // Debug Port
   uint8_t     fast_clock;                       // Fast Clock Flag
-  uint8_t     padding[2];
+  uint8_t     spi_clock;                       // SPI Clock Flag
+  uint8_t     padding[1];
   uint32_t   clock_delay;                       // Clock Delay
   uint32_t nominal_clock;                       // Nominal requested clock frequency in Hertz.
   uint32_t     timestamp;                       // Last captured Timestamp
@@ -290,8 +291,25 @@ extern void     JTAG_WriteAbort (uint32_t data);
 extern uint8_t  JTAG_Transfer   (uint32_t request, uint32_t *data);
 extern uint8_t  SWD_Transfer    (uint32_t request, uint32_t *data);
 
+// SPI assisted SWD, implemented by the HIC when its DAP_config.h sets
+// DAP_SWD_SPI to 1 (undefined means 0). LSB first, SWCLK idles high.
+// Writes change SWDIO on the falling edge (mode 3); reads sample SWDIO
+// while SWCLK is low, before the target shifts on the rising edge.
+// SWCLK and SWDIO are under GPIO control with SWCLK high on entry and
+// must be left that way on return, SWDIO driving the last bit written.
+//   SWD_SPI_Clock: set the fastest SPI clock not above clock, 0 if none
+//   SWD_SPI_Write: drive the lower count bytes of data on SWDIO
+//   SWD_SPI_Read:  capture count bytes from SWDIO
+extern uint32_t SWD_SPI_Clock   (uint32_t clock);
+extern void     SWD_SPI_Write   (uint32_t data, uint32_t count);
+extern uint32_t SWD_SPI_Read    (uint32_t count);
+
 extern void     Delayms         (uint32_t delay);
 
+#ifdef DAP_ADAPTIVE_CLOCK
+extern void     DAP_SetClock    (uint32_t clock);
+#endif
+
 extern uint32_t SWO_Transport      (const uint8_t *request, uint8_t *response);
 extern uint32_t SWO_Mode           (const uint8_t *request, uint8_t *response);
 extern uint32_t SWO_Baudrate       (const uint8_t *request, uint8_t *response);
@@ -303,6 +321,7 @@ extern uint32_t SWO_Data           (const uint8_t *request, uint8_t *response);
 extern void     SWO_QueueTransfer    (uint8_t *buf, uint32_t num);
 extern void     SWO_AbortTransfer    (void);
 extern void     SWO_TransferComplete (void);
+extern void     SWO_Thread           (void *argument);
 
 extern uint32_t SWO_Mode_UART     (uint32_t enable);
 extern uint32_t SWO_Baudrate_UART (uint32_t baudrate);
@@ -0,0 +1,195 @@
+/**
+ * @file    DAP_clock.c
+ * @brief   Adaptive SWD clock driven by the transfer error rate
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2021, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef DAP_ADAPTIVE_CLOCK
+
+#include <string.h>
+#include "DAP_config.h"
+#include "DAP.h"
+#include "DAP_clock.h"
+#include "settings.h"
+
+// Request for a DP read of DPIDR
+#define DPIDR_READ      DAP_TRANSFER_RnW
+
+static DAP_clock_t state;
+static bool enabled;
+static uint32_t transfers;
+static uint32_t errors;
+static uint32_t waits;
+static uint32_t clean;
+
+static void start_window(void)
+{
+    transfers = 0;
+    errors = 0;
+    waits = 0;
+}
+
+static void set_clock(uint32_t clock)
+{
+    state.clock = clock;
+    DAP_SetClock(clock);
+    start_window();
+    clean = 0;
+}
+
+// Start from the request, or from the stored clock of this target if lower
+static void restart(void)
+{
+    uint32_t clock = state.requested;
+    uint32_t saved = config_get_swd_clock(state.idcode);
+
+    state.ceiling = 0;
+    state.stable = 0;
+    if (enabled && saved && (saved < clock)) {
+        clock = saved;
+    }
+    set_clock(clock);
+}
+
+static void step_down(void)
+{
+    uint32_t clock = state.clock - state.clock / 4;
+
+    if (clock < DAP_CLOCK_MIN) {
+        clock = DAP_CLOCK_MIN;
+    }
+    state.ceiling = state.clock;
+    if (state.stable >= state.ceiling) {
+        state.stable = 0;
+    }
+    if (clock != state.clock) {
+        state.steps_down++;
+    }
+    set_clock(clock);
+}
+
+static void step_up(void)
+{
+    uint32_t clock = state.clock + state.clock / 4;
+
+    if (clock > state.requested) {
+        clock = state.requested;
+    }
+    // Search between the current clock and the one that failed
+    if (state.ceiling && (clock >= state.ceiling)) {
+        clock = state.clock + (state.ceiling - state.clock) / 2;
+    }
+    if (clock > state.clock) {
+        state.steps_up++;
+        set_clock(clock);
+    }
+}
+
+void DAP_clock_init(uint32_t clock)
+{
+    memset(&state, 0, sizeof(state));
+    enabled = config_get_adaptive_swd_clock();
+    state.requested = clock;
+    state.clock = clock;
+    start_window();
+    clean = 0;
+}
+
+void DAP_clock_enable(bool enable)
+{
+    enabled = enable;
+    config_set_adaptive_swd_clock(enable);
+    restart();
+}
+
+bool DAP_clock_enabled(void)
+{
+    return enabled;
+}
+
+uint32_t DAP_clock_request(uint32_t clock)
+{
+    state.requested = clock;
+    restart();
+    return state.clock;
+}
+
+void DAP_clock_transfer(uint32_t request, const uint32_t *data, uint8_t ack)
+{
+    if (ack == DAP_TRANSFER_OK) {
+        if (((request & 0x0FU) == DPIDR_READ) && data && (*data != state.idcode)) {
+            // New target, its stored clock applies from here on
+            state.idcode = *data;
+            restart();
+            return;
+        }
+    } else if (ack == DAP_TRANSFER_WAIT) {
+        waits++;
+    } else if (ack != DAP_TRANSFER_FAULT) {
+        errors++;
+    }
+    if (!enabled) {
+        return;
+    }
+
+    if ((errors >= DAP_CLOCK_ERRORS) || (waits >= DAP_CLOCK_WAITS)) {
+        step_down();
+        return;
+    }
+    if (++transfers < DAP_CLOCK_WINDOW) {
+        return;
+    }
+
+    if (errors) {
+        clean = 0;
+        start_window();
+        return;
+    }
+
+    // Clean window
+    start_window();
+    if (state.clock > state.stable) {
+        state.stable = state.clock;
+    }
+    if (++clean >= DAP_CLOCK_PROBE) {
+        clean = 0;
+        step_up();
+    }
+}
+
+const DAP_clock_t *DAP_clock_get(void)
+{
+    return &state;
+}
+
+bool DAP_clock_save(void)
+{
+    if (!state.stable || !state.idcode) {
+        return false;
+    }
+    config_set_swd_clock(state.idcode, state.stable);
+    return true;
+}
+
+void DAP_clock_forget(void)
+{
+    config_set_swd_clock(0, 0);
+    restart();
+}
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * @file    DAP_clock.h
+ * @brief   Adaptive SWD clock driven by the transfer error rate
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2021, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DAP_CLOCK_H
+#define DAP_CLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The adaptive clock is only built when DAP_ADAPTIVE_CLOCK is defined for
+// the project. When enabled, the clock requested with DAP_SWJ_Clock becomes
+// an upper bound. Protocol errors (parity, missing ACK) or a WAIT storm
+// lower the clock. After a run of clean windows it is raised again, up to
+// the request but staying below the lowest clock that has failed.
+
+// Transfers per evaluation window
+#define DAP_CLOCK_WINDOW        256U
+// Protocol errors that lower the clock right away
+#define DAP_CLOCK_ERRORS        2U
+// WAIT acknowledges in a window that lower the clock
+#define DAP_CLOCK_WAITS         (DAP_CLOCK_WINDOW / 2U)
+// Clean windows before a higher clock is tried
+#define DAP_CLOCK_PROBE         8U
+// The clock is never lowered below this
+#define DAP_CLOCK_MIN           100000U
+
+typedef struct {
+    uint32_t requested;     // clock requested by the host
+    uint32_t clock;         // clock in use
+    uint32_t ceiling;       // lowest clock that failed, 0 if none
+    uint32_t stable;        // clock of the last clean window, 0 if none
+    uint32_t idcode;        // last DPIDR read from the target
+    uint32_t steps_down;
+    uint32_t steps_up;
+} DAP_clock_t;
+
+// Called from DAP_Setup with the default clock
+void DAP_clock_init(uint32_t clock);
+void DAP_clock_enable(bool enable);
+bool DAP_clock_enabled(void);
+
+// Called with the host request from DAP_SWJ_Clock, returns the clock to use
+uint32_t DAP_clock_request(uint32_t clock);
+// Called after every SWD transfer
+void DAP_clock_transfer(uint32_t request, const uint32_t *data, uint8_t ack);
+
+const DAP_clock_t *DAP_clock_get(void);
+// Store the stable clock for the current target, returns false if there is none
+bool DAP_clock_save(void);
+void DAP_clock_forget(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
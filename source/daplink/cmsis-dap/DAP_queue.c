@@ -23,13 +23,58 @@
 #include "DAP_queue.h"
 #include "daplink_vendor_commands.h"
 #include "main_interface.h"
+#include "util.h"
+#ifdef DAP_STATS
+#include "DAP_stats.h"
+#endif
 
-void DAP_queue_init(DAP_queue * queue)
+static DAP_queue * DAP_queues[DAP_QUEUE_MAX];
+static volatile uint32_t DAP_queue_num;
+
+// Set from MSD_Open to MSD_Close. The main task holds the target for the
+// whole stream, so the requests in between are executed there as well.
+static BOOL DAP_queue_msd_open;
+
+static uint32_t DAP_queue_next(uint32_t count)
+{
+    return (count + 1) % DAP_QUEUE_WRAP;
+}
+
+static uint32_t DAP_queue_distance(uint32_t from, uint32_t to)
+{
+    return (to + DAP_QUEUE_WRAP - from) % DAP_QUEUE_WRAP;
+}
+
+static uint32_t DAP_queue_req_slot(uint32_t count)
 {
-    queue->recv_idx = 0;
-    queue->send_idx = 0;
-    queue->free_count = FREE_COUNT_INIT;
-    queue->send_count = SEND_COUNT_INIT;
+    return count % DAP_QUEUE_SLOTS;
+}
+
+static uint32_t DAP_queue_resp_slot(uint32_t count)
+{
+    return (count + DAP_QUEUE_SLOTS - 1) % DAP_QUEUE_SLOTS;
+}
+
+void DAP_queue_init(DAP_queue * queue, DAP_queue_send_cb_t send_cb)
+{
+    uint32_t i;
+
+    queue->recv_count = 0;
+    queue->exec_count = 0;
+    queue->send_count = 0;
+    queue->send_cb = send_cb;
+
+    for (i = 0; i < DAP_queue_num; i++) {
+        if (DAP_queues[i] == queue) {
+            return;
+        }
+    }
+    if (DAP_queue_num >= DAP_QUEUE_MAX) {
+        util_assert(0);
+        return;
+    }
+    DAP_queues[DAP_queue_num] = queue;
+    compiler_store_release(&DAP_queue_num, DAP_queue_num + 1);
 }
 
 /*
@@ -40,12 +85,13 @@ void DAP_queue_init(DAP_queue * queue)
 
 BOOL DAP_queue_get_send_buf(DAP_queue * queue, uint8_t ** buf, int * len)
 {
-    if (queue->send_count) {
-        queue->send_count--;
-        *buf = queue->USB_Request[queue->send_idx];
-        *len = queue->resp_size[queue->send_idx];
-        queue->send_idx = (queue->send_idx + 1) % DAP_PACKET_COUNT;
-        queue->free_count++;
+    uint32_t slot;
+    // Read the response only after it has been published
+    if (queue->send_count != compiler_load_acquire(&queue->exec_count)) {
+        slot = DAP_queue_resp_slot(queue->send_count);
+        *buf = queue->slot[slot];
+        *len = queue->resp_size[slot];
+        queue->send_count = DAP_queue_next(queue->send_count);
         return (__TRUE);
     }
     return (__FALSE);
@@ -66,31 +112,155 @@ __WEAK uint8_t DAP_activity_blink(const uint8_t *buf)
 }
 
 /*
- *  Execute a request and store result to the DAP_queue
- *    Parameters:      queue - DAP queue, reqbuf = buffer with DAP request, len = of the request buffer, retbuf = buffer to peek on the result of the DAP operation
+ *  Determine if a request has to be executed by the main task. The UART and
+ *  MSD vendor commands share the UART buffers, the drag-n-drop stream and the
+ *  flash manager settings with it, and the adaptive clock command writes the
+ *  persistent config that only the main task programs. The commands batched in DAP_ExecuteCommands
+ *  are only known once they run, so such a batch goes to the main task too.
+ *    Parameters:      buf: buffer with DAP request
+ *    Return Value:    1 if the main task executes the request, 0 otherwise
+ */
+static uint8_t DAP_queue_main_task_request(const uint8_t *buf)
+{
+    if (DAP_queue_msd_open) {
+        return 1;
+    }
+
+    switch (buf[0]) {
+        case ID_DAP_ExecuteCommands:
+        case ID_DAP_UART_GetLineCoding:
+        case ID_DAP_UART_SetConfiguration:
+        case ID_DAP_UART_Read:
+        case ID_DAP_UART_Write:
+        case ID_DAP_MSD_Open:
+        case ID_DAP_MSD_Close:
+        case ID_DAP_MSD_Write:
+        case ID_DAP_SelectEraseMode:
+        case ID_DAP_SelectIncrementalMode:
+        case ID_DAP_AdaptiveClock:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/*
+ *  Get the free slot of the DAP_queue the next request can be received into
+ *    Parameters:      queue - DAP queue, buf = return the buffer location, DAP_PACKET_SIZE bytes
  *    Return Value:    TRUE - Success, FALSE - Error
  */
 
+BOOL DAP_queue_get_recv_buf(DAP_queue * queue, uint8_t ** buf)
+{
+    if (DAP_queue_distance(queue->send_count, queue->recv_count) < DAP_PACKET_COUNT) {
+        *buf = queue->slot[DAP_queue_req_slot(queue->recv_count)];
+        return (__TRUE);
+    }
+#ifdef DAP_STATS
+    DAP_stats_queue_full();
+#endif
+    return (__FALSE);
+}
+
+/*
+ *  Queue the request received into the buffer from DAP_queue_get_recv_buf and wake the DAP thread
+ *    Parameters:      queue - DAP queue
+ *    Return Value:    None
+ */
 
-BOOL DAP_queue_execute_buf(DAP_queue * queue, const uint8_t *reqbuf, int len, uint8_t ** retbuf)
+void DAP_queue_commit_recv_buf(DAP_queue * queue)
 {
-    uint32_t rsize;
-    if (queue->free_count > 0) {
-        if (DAP_activity_blink(reqbuf)) {
-            main_blink_hid_led(MAIN_LED_FLASH);
-        }
+    if (DAP_activity_blink(queue->slot[DAP_queue_req_slot(queue->recv_count)])) {
+        main_blink_hid_led(MAIN_LED_FLASH);
+    }
+
+    // Publish the request only once it is complete
+    compiler_store_release(&queue->recv_count, DAP_queue_next(queue->recv_count));
+#ifdef DAP_STATS
+    DAP_stats_queue_depth(DAP_queue_distance(queue->send_count, queue->recv_count));
+#endif
+    main_dap_execute_event();
+}
+
+/*
+ *  Copy a request to the DAP_queue and wake the DAP thread to execute it
+ *    Parameters:      queue - DAP queue, reqbuf = buffer with DAP request, len = of the request buffer
+ *    Return Value:    TRUE - Success, FALSE - Error
+ */
 
+BOOL DAP_queue_submit_buf(DAP_queue * queue, const uint8_t *reqbuf, int len)
+{
+    uint8_t * rbuf;
+    if (DAP_queue_get_recv_buf(queue, &rbuf)) {
         if (len > DAP_PACKET_SIZE) {
             len = DAP_PACKET_SIZE;
         }
-        queue->free_count--;
-        memcpy(queue->USB_Request[queue->recv_idx], reqbuf, len);
-        rsize = DAP_ExecuteCommand(reqbuf, queue->USB_Request[queue->recv_idx]);
-        queue->resp_size[queue->recv_idx] = rsize & 0xFFFF; //get the response size
-        *retbuf = queue->USB_Request[queue->recv_idx];
-        queue->recv_idx = (queue->recv_idx + 1) % DAP_PACKET_COUNT;
-        queue->send_count++;
+        memcpy(rbuf, reqbuf, len);
+        DAP_queue_commit_recv_buf(queue);
         return (__TRUE);
     }
     return (__FALSE);
 }
+
+/*
+ *  Execute the pending requests of all DAP_queues. Called from the DAP thread.
+ *    Parameters:      None
+ *    Return Value:    None
+ */
+
+void DAP_queue_execute_pending(void)
+{
+    DAP_queue * queue;
+    uint8_t * req;
+    uint8_t * resp;
+    uint32_t i, rsize;
+    BOOL executed;
+
+    do {
+        executed = __FALSE;
+        for (i = 0; i < compiler_load_acquire(&DAP_queue_num); i++) {
+            queue = DAP_queues[i];
+            if (queue->exec_count == compiler_load_acquire(&queue->recv_count)) {
+                continue;
+            }
+            req = queue->slot[DAP_queue_req_slot(queue->exec_count)];
+            resp = queue->slot[DAP_queue_resp_slot(queue->exec_count)];
+            if (DAP_queue_main_task_request(req)) {
+                if (req[0] == ID_DAP_MSD_Open) {
+                    DAP_queue_msd_open = __TRUE;
+                } else if (req[0] == ID_DAP_MSD_Close) {
+                    DAP_queue_msd_open = __FALSE;
+                }
+                rsize = main_dap_execute_command(req, resp);
+            } else {
+                main_target_lock();
+                rsize = DAP_ExecuteCommand(req, resp);
+                main_target_unlock();
+            }
+            queue->resp_size[DAP_queue_resp_slot(queue->exec_count)] = rsize & 0xFFFF; //get the response size
+            compiler_store_release(&queue->exec_count, DAP_queue_next(queue->exec_count));
+            // Let the USB thread send this response while the next one executes
+            main_dap_send_event();
+            executed = __TRUE;
+        }
+    } while (executed);
+}
+
+/*
+ *  Hand the executed responses of all DAP_queues to their transport. Called from the USB thread.
+ *    Parameters:      None
+ *    Return Value:    None
+ */
+
+void DAP_queue_send_pending(void)
+{
+    DAP_queue * queue;
+    uint32_t i;
+
+    for (i = 0; i < compiler_load_acquire(&DAP_queue_num); i++) {
+        queue = DAP_queues[i];
+        if ((queue->send_count != compiler_load_acquire(&queue->exec_count)) && queue->send_cb) {
+            queue->send_cb();
+        }
+    }
+}
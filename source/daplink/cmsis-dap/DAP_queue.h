@@ -30,19 +30,38 @@
 extern "C" {
 #endif
 
-#define FREE_COUNT_INIT          (DAP_PACKET_COUNT)
-#define SEND_COUNT_INIT          0
+// One queue per DAP transport (HID and bulk)
+#define DAP_QUEUE_MAX            2
+
+// Called from the USB thread when a response is ready to be sent
+typedef void (*DAP_queue_send_cb_t)(void);
+
+// Requests are received and responses sent by the USB thread while the DAP
+// thread executes them. Each counter is only written by one thread, so a slot
+// is owned by whoever is between its two counters. There is one slot more than
+// requests in flight: request n is received into slot n and its response is
+// built in slot n - 1, which request n - 1 no longer needs once executed, so
+// requests are not copied once received. The USB drivers still copy between
+// the endpoint buffers and the slots.
+#define DAP_QUEUE_SLOTS          (DAP_PACKET_COUNT + 1)
+// Counters wrap at a multiple of the slot count so they map onto slots
+#define DAP_QUEUE_WRAP           (DAP_QUEUE_SLOTS * 2)
 
 typedef struct _DAP_queue {
-    uint8_t     USB_Request [DAP_PACKET_COUNT][DAP_PACKET_SIZE];  // Request  Buffer
-    uint16_t    resp_size[DAP_PACKET_COUNT]; //track the return response size
-    uint32_t    free_count;
-    uint32_t    send_count;
-    uint32_t    recv_idx;
-    uint32_t    send_idx;
+    uint8_t     slot[DAP_QUEUE_SLOTS][DAP_PACKET_SIZE];  // Request and Response Buffers
+    uint16_t    resp_size[DAP_QUEUE_SLOTS]; //track the return response size
+    volatile uint32_t recv_count;            //requests received (USB thread)
+    volatile uint32_t exec_count;            //requests executed (DAP thread)
+    volatile uint32_t send_count;            //responses sent (USB thread)
+    DAP_queue_send_cb_t send_cb;
 } DAP_queue;
 
-void DAP_queue_init(DAP_queue * queue);
+/*
+ *  Reset a DAP_queue and register it with the DAP thread
+ *    Parameters:      queue - DAP queue, send_cb = called when a response is ready to be sent
+ *    Return Value:    None
+ */
+void DAP_queue_init(DAP_queue * queue, DAP_queue_send_cb_t send_cb);
 
 /*
  *  Get the a buffer from the DAP_queue where the response to the request is stored
@@ -52,11 +71,39 @@ void DAP_queue_init(DAP_queue * queue);
 BOOL DAP_queue_get_send_buf(DAP_queue * queue, uint8_t ** buf, int * len);
 
 /*
- *  Execute a request and store result to the DAP_queue
- *    Parameters:      queue - DAP queue, reqbuf = buffer with DAP request, len = of the request buffer, retbuf = buffer to peek on the result of the DAP operation
+ *  Get the free slot of the DAP_queue the next request can be received into
+ *    Parameters:      queue - DAP queue, buf = return the buffer location, DAP_PACKET_SIZE bytes
  *    Return Value:    TRUE - Success, FALSE - Error
  */
-BOOL DAP_queue_execute_buf(DAP_queue * queue, const uint8_t *reqbuf, int len, uint8_t ** retbuf);
+BOOL DAP_queue_get_recv_buf(DAP_queue * queue, uint8_t ** buf);
+
+/*
+ *  Queue the request received into the buffer from DAP_queue_get_recv_buf and wake the DAP thread
+ *    Parameters:      queue - DAP queue
+ *    Return Value:    None
+ */
+void DAP_queue_commit_recv_buf(DAP_queue * queue);
+
+/*
+ *  Copy a request to the DAP_queue and wake the DAP thread to execute it
+ *    Parameters:      queue - DAP queue, reqbuf = buffer with DAP request, len = of the request buffer
+ *    Return Value:    TRUE - Success, FALSE - Error
+ */
+BOOL DAP_queue_submit_buf(DAP_queue * queue, const uint8_t *reqbuf, int len);
+
+/*
+ *  Execute the pending requests of all DAP_queues. Called from the DAP thread.
+ *    Parameters:      None
+ *    Return Value:    None
+ */
+void DAP_queue_execute_pending(void);
+
+/*
+ *  Hand the executed responses of all DAP_queues to their transport. Called from the USB thread.
+ *    Parameters:      None
+ *    Return Value:    None
+ */
+void DAP_queue_send_pending(void);
 
 #ifdef __cplusplus
 }
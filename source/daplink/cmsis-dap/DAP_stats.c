@@ -0,0 +1,154 @@
+/**
+ * @file    DAP_stats.c
+ * @brief   Implementation of DAP_stats.h
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2021, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef DAP_STATS
+
+#include <string.h>
+#include "DAP_config.h"
+#include "DAP.h"
+#include "DAP_stats.h"
+
+#define DAP_STATS_OTHER         (DAP_STATS_CMDS - 1)
+
+static DAP_stats_t stats;
+static DAP_stats_cmd_t cmd_stats[DAP_STATS_CMDS];
+
+static uint32_t command_index(uint8_t id)
+{
+    if (id < DAP_STATS_STD_CMDS) {
+        return id;
+    }
+    if ((id >= ID_DAP_Vendor0) && (id < ID_DAP_Vendor0 + DAP_STATS_VENDOR_CMDS)) {
+        return DAP_STATS_STD_CMDS + (id - ID_DAP_Vendor0);
+    }
+    return DAP_STATS_OTHER;
+}
+
+static uint32_t time_bucket(uint32_t us)
+{
+    uint32_t bucket = 0;
+
+    us >>= 4;
+    while (us && (bucket < DAP_STATS_BUCKETS - 1)) {
+        us >>= 2;
+        bucket++;
+    }
+    return bucket;
+}
+
+void DAP_stats_reset(void)
+{
+    memset(&stats, 0, sizeof(stats));
+    memset(cmd_stats, 0, sizeof(cmd_stats));
+}
+
+uint32_t DAP_stats_start(void)
+{
+#if (TIMESTAMP_CLOCK != 0U)
+    return TIMESTAMP_GET();
+#else
+    return 0;
+#endif
+}
+
+void DAP_stats_command(uint8_t id, uint32_t start)
+{
+    DAP_stats_cmd_t *cmd = &cmd_stats[command_index(id)];
+    uint32_t us = 0;
+
+#if (TIMESTAMP_CLOCK != 0U)
+    us = TIMESTAMP_GET() - start;
+#if (TIMESTAMP_CLOCK > 1000000U)
+    us /= TIMESTAMP_CLOCK / 1000000U;
+#endif
+#endif
+    cmd->count++;
+    cmd->total_us += us;
+    if (us > cmd->max_us) {
+        cmd->max_us = us;
+    }
+    cmd->hist[time_bucket(us)]++;
+}
+
+void DAP_stats_swd_ack(uint8_t ack)
+{
+    switch (ack) {
+        case DAP_TRANSFER_OK:
+            break;
+        case DAP_TRANSFER_WAIT:
+            stats.swd_wait++;
+            break;
+        case DAP_TRANSFER_FAULT:
+            stats.swd_fault++;
+            break;
+        default:
+            stats.swd_error++;
+            break;
+    }
+}
+
+void DAP_stats_queue_depth(uint32_t depth)
+{
+    if (depth > stats.queue_max) {
+        stats.queue_max = depth;
+    }
+}
+
+void DAP_stats_queue_full(void)
+{
+    stats.queue_full++;
+}
+
+const DAP_stats_t *DAP_stats_get(void)
+{
+    return &stats;
+}
+
+const DAP_stats_cmd_t *DAP_stats_get_command(uint8_t id)
+{
+    uint32_t index = command_index(id);
+
+    if (index == DAP_STATS_OTHER) {
+        return NULL;
+    }
+    return &cmd_stats[index];
+}
+
+uint8_t DAP_stats_command_id(uint32_t index)
+{
+    if (index < DAP_STATS_STD_CMDS) {
+        return index;
+    }
+    if (index < DAP_STATS_OTHER) {
+        return ID_DAP_Vendor0 + (index - DAP_STATS_STD_CMDS);
+    }
+    return 0xFF;
+}
+
+const DAP_stats_cmd_t *DAP_stats_get_entry(uint32_t index)
+{
+    if (index >= DAP_STATS_CMDS) {
+        return NULL;
+    }
+    return &cmd_stats[index];
+}
+
+#endif
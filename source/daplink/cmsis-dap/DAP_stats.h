@@ -0,0 +1,79 @@
+/**
+ * @file    DAP_stats.h
+ * @brief   DAP command timing and transfer statistics
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2021, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DAP_STATS_H
+#define DAP_STATS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Statistics are only collected when DAP_STATS is defined for the project.
+// Times are in microseconds and stay 0 on HICs without TIMESTAMP_CLOCK.
+
+// Standard commands are tracked individually, and so are the first DAPLink
+// vendor commands. Anything else shares the last entry.
+#define DAP_STATS_STD_CMDS      0x20
+#define DAP_STATS_VENDOR_CMDS   0x10
+#define DAP_STATS_CMDS          (DAP_STATS_STD_CMDS + DAP_STATS_VENDOR_CMDS + 1)
+
+// Execution time histogram, bucket n counts times below 16 << (2 * n) us
+// and the last bucket counts everything above
+#define DAP_STATS_BUCKETS       8
+
+typedef struct {
+    uint32_t count;
+    uint32_t total_us;
+    uint32_t max_us;
+    uint32_t hist[DAP_STATS_BUCKETS];
+} DAP_stats_cmd_t;
+
+typedef struct {
+    uint32_t swd_wait;      // WAIT acknowledges, each one is a retry
+    uint32_t swd_fault;     // FAULT acknowledges
+    uint32_t swd_error;     // missing acknowledges and parity errors
+    uint32_t queue_max;     // most requests in a DAP_queue at once
+    uint32_t queue_full;    // requests dropped because a DAP_queue was full
+} DAP_stats_t;
+
+void DAP_stats_reset(void);
+
+// Timestamp to pass to DAP_stats_command once the command has executed
+uint32_t DAP_stats_start(void);
+void DAP_stats_command(uint8_t id, uint32_t start);
+void DAP_stats_swd_ack(uint8_t ack);
+void DAP_stats_queue_depth(uint32_t depth);
+void DAP_stats_queue_full(void);
+
+const DAP_stats_t *DAP_stats_get(void);
+// Returns NULL if the command ID is not tracked on its own
+const DAP_stats_cmd_t *DAP_stats_get_command(uint8_t id);
+// Command ID of a statistics entry, or 0xFF for the shared entry
+uint8_t DAP_stats_command_id(uint32_t index);
+const DAP_stats_cmd_t *DAP_stats_get_entry(uint32_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
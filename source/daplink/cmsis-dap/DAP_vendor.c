@@ -45,6 +45,29 @@
 #include "file_stream.h"
 #endif
 
+#ifdef DAP_STATS
+#include "DAP_stats.h"
+#endif
+
+#ifdef DAP_ADAPTIVE_CLOCK
+#include "DAP_clock.h"
+#endif
+
+#if defined(DAP_STATS) || defined(DAP_ADAPTIVE_CLOCK)
+// Append words to a response in little endian order
+static uint32_t write_words(uint8_t *response, const uint32_t *words, uint32_t count)
+{
+    uint32_t i;
+    for (i = 0; i < count; i++) {
+        response[i * 4 + 0] = (uint8_t)(words[i] >> 0);
+        response[i * 4 + 1] = (uint8_t)(words[i] >> 8);
+        response[i * 4 + 2] = (uint8_t)(words[i] >> 16);
+        response[i * 4 + 3] = (uint8_t)(words[i] >> 24);
+    }
+    return count * 4;
+}
+#endif
+
 //**************************************************************************************************
 /**
 \defgroup DAP_Vendor_Adapt_gr Adapt Vendor Commands
@@ -187,9 +210,110 @@ uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response) {
         num += (1U << 16) | 1U; // increment request and response count each by 1
         break;
     }
-    case ID_DAP_Vendor14: break;
-    case ID_DAP_Vendor15: break;
-    case ID_DAP_Vendor16: break;
+    case ID_DAP_SelectIncrementalMode: {
+        // skip sectors that already hold the image data when programming
+        //              COMMAND(OUT Packet)
+        //              BYTE 0 1000 1111 0x8E
+        //              BYTE 1 Desired Mode:
+        //                                              0x00 - Program all sectors
+        //                                              nonzero - Skip unchanged sectors
+        //              RESPONSE(IN Packet)
+        //              BYTE 0
+        //                                              0x00 - OK
+        *response = DAP_OK;
+        if (0x00U == *request) {
+            flash_manager_set_incremental(false);
+        } else {
+            flash_manager_set_incremental(true);
+        }
+        num += (1U << 16) | 1U; // increment request and response count each by 1
+        break;
+    }
+    case ID_DAP_GetStats: {
+        // read or clear the DAP statistics
+        //              COMMAND(OUT Packet)
+        //              BYTE 0 1000 1111 0x8F
+        //              BYTE 1 Selector:
+        //                                              0x00 - Counters
+        //                                              0x01 - Command, BYTE 2 is the command ID
+        //                                              0x02 - Clear all statistics
+        //              RESPONSE(IN Packet)
+        //              BYTE 0
+        //                                              0x00 - OK
+        //                                              0xFF - Error, or statistics not built in
+        //              BYTE 1..n little endian words
+        //                                              0x00 - swd_wait, swd_fault, swd_error, queue_max, queue_full
+        //                                              0x01 - count, total_us, max_us, histogram
+        uint8_t selector = *request;
+        *response = DAP_ERROR;
+        num += (1U << 16) | 1U;
+        if (selector == 0x01U) {
+            num += (1U << 16);
+        }
+#ifdef DAP_STATS
+        if (selector == 0x00U) {
+            const DAP_stats_t *stats = DAP_stats_get();
+            const uint32_t words[] = {
+                stats->swd_wait, stats->swd_fault, stats->swd_error, stats->queue_max, stats->queue_full
+            };
+            *response = DAP_OK;
+            num += write_words(response + 1, words, sizeof(words) / sizeof(words[0]));
+        } else if (selector == 0x01U) {
+            const DAP_stats_cmd_t *cmd = DAP_stats_get_command(request[1]);
+            if (cmd != NULL) {
+                *response = DAP_OK;
+                num += write_words(response + 1, &cmd->count, sizeof(*cmd) / sizeof(uint32_t));
+            }
+        } else if (selector == 0x02U) {
+            DAP_stats_reset();
+            *response = DAP_OK;
+        }
+#endif
+        break;
+    }
+    case ID_DAP_AdaptiveClock: {
+        // control the adaptive SWD clock
+        //              COMMAND(OUT Packet)
+        //              BYTE 0 1001 0000 0x90
+        //              BYTE 1 Selector:
+        //                                              0x00 - Status
+        //                                              0x01 - Enable, BYTE 2 is 0x00 to disable
+        //                                              0x02 - Store the stable clock for this target
+        //                                              0x03 - Forget the stored clock
+        //              RESPONSE(IN Packet)
+        //              BYTE 0
+        //                                              0x00 - OK
+        //                                              0xFF - Error, or adaptive clock not built in
+        //              BYTE 1..n for status
+        //                                              enabled, then little endian words requested,
+        //                                              clock, ceiling, stable, idcode, steps_down, steps_up
+        uint8_t selector = *request;
+        *response = DAP_ERROR;
+        num += (1U << 16) | 1U;
+        if (selector == 0x01U) {
+            num += (1U << 16);
+        }
+#ifdef DAP_ADAPTIVE_CLOCK
+        if (selector == 0x00U) {
+            const DAP_clock_t *clock = DAP_clock_get();
+            *response++ = DAP_OK;
+            *response++ = DAP_clock_enabled() ? 1U : 0U;
+            num += 1;
+            num += write_words(response, &clock->requested, sizeof(*clock) / sizeof(uint32_t));
+        } else if (selector == 0x01U) {
+            DAP_clock_enable(request[1] != 0U);
+            *response = DAP_OK;
+        } else if (selector == 0x02U) {
+            if (DAP_clock_save()) {
+                *response = DAP_OK;
+            }
+        } else if (selector == 0x03U) {
+            DAP_clock_forget();
+            *response = DAP_OK;
+        }
+#endif
+        break;
+    }
     case ID_DAP_Vendor17: break;
     case ID_DAP_Vendor18: break;
     case ID_DAP_Vendor19: break;
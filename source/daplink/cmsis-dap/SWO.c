@@ -32,8 +32,6 @@
 #endif
 #if (SWO_STREAM != 0)
 #include "cmsis_os2.h"
-#define   osObjectsExternal
-#include "osObjects.h"
 #endif
 
 #if (SWO_STREAM != 0)
@@ -127,7 +125,9 @@ static void USART_Callback (uint32_t event) {
       TraceBlockSize = num;
       pUSART->Receive(&TraceBuf[index_i], num);
     } else {
+      // Trace Buffer full: capture pauses and incoming data is lost
       TraceStatus = DAP_SWO_CAPTURE_ACTIVE | DAP_SWO_CAPTURE_PAUSED;
+      SetTraceError(DAP_SWO_BUFFER_OVERRUN);
     }
     TraceUpdate = 1U;
 #if (SWO_STREAM != 0)
@@ -27,6 +27,12 @@
 
 #include "DAP_config.h"
 #include "DAP.h"
+#ifdef DAP_STATS
+#include "DAP_stats.h"
+#endif
+#ifdef DAP_ADAPTIVE_CLOCK
+#include "DAP_clock.h"
+#endif
 
 #if defined(__CC_ARM)
 #pragma push
@@ -64,6 +70,56 @@
 
 #define PIN_DELAY() PIN_DELAY_SLOW(DAP_Data.clock_delay)
 
+#define SW_REPEAT4(x)   x x x x
+#define SW_REPEAT32(x)  SW_REPEAT4(SW_REPEAT4(x) SW_REPEAT4(x))
+
+// Turnaround using the configured period
+#define SW_TURNAROUND_N()               \
+  for (n = DAP_Data.swd_conf.turnaround; n; n--) {      \
+    SW_CLOCK_CYCLE();                                   \
+  }
+
+// Turnaround with the default period of one cycle
+#define SW_TURNAROUND_1()               \
+  SW_CLOCK_CYCLE()
+
+// Data phase as a loop
+#define SW_READ_DATA_LOOP(val)          \
+  for (n = 32U; n; n--) {                               \
+    SW_READ_BIT(bit);                                   \
+    val >>= 1;                                          \
+    val  |= bit << 31;                                  \
+  }
+
+#define SW_WRITE_DATA_LOOP(val)         \
+  for (n = 32U; n; n--) {                               \
+    SW_WRITE_BIT(val);                                  \
+    val >>= 1;                                          \
+  }
+
+// Data phase fully unrolled. This saves a decrement and a taken branch on
+// each of the 32 bits but costs several hundred bytes of code a kernel, so
+// a HIC opts in by setting DAP_SWD_UNROLLED to 1 in its DAP_config.h
+// (undefined means 0).
+#define SW_READ_DATA_UNROLLED(val)      \
+  SW_REPEAT32(SW_READ_BIT(bit); val = (val >> 1) | (bit << 31);)
+
+#define SW_WRITE_DATA_UNROLLED(val)     \
+  SW_REPEAT32(SW_WRITE_BIT(val); val >>= 1;)
+
+
+#if (DAP_SWD != 0)
+// Calculate parity of a 32-bit value
+__STATIC_INLINE uint32_t SWD_Parity (uint32_t val) {
+  val ^= val >> 16;
+  val ^= val >> 8;
+  val ^= val >> 4;
+  val ^= val >> 2;
+  val ^= val >> 1;
+  return (val & 1U);
+}
+#endif
+
 
 // Generate SWJ Sequence
 //   count:  sequence bit count
@@ -112,6 +168,13 @@ __WEAK void SWD_Sequence (uint32_t info, const uint8_t *swdo, uint8_t *swdi) {
 
   if (info & SWD_SEQUENCE_DIN) {
     while (n) {
+#if (DAP_SWD_SPI != 0)
+      if (DAP_Data.spi_clock && (n >= 8U)) {
+        *swdi++ = (uint8_t)SWD_SPI_Read(1U);
+        n -= 8U;
+        continue;
+      }
+#endif
       val = 0U;
       for (k = 8U; k && n; k--, n--) {
         SW_READ_BIT(bit);
@@ -124,6 +187,13 @@ __WEAK void SWD_Sequence (uint32_t info, const uint8_t *swdo, uint8_t *swdi) {
   } else {
     while (n) {
       val = *swdo++;
+#if (DAP_SWD_SPI != 0)
+      if (DAP_Data.spi_clock && (n >= 8U)) {
+        SWD_SPI_Write(val, 1U);
+        n -= 8U;
+        continue;
+      }
+#endif
       for (k = 8U; k && n; k--, n--) {
         SW_WRITE_BIT(val);
         val >>= 1;
@@ -171,9 +241,7 @@ static uint8_t SWD_Transfer##speed (uint32_t request, uint32_t *data) {
                                                                                 \
   /* Turnaround */                                                              \
   PIN_SWDIO_OUT_DISABLE();                                                      \
-  for (n = DAP_Data.swd_conf.turnaround; n; n--) {                              \
-    SW_CLOCK_CYCLE();                                                           \
-  }                                                                             \
+  SW_TURNAROUND();                                                              \
                                                                                 \
   /* Acknowledge response */                                                    \
   SW_READ_BIT(bit);                                                             \
@@ -188,37 +256,23 @@ static uint8_t SWD_Transfer##speed (uint32_t request, uint32_t *data) {
     if (request & DAP_TRANSFER_RnW) {                                           \
       /* Read data */                                                           \
       val = 0U;                                                                 \
-      parity = 0U;                                                              \
-      for (n = 32U; n; n--) {                                                   \
-        SW_READ_BIT(bit);               /* Read RDATA[0:31] */                  \
-        parity += bit;                                                          \
-        val >>= 1;                                                              \
-        val  |= bit << 31;                                                      \
-      }                                                                         \
+      SW_READ_DATA(val);                /* Read RDATA[0:31] */                  \
       SW_READ_BIT(bit);                 /* Read Parity */                       \
-      if ((parity ^ bit) & 1U) {                                                \
+      if ((SWD_Parity(val) ^ bit) & 1U) {                                       \
         ack = DAP_TRANSFER_ERROR;                                               \
       }                                                                         \
       if (data) { *data = val; }                                                \
       /* Turnaround */                                                          \
-      for (n = DAP_Data.swd_conf.turnaround; n; n--) {                          \
-        SW_CLOCK_CYCLE();                                                       \
-      }                                                                         \
+      SW_TURNAROUND();                                                          \
       PIN_SWDIO_OUT_ENABLE();                                                   \
     } else {                                                                    \
       /* Turnaround */                                                          \
-      for (n = DAP_Data.swd_conf.turnaround; n; n--) {                          \
-        SW_CLOCK_CYCLE();                                                       \
-      }                                                                         \
+      SW_TURNAROUND();                                                          \
       PIN_SWDIO_OUT_ENABLE();                                                   \
       /* Write data */                                                          \
       val = *data;                                                              \
-      parity = 0U;                                                              \
-      for (n = 32U; n; n--) {                                                   \
-        SW_WRITE_BIT(val);              /* Write WDATA[0:31] */                 \
-        parity += val;                                                          \
-        val >>= 1;                                                              \
-      }                                                                         \
+      parity = SWD_Parity(val);                                                 \
+      SW_WRITE_DATA(val);               /* Write WDATA[0:31] */                 \
       SW_WRITE_BIT(parity);             /* Write Parity Bit */                  \
     }                                                                           \
     /* Capture Timestamp */                                                     \
@@ -245,9 +299,7 @@ static uint8_t SWD_Transfer##speed (uint32_t request, uint32_t *data) {
       }                                                                         \
     }                                                                           \
     /* Turnaround */                                                            \
-    for (n = DAP_Data.swd_conf.turnaround; n; n--) {                            \
-      SW_CLOCK_CYCLE();                                                         \
-    }                                                                           \
+    SW_TURNAROUND();                                                            \
     PIN_SWDIO_OUT_ENABLE();                                                     \
     if (DAP_Data.swd_conf.data_phase && ((request & DAP_TRANSFER_RnW) == 0U)) { \
       PIN_SWDIO_OUT(0U);                                                        \
@@ -269,25 +321,169 @@ static uint8_t SWD_Transfer##speed (uint32_t request, uint32_t *data) {
 }
 
 
+// Fast clock: data phase unrolled where the HIC opts in, with a variant for
+// the default turnaround
 #undef  PIN_DELAY
-#define PIN_DELAY() PIN_DELAY_FAST()
+#define PIN_DELAY()       PIN_DELAY_FAST()
+#if (DAP_SWD_UNROLLED != 0)
+#define SW_READ_DATA      SW_READ_DATA_UNROLLED
+#define SW_WRITE_DATA     SW_WRITE_DATA_UNROLLED
+#else
+#define SW_READ_DATA      SW_READ_DATA_LOOP
+#define SW_WRITE_DATA     SW_WRITE_DATA_LOOP
+#endif
+#define SW_TURNAROUND     SW_TURNAROUND_1
+SWD_TransferFunction(Fast1)
+
+#undef  SW_TURNAROUND
+#define SW_TURNAROUND     SW_TURNAROUND_N
 SWD_TransferFunction(Fast)
 
+// Slow clock: dominated by the delay, keep it small
 #undef  PIN_DELAY
-#define PIN_DELAY() PIN_DELAY_SLOW(DAP_Data.clock_delay)
+#define PIN_DELAY()       PIN_DELAY_SLOW(DAP_Data.clock_delay)
+#undef  SW_READ_DATA
+#define SW_READ_DATA      SW_READ_DATA_LOOP
+#undef  SW_WRITE_DATA
+#define SW_WRITE_DATA     SW_WRITE_DATA_LOOP
 SWD_TransferFunction(Slow)
 
 
+#if (DAP_SWD_SPI != 0)
+// SWD Transfer I/O with the request and data phases shifted by the SPI
+// peripheral; turnaround, acknowledge and parity bits stay on GPIO.
+//   request: A[3:2] RnW APnDP
+//   data:    DATA[31:0]
+//   return:  ACK[2:0]
+static uint8_t SWD_TransferSPI (uint32_t request, uint32_t *data) {
+  uint32_t ack;
+  uint32_t bit;
+  uint32_t val;
+  uint32_t n;
+
+  /* Packet Request: Start, APnDP, RnW, A2, A3, Parity, Stop, Park */
+  val  = (request & 0x0FU) << 1;
+  val |= 0x81U | (SWD_Parity(request & 0x0FU) << 5);
+  SWD_SPI_Write(val, 1U);
+
+  /* Turnaround */
+  PIN_SWDIO_OUT_DISABLE();
+  for (n = DAP_Data.swd_conf.turnaround; n; n--) {
+    SW_CLOCK_CYCLE();
+  }
+
+  /* Acknowledge response */
+  SW_READ_BIT(bit);
+  ack  = bit << 0;
+  SW_READ_BIT(bit);
+  ack |= bit << 1;
+  SW_READ_BIT(bit);
+  ack |= bit << 2;
+
+  if (ack == DAP_TRANSFER_OK) {         /* OK response */
+    /* Data transfer */
+    if (request & DAP_TRANSFER_RnW) {
+      /* Read data */
+      val = SWD_SPI_Read(4U);           /* Read RDATA[0:31] */
+      SW_READ_BIT(bit);                 /* Read Parity */
+      if ((SWD_Parity(val) ^ bit) & 1U) {
+        ack = DAP_TRANSFER_ERROR;
+      }
+      if (data) { *data = val; }
+      /* Turnaround */
+      for (n = DAP_Data.swd_conf.turnaround; n; n--) {
+        SW_CLOCK_CYCLE();
+      }
+      PIN_SWDIO_OUT_ENABLE();
+    } else {
+      /* Turnaround */
+      for (n = DAP_Data.swd_conf.turnaround; n; n--) {
+        SW_CLOCK_CYCLE();
+      }
+      PIN_SWDIO_OUT_ENABLE();
+      /* Write data */
+      val = *data;
+      SWD_SPI_Write(val, 4U);           /* Write WDATA[0:31] */
+      SW_WRITE_BIT(SWD_Parity(val));    /* Write Parity Bit */
+    }
+    /* Capture Timestamp */
+    if (request & DAP_TRANSFER_TIMESTAMP) {
+      DAP_Data.timestamp = TIMESTAMP_GET();
+    }
+    /* Idle cycles */
+    n = DAP_Data.transfer.idle_cycles;
+    if (n) {
+      PIN_SWDIO_OUT(0U);
+      for (; n; n--) {
+        SW_CLOCK_CYCLE();
+      }
+    }
+    PIN_SWDIO_OUT(1U);
+    return ((uint8_t)ack);
+  }
+
+  if ((ack == DAP_TRANSFER_WAIT) || (ack == DAP_TRANSFER_FAULT)) {
+    /* WAIT or FAULT response */
+    if (DAP_Data.swd_conf.data_phase && ((request & DAP_TRANSFER_RnW) != 0U)) {
+      for (n = 32U+1U; n; n--) {
+        SW_CLOCK_CYCLE();               /* Dummy Read RDATA[0:31] + Parity */
+      }
+    }
+    /* Turnaround */
+    for (n = DAP_Data.swd_conf.turnaround; n; n--) {
+      SW_CLOCK_CYCLE();
+    }
+    PIN_SWDIO_OUT_ENABLE();
+    if (DAP_Data.swd_conf.data_phase && ((request & DAP_TRANSFER_RnW) == 0U)) {
+      PIN_SWDIO_OUT(0U);
+      for (n = 32U+1U; n; n--) {
+        SW_CLOCK_CYCLE();               /* Dummy Write WDATA[0:31] + Parity */
+      }
+    }
+    PIN_SWDIO_OUT(1U);
+    return ((uint8_t)ack);
+  }
+
+  /* Protocol error */
+  for (n = DAP_Data.swd_conf.turnaround + 32U + 1U; n; n--) {
+    SW_CLOCK_CYCLE();                   /* Back off data phase */
+  }
+  PIN_SWDIO_OUT_ENABLE();
+  PIN_SWDIO_OUT(1U);
+  return ((uint8_t)ack);
+}
+#endif
+
+
 // SWD Transfer I/O
 //   request: A[3:2] RnW APnDP
 //   data:    DATA[31:0]
 //   return:  ACK[2:0]
 __WEAK uint8_t  SWD_Transfer(uint32_t request, uint32_t *data) {
+  uint8_t ack;
+#if (DAP_SWD_SPI != 0)
+  if (DAP_Data.spi_clock) {
+    ack = SWD_TransferSPI(request, data);
+  } else
+#endif
   if (DAP_Data.fast_clock) {
-    return SWD_TransferFast(request, data);
+    if (DAP_Data.swd_conf.turnaround == 1U) {
+      ack = SWD_TransferFast1(request, data);
+    } else {
+      ack = SWD_TransferFast(request, data);
+    }
   } else {
-    return SWD_TransferSlow(request, data);
+    ack = SWD_TransferSlow(request, data);
+  }
+#ifdef DAP_STATS
+  if (ack != DAP_TRANSFER_OK) {
+    DAP_stats_swd_ack(ack);
   }
+#endif
+#ifdef DAP_ADAPTIVE_CLOCK
+  DAP_clock_transfer(request, data, ack);
+#endif
+  return ack;
 }
 
 
@@ -35,5 +35,8 @@
 #define ID_DAP_MSD_Close                ID_DAP_Vendor11
 #define ID_DAP_MSD_Write                ID_DAP_Vendor12
 #define ID_DAP_SelectEraseMode          ID_DAP_Vendor13
+#define ID_DAP_SelectIncrementalMode    ID_DAP_Vendor14
+#define ID_DAP_GetStats                 ID_DAP_Vendor15
+#define ID_DAP_AdaptiveClock            ID_DAP_Vendor16
 //@}
 
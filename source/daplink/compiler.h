@@ -22,6 +22,7 @@
 #ifndef COMPILER_H
 #define COMPILER_H
 
+#include <stdint.h>
 #include "cmsis_compiler.h"
 
 #ifdef __cplusplus
@@ -64,6 +65,37 @@ extern "C" {
 #error "Unknown compiler"
 #endif
 
+// Counters one context publishes to another, as in the lock-free queues.
+// The load orders the reads of what the counter guards after it and the
+// store orders the writes it publishes before it. On Cortex-M both are a
+// plain access and a DMB. The compilers with the __atomic builtins say so
+// with them, which lets a thread sanitizer see the ordering on a host.
+#if defined(__ATOMIC_ACQUIRE)
+__STATIC_FORCEINLINE uint32_t compiler_load_acquire(volatile uint32_t *addr)
+{
+    return __atomic_load_n(addr, __ATOMIC_ACQUIRE);
+}
+
+__STATIC_FORCEINLINE void compiler_store_release(volatile uint32_t *addr, uint32_t value)
+{
+    __atomic_store_n(addr, value, __ATOMIC_RELEASE);
+}
+#else
+__STATIC_FORCEINLINE uint32_t compiler_load_acquire(volatile uint32_t *addr)
+{
+    uint32_t value = *addr;
+
+    __DMB();
+    return value;
+}
+
+__STATIC_FORCEINLINE void compiler_store_release(volatile uint32_t *addr, uint32_t value)
+{
+    __DMB();
+    *addr = value;
+}
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -30,6 +30,10 @@ extern "C" {
 uint32_t crc32(const void *data, int nBytes);
 uint32_t crc32_continue(uint32_t prev_crc, const void *data, int nBytes);
 
+//! Software CRC-32, for HICs whose crc32()/crc32_continue() use a hardware engine
+//! and need to handle unaligned bytes themselves.
+uint32_t crc32_sw_continue(uint32_t prev_crc, const void *data, int nBytes);
+
 #ifdef __cplusplus
 }
 #endif
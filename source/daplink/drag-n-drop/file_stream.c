@@ -20,10 +20,12 @@
  */
 
 #include <string.h>
+#include <ctype.h>
 
 #include "file_stream.h"
 #include "util.h"
 #include "intelhex.h"
+#include "srec.h"
 #include "flash_decoder.h"
 #include "error.h"
 #include "cmsis_os2.h"
@@ -41,12 +43,14 @@ typedef bool (*stream_detect_cb_t)(const uint8_t *data, uint32_t size);
 typedef error_t (*stream_open_cb_t)(void *state);
 typedef error_t (*stream_write_cb_t)(void *state, const uint8_t *data, uint32_t size);
 typedef error_t (*stream_close_cb_t)(void *state);
+typedef void (*stream_size_hint_cb_t)(void *state, uint32_t size);
 
 typedef struct {
     stream_detect_cb_t detect;
     stream_open_cb_t open;
     stream_write_cb_t write;
     stream_close_cb_t close;
+    stream_size_hint_cb_t size_hint;
 } stream_t;
 
 typedef struct {
@@ -60,24 +64,61 @@ typedef struct {
     uint8_t bin_buffer[256];
 } hex_state_t;
 
+// Program headers of at most this many PT_LOAD segments are kept
+#define ELF_MAX_SEGMENTS    8
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+    uint32_t addr;
+} elf_segment_t;
+
+typedef struct {
+    uint32_t file_pos;          // Offset in the file of the next byte written
+    uint8_t header[52];         // ELF header, then one program header at a time
+    uint32_t phoff;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t ph_index;          // Program headers processed so far
+    uint8_t segment_count;
+    uint8_t segment_index;      // Segment being programmed
+    elf_segment_t segments[ELF_MAX_SEGMENTS];   // Sorted by file offset
+} elf_state_t;
+
 typedef union {
     bin_state_t bin;
     hex_state_t hex;
+    elf_state_t elf;
 } shared_state_t;
 
+typedef hexfile_parse_status_t (*record_parse_cb_t)(const uint8_t *blob, const uint32_t blob_size, uint32_t *parse_cnt, uint8_t *bin_buf, const uint32_t bin_buf_size, uint32_t *bin_buf_address, uint32_t *bin_buf_cnt);
+
 static bool detect_bin(const uint8_t *data, uint32_t size);
 static error_t open_bin(void *state);
 static error_t write_bin(void *state, const uint8_t *data, uint32_t size);
 static error_t close_bin(void *state);
+static void size_hint_bin(void *state, uint32_t size);
 
 static bool detect_hex(const uint8_t *data, uint32_t size);
 static error_t open_hex(void *state);
 static error_t write_hex(void *state, const uint8_t *data, uint32_t size);
 static error_t close_hex(void *state);
 
+static bool detect_srec(const uint8_t *data, uint32_t size);
+static error_t open_srec(void *state);
+static error_t write_srec(void *state, const uint8_t *data, uint32_t size);
+static error_t close_srec(void *state);
+
+static bool detect_elf(const uint8_t *data, uint32_t size);
+static error_t open_elf(void *state);
+static error_t write_elf(void *state, const uint8_t *data, uint32_t size);
+static error_t close_elf(void *state);
+
 stream_t stream[] = {
-    {detect_bin, open_bin, write_bin, close_bin},   // STREAM_TYPE_BIN
-    {detect_hex, open_hex, write_hex, close_hex},   // STREAM_TYPE_HEX
+    {detect_bin, open_bin, write_bin, close_bin, size_hint_bin},    // STREAM_TYPE_BIN
+    {detect_hex, open_hex, write_hex, close_hex, 0},                // STREAM_TYPE_HEX
+    {detect_srec, open_srec, write_srec, close_srec, 0},            // STREAM_TYPE_SREC
+    {detect_elf, open_elf, write_elf, close_elf, 0},                // STREAM_TYPE_ELF
 };
 COMPILER_ASSERT(ARRAY_SIZE(stream) == STREAM_TYPE_COUNT);
 // STREAM_TYPE_NONE must not be included in count
@@ -119,6 +160,15 @@ stream_type_t stream_type_from_name(const vfs_filename_t filename)
         return STREAM_TYPE_BIN;
     } else if (0 == strncmp("HEX", &filename[8], 3)) {
         return STREAM_TYPE_HEX;
+    } else if ((0 == strncmp("SRE", &filename[8], 3)) ||
+               (0 == strncmp("S19", &filename[8], 3)) ||
+               (0 == strncmp("S28", &filename[8], 3)) ||
+               (0 == strncmp("S37", &filename[8], 3)) ||
+               (0 == strncmp("MOT", &filename[8], 3))) {
+        return STREAM_TYPE_SREC;
+    } else if ((0 == strncmp("ELF", &filename[8], 3)) ||
+               (0 == strncmp("AXF", &filename[8], 3))) {
+        return STREAM_TYPE_ELF;
     } else {
         return STREAM_TYPE_NONE;
     }
@@ -202,6 +252,22 @@ error_t stream_close(void)
     return status;
 }
 
+void stream_set_size_hint(uint32_t size)
+{
+    // Only useful while data is still being written
+    if (state != STREAM_STATE_OPEN) {
+        return;
+    }
+
+    stream_thread_assert();
+
+    // A hex file's size says little about the extent of the image
+    // so only streams that can map it to an address range use it
+    if (current_stream->size_hint) {
+        current_stream->size_hint(&shared_state, size);
+    }
+}
+
 /* Binary file processing */
 
 static bool detect_bin(const uint8_t *data, uint32_t size)
@@ -285,6 +351,12 @@ static error_t close_bin(void *state)
     return status;
 }
 
+static void size_hint_bin(void *state, uint32_t size)
+{
+    // Bin files map one to one onto flash
+    flash_decoder_set_image_size(size);
+}
+
 /* Hex file processing */
 
 static bool detect_hex(const uint8_t *data, uint32_t size)
@@ -303,10 +375,11 @@ static error_t open_hex(void *state)
     return status;
 }
 
-static error_t write_hex(void *state, const uint8_t *data, uint32_t size)
+// Feed a block of a record based file through its parser and write out
+// the decoded data. Record based formats share the hex_state_t buffer.
+static error_t write_records(hex_state_t *hex_state, const uint8_t *data, uint32_t size, record_parse_cb_t parse)
 {
     error_t status = ERROR_SUCCESS;
-    hex_state_t *hex_state = (hex_state_t *)state;
     hexfile_parse_status_t parse_status = HEX_PARSE_UNINIT;
     uint32_t bin_start_address = 0; // Decoded from the hex file, the binary buffer data starts at this address
     uint32_t bin_buf_written = 0;   // The amount of data in the binary buffer starting at address above
@@ -314,7 +387,7 @@ static error_t write_hex(void *state, const uint8_t *data, uint32_t size)
 
     while (1) {
         // try to decode a block of hex data into bin data
-        parse_status = parse_hex_blob(data, size, &block_amt_parsed, hex_state->bin_buffer, sizeof(hex_state->bin_buffer), &bin_start_address, &bin_buf_written);
+        parse_status = parse(data, size, &block_amt_parsed, hex_state->bin_buffer, sizeof(hex_state->bin_buffer), &bin_start_address, &bin_buf_written);
 
         // the entire block of hex was decoded. This is a simple state
         if (HEX_PARSE_OK == parse_status) {
@@ -348,7 +421,8 @@ static error_t write_hex(void *state, const uint8_t *data, uint32_t size)
         } else if (HEX_PARSE_CKSUM_FAIL == parse_status) {
             status = ERROR_HEX_CKSUM;
             break;
-        } else if ((HEX_PARSE_UNINIT == parse_status) || (HEX_PARSE_FAILURE == parse_status)) {
+        } else if ((HEX_PARSE_UNINIT == parse_status) || (HEX_PARSE_FAILURE == parse_status) ||
+                   (HEX_PARSE_LINE_OVERRUN == parse_status)) {
             util_assert(HEX_PARSE_UNINIT != parse_status);
             status = ERROR_HEX_PARSER;
             break;
@@ -358,9 +432,220 @@ static error_t write_hex(void *state, const uint8_t *data, uint32_t size)
     return status;
 }
 
+static error_t write_hex(void *state, const uint8_t *data, uint32_t size)
+{
+    return write_records((hex_state_t *)state, data, size, parse_hex_blob);
+}
+
 static error_t close_hex(void *state)
 {
     error_t status;
     status = flash_decoder_close();
     return status;
 }
+
+/* S-record file processing */
+
+static bool detect_srec(const uint8_t *data, uint32_t size)
+{
+    // A header or data record
+    return (size >= 4) && ('S' == data[0]) && (data[1] >= '0') && (data[1] <= '3') &&
+           isxdigit(data[2]) && isxdigit(data[3]);
+}
+
+static error_t open_srec(void *state)
+{
+    error_t status;
+    hex_state_t *hex_state = (hex_state_t *)state;
+    memset(hex_state, 0, sizeof(*hex_state));
+    reset_srec_parser();
+    status = flash_decoder_open();
+    return status;
+}
+
+static error_t write_srec(void *state, const uint8_t *data, uint32_t size)
+{
+    error_t status = write_records((hex_state_t *)state, data, size, parse_srec_blob);
+
+    // Report errors against the right file type
+    if (ERROR_HEX_CKSUM == status) {
+        status = ERROR_SREC_CKSUM;
+    } else if (ERROR_HEX_PARSER == status) {
+        status = ERROR_SREC_PARSER;
+    }
+
+    return status;
+}
+
+static error_t close_srec(void *state)
+{
+    error_t status;
+    status = flash_decoder_close();
+    return status;
+}
+
+/* ELF file processing */
+
+#define ELF_HEADER_SIZE     52
+#define ELF_PHDR_SIZE       32
+#define ELF_PT_LOAD         1
+
+static uint32_t elf_read32(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint16_t elf_read16(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static bool detect_elf(const uint8_t *data, uint32_t size)
+{
+    // 32 bit little endian executable
+    return (size >= ELF_HEADER_SIZE) && (0 == memcmp(data, "\x7f" "ELF", 4)) &&
+           (1 == data[4]) && (1 == data[5]) && (2 == elf_read16(&data[16]));
+}
+
+static error_t open_elf(void *state)
+{
+    error_t status;
+    elf_state_t *elf_state = (elf_state_t *)state;
+    memset(elf_state, 0, sizeof(*elf_state));
+    status = flash_decoder_open();
+    return status;
+}
+
+// Record a PT_LOAD segment, keeping the list in file order
+static error_t elf_add_segment(elf_state_t *elf_state, const uint8_t *phdr)
+{
+    elf_segment_t segment;
+    uint8_t i;
+
+    if (ELF_PT_LOAD != elf_read32(&phdr[0])) {
+        return ERROR_SUCCESS;
+    }
+
+    segment.offset = elf_read32(&phdr[4]);
+    segment.addr = elf_read32(&phdr[12]);   // p_paddr, the load address
+    segment.size = elf_read32(&phdr[16]);   // p_filesz
+
+    if (0 == segment.size) {
+        return ERROR_SUCCESS;
+    }
+
+    // The data must still be ahead in the file
+    if ((elf_state->segment_count >= ELF_MAX_SEGMENTS) || (segment.offset < elf_state->file_pos)) {
+        return ERROR_ELF_LAYOUT;
+    }
+
+    i = elf_state->segment_count;
+    while ((i > 0) && (elf_state->segments[i - 1].offset > segment.offset)) {
+        elf_state->segments[i] = elf_state->segments[i - 1];
+        i--;
+    }
+
+    elf_state->segments[i] = segment;
+    elf_state->segment_count++;
+    return ERROR_SUCCESS;
+}
+
+static error_t write_elf(void *state, const uint8_t *data, uint32_t size)
+{
+    elf_state_t *elf_state = (elf_state_t *)state;
+    error_t status;
+    uint32_t copy_size;
+
+    while (size > 0) {
+        if (elf_state->file_pos < ELF_HEADER_SIZE) {
+            // Collect the ELF header
+            copy_size = MIN(size, ELF_HEADER_SIZE - elf_state->file_pos);
+            memcpy(&elf_state->header[elf_state->file_pos], data, copy_size);
+
+            if (elf_state->file_pos + copy_size == ELF_HEADER_SIZE) {
+                elf_state->phoff = elf_read32(&elf_state->header[28]);
+                elf_state->phentsize = elf_read16(&elf_state->header[42]);
+                elf_state->phnum = elf_read16(&elf_state->header[44]);
+
+                if ((elf_state->phentsize < ELF_PHDR_SIZE) || (0 == elf_state->phnum)) {
+                    return ERROR_ELF_PARSER;
+                }
+
+                if (elf_state->phoff < ELF_HEADER_SIZE) {
+                    return ERROR_ELF_LAYOUT;
+                }
+            }
+        } else if (elf_state->ph_index < elf_state->phnum) {
+            // Collect the program headers one at a time
+            uint32_t ph_start = elf_state->phoff + elf_state->ph_index * elf_state->phentsize;
+
+            if (elf_state->file_pos < ph_start) {
+                copy_size = MIN(size, ph_start - elf_state->file_pos);
+            } else {
+                uint32_t ph_pos = elf_state->file_pos - ph_start;
+                copy_size = MIN(size, elf_state->phentsize - ph_pos);
+
+                if (ph_pos < ELF_PHDR_SIZE) {
+                    memcpy(&elf_state->header[ph_pos], data, MIN(copy_size, ELF_PHDR_SIZE - ph_pos));
+                }
+
+                if (ph_pos + copy_size == elf_state->phentsize) {
+                    elf_state->ph_index++;
+                    elf_state->file_pos += copy_size;
+                    data += copy_size;
+                    size -= copy_size;
+                    copy_size = 0;
+                    status = elf_add_segment(elf_state, elf_state->header);
+
+                    if (ERROR_SUCCESS != status) {
+                        return status;
+                    }
+
+                    if ((elf_state->ph_index == elf_state->phnum) && (0 == elf_state->segment_count)) {
+                        return ERROR_ELF_PARSER;
+                    }
+                }
+            }
+        } else {
+            // Program the segments as their data goes past
+            elf_segment_t *segment = &elf_state->segments[elf_state->segment_index];
+
+            if (elf_state->file_pos < segment->offset) {
+                copy_size = MIN(size, segment->offset - elf_state->file_pos);
+            } else if (elf_state->file_pos < segment->offset + segment->size) {
+                uint32_t segment_pos = elf_state->file_pos - segment->offset;
+                copy_size = MIN(size, segment->size - segment_pos);
+                status = flash_decoder_write(segment->addr + segment_pos, data, copy_size);
+
+                if (ERROR_SUCCESS != status) {
+                    return status;
+                }
+
+                if (segment_pos + copy_size == segment->size) {
+                    elf_state->segment_index++;
+
+                    if (elf_state->segment_index == elf_state->segment_count) {
+                        // Nothing left to program in the rest of the file
+                        return ERROR_SUCCESS_DONE;
+                    }
+                }
+            } else {
+                // Segments overlapping in the file
+                return ERROR_ELF_LAYOUT;
+            }
+        }
+
+        elf_state->file_pos += copy_size;
+        data += copy_size;
+        size -= copy_size;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+static error_t close_elf(void *state)
+{
+    error_t status;
+    status = flash_decoder_close();
+    return status;
+}
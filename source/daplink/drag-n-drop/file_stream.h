@@ -36,6 +36,8 @@ typedef enum {
 
     STREAM_TYPE_BIN = STREAM_TYPE_START,
     STREAM_TYPE_HEX,
+    STREAM_TYPE_SREC,
+    STREAM_TYPE_ELF,
 
     // Add new stream types here
 
@@ -56,6 +58,9 @@ error_t stream_write(const uint8_t *data, uint32_t size);
 
 error_t stream_close(void);
 
+// Size of the file being streamed, from its directory entry
+void stream_set_size_hint(uint32_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -57,6 +57,7 @@ static uint32_t current_addr;
 static bool flash_initialized;
 static bool initial_addr_set;
 static bool flash_type_target_bin;
+static uint32_t image_size;
 
 static bool flash_decoder_is_at_end(uint32_t addr, const uint8_t *data, uint32_t size);
 
@@ -227,6 +228,7 @@ error_t flash_decoder_open(void)
     current_addr = 0;
     flash_initialized = false;
     initial_addr_set = false;
+    image_size = 0;
     return ERROR_SUCCESS;
 }
 
@@ -315,6 +317,10 @@ error_t flash_decoder_write(uint32_t addr, const uint8_t *data, uint32_t size)
             }
 
             flash_initialized = true;
+
+            if (image_size > 0) {
+                flash_manager_set_image_end(initial_addr + image_size);
+            }
         }
 
         // If flash has been initalized then write out buffered data
@@ -353,6 +359,17 @@ error_t flash_decoder_write(uint32_t addr, const uint8_t *data, uint32_t size)
     return ERROR_SUCCESS;
 }
 
+// Size of an image written contiguously from its initial address
+void flash_decoder_set_image_size(uint32_t size)
+{
+    flash_decoder_printf("flash_decoder_set_image_size(size=0x%x)\r\n", size);
+    image_size = size;
+
+    if ((DECODER_STATE_OPEN == state) && flash_initialized) {
+        flash_manager_set_image_end(initial_addr + image_size);
+    }
+}
+
 error_t flash_decoder_close(void)
 {
     error_t status = ERROR_SUCCESS;
@@ -49,6 +49,7 @@ error_t flash_decoder_validate_target_image(flash_decoder_type_t type, const uin
 error_t flash_decoder_open(void);
 error_t flash_decoder_write(uint32_t addr, const uint8_t *data, uint32_t size);
 error_t flash_decoder_close(void);
+void flash_decoder_set_image_size(uint32_t size);
 
 #ifdef __cplusplus
 }
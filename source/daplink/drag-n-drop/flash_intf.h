@@ -23,6 +23,7 @@
 #define FLASH_INTF_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "error.h"
 
@@ -46,6 +47,9 @@ typedef uint32_t (*flash_program_page_min_size_cb_t)(uint32_t addr);
 typedef uint32_t (*flash_erase_sector_size_cb_t)(uint32_t addr);
 typedef uint8_t (*flash_busy_cb_t)(void);
 typedef error_t (*flash_algo_set_cb_t)(uint32_t addr);
+typedef error_t (*flash_intf_compare_cb_t)(uint32_t addr, const uint8_t *buf, uint32_t size, bool *match);
+typedef error_t (*flash_intf_erase_sector_start_cb_t)(uint32_t sector, bool *started);
+typedef bool (*flash_algo_loaded_cb_t)(uint32_t addr);
 
 typedef struct {
     flash_intf_init_cb_t init;
@@ -57,6 +61,9 @@ typedef struct {
     flash_erase_sector_size_cb_t erase_sector_size;
     flash_busy_cb_t flash_busy;
     flash_algo_set_cb_t flash_algo_set;
+    flash_intf_compare_cb_t compare;    // Optional, checks if flash already holds buf
+    flash_intf_erase_sector_start_cb_t erase_sector_start;  // Optional, erases a sector without waiting for it to finish
+    flash_algo_loaded_cb_t flash_algo_loaded;   // Optional, checks if addr can be written without an algo switch
 } flash_intf_t;
 
 // All flash interfaces.  Unsupported interfaces are NULL.
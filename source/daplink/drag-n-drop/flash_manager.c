@@ -36,19 +36,49 @@
 #define flash_manager_printf(...)
 #endif
 
+// Data for a flash algo other than the loaded one is held back in a buffer
+// of this size, so interleaved records for another region don't force an
+// algo switch each. It is written out by address once it fills or the
+// image ends, so each algo is switched to once per buffer full.
+#ifndef FLASH_MANAGER_STASH_SIZE
+#define FLASH_MANAGER_STASH_SIZE    256
+#endif
+
+// Most separate runs of data the stash can hold. A run continuing the one
+// held back last takes no more.
+#ifndef FLASH_MANAGER_STASH_RUNS
+#define FLASH_MANAGER_STASH_RUNS    16
+#endif
+
 typedef enum {
     STATE_CLOSED,
     STATE_OPEN,
     STATE_ERROR
 } state_t;
 
+typedef struct {
+    uint32_t addr;
+    uint32_t size;
+    uint32_t offset;    // of the data in stash_buf
+} stash_run_t;
+
 // Target programming expects buffer
 // passed in to be 4 byte aligned
 __attribute__((aligned(4)))
 static uint8_t buf[1024];
 static bool buf_empty;
+__attribute__((aligned(4)))
+static uint8_t stash_buf[FLASH_MANAGER_STASH_SIZE];
+static stash_run_t stash_runs[FLASH_MANAGER_STASH_RUNS];    // in address order
+static uint32_t stash_run_count;
+static uint32_t stash_size;
 static bool current_sector_valid;
 static bool page_erase_enabled = false;
+static bool incremental_enabled = false;
+static bool sector_erase_pending;
+static bool erase_ahead_valid;
+static uint32_t erase_ahead_addr;
+static uint32_t image_end;
 static uint32_t current_write_block_addr;
 static uint32_t current_write_block_size;
 static uint32_t current_sector_addr;
@@ -58,8 +88,13 @@ static const flash_intf_t *intf;
 static state_t state = STATE_CLOSED;
 
 static bool flash_intf_valid(const flash_intf_t *flash_intf);
+static error_t write_data(uint32_t addr, const uint8_t *data, uint32_t size);
+static bool stash_data(uint32_t addr, const uint8_t *data, uint32_t size);
+static error_t flush_stash(void);
 static error_t flush_current_block(uint32_t addr);
 static error_t setup_next_sector(uint32_t addr);
+static error_t erase_next_sector(uint32_t addr);
+static bool sector_erase_deferred(uint32_t addr);
 
 error_t flash_manager_init(const flash_intf_t *flash_intf)
 {
@@ -81,7 +116,13 @@ error_t flash_manager_init(const flash_intf_t *flash_intf)
     // Initialize variables
     memset(buf, 0xFF, sizeof(buf));
     buf_empty = true;
+    stash_run_count = 0;
+    stash_size = 0;
     current_sector_valid = false;
+    sector_erase_pending = false;
+    erase_ahead_valid = false;
+    erase_ahead_addr = 0;
+    image_end = 0;
     current_write_block_addr = 0;
     current_write_block_size = 0;
     current_sector_addr = 0;
@@ -96,7 +137,7 @@ error_t flash_manager_init(const flash_intf_t *flash_intf)
         return status;
     }
 
-    if (!page_erase_enabled) {
+    if (!page_erase_enabled && !incremental_enabled) {
         // Erase flash and unint if there are errors
         status = intf->erase_chip();
         flash_manager_printf("    intf->erase_chip ret=%i\r\n", status);
@@ -113,10 +154,7 @@ error_t flash_manager_init(const flash_intf_t *flash_intf)
 
 error_t flash_manager_data(uint32_t addr, const uint8_t *data, uint32_t size)
 {
-    uint32_t size_left;
-    uint32_t copy_size;
-    uint32_t pos;
-    error_t status = ERROR_SUCCESS;
+    error_t status;
     flash_manager_printf("flash_manager_data(addr=0x%x size=0x%x)\r\n", addr, size);
 
     if (state != STATE_OPEN) {
@@ -124,6 +162,34 @@ error_t flash_manager_data(uint32_t addr, const uint8_t *data, uint32_t size)
         return ERROR_INTERNAL;
     }
 
+    if (current_sector_valid && intf->flash_algo_loaded && !intf->flash_algo_loaded(addr)) {
+        // Keep data for another algo until the stash is full
+        if (stash_data(addr, data, size)) {
+            return ERROR_SUCCESS;
+        }
+
+        // Switch to the held back data, then hold this back instead if
+        // the algo it needs is still not the one loaded
+        status = flush_stash();
+        if (ERROR_SUCCESS != status) {
+            return status;
+        }
+
+        if (!intf->flash_algo_loaded(addr) && stash_data(addr, data, size)) {
+            return ERROR_SUCCESS;
+        }
+    }
+
+    return write_data(addr, data, size);
+}
+
+static error_t write_data(uint32_t addr, const uint8_t *data, uint32_t size)
+{
+    uint32_t size_left;
+    uint32_t copy_size;
+    uint32_t pos;
+    error_t status = ERROR_SUCCESS;
+
     // Setup the current sector if it is not setup already
     if (!current_sector_valid) {
         status = setup_next_sector(addr);
@@ -165,6 +231,16 @@ error_t flash_manager_data(uint32_t addr, const uint8_t *data, uint32_t size)
 
         // Check for end
         if (size <= 0) {
+            // The whole sector is programmed, so get the next one erasing
+            // while its data arrives. Only done on return, since any more
+            // data here would have to wait for the erase to finish.
+            if (addr == current_sector_addr + current_sector_size) {
+                status = erase_next_sector(addr);
+                if (ERROR_SUCCESS != status) {
+                    state = STATE_ERROR;
+                    return status;
+                }
+            }
             break;
         }
 
@@ -205,7 +281,11 @@ error_t flash_manager_uninit(void)
         return ERROR_INTERNAL;
     }
 
-    // Flush last buffer if its not empty
+    // Flush held back data and the last buffer if its not empty
+    if (STATE_OPEN == state) {
+        flash_write_error = flush_stash();
+        flash_manager_printf("    flush_stash ret=%i\r\n",flash_write_error);
+    }
     if (STATE_OPEN == state) {
         flash_write_error = flush_current_block(0);
         flash_manager_printf("    last flush_current_block ret=%i\r\n",flash_write_error);
@@ -216,7 +296,13 @@ error_t flash_manager_uninit(void)
     // Reset variables to catch accidental use
     memset(buf, 0xFF, sizeof(buf));
     buf_empty = true;
+    stash_run_count = 0;
+    stash_size = 0;
     current_sector_valid = false;
+    sector_erase_pending = false;
+    erase_ahead_valid = false;
+    erase_ahead_addr = 0;
+    image_end = 0;
     current_write_block_addr = 0;
     current_write_block_size = 0;
     current_sector_addr = 0;
@@ -243,6 +329,20 @@ void flash_manager_set_page_erase(bool enabled)
     page_erase_enabled = enabled;
 }
 
+void flash_manager_set_incremental(bool enabled)
+{
+    config_ram_set_incremental(enabled);
+    incremental_enabled = enabled;
+}
+
+// End of the image being programmed, if known. Sectors below it can be
+// erased before their data arrives.
+void flash_manager_set_image_end(uint32_t addr)
+{
+    flash_manager_printf("flash_manager_set_image_end(addr=0x%x)\r\n", addr);
+    image_end = addr;
+}
+
 static bool flash_intf_valid(const flash_intf_t *flash_intf)
 {
     // Check for all requried members
@@ -281,12 +381,83 @@ static bool flash_intf_valid(const flash_intf_t *flash_intf)
     return true;
 }
 
+// Hold back data for another algo. Returns false if it doesn't fit.
+static bool stash_data(uint32_t addr, const uint8_t *data, uint32_t size)
+{
+    uint32_t i;
+
+    if (stash_size + size > sizeof(stash_buf)) {
+        return false;
+    }
+
+    // Find where the run goes in address order, after any it rewrites
+    for (i = stash_run_count; i > 0; i--) {
+        if (stash_runs[i - 1].addr <= addr) {
+            break;
+        }
+    }
+
+    if ((i > 0) && (addr == stash_runs[i - 1].addr + stash_runs[i - 1].size) &&
+            (stash_runs[i - 1].offset + stash_runs[i - 1].size == stash_size)) {
+        // Continues the run held back last
+        stash_runs[i - 1].size += size;
+    } else {
+        if (stash_run_count >= FLASH_MANAGER_STASH_RUNS) {
+            return false;
+        }
+
+        memmove(&stash_runs[i + 1], &stash_runs[i], (stash_run_count - i) * sizeof(stash_runs[0]));
+        stash_runs[i].addr = addr;
+        stash_runs[i].size = size;
+        stash_runs[i].offset = stash_size;
+        stash_run_count++;
+    }
+
+    memcpy(stash_buf + stash_size, data, size);
+    stash_size += size;
+    return true;
+}
+
+// Write out data held back for other algos in address order, so each
+// algo is switched to once and each sector is set up once
+static error_t flush_stash(void)
+{
+    error_t status = ERROR_SUCCESS;
+    uint32_t count = stash_run_count;
+    uint32_t i;
+
+    stash_run_count = 0;
+    stash_size = 0;
+
+    for (i = 0; (i < count) && (ERROR_SUCCESS == status); i++) {
+        status = write_data(stash_runs[i].addr, stash_buf + stash_runs[i].offset, stash_runs[i].size);
+    }
+
+    return status;
+}
+
 static error_t flush_current_block(uint32_t addr){
     // Write out current buffer if there is data in it
     error_t status = ERROR_SUCCESS;
     if (!buf_empty) {
-        status = intf->program_page(current_write_block_addr, buf, current_write_block_size);
-        flash_manager_printf("    intf->program_page(addr=0x%x, size=0x%x) ret=%i\r\n", current_write_block_addr, current_write_block_size, status);
+        bool match = false;
+
+        if (sector_erase_pending) {
+            // Leave the sector alone if it already holds this data
+            sector_erase_pending = false;
+            status = intf->compare(current_write_block_addr, buf, current_write_block_size, &match);
+            flash_manager_printf("    intf->compare(addr=0x%x, size=0x%x) ret=%i match=%i\r\n", current_write_block_addr, current_write_block_size, status, match);
+
+            if ((ERROR_SUCCESS == status) && !match) {
+                status = intf->erase_sector(current_sector_addr);
+                flash_manager_printf("    intf->erase_sector(addr=0x%x) ret=%i\r\n", current_sector_addr, status);
+            }
+        }
+
+        if ((ERROR_SUCCESS == status) && !match) {
+            status = intf->program_page(current_write_block_addr, buf, current_write_block_size);
+            flash_manager_printf("    intf->program_page(addr=0x%x, size=0x%x) ret=%i\r\n", current_write_block_addr, current_write_block_size, status);
+        }
         buf_empty = true;
     }
 
@@ -330,7 +501,16 @@ static error_t setup_next_sector(uint32_t addr)
         }
     }
 
-    if (page_erase_enabled) {
+    sector_erase_pending = false;
+
+    if (erase_ahead_valid && (erase_ahead_addr == current_sector_addr)) {
+        // Erased while the previous sector was being received
+        erase_ahead_valid = false;
+    } else if (sector_erase_deferred(current_sector_addr)) {
+        // The whole sector fits in the buffer, so defer the erase until
+        // it is known whether the contents change
+        sector_erase_pending = true;
+    } else if (page_erase_enabled || incremental_enabled) {
         // Erase the current sector
         status = intf->erase_sector(current_sector_addr);
         flash_manager_printf("    intf->erase_sector(addr=0x%x) ret=%i\r\n", current_sector_addr);
@@ -348,3 +528,39 @@ static error_t setup_next_sector(uint32_t addr)
                          current_write_block_size, current_sector_size, min_prog_size);
     return ERROR_SUCCESS;
 }
+
+// Start erasing the sector at addr if it is part of the image and would
+// be erased anyway once its first data arrives
+static error_t erase_next_sector(uint32_t addr)
+{
+    bool started = false;
+    error_t status;
+
+    if ((0 == intf->erase_sector_start) || (addr >= image_end)) {
+        return ERROR_SUCCESS;
+    }
+
+    if (erase_ahead_valid && (erase_ahead_addr == addr)) {
+        return ERROR_SUCCESS;
+    }
+
+    if (!(page_erase_enabled || incremental_enabled) || sector_erase_deferred(addr)) {
+        return ERROR_SUCCESS;
+    }
+
+    status = intf->erase_sector_start(addr, &started);
+    flash_manager_printf("    intf->erase_sector_start(addr=0x%x) ret=%i started=%i\r\n", addr, status, started);
+
+    if (started) {
+        erase_ahead_addr = addr;
+        erase_ahead_valid = true;
+    }
+
+    return status;
+}
+
+// True if the sector at addr is only erased after a compare shows a change
+static bool sector_erase_deferred(uint32_t addr)
+{
+    return incremental_enabled && intf->compare && (intf->erase_sector_size(addr) <= sizeof(buf));
+}
@@ -35,6 +35,8 @@ error_t flash_manager_init(const flash_intf_t *flash_intf);
 error_t flash_manager_data(uint32_t addr, const uint8_t *data, uint32_t size);
 error_t flash_manager_uninit(void);
 void flash_manager_set_page_erase(bool enabled);
+void flash_manager_set_incremental(bool enabled);
+void flash_manager_set_image_end(uint32_t addr);
 
 #ifdef __cplusplus
 }
@@ -238,7 +238,7 @@ static error_t program_page(uint32_t addr, const uint8_t *buf, uint32_t size)
 
     if (addr + size >= updt_end) {
         // Something has been updated so recompute the crc
-        info_crc_compute();
+        info_crc_invalidate();
         update_complete = true;
     }
 
@@ -425,7 +425,7 @@ static error_t intercept_page_write(uint32_t addr, const uint8_t *buf, uint32_t
         }
 
         // The bootloader has been updated so recompute the crc
-        info_crc_compute();
+        info_crc_invalidate();
         update_complete = true;
         return status;
     }
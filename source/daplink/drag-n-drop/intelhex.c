@@ -66,34 +66,63 @@ static uint16_t swap16(uint16_t a)
     return ((a & 0x00ff) << 8) | ((a & 0xff00) >> 8);
 }
 
-/** Converts a character representation of a hex to real value.
- *   @param c is the hex value in char format
- *   @return the value of the hex
+// Characters that are not hex digits but delimit records
+#define HEX_SPECIAL 0x80
+
+// Digits 0-9 and letters A-F/a-f map to their value, like
+// (c & 0x10) ? c & 0xf : (c & 0xf) + 9 does for any character
+#define HEX_ROW_ALPHA   0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
+#define HEX_ROW_DIGIT   0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+
+/** Value of each character as a hex digit, or HEX_SPECIAL for ':', '\r' and '\n'
  */
-static uint8_t ctoh(char c)
-{
-    return (c & 0x10) ? /*0-9*/ c & 0xf : /*A-F, a-f*/ (c & 0xf) + 9;
-}
+static const uint8_t hex_nibble[256] = {
+    0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x00, 0x01, 0x02, HEX_SPECIAL, 0x04, 0x05, HEX_SPECIAL, 0x07, 0x08,
+    HEX_ROW_DIGIT,
+    HEX_ROW_ALPHA,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, HEX_SPECIAL, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    HEX_ROW_ALPHA, HEX_ROW_DIGIT,
+    HEX_ROW_ALPHA, HEX_ROW_DIGIT,
+    HEX_ROW_ALPHA, HEX_ROW_DIGIT,
+    HEX_ROW_ALPHA, HEX_ROW_DIGIT,
+    HEX_ROW_ALPHA, HEX_ROW_DIGIT,
+    HEX_ROW_ALPHA, HEX_ROW_DIGIT,
+};
 
-/** Calculate checksum on a hex record
- *   @param data is the line of hex record
- *   @param size is the length of the data array
- *   @return 1 if the data provided is a valid hex record otherwise 0
+/** Decode pairs of hex characters until count bytes are done or a
+ *  record delimiter is found
+ *   @param src the ascii hex characters, at least 2 * count of them
+ *   @param count the number of bytes to decode
+ *   @param dst where the decoded bytes go
+ *   @param sum running checksum the decoded bytes are added to
+ *   @return the number of bytes decoded
  */
-static uint8_t validate_checksum(hex_line_t *record)
+static uint32_t decode_hex_pairs(const uint8_t *src, uint32_t count, uint8_t *dst, uint8_t *sum)
 {
-    uint8_t result = 0, i = 0;
+    uint8_t result = *sum;
+    uint32_t i = 0;
+
+    for (; i < count; i++) {
+        uint8_t high = hex_nibble[src[0]];
+        uint8_t low = hex_nibble[src[1]];
+
+        if ((high | low) & HEX_SPECIAL) {
+            break;
+        }
 
-    for (; i < (record->byte_count + 5); i++) {
-        result += record->buf[i];
+        dst[i] = (high << 4) | low;
+        result += dst[i];
+        src += 2;
     }
 
-    return (result == 0);
+    *sum = result;
+    return i;
 }
 
 static hex_line_t line = {0};
 static uint32_t next_address_to_write = 0;
-static uint8_t low_nibble = 0, idx = 0, record_processed = 0, load_unaligned_record = 0, skip_until_aligned = 0;
+static uint8_t low_nibble = 0, high_nibble = 0, idx = 0, load_unaligned_record = 0, skip_until_aligned = 0;
+static uint8_t record_sum = 0, record_direct = 0;
 static uint16_t binary_version = 0;
 uint16_t board_id_hex __WEAK;
 uint16_t board_id_hex_default __WEAK;
@@ -103,13 +132,31 @@ void reset_hex_parser(void)
     memset(line.buf, 0, sizeof(hex_line_t));
     next_address_to_write = 0;
     low_nibble = 0;
+    high_nibble = 0;
     idx = 0;
-    record_processed = 0;
+    record_sum = 0;
+    record_direct = 0;
     load_unaligned_record = 0;
     binary_version = 0;
     skip_until_aligned = 0;
 }
 
+/** Check if the data of a record is kept
+ *   @return 1 if the record is for this board or has no board ID
+ */
+static uint8_t binary_version_matches(void)
+{
+    return (binary_version == 0 || binary_version == board_id_hex_default || binary_version == board_id_hex);
+}
+
+/** Check if a record continues the data already decoded
+ *   @return 1 if the address of line follows the last data written
+ */
+static uint8_t record_is_aligned(void)
+{
+    return ((next_address_to_write & 0xffff0000) | line.address) == next_address_to_write;
+}
+
 hexfile_parse_status_t parse_hex_blob(const uint8_t *hex_blob, const uint32_t hex_blob_size, uint32_t *hex_parse_cnt, uint8_t *bin_buf, const uint32_t bin_buf_size, uint32_t *bin_buf_address, uint32_t *bin_buf_cnt)
 {
     uint8_t *end = (uint8_t *)hex_blob + hex_blob_size;
@@ -142,124 +189,177 @@ hexfile_parse_status_t parse_hex_blob(const uint8_t *hex_blob, const uint32_t he
     }
 
     while (hex_blob != end) {
-        switch ((uint8_t)(*hex_blob)) {
-            // we've hit the end of an ascii line
-            // junk we dont care about could also just run the validate_checksum on &line
-            case '\r':
-            case '\n':
-                //ignore new lines
-                break;
+        uint8_t nibble = hex_nibble[*hex_blob];
+        uint8_t value;
 
+        if (nibble & HEX_SPECIAL) {
             // found start of a new record. reset state variables
-            case ':':
-                memset(line.buf, 0, sizeof(hex_line_t));
+            if (':' == *hex_blob) {
+                // Clear the header and the first two data bytes which a
+                // short metadata record may be read through
+                memset(line.buf, 0, 6);
                 low_nibble = 0;
                 idx = 0;
-                record_processed = 0;
+                record_sum = 0;
+                record_direct = 0;
+            }
+
+            // new lines are ignored
+            hex_blob++;
+            continue;
+        }
+
+        // junk after a complete record is ignored until the next one starts
+        if (idx >= (line.byte_count + 5)) {
+            hex_blob++;
+            continue;
+        }
+
+        // decode the data of the record a whole byte at a time
+        if (!low_nibble && (idx >= 4) && (idx < (line.byte_count + 4))) {
+            uint8_t *dst = record_direct ? bin_buf : line.data;
+            uint32_t count = (uint32_t)(end - hex_blob) / 2;
+            uint32_t decoded;
+
+            if (count > (uint32_t)(line.byte_count + 4 - idx)) {
+                count = line.byte_count + 4 - idx;
+            }
+
+            decoded = decode_hex_pairs(hex_blob, count, dst + idx - 4, &record_sum);
+
+            if (decoded > 0) {
+                idx += decoded;
+                hex_blob += 2 * decoded;
+                continue;
+            }
+        }
+
+        if (!low_nibble) {
+            high_nibble = nibble;
+            low_nibble = 1;
+            hex_blob++;
+            continue;
+        }
+
+        low_nibble = 0;
+        value = (high_nibble << 4) | nibble;
+        record_sum += value;
+
+        if (record_direct && (idx >= 4) && (idx < (line.byte_count + 4))) {
+            bin_buf[idx - 4] = value;
+        } else {
+            line.buf[idx] = value;
+        }
+
+        idx++;
+
+        if (4 == idx) {
+            // the record must fit the line buffer
+            if (line.byte_count > (sizeof(line.buf) - 5)) {
+                status = HEX_PARSE_LINE_OVERRUN;
+                goto hex_parser_exit;
+            }
+
+            // address byteswap...
+            line.address = swap16(line.address);
+            // data that continues the buffer is decoded straight into it
+            record_direct = ((DATA_RECORD == line.record_type) || (CUSTOM_DATA_RECORD == line.record_type)) &&
+                            binary_version_matches() && record_is_aligned();
+        }
+
+        if (idx < (line.byte_count + 5)) {
+            hex_blob++;
+            continue;
+        }
+
+        // all data in
+        if (0 != record_sum) {
+            status = HEX_PARSE_CKSUM_FAIL;
+            goto hex_parser_exit;
+        }
+
+        switch (line.record_type) {
+            case CUSTOM_METADATA_RECORD:
+                binary_version = (uint16_t) line.data[0] << 8 | line.data[1];
                 break;
 
-            // decoding lines
-            default:
-                if (low_nibble) {
-                    line.buf[idx] |= ctoh((uint8_t)(*hex_blob)) & 0xf;
-                    if (++idx >= (line.byte_count + 5)) { //all data in
-                        if (0 == validate_checksum(&line)) {
-                            status = HEX_PARSE_CKSUM_FAIL;
-                            goto hex_parser_exit;
-                        } else {
-                            if (!record_processed) {
-                                record_processed = 1;
-                                // address byteswap...
-                                line.address = swap16(line.address);
-
-                                switch (line.record_type) {
-                                    case CUSTOM_METADATA_RECORD:
-                                        binary_version = (uint16_t) line.data[0] << 8 | line.data[1];
-                                        break;
-
-                                    case DATA_RECORD:
-                                    case CUSTOM_DATA_RECORD:
-                                        if (binary_version == 0 || binary_version == board_id_hex_default || binary_version == board_id_hex) {
-                                            // Only save data from the correct binary
-                                            // verify this is a continous block of memory or need to exit and dump
-                                            if (((next_address_to_write & 0xffff0000) | line.address) != next_address_to_write) {
-                                                load_unaligned_record = 1;
-                                                status = HEX_PARSE_UNALIGNED;
-                                                // Function will be executed again and will start by finishing to process this record by
-                                                // adding the this line into bin_buf, so the 1st loop iteration should be the next blob byte
-                                                hex_blob++;
-                                                goto hex_parser_exit;
-                                            } else {
-                                                // This should be superfluous but it is necessary for GCC
-                                                load_unaligned_record = 0;
-                                            }
-
-                                            // move from line buffer back to input buffer
-                                            memcpy(bin_buf, line.data, line.byte_count);
-                                            bin_buf += line.byte_count;
-                                            *bin_buf_cnt = (uint32_t)(*bin_buf_cnt) + line.byte_count;
-                                            // Save next address to write
-                                            next_address_to_write = ((next_address_to_write & 0xffff0000) | line.address) + line.byte_count;
-                                        } else {
-                                            // This is Universal Hex block that does not match our version.
-                                            // We can skip this block and all blocks until we find a
-                                            // block aligned on a record boundary.
-                                            skip_until_aligned = 1;
-                                            status = HEX_PARSE_OK;
-                                            goto hex_parser_exit;
-                                        }
-                                        break;
-
-                                    case EOF_RECORD:
-                                        status = HEX_PARSE_EOF;
-                                        goto hex_parser_exit;
-
-                                    case EXT_SEG_ADDR_RECORD:
-                                        // Could have had data in the buffer so must exit and try to program
-                                        //  before updating bin_buf_address with next_address_to_write
-                                        memset(bin_buf, 0xff, (bin_buf_size - (uint32_t)(*bin_buf_cnt)));
-                                        // figure the start address for the buffer before returning
-                                        *bin_buf_address = next_address_to_write - (uint32_t)(*bin_buf_cnt);
-                                        *hex_parse_cnt = (uint32_t)(hex_blob_size - (end - hex_blob));
-                                        // update the address msb's
-                                        next_address_to_write = (next_address_to_write & 0x00000000) | ((line.data[0] << 12) | (line.data[1] << 4));
-                                        // Need to exit and program if buffer has been filled
-                                        status = HEX_PARSE_UNALIGNED;
-                                        return status;
-
-                                    case EXT_LINEAR_ADDR_RECORD:
-                                        // Could have had data in the buffer so must exit and try to program
-                                        //  before updating bin_buf_address with next_address_to_write
-                                        //  Good catch Gaute!!
-                                        memset(bin_buf, 0xff, (bin_buf_size - (uint32_t)(*bin_buf_cnt)));
-                                        // figure the start address for the buffer before returning
-                                        *bin_buf_address = next_address_to_write - (uint32_t)(*bin_buf_cnt);
-                                        *hex_parse_cnt = (uint32_t)(hex_blob_size - (end - hex_blob));
-                                        // update the address msb's
-                                        next_address_to_write = (next_address_to_write & 0x00000000) | ((line.data[0] << 24) | (line.data[1] << 16));
-                                        // Need to exit and program if buffer has been filled
-                                        status = HEX_PARSE_UNALIGNED;
-                                        return status;
-
-                                    default:
-                                        break;
-                                }
-                            }
-                        }
+            case DATA_RECORD:
+            case CUSTOM_DATA_RECORD:
+                if (binary_version_matches()) {
+                    // Only save data from the correct binary
+                    // verify this is a continous block of memory or need to exit and dump
+                    if (!record_is_aligned()) {
+                        load_unaligned_record = 1;
+                        status = HEX_PARSE_UNALIGNED;
+                        // Function will be executed again and will start by finishing to process this record by
+                        // adding the this line into bin_buf, so the 1st loop iteration should be the next blob byte
+                        hex_blob++;
+                        goto hex_parser_exit;
                     }
-                } else {
-                    if (idx < sizeof(hex_line_t)) {
-                        line.buf[idx] = ctoh((uint8_t)(*hex_blob)) << 4;
+
+                    // move from line buffer back to input buffer unless it was decoded in place
+                    if (!record_direct) {
+                        memcpy(bin_buf, line.data, line.byte_count);
                     }
+                    record_direct = 0;
+                    bin_buf += line.byte_count;
+                    *bin_buf_cnt = (uint32_t)(*bin_buf_cnt) + line.byte_count;
+                    // Save next address to write
+                    next_address_to_write = ((next_address_to_write & 0xffff0000) | line.address) + line.byte_count;
+                } else {
+                    // This is Universal Hex block that does not match our version.
+                    // We can skip this block and all blocks until we find a
+                    // block aligned on a record boundary.
+                    skip_until_aligned = 1;
+                    status = HEX_PARSE_OK;
+                    goto hex_parser_exit;
                 }
+                break;
 
-                low_nibble = !low_nibble;
+            case EOF_RECORD:
+                status = HEX_PARSE_EOF;
+                goto hex_parser_exit;
+
+            case EXT_SEG_ADDR_RECORD:
+                // Could have had data in the buffer so must exit and try to program
+                //  before updating bin_buf_address with next_address_to_write
+                memset(bin_buf, 0xff, (bin_buf_size - (uint32_t)(*bin_buf_cnt)));
+                // figure the start address for the buffer before returning
+                *bin_buf_address = next_address_to_write - (uint32_t)(*bin_buf_cnt);
+                *hex_parse_cnt = (uint32_t)(hex_blob_size - (end - hex_blob));
+                // update the address msb's
+                next_address_to_write = (next_address_to_write & 0x00000000) | ((line.data[0] << 12) | (line.data[1] << 4));
+                // Need to exit and program if buffer has been filled
+                status = HEX_PARSE_UNALIGNED;
+                return status;
+
+            case EXT_LINEAR_ADDR_RECORD:
+                // Could have had data in the buffer so must exit and try to program
+                //  before updating bin_buf_address with next_address_to_write
+                //  Good catch Gaute!!
+                memset(bin_buf, 0xff, (bin_buf_size - (uint32_t)(*bin_buf_cnt)));
+                // figure the start address for the buffer before returning
+                *bin_buf_address = next_address_to_write - (uint32_t)(*bin_buf_cnt);
+                *hex_parse_cnt = (uint32_t)(hex_blob_size - (end - hex_blob));
+                // update the address msb's
+                next_address_to_write = (next_address_to_write & 0x00000000) | ((line.data[0] << 24) | (line.data[1] << 16));
+                // Need to exit and program if buffer has been filled
+                status = HEX_PARSE_UNALIGNED;
+                return status;
+
+            default:
                 break;
         }
 
         hex_blob++;
     }
 
+    // A record decoded in place continues in the next block, which gets a fresh buffer
+    if (record_direct && (idx > 4)) {
+        memcpy(line.data, bin_buf, idx - 4);
+    }
+    record_direct = 0;
+
     // decoded an entire hex block - verify (cant do this hex_parse_cnt is figured below)
     //status = (hex_blob_size == (uint32_t)(*hex_parse_cnt)) ? HEX_PARSE_OK : HEX_PARSE_FAILURE;
     status = HEX_PARSE_OK;
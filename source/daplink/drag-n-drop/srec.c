@@ -0,0 +1,256 @@
+/**
+ * @file    srec.c
+ * @brief   Implementation of srec.h
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2021, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "srec.h"
+
+// Largest byte count handled, enough for 64 data bytes with a 32 bit address
+#define SREC_MAX_COUNT  0x45
+
+typedef enum {
+    SREC_STATE_IDLE,        // Waiting for the 'S' starting a record
+    SREC_STATE_TYPE,        // Waiting for the record type digit
+    SREC_STATE_BYTES,       // Decoding the byte count, address, data and checksum
+} srec_state_t;
+
+// Record bytes are the byte count followed by that many bytes of
+// address, data and checksum
+static uint8_t line[SREC_MAX_COUNT + 1];
+static srec_state_t state = SREC_STATE_IDLE;
+static uint8_t record_type = 0;
+static uint8_t idx = 0, low_nibble = 0, load_unaligned_record = 0;
+static uint32_t next_address_to_write = 0;
+
+/** Converts a character representation of a hex digit to its value
+ *   @param c is the hex value in char format
+ *   @return the value of the hex digit or 0xFF if c is not one
+ */
+static uint8_t srec_ctoh(uint8_t c)
+{
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    } else if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    } else if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
+
+    return 0xFF;
+}
+
+/** Size of the address field of a record type
+ *   @return the number of address bytes or 0 for unknown types
+ */
+static uint8_t address_size(uint8_t type)
+{
+    switch (type) {
+        case 0:
+        case 1:
+        case 5:
+        case 9:
+            return 2;
+
+        case 2:
+        case 6:
+        case 8:
+            return 3;
+
+        case 3:
+        case 7:
+            return 4;
+
+        default:
+            return 0;
+    }
+}
+
+/** Address of the record in line
+ */
+static uint32_t record_address(void)
+{
+    uint32_t address = 0;
+    uint8_t i;
+
+    for (i = 0; i < address_size(record_type); i++) {
+        address = (address << 8) | line[1 + i];
+    }
+
+    return address;
+}
+
+/** Data of the record in line
+ */
+static const uint8_t *record_data(uint8_t *size)
+{
+    uint8_t offset = 1 + address_size(record_type);
+    *size = line[0] - offset;
+    return &line[offset];
+}
+
+void reset_srec_parser(void)
+{
+    memset(line, 0, sizeof(line));
+    state = SREC_STATE_IDLE;
+    record_type = 0;
+    idx = 0;
+    low_nibble = 0;
+    load_unaligned_record = 0;
+    next_address_to_write = 0;
+}
+
+hexfile_parse_status_t parse_srec_blob(const uint8_t *srec_blob, const uint32_t srec_blob_size, uint32_t *srec_parse_cnt, uint8_t *bin_buf, const uint32_t bin_buf_size, uint32_t *bin_buf_address, uint32_t *bin_buf_cnt)
+{
+    const uint8_t *end = srec_blob + srec_blob_size;
+    hexfile_parse_status_t status = HEX_PARSE_UNINIT;
+    const uint8_t *data;
+    uint8_t data_size;
+    uint8_t sum;
+    uint8_t i;
+    // reset the amount of data that is being return'd
+    *bin_buf_cnt = 0;
+
+    // The last record did not continue the data returned with it so it
+    // starts this buffer
+    if (load_unaligned_record) {
+        load_unaligned_record = 0;
+        data = record_data(&data_size);
+        memcpy(bin_buf, data, data_size);
+        *bin_buf_cnt = data_size;
+        next_address_to_write = record_address() + data_size;
+    }
+
+    while (srec_blob != end) {
+        uint8_t c = *srec_blob;
+
+        if (('\r' == c) || ('\n' == c)) {
+            // ignore new lines
+        } else if ('S' == c) {
+            // found start of a new record. reset state variables
+            state = SREC_STATE_TYPE;
+        } else if (SREC_STATE_TYPE == state) {
+            if ((c < '0') || (c > '9')) {
+                status = HEX_PARSE_FAILURE;
+                goto srec_parser_exit;
+            }
+
+            record_type = c - '0';
+            idx = 0;
+            low_nibble = 0;
+            state = SREC_STATE_BYTES;
+        } else if (SREC_STATE_BYTES == state) {
+            uint8_t nibble = srec_ctoh(c);
+
+            if (0xFF == nibble) {
+                status = HEX_PARSE_FAILURE;
+                goto srec_parser_exit;
+            }
+
+            if (!low_nibble) {
+                line[idx] = nibble << 4;
+                low_nibble = 1;
+                srec_blob++;
+                continue;
+            }
+
+            line[idx] |= nibble;
+            low_nibble = 0;
+            idx++;
+
+            if (1 == idx) {
+                // the byte count must cover the address and checksum and fit the line
+                if (line[0] > SREC_MAX_COUNT) {
+                    status = HEX_PARSE_LINE_OVERRUN;
+                    goto srec_parser_exit;
+                }
+
+                if (line[0] < address_size(record_type) + 1) {
+                    status = HEX_PARSE_FAILURE;
+                    goto srec_parser_exit;
+                }
+            }
+
+            if (idx > line[0]) {
+                // all data in
+                state = SREC_STATE_IDLE;
+                sum = 0;
+
+                for (i = 0; i <= line[0]; i++) {
+                    sum += line[i];
+                }
+
+                if (0xFF != sum) {
+                    status = HEX_PARSE_CKSUM_FAIL;
+                    goto srec_parser_exit;
+                }
+
+                switch (record_type) {
+                    case 1:
+                    case 2:
+                    case 3:
+                        data = record_data(&data_size);
+
+                        if (0 == data_size) {
+                            break;
+                        }
+
+                        if (0 == *bin_buf_cnt) {
+                            next_address_to_write = record_address();
+                        } else if ((record_address() != next_address_to_write) ||
+                                   (*bin_buf_cnt + data_size > bin_buf_size)) {
+                            // Return what has been decoded and start the next
+                            // call with this record
+                            load_unaligned_record = 1;
+                            status = HEX_PARSE_UNALIGNED;
+                            srec_blob++;
+                            goto srec_parser_exit;
+                        }
+
+                        memcpy(bin_buf + *bin_buf_cnt, data, data_size);
+                        *bin_buf_cnt += data_size;
+                        next_address_to_write += data_size;
+                        break;
+
+                    case 7:
+                    case 8:
+                    case 9:
+                        status = HEX_PARSE_EOF;
+                        srec_blob++;
+                        goto srec_parser_exit;
+
+                    default:
+                        // Header and record count records carry nothing to program
+                        break;
+                }
+            }
+        }
+
+        srec_blob++;
+    }
+
+    status = HEX_PARSE_OK;
+srec_parser_exit:
+    memset(bin_buf + *bin_buf_cnt, 0xff, bin_buf_size - *bin_buf_cnt);
+    // figure the start address for the buffer before returning
+    *bin_buf_address = next_address_to_write - *bin_buf_cnt;
+    *srec_parse_cnt = (uint32_t)(srec_blob_size - (end - srec_blob));
+    return status;
+}
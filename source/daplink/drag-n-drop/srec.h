@@ -0,0 +1,62 @@
+/**
+ * @file    srec.h
+ * @brief   Parser for the Motorola S-record format
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2021, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SREC_H
+#define SREC_H
+
+/** \ingroup srec_parser
+ *  @{
+ */
+
+#include <stdint.h>
+
+#include "intelhex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Prepare any state that is maintained for the start of a file
+ *  @param none
+ *  @return none
+ */
+void reset_srec_parser(void);
+
+/** Convert a blob of S-record data into its binary equivelant
+ *  @param srec_blob A block of ascii encoded S-record data
+ *  @param srec_blob_size The amount of valid data in the srec_blob
+ *  @param srec_parse_cnt The amount of srec_blob data from the call that was parsed
+ *  @param bin_buf Buffer the decoded file contents goes into
+ *  @param bin_buf_size max size of the buffer
+ *  @param bin_buf_address The start address for data in the bin_buf as decoded from the file
+ *  @param bin_buf_cnt The amount of data in the bin_buf
+ *  @return A member of hex_parse_status_t that describes the state of decoding.
+ *          HEX_PARSE_EOF is returned for a S7, S8 or S9 termination record.
+ */
+hexfile_parse_status_t parse_srec_blob(const uint8_t *srec_blob, const uint32_t srec_blob_size, uint32_t *srec_parse_cnt, uint8_t *bin_buf, const uint32_t bin_buf_size, uint32_t *bin_buf_address, uint32_t *bin_buf_cnt);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif
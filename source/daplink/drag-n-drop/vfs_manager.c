@@ -56,6 +56,9 @@
 #define DISCONNECT_DELAY_TRANSFER_IDLE_MS 500
 // TRANSFER_NOT_STARTED || TRASNFER_FINISHED
 #define DISCONNECT_DELAY_MS 500
+// TRASNFER_FINISHED on a definite end of the image. The remount still
+// waits for one idle period so the host's closing metadata writes get through
+#define DISCONNECT_DELAY_TRANSFER_DONE_MS 0
 
 // Make sure none of the delays exceed the max time
 COMPILER_ASSERT(CONNECT_DELAY_MS < MAX_EVENT_TIME_MS);
@@ -63,6 +66,7 @@ COMPILER_ASSERT(RECONNECT_DELAY_MS < MAX_EVENT_TIME_MS);
 COMPILER_ASSERT(DISCONNECT_DELAY_TRANSFER_TIMEOUT_MS < MAX_EVENT_TIME_MS);
 COMPILER_ASSERT(DISCONNECT_DELAY_TRANSFER_IDLE_MS < MAX_EVENT_TIME_MS);
 COMPILER_ASSERT(DISCONNECT_DELAY_MS < MAX_EVENT_TIME_MS);
+COMPILER_ASSERT(DISCONNECT_DELAY_TRANSFER_DONE_MS < MAX_EVENT_TIME_MS);
 
 typedef enum {
     TRANSFER_NOT_STARTED,
@@ -86,6 +90,8 @@ typedef struct {
     bool stream_finished;           // Stream processing is done. This only gets reset remount
     bool stream_optional_finish;    // True if the stream processing can be considered done
     bool file_info_optional_finish; // True if the file transfer can be considered done
+    bool file_size_ahead;           // Root dir gave the file size before all of the data arrived
+    bool host_flushed;              // The host flushed its cache once the file size was reached
     bool transfer_timeout;          // Set if the transfer was finished because of a timeout. This only gets reset remount
     stream_type_t stream;           // Current stream or STREAM_TYPE_NONE is stream is closed.  This only gets reset remount
 } file_transfer_state_t;
@@ -112,6 +118,8 @@ static const file_transfer_state_t default_transfer_state = {
     false,
     false,
     false,
+    false,
+    false,
     STREAM_TYPE_NONE,
 };
 
@@ -126,7 +134,14 @@ U32 USBD_MSC_BlockCount;
 U8 *USBD_MSC_BlockBuf;
 #endif
 
-static uint32_t usb_buffer[VFS_SECTOR_SIZE / sizeof(uint32_t)];
+// Number of sectors moved by each MSC read or write. Bigger groups hand the
+// virtual filesystem and the file stream fewer, larger chunks at the cost of
+// VFS_SECTOR_SIZE bytes of RAM per sector.
+#ifndef MSC_BLOCK_GROUP
+#define MSC_BLOCK_GROUP         1
+#endif
+
+static uint32_t usb_buffer[MSC_BLOCK_GROUP * VFS_SECTOR_SIZE / sizeof(uint32_t)];
 static error_t fail_reason = ERROR_SUCCESS;
 static file_transfer_state_t file_transfer_state;
 
@@ -157,6 +172,8 @@ static void transfer_reset_file_info(void);
 static void transfer_stream_open(stream_type_t stream, uint32_t start_sector);
 static void transfer_stream_data(uint32_t sector, const uint8_t *data, uint32_t size);
 static void transfer_update_state(error_t status);
+static void transfer_update_size_hint(void);
+static bool transfer_file_complete(void);
 
 __WEAK void board_vfs_stream_closed_hook(void){}
 
@@ -300,6 +317,13 @@ error_t vfs_mngr_get_transfer_status()
     return fail_reason;
 }
 
+bool vfs_mngr_transfer_in_progress(void)
+{
+    sync_assert_usb_thread();
+    return (TRANSFER_IN_PROGRESS == file_transfer_state.transfer_state) ||
+           (TRANSFER_CAN_BE_FINISHED == file_transfer_state.transfer_state);
+}
+
 void usbd_msc_init(void)
 {
     sync_init();
@@ -350,6 +374,20 @@ void usbd_msc_write_sect(uint32_t sector, uint8_t *buf, uint32_t num_of_sectors)
     file_data_handler(sector, buf, num_of_sectors);
 }
 
+// A host sends SYNCHRONIZE CACHE when it flushes a file. Once the whole file
+// the root dir describes has been written that is the end of a bin file.
+void usbd_msc_sync_cache(void)
+{
+    sync_assert_usb_thread();
+
+    if (!USBD_MSC_MediaReady || (TRANSFER_CAN_BE_FINISHED != file_transfer_state.transfer_state)) {
+        return;
+    }
+
+    file_transfer_state.host_flushed = true;
+    transfer_update_state(ERROR_SUCCESS);
+}
+
 static void sync_init(void)
 {
     sync_thread = osThreadGetId();
@@ -385,7 +423,7 @@ static void build_filesystem()
     // Set mass storage parameters
     USBD_MSC_MemorySize = vfs_get_total_size();
     USBD_MSC_BlockSize  = VFS_SECTOR_SIZE;
-    USBD_MSC_BlockGroup = 1;
+    USBD_MSC_BlockGroup = MSC_BLOCK_GROUP;
     USBD_MSC_BlockCount = USBD_MSC_MemorySize / USBD_MSC_BlockSize;
     USBD_MSC_BlockBuf   = (uint8_t *)usb_buffer;
 }
@@ -443,45 +481,71 @@ static void file_data_handler(uint32_t sector, const uint8_t *buf, uint32_t num_
 
     // this is the key for starting a file write - we dont care what file types are sent
     //  just look for something unique (NVIC table, hex, srec, etc) until root dir is updated
-    if (!file_transfer_state.stream_started) {
-        // look for file types we can program
-        stream = stream_start_identify((uint8_t *)buf, VFS_SECTOR_SIZE * num_of_sectors);
+    while (!file_transfer_state.stream_started && (num_of_sectors > 0)) {
+        // look for file types we can program, one sector at a time
+        stream = stream_start_identify((uint8_t *)buf, VFS_SECTOR_SIZE);
 
         if (STREAM_TYPE_NONE != stream) {
             transfer_stream_open(stream, sector);
+
+            if (file_transfer_state.stream_started) {
+                break;
+            }
         }
+
+        sector++;
+        buf += VFS_SECTOR_SIZE;
+        num_of_sectors--;
     }
 
-    if (file_transfer_state.stream_started) {
+    if (file_transfer_state.stream_started && (num_of_sectors > 0)) {
         // Ignore sectors coming before this file
         if (sector < file_transfer_state.start_sector) {
-            return;
+            uint32_t skip = MIN(file_transfer_state.start_sector - sector, num_of_sectors);
+            sector += skip;
+            buf += skip * VFS_SECTOR_SIZE;
+            num_of_sectors -= skip;
+            if (0 == num_of_sectors) {
+                return;
+            }
         }
 
         // sectors must be in order
-        if (sector != file_transfer_state.file_next_sector) {
+        if (sector < file_transfer_state.file_next_sector) {
+            uint32_t skip = MIN(file_transfer_state.file_next_sector - sector, num_of_sectors);
+
             vfs_mngr_printf("vfs_manager file_data_handler sector=%i\r\n", sector);
+            vfs_mngr_printf("    sector out of order! lowest ooo = %i\r\n",
+                            file_transfer_state.last_ooo_sector);
+
+            if (VFS_INVALID_SECTOR == file_transfer_state.last_ooo_sector) {
+                file_transfer_state.last_ooo_sector = sector;
+            }
 
-            if (sector < file_transfer_state.file_next_sector) {
-                vfs_mngr_printf("    sector out of order! lowest ooo = %i\r\n",
-                                file_transfer_state.last_ooo_sector);
+            file_transfer_state.last_ooo_sector =
+                MIN(file_transfer_state.last_ooo_sector, sector);
 
-                if (VFS_INVALID_SECTOR == file_transfer_state.last_ooo_sector) {
-                    file_transfer_state.last_ooo_sector = sector;
-                }
+            vfs_mngr_printf("    discarding data - size transferred=0x%x, data=%x,%x,%x,%x,...\r\n",
+                            file_transfer_state.size_transferred, buf[0], buf[1], buf[2], buf[3]);
 
-                file_transfer_state.last_ooo_sector =
-                    MIN(file_transfer_state.last_ooo_sector, sector);
-            } else {
-                vfs_mngr_printf("    sector not part of file transfer\r\n");
+            // Sectors of this group past the out of order ones can still be used
+            sector += skip;
+            buf += skip * VFS_SECTOR_SIZE;
+            num_of_sectors -= skip;
+            if (0 == num_of_sectors) {
+                return;
             }
+        }
 
+        if (sector != file_transfer_state.file_next_sector) {
+            vfs_mngr_printf("vfs_manager file_data_handler sector=%i\r\n", sector);
+            vfs_mngr_printf("    sector not part of file transfer\r\n");
             vfs_mngr_printf("    discarding data - size transferred=0x%x, data=%x,%x,%x,%x,...\r\n",
                             file_transfer_state.size_transferred, buf[0], buf[1], buf[2], buf[3]);
             return;
         }
 
-        // This sector could be part of the file so record it
+        // These sectors could be part of the file so record them
         size = VFS_SECTOR_SIZE * num_of_sectors;
         file_transfer_state.size_transferred += size;
         file_transfer_state.file_next_sector = sector + num_of_sectors;
@@ -495,6 +559,7 @@ static void file_data_handler(uint32_t sector, const uint8_t *buf, uint32_t num_
             return;
         }
 
+        // The whole run goes to the stream in one go
         transfer_stream_data(sector, buf, size);
     }
 }
@@ -507,12 +572,28 @@ static bool ready_for_state_change(void)
     if (VFS_MNGR_STATE_CONNECTED == vfs_state) {
         switch (file_transfer_state.transfer_state) {
             case TRANSFER_NOT_STARTED:
-            case TRASNFER_FINISHED:
                 timeout_ms = DISCONNECT_DELAY_MS;
                 break;
 
+            case TRASNFER_FINISHED:
+                // Don't hold a good image back once it has definitely ended,
+                // only a timeout leaves room for doubt
+                if ((ERROR_SUCCESS == fail_reason) &&
+                        !file_transfer_state.transfer_timeout) {
+                    timeout_ms = DISCONNECT_DELAY_TRANSFER_DONE_MS;
+                } else {
+                    timeout_ms = DISCONNECT_DELAY_MS;
+                }
+                break;
+
             case TRANSFER_IN_PROGRESS:
-                timeout_ms = DISCONNECT_DELAY_TRANSFER_TIMEOUT_MS;
+                // A hex file ends at its end record. Its directory entry may
+                // still come, or never if it went into a subdirectory.
+                if (file_transfer_state.stream_finished) {
+                    timeout_ms = DISCONNECT_DELAY_TRANSFER_DONE_MS;
+                } else {
+                    timeout_ms = DISCONNECT_DELAY_TRANSFER_TIMEOUT_MS;
+                }
                 break;
 
             case TRANSFER_CAN_BE_FINISHED:
@@ -616,7 +697,9 @@ static void transfer_update_file_info(vfs_file_t file, uint32_t start_sector, ui
 
     // Update values - Size is the only value that can change
     file_transfer_state.file_size = size;
+    file_transfer_state.file_size_ahead = (size > file_transfer_state.size_transferred);
     vfs_mngr_printf("    updated size=%i\r\n", size);
+    transfer_update_size_hint();
 
     transfer_update_state(ERROR_SUCCESS);
 }
@@ -687,6 +770,7 @@ static void transfer_stream_open(stream_type_t stream, uint32_t start_sector)
         file_transfer_state.file_next_sector = start_sector;
         file_transfer_state.stream_open = true;
         file_transfer_state.stream_started = true;
+        transfer_update_size_hint();
     }
 
     transfer_update_state(status);
@@ -709,6 +793,12 @@ static void transfer_stream_data(uint32_t sector, const uint8_t *data, uint32_t
     util_assert(file_transfer_state.stream_open);
     status = stream_write((uint8_t *)data, size);
     vfs_mngr_printf("    stream_write ret=%i\r\n", status);
+    file_transfer_state.size_processed += size;
+
+    if ((ERROR_SUCCESS_DONE_OR_CONTINUE == status) && transfer_file_complete()) {
+        // Finish programming now instead of when the drive remounts
+        status = ERROR_SUCCESS_DONE;
+    }
 
     if (ERROR_SUCCESS_DONE == status) {
         // Override status so ERROR_SUCCESS_DONE
@@ -728,10 +818,32 @@ static void transfer_stream_data(uint32_t sector, const uint8_t *data, uint32_t
         file_transfer_state.stream_optional_finish = false;
     }
 
-    file_transfer_state.size_processed += size;
     transfer_update_state(status);
 }
 
+// Check if all of the file has gone through the stream. This is only certain
+// when the root dir gave the size before the data got there, since a host
+// flushing a file while writing it updates the size after each part.
+static bool transfer_file_complete(void)
+{
+    return file_transfer_state.file_size_ahead &&
+           (file_transfer_state.file_to_program != VFS_FILE_INVALID) &&
+           (file_transfer_state.file_size > 0) &&
+           (file_transfer_state.start_sector == file_transfer_state.file_start_sector) &&
+           (file_transfer_state.size_processed >= file_transfer_state.file_size);
+}
+
+// Pass the file size on to the stream once the directory entry
+// is known to belong to the file being streamed
+static void transfer_update_size_hint(void)
+{
+    if (file_transfer_state.stream_open &&
+        (file_transfer_state.file_size > 0) &&
+        (file_transfer_state.start_sector == file_transfer_state.file_start_sector)) {
+        stream_set_size_hint(file_transfer_state.file_size);
+    }
+}
+
 // Check if the current transfer is still in progress, done, or if an error has occurred
 static void transfer_update_state(error_t status)
 {
@@ -768,10 +880,16 @@ static void transfer_update_state(error_t status)
     // can be considered complete
     transfer_can_be_finished = file_transfer_state.file_info_optional_finish &&
                                file_transfer_state.stream_optional_finish;
-    // The transfer must be fnished if stream processing is for sure complete
-    // and file processing can be considered complete
-    transfer_must_be_finished = file_transfer_state.stream_finished &&
-                                file_transfer_state.file_info_optional_finish;
+    // The transfer must be finished if stream processing is for sure complete
+    // and file processing can be considered complete. A bin file sized after its
+    // data has no end of its own, but it is done when the size ends inside a
+    // sector, since an append would have to rewrite a sector already streamed,
+    // or when the host flushed it.
+    transfer_must_be_finished = (file_transfer_state.stream_finished &&
+                                 file_transfer_state.file_info_optional_finish) ||
+                                (transfer_can_be_finished &&
+                                 ((file_transfer_state.file_size % VFS_SECTOR_SIZE) ||
+                                  file_transfer_state.host_flushed));
     out_of_order_sector = false;
 
     if (file_transfer_state.last_ooo_sector != VFS_INVALID_SECTOR) {
@@ -796,6 +914,9 @@ static void transfer_update_state(error_t status)
             local_status = ERROR_SUCCESS;
         } else if (transfer_can_be_finished) {
             local_status = ERROR_SUCCESS;
+        } else if (file_transfer_state.stream_finished) {
+            // The image was complete, only its directory entry never showed up
+            local_status = ERROR_SUCCESS;
         } else {
             local_status = ERROR_TRANSFER_TIMEOUT;
         }
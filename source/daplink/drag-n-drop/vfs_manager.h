@@ -59,6 +59,9 @@ void vfs_mngr_periodic(uint32_t elapsed_ms);
 // if none have been performed yet
 error_t vfs_mngr_get_transfer_status(void);
 
+// Return true while a file is being programmed to the target
+bool vfs_mngr_transfer_in_progress(void);
+
 
 /* Use functions */
 
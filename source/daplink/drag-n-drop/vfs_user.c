@@ -38,6 +38,12 @@
 #include "cortex_m.h"
 #include "target_board.h"
 #include "flash_manager.h"
+#ifdef DAP_STATS
+#include "DAP_stats.h"
+#endif
+#if defined(DAPLINK_IF) && defined(TARGET_MEMORY_FILES)
+#include "target_memory_file.h"
+#endif
 
 //! @brief Size in bytes of the virtual disk.
 //!
@@ -70,6 +76,8 @@ typedef enum _magic_file {
     kImageCheckOffConfigFile,   //!< Disable Incompatible target image detection.
     kPageEraseActionFile,       //!< Enable page programming and sector erase for drag and drop.
     kChipEraseActionFile,       //!< Enable page programming and chip erase for drag and drop.
+    kIncrementalOnActionFile,   //!< Skip sectors that already hold the image data for drag and drop.
+    kIncrementalOffActionFile,  //!< Program every sector for drag and drop.
 } magic_file_t;
 
 //! @brief Mapping from filename string to magic file enum.
@@ -98,6 +106,8 @@ static const magic_file_info_t s_magic_file_info[] = {
         { "COMP_OFFCFG", kImageCheckOffConfigFile   },
         { "PAGE_ON ACT", kPageEraseActionFile       },
         { "PAGE_OFFACT", kChipEraseActionFile       },
+        { "INCR_ON ACT", kIncrementalOnActionFile   },
+        { "INCR_OFFACT", kIncrementalOffActionFile  },
     };
 
 static char assert_buf[64 + 1];
@@ -112,6 +122,9 @@ static uint32_t read_file_details_txt(uint32_t sector_offset, uint8_t *data, uin
 static uint32_t read_file_fail_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
 static uint32_t read_file_assert_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
 static uint32_t read_file_need_bl_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
+#ifdef DAP_STATS
+static uint32_t read_file_stats_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
+#endif
 
 static uint32_t update_details_txt_file(uint8_t *data, uint32_t datasize, uint32_t start);
 static void erase_target(void);
@@ -132,6 +145,15 @@ void vfs_user_build_filesystem()
     // DETAILS.TXT
     file_size = get_file_size(read_file_details_txt);
     vfs_create_file("DETAILS TXT", read_file_details_txt, 0, file_size);
+#ifdef DAP_STATS
+    // STATS.TXT
+    file_size = get_file_size(read_file_stats_txt);
+    vfs_create_file("STATS   TXT", read_file_stats_txt, 0, file_size);
+#endif
+#if defined(DAPLINK_IF) && defined(TARGET_MEMORY_FILES)
+    // FLASH.BIN and RAM.BIN
+    target_memory_file_create();
+#endif
 
     // FAIL.TXT
     if (vfs_mngr_get_transfer_status() != ERROR_SUCCESS) {
@@ -268,6 +290,12 @@ void vfs_user_file_change_handler(const vfs_filename_t filename, vfs_file_change
                     case kChipEraseActionFile:
                         config_ram_set_page_erase(false);
                         break;
+                    case kIncrementalOnActionFile:
+                        flash_manager_set_incremental(true);
+                        break;
+                    case kIncrementalOffActionFile:
+                        flash_manager_set_incremental(false);
+                        break;
                     default:
                         util_assert(false);
                 }
@@ -393,6 +421,63 @@ static uint32_t read_file_details_txt(uint32_t sector_offset, uint8_t *data, uin
     return update_details_txt_file(data, num_sectors * VFS_SECTOR_SIZE, sector_offset * VFS_SECTOR_SIZE);
 }
 
+#ifdef DAP_STATS
+// Numbers are zero padded so the file keeps the size it was created with
+static uint32_t stats_value_in_region(uint8_t *buf, uint32_t size, uint32_t start, uint32_t pos, uint32_t value)
+{
+    char number[11] = { ' ' };
+    util_write_uint32_zp(number + 1, value, 10);
+    return util_write_in_region(buf, size, start, pos, number, sizeof(number));
+}
+
+static uint32_t stats_field_in_region(uint8_t *buf, uint32_t size, uint32_t start, uint32_t pos, const char *label, uint32_t value)
+{
+    uint32_t l = util_write_string_in_region(buf, size, start, pos, label);
+    l += util_write_in_region(buf, size, start, pos + l, ":", 1);
+    l += stats_value_in_region(buf, size, start, pos + l, value);
+    l += util_write_in_region(buf, size, start, pos + l, "\r\n", 2);
+    return l;
+}
+
+// File callback to be used with vfs_add_file to return file contents
+static uint32_t read_file_stats_txt(uint32_t sector_offset, uint8_t *buf, uint32_t num_sectors)
+{
+    uint32_t start = sector_offset * VFS_SECTOR_SIZE;
+    uint32_t size = num_sectors * VFS_SECTOR_SIZE;
+    uint32_t pos = 0;
+    const DAP_stats_t *stats = DAP_stats_get();
+    uint32_t i, j;
+
+    pos += util_write_string_in_region(buf, size, start, pos,
+        "# DAPLink DAP statistics, remount to refresh\r\n");
+    pos += stats_field_in_region(buf, size, start, pos, "SWD WAIT", stats->swd_wait);
+    pos += stats_field_in_region(buf, size, start, pos, "SWD FAULT", stats->swd_fault);
+    pos += stats_field_in_region(buf, size, start, pos, "SWD no ACK", stats->swd_error);
+    pos += stats_field_in_region(buf, size, start, pos, "Queue high water", stats->queue_max);
+    pos += stats_field_in_region(buf, size, start, pos, "Queue full", stats->queue_full);
+
+    // One row per command, times in us
+    pos += util_write_string_in_region(buf, size, start, pos,
+        "# ID count total_us max_us <16us <64us <256us <1ms <4ms <16ms <64ms more\r\n");
+    for (i = 0; i < DAP_STATS_CMDS; i++) {
+        const DAP_stats_cmd_t *cmd = DAP_stats_get_entry(i);
+        char id[2];
+        util_write_hex8(id, DAP_stats_command_id(i));
+        pos += util_write_string_in_region(buf, size, start, pos, "0x");
+        pos += util_write_in_region(buf, size, start, pos, id, sizeof(id));
+        pos += stats_value_in_region(buf, size, start, pos, cmd->count);
+        pos += stats_value_in_region(buf, size, start, pos, cmd->total_us);
+        pos += stats_value_in_region(buf, size, start, pos, cmd->max_us);
+        for (j = 0; j < DAP_STATS_BUCKETS; j++) {
+            pos += stats_value_in_region(buf, size, start, pos, cmd->hist[j]);
+        }
+        pos += util_write_in_region(buf, size, start, pos, "\r\n", 2);
+    }
+
+    return pos;
+}
+#endif
+
 // Text representation of each error type, starting from the rightmost bit
 static const char* const error_type_names[] = {
     "internal",
@@ -535,6 +620,7 @@ static uint32_t update_details_txt_file(uint8_t *buf, uint32_t size, uint32_t st
     pos += setting_in_region(buf, size, start, pos, "Overflow detection", config_get_overflow_detect());
     pos += setting_in_region(buf, size, start, pos, "Incompatible image detection", config_get_detect_incompatible_target());
     pos += setting_in_region(buf, size, start, pos, "Page erasing", config_ram_get_page_erase());
+    pos += setting_in_region(buf, size, start, pos, "Incremental programming", config_ram_get_incremental());
 
     // Current mode and version
 #if defined(DAPLINK_BL)
@@ -586,15 +672,18 @@ static uint32_t update_details_txt_file(uint8_t *buf, uint32_t size, uint32_t st
 #endif
         "\r\n");
 
+    // The CRCs are fixed width, so sizing the file (buf is NULL) doesn't wait for them
 #if DAPLINK_ROM_BL_SIZE != 0
     // CRC of the bootloader (if there is one)
     if (info_get_bootloader_present()) {
-        pos += hex32_field_in_region(buf, size, start, pos, "Bootloader CRC", info_get_crc_bootloader());
+        pos += hex32_field_in_region(buf, size, start, pos, "Bootloader CRC",
+                                     (buf != NULL) ? info_get_crc_bootloader() : 0);
     }
 #endif
 
     // CRC of the interface
-    pos += hex32_field_in_region(buf, size, start, pos, "Interface CRC", info_get_crc_interface());
+    pos += hex32_field_in_region(buf, size, start, pos, "Interface CRC",
+                                 (buf != NULL) ? info_get_crc_interface() : 0);
 
     // Number of remounts that have occurred
     pos += uint32_field_in_region(buf, size, start, pos, "Remount count", remount_count);
@@ -109,6 +109,7 @@ static void write_none(uint32_t offset, const uint8_t *data, uint32_t size);
 
 static uint32_t read_mbr(uint32_t offset, uint8_t *data, uint32_t size);
 static uint32_t read_fat(uint32_t offset, uint8_t *data, uint32_t size);
+static uint16_t read_fat_entry(uint32_t idx);
 static uint32_t read_dir(uint32_t offset, uint8_t *data, uint32_t size);
 static void write_dir(uint32_t offset, const uint8_t *data, uint32_t size);
 static void file_change_cb_stub(const vfs_filename_t filename, vfs_file_change_t change,
@@ -308,9 +309,9 @@ static void write_fat(file_allocation_table_t *fat, uint32_t idx, uint16_t val)
     low_idx = idx * 2 + 0;
     high_idx = idx * 2 + 1;
 
-    // Assert that this is still within the fat table
+    // Only the first FAT sector is kept in RAM. Entries past it belong to
+    // files laid out back to back and are generated by read_fat_entry
     if (high_idx >= ARRAY_SIZE(fat->f)) {
-        util_assert(0);
         return;
     }
 
@@ -409,6 +410,12 @@ vfs_file_t vfs_create_file(const vfs_filename_t filename, vfs_read_cb_t read_cb,
     // Write the cluster chain to the fat table
     first_cluster = 0;
 
+    if (fat_idx + clusters > mbr.logical_sectors_per_fat * VFS_SECTOR_SIZE / 2) {
+        // Not enough room left on the disk
+        util_assert(0);
+        return VFS_FILE_INVALID;
+    }
+
     if (len > 0) {
         first_cluster = fat_idx;
 
@@ -514,6 +521,7 @@ void vfs_read(uint32_t requested_sector, uint8_t *buf, uint32_t num_sectors)
             virtual_media[i].read_cb(sector_offset, buf, sectors_to_write);
             // Update requested sector
             requested_sector += sectors_to_write;
+            buf += sectors_to_write * VFS_SECTOR_SIZE;
             num_sectors -= sectors_to_write;
         }
 
@@ -547,6 +555,7 @@ void vfs_write(uint32_t requested_sector, const uint8_t *buf, uint32_t num_secto
             virtual_media[i].write_cb(sector_offset, buf, sectors_to_read);
             // Update requested sector
             requested_sector += sectors_to_read;
+            buf += sectors_to_read * VFS_SECTOR_SIZE;
             num_sectors -= sectors_to_read;
         }
 
@@ -590,16 +599,46 @@ static uint32_t read_mbr(uint32_t sector_offset, uint8_t *data, uint32_t num_sec
 
 static uint32_t read_fat(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
 {
-    uint32_t read_size = sizeof(file_allocation_table_t);
-    COMPILER_ASSERT(sizeof(file_allocation_table_t) <= VFS_SECTOR_SIZE);
+    uint32_t idx;
+    uint32_t end;
+    uint16_t val;
+    COMPILER_ASSERT(sizeof(file_allocation_table_t) == VFS_SECTOR_SIZE);
 
-    if (sector_offset != 0) {
-        // Don't worry about reading other sectors
-        return 0;
+    if (sector_offset == 0) {
+        memcpy(data, &fat, sizeof(file_allocation_table_t));
     }
 
-    memcpy(data, &fat, read_size);
-    return read_size;
+    // Entries of sectors past the first one, up to the last allocated cluster
+    idx = MAX(sector_offset, 1) * VFS_SECTOR_SIZE / 2;
+    end = MIN((sector_offset + num_sectors) * VFS_SECTOR_SIZE / 2, fat_idx);
+
+    for (; idx < end; idx++) {
+        val = read_fat_entry(idx);
+        data[(idx * 2 - sector_offset * VFS_SECTOR_SIZE) + 0] = (val >> 0) & 0xFF;
+        data[(idx * 2 - sector_offset * VFS_SECTOR_SIZE) + 1] = (val >> 8) & 0xFF;
+    }
+
+    return num_sectors * VFS_SECTOR_SIZE;
+}
+
+// Rebuild a FAT entry from the cluster chains laid down by vfs_create_file
+static uint16_t read_fat_entry(uint32_t idx)
+{
+    uint32_t i;
+    uint32_t cluster = 2;
+    uint32_t clusters;
+
+    for (i = MEDIA_IDX_COUNT; i < virtual_media_idx; i++) {
+        clusters = virtual_media[i].length / (VFS_SECTOR_SIZE * mbr.sectors_per_cluster);
+
+        if (idx < cluster + clusters) {
+            return (idx == cluster + clusters - 1) ? 0xFFFF : idx + 1;
+        }
+
+        cluster += clusters;
+    }
+
+    return 0;
 }
 
 /* No need to handle writes to the fat */
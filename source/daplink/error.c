@@ -125,6 +125,17 @@ static const char *const error_message[] = {
     // ERROR_BL_UPDT_BAD_CRC
     "The bootloader CRC did not pass.",
 
+    /* File stream errors */
+
+    // ERROR_SREC_CKSUM
+    "The S-record file cannot be decoded. Checksum calculation failure occurred.",
+    // ERROR_SREC_PARSER
+    "The S-record file cannot be decoded. Parser logic failure occurred.",
+    // ERROR_ELF_PARSER
+    "The ELF file cannot be decoded. Only 32 bit little endian executables with loadable segments are supported.",
+    // ERROR_ELF_LAYOUT
+    "The ELF file cannot be programmed. Program headers must come before the segment data.",
+
 };
 
 COMPILER_ASSERT(ERROR_COUNT == ARRAY_SIZE(error_message));
@@ -230,6 +241,17 @@ static error_type_t error_type[] = {
     ERROR_TYPE_INTERFACE,
     // ERROR_BL_UPDT_BAD_CRC
     ERROR_TYPE_INTERFACE,
+
+    /* File stream errors */
+
+    // ERROR_SREC_CKSUM
+    ERROR_TYPE_USER | ERROR_TYPE_TRANSIENT,
+    // ERROR_SREC_PARSER
+    ERROR_TYPE_USER | ERROR_TYPE_TRANSIENT,
+    // ERROR_ELF_PARSER
+    ERROR_TYPE_USER,
+    // ERROR_ELF_LAYOUT
+    ERROR_TYPE_USER,
 };
 
 COMPILER_ASSERT(ERROR_COUNT == ARRAY_SIZE(error_type));
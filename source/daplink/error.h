@@ -81,6 +81,12 @@ typedef enum {
     ERROR_IAP_NO_INTERCEPT,
     ERROR_BL_UPDT_BAD_CRC,
 
+    /* File stream errors */
+    ERROR_SREC_CKSUM,
+    ERROR_SREC_PARSER,
+    ERROR_ELF_PARSER,
+    ERROR_ELF_LAYOUT,
+
     // Add new values here
 
     ERROR_COUNT
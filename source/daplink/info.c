@@ -44,9 +44,45 @@ static uint32_t host_id[4];
 static uint32_t target_id[4];
 static uint32_t hic_id = DAPLINK_HIC_ID;
 
-static uint32_t crc_bootloader;
-static uint32_t crc_interface;
-static uint32_t crc_config_user;
+// Bytes folded into a stale CRC per call to info_crc_periodic()
+#define CRC_STEP_SIZE           4096
+// Number of words sampled across a region for its fingerprint
+#define CRC_FINGERPRINT_SAMPLES 32
+
+// CRC of a flash region, computed incrementally
+typedef struct {
+    uint32_t start;
+    uint32_t size;
+    uint32_t offset;            // Bytes already folded into crc
+    uint32_t crc;
+    uint32_t key;               // Fingerprint the CRC is cached under, 0 if not cached
+    bool valid;
+} crc_region_t;
+
+typedef enum {
+    CRC_REGION_BOOTLOADER,
+    CRC_REGION_INTERFACE,
+    CRC_REGION_CONFIG_USER,
+    CRC_REGION_COUNT
+} crc_region_id_t;
+
+// The last word of the bootloader and interface holds their stored CRC. The
+// user config CRC is never cached: config_rom lives in that region, so storing
+// a CRC there would change what it covers. The region is one sector at most.
+static crc_region_t crc_regions[CRC_REGION_COUNT] = {
+    [CRC_REGION_BOOTLOADER] = {
+        .start = DAPLINK_ROM_BL_START,
+        .size = (DAPLINK_ROM_BL_SIZE > 0) ? DAPLINK_ROM_BL_SIZE - 4 : 0,
+    },
+    [CRC_REGION_INTERFACE] = {
+        .start = DAPLINK_ROM_IF_START,
+        .size = (DAPLINK_ROM_IF_SIZE > 0) ? DAPLINK_ROM_IF_SIZE - 4 : 0,
+    },
+    [CRC_REGION_CONFIG_USER] = {
+        .start = DAPLINK_ROM_CONFIG_USER_START,
+        .size = DAPLINK_ROM_CONFIG_USER_SIZE,
+    },
+};
 
 // Strings
 static char string_unique_id[48 + 1];
@@ -187,7 +223,7 @@ static void setup_string_descriptor()
 
 void info_init(void)
 {
-    info_crc_compute();
+    info_crc_invalidate();
     read_unique_id(host_id);
     setup_basics();
     setup_unique_id();
@@ -263,41 +299,143 @@ bool info_get_config_user_present(void)
     return false;
 }
 
+// Fold the next part of the region into its CRC, and store the CRC in the cache
+// once it is complete. Returns true if the CRC is complete.
+static bool crc_region_step(crc_region_id_t id, uint32_t max)
+{
+    crc_region_t *region = &crc_regions[id];
+    uint32_t n;
+
+    if (region->valid) {
+        return true;
+    }
+
+    // Regions that don't exist or can't be read have a CRC of 0
+    if ((region->offset == 0)
+            && ((region->size == 0) || !flash_is_readable(region->start, region->size))) {
+        region->crc = 0;
+        region->valid = true;
+        return true;
+    }
+
+    n = MIN(region->size - region->offset, max);
+    region->crc = crc32_continue(region->crc, (void *)(region->start + region->offset), n);
+    region->offset += n;
+    if (region->offset < region->size) {
+        return false;
+    }
+    region->valid = true;
+
+    if (CRC_REGION_BOOTLOADER == id) {
+        config_set_crc_bootloader(region->key, region->crc);
+    } else if (CRC_REGION_INTERFACE == id) {
+        config_set_crc_interface(region->key, region->crc);
+    }
+    return true;
+}
+
+static uint32_t crc_region_get(crc_region_id_t id)
+{
+    crc_region_step(id, crc_regions[id].size);
+    return crc_regions[id].crc;
+}
+
+// Cheap stand-in for the CRC of an image, used to tell whether its cached CRC is
+// still good. It covers the info block, the vector table, the stored CRC in the
+// last word and words sampled at even intervals, one of which any update changes.
+static uint32_t crc_region_fingerprint(crc_region_id_t id)
+{
+    const crc_region_t *region = &crc_regions[id];
+    uint32_t sample[CRC_FINGERPRINT_SAMPLES + 1];
+    uint32_t stride = ROUND_DOWN(region->size / CRC_FINGERPRINT_SAMPLES, 4);
+    uint32_t addr;
+    uint32_t key;
+    uint32_t i;
+
+    if ((region->size == 0) || !flash_is_readable(region->start, region->size + 4)) {
+        return 0;
+    }
+
+    for (i = 0; i < CRC_FINGERPRINT_SAMPLES; i++) {
+        addr = region->start + i * stride;
+        sample[i] = *(uint32_t *)addr;
+    }
+    sample[CRC_FINGERPRINT_SAMPLES] = *(uint32_t *)(region->start + region->size);
+
+    key = crc32((void *)region->start, 64);
+    key = crc32_continue(key, (void *)(region->start + DAPLINK_INFO_OFFSET), sizeof(daplink_info_t));
+    key = crc32_continue(key, &region->size, sizeof(region->size));
+    key = crc32_continue(key, sample, sizeof(sample));
+    return key;
+}
+
 uint32_t info_get_crc_bootloader()
 {
-    return crc_bootloader;
+    return crc_region_get(CRC_REGION_BOOTLOADER);
 }
 
 uint32_t info_get_crc_interface()
 {
-    return crc_interface;
+    return crc_region_get(CRC_REGION_INTERFACE);
 }
 
 uint32_t info_get_crc_config_user()
 {
-    return crc_config_user;
+    return crc_region_get(CRC_REGION_CONFIG_USER);
 }
 
-void info_crc_compute()
+uint32_t info_compute_crc_interface(void)
 {
-    crc_bootloader = 0;
-    crc_interface = 0;
-    crc_config_user = 0;
-
-    // Compute the CRCs of regions that exist
-    if ((DAPLINK_ROM_BL_SIZE > 0)
-            && flash_is_readable(DAPLINK_ROM_BL_START, DAPLINK_ROM_BL_SIZE - 4)) {
-        crc_bootloader = crc32((void *)DAPLINK_ROM_BL_START, DAPLINK_ROM_BL_SIZE - 4);
+    const crc_region_t *region = &crc_regions[CRC_REGION_INTERFACE];
+
+    if ((region->size == 0) || !flash_is_readable(region->start, region->size)) {
+        return 0;
+    }
+    return crc32((void *)region->start, region->size);
+}
+
+void info_crc_invalidate(void)
+{
+    crc_region_id_t id;
+    crc_region_t *region;
+    uint32_t crc;
+
+    for (id = (crc_region_id_t)0; id < CRC_REGION_COUNT; id++) {
+        region = &crc_regions[id];
+        region->offset = 0;
+        region->crc = 0;
+        region->key = 0;
+        region->valid = false;
     }
 
-    if ((DAPLINK_ROM_IF_SIZE > 0)
-            && flash_is_readable(DAPLINK_ROM_IF_START, DAPLINK_ROM_IF_SIZE - 4)) {
-        crc_interface = crc32((void *)DAPLINK_ROM_IF_START, DAPLINK_ROM_IF_SIZE - 4);
+    // Pick up the cached CRCs of images that haven't changed
+    region = &crc_regions[CRC_REGION_BOOTLOADER];
+    region->key = crc_region_fingerprint(CRC_REGION_BOOTLOADER);
+    crc = config_get_crc_bootloader(region->key);
+    if ((region->key != 0) && (crc != 0)) {
+        region->crc = crc;
+        region->valid = true;
     }
 
-    if ((DAPLINK_ROM_CONFIG_USER_SIZE > 0)
-            && flash_is_readable(DAPLINK_ROM_CONFIG_USER_START, DAPLINK_ROM_CONFIG_USER_SIZE)) {
-        crc_config_user = crc32((void *)DAPLINK_ROM_CONFIG_USER_START, DAPLINK_ROM_CONFIG_USER_SIZE);
+    region = &crc_regions[CRC_REGION_INTERFACE];
+    region->key = crc_region_fingerprint(CRC_REGION_INTERFACE);
+    crc = config_get_crc_interface(region->key);
+    if ((region->key != 0) && (crc != 0)) {
+        region->crc = crc;
+        region->valid = true;
+    }
+}
+
+void info_crc_periodic(void)
+{
+    crc_region_id_t id;
+
+    // One step of one region per call so each call stays short
+    for (id = (crc_region_id_t)0; id < CRC_REGION_COUNT; id++) {
+        if (!crc_regions[id].valid) {
+            crc_region_step(id, CRC_STEP_SIZE);
+            return;
+        }
     }
 }
 
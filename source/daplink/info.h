@@ -31,7 +31,14 @@ extern "C" {
 
 void info_init(void);
 void info_set_uuid_target(uint32_t *uuid_data);
-void info_crc_compute(void);
+
+// Recompute the CRCs of the bootloader, interface and user config, for example
+// after one of them was updated. CRCs still in the cache are not recomputed.
+void info_crc_invalidate(void);
+
+// Fold the next part of any stale region into its CRC. Called from the main
+// loop so the CRCs are ready by the time they are needed.
+void info_crc_periodic(void);
 
 
 // Get the 48 digit unique ID as a null terminated string.
@@ -75,11 +82,17 @@ bool info_get_config_user_present(void);
 
 // Get the CRCs of various regions.
 // The CRC returned is only valid if
-// the given region is present.
+// the given region is present. Any part
+// of the CRC still outstanding is computed
+// before returning.
 uint32_t info_get_crc_bootloader(void);
 uint32_t info_get_crc_interface(void);
 uint32_t info_get_crc_config_user(void);
 
+// Compute the CRC of the interface from flash, bypassing the cache. For checks
+// that must not trust a cached value, such as before updating the bootloader.
+uint32_t info_compute_crc_interface(void);
+
 // Get version info as an integer
 uint32_t info_get_bootloader_version(void);
 uint32_t info_get_interface_version(void);
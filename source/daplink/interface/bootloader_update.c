@@ -58,7 +58,7 @@ static bool interface_image_valid()
         stored_crc = *(uint32_t *)(DAPLINK_ROM_IF_START + DAPLINK_ROM_IF_SIZE - 4);
     }
 
-    computed_crc = info_get_crc_interface();
+    computed_crc = info_compute_crc_interface();
     return computed_crc == stored_crc;
 }
 
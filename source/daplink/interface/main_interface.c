@@ -34,6 +34,7 @@
 #include "daplink.h"
 #include "util.h"
 #include "DAP.h"
+#include "DAP_queue.h"
 #include "bootloader.h"
 #include "cortex_m.h"
 #include "sdk.h"
@@ -44,6 +45,9 @@
 #include "vfs_manager.h"
 #include "flash_intf.h"
 #include "flash_manager.h"
+#ifdef TARGET_MEMORY_FILES
+#include "target_memory_file.h"
+#endif
 #endif
 
 #ifndef USE_LEGACY_CMSIS_RTOS
@@ -79,9 +83,19 @@ void __libc_init_array (void) {}
 #define FLAGS_MAIN_PROC_USB     (1 << 9)
 // Used by cdc when an event occurs
 #define FLAGS_MAIN_CDC_EVENT    (1 << 11)
+// Used by the DAP task when a response is ready
+#define FLAGS_MAIN_DAP_EVENT    (1 << 12)
+// Used by the DAP task for a command the main task has to execute
+#define FLAGS_MAIN_DAP_COMMAND  (1 << 13)
+// Used by the SWO task when trace data is ready to be sent
+#define FLAGS_MAIN_SWO_EVENT    (1 << 14)
 // Used by msd when flashing a new binary
 #define FLAGS_LED_BLINK_30MS    (1 << 6)
 
+// Event flags for DAP task
+#define FLAGS_DAP_EXECUTE       (1 << 0)
+#define FLAGS_DAP_COMMAND_DONE  (1 << 1)
+
 // Timing constants (in 90mS ticks)
 // USB busy time (~3 sec)
 #define USB_BUSY_TIME           (33)
@@ -113,6 +127,14 @@ void __libc_init_array (void) {}
 // Reference to our main task
 osThreadId_t main_task_id;
 #ifndef USE_LEGACY_CMSIS_RTOS
+// Reference to the task executing DAP commands
+static osThreadId_t dap_task_id;
+// Serializes target access between the DAP task and the main task
+static osMutexId_t target_mutex_id;
+// DAP command handed to the main task and its result
+static const uint8_t *dap_command_request;
+static uint8_t *dap_command_response;
+static uint32_t dap_command_num;
 static uint32_t s_main_thread_cb[WORDS(sizeof(osRtxThread_t))];
 static uint64_t s_main_task_stack[MAIN_TASK_STACK / sizeof(uint64_t)];
 static const osThreadAttr_t k_main_thread_attr = {
@@ -124,6 +146,40 @@ static const osThreadAttr_t k_main_thread_attr = {
         .priority = MAIN_TASK_PRIORITY,
     };
 
+static uint32_t s_dap_thread_cb[WORDS(sizeof(osRtxThread_t))];
+static uint64_t s_dap_task_stack[DAP_TASK_STACK / sizeof(uint64_t)];
+static const osThreadAttr_t k_dap_thread_attr = {
+        .name = "dap",
+        .cb_mem = s_dap_thread_cb,
+        .cb_size = sizeof(s_dap_thread_cb),
+        .stack_mem = s_dap_task_stack,
+        .stack_size = sizeof(s_dap_task_stack),
+        .priority = DAP_TASK_PRIORITY,
+    };
+
+#if (SWO_STREAM != 0)
+// Referenced by SWO.c to wake the streaming thread
+osThreadId_t SWO_ThreadId;
+static uint32_t s_swo_thread_cb[WORDS(sizeof(osRtxThread_t))];
+static uint64_t s_swo_task_stack[SWO_TASK_STACK / sizeof(uint64_t)];
+static const osThreadAttr_t k_swo_thread_attr = {
+        .name = "swo",
+        .cb_mem = s_swo_thread_cb,
+        .cb_size = sizeof(s_swo_thread_cb),
+        .stack_mem = s_swo_task_stack,
+        .stack_size = sizeof(s_swo_task_stack),
+        .priority = SWO_TASK_PRIORITY,
+    };
+#endif
+
+static uint32_t s_target_mutex_cb[WORDS(sizeof(osRtxMutex_t))];
+static const osMutexAttr_t k_target_mutex_attr = {
+        .name = "target",
+        .attr_bits = osMutexRecursive | osMutexPrioInherit,
+        .cb_mem = s_target_mutex_cb,
+        .cb_size = sizeof(s_target_mutex_cb),
+    };
+
 static uint32_t s_timer_30ms_cb[WORDS(sizeof(osRtxTimer_t))];
 static const osTimerAttr_t k_timer_30ms_attr = {
         .name = "30ms",
@@ -251,6 +307,70 @@ void main_cdc_send_event(void)
     return;
 }
 
+// Execute the queued DAP commands
+void main_dap_execute_event(void)
+{
+#ifndef USE_LEGACY_CMSIS_RTOS
+    osThreadFlagsSet(dap_task_id, FLAGS_DAP_EXECUTE);
+#else
+    DAP_queue_execute_pending();
+#endif
+    return;
+}
+
+// Send the DAP responses
+void main_dap_send_event(void)
+{
+#ifndef USE_LEGACY_CMSIS_RTOS
+    osThreadFlagsSet(main_task_id, FLAGS_MAIN_DAP_EVENT);
+#else
+    DAP_queue_send_pending();
+#endif
+    return;
+}
+
+// Send the queued SWO trace data
+void main_swo_send_event(void)
+{
+#ifndef USE_LEGACY_CMSIS_RTOS
+    osThreadFlagsSet(main_task_id, FLAGS_MAIN_SWO_EVENT);
+#elif (SWO_STREAM != 0)
+    USBD_BULK_SWO_Send_Event();
+#endif
+    return;
+}
+
+// Execute a DAP command on the main task and wait for it to finish. The DAP
+// task doesn't hold the target while it waits, since the main task may keep
+// it for a whole drag-n-drop session.
+uint32_t main_dap_execute_command(const uint8_t *request, uint8_t *response)
+{
+#ifndef USE_LEGACY_CMSIS_RTOS
+    dap_command_request = request;
+    dap_command_response = response;
+    osThreadFlagsSet(main_task_id, FLAGS_MAIN_DAP_COMMAND);
+    osThreadFlagsWait(FLAGS_DAP_COMMAND_DONE, osFlagsWaitAny, osWaitForever);
+    return dap_command_num;
+#else
+    return DAP_ExecuteCommand(request, response);
+#endif
+}
+
+// Claim the target for a sequence of debug accesses
+void main_target_lock(void)
+{
+#ifndef USE_LEGACY_CMSIS_RTOS
+    osMutexAcquire(target_mutex_id, osWaitForever);
+#endif
+}
+
+void main_target_unlock(void)
+{
+#ifndef USE_LEGACY_CMSIS_RTOS
+    osMutexRelease(target_mutex_id);
+#endif
+}
+
 void main_usb_set_test_mode(bool enabled)
 {
     usb_test_mode = enabled;
@@ -263,6 +383,16 @@ void USBD_SignalHandler()
 
 extern void cdc_process_event(void);
 
+#ifndef USE_LEGACY_CMSIS_RTOS
+void dap_task(void * arg)
+{
+    while (1) {
+        osThreadFlagsWait(FLAGS_DAP_EXECUTE, osFlagsWaitAny, osWaitForever);
+        DAP_queue_execute_pending();
+    }
+}
+#endif
+
 void main_task(void * arg)
 {
     // State processing
@@ -347,6 +477,9 @@ void main_task(void * arg)
                        | FLAGS_MAIN_DISABLEDEBUG    // Disable target debug
                        | FLAGS_MAIN_PROC_USB        // process usb events
                        | FLAGS_MAIN_CDC_EVENT       // cdc event
+                       | FLAGS_MAIN_DAP_EVENT       // dap response ready
+                       | FLAGS_MAIN_DAP_COMMAND     // dap command to execute
+                       | FLAGS_MAIN_SWO_EVENT       // swo trace data ready
                        | FLAGS_BOARD_EVENT          // custom board event
                        , osFlagsWaitAny
                        , osWaitForever);
@@ -360,6 +493,25 @@ void main_task(void * arg)
             USBD_Handler();
         }
 
+#ifndef USE_LEGACY_CMSIS_RTOS
+        if (flags & FLAGS_MAIN_DAP_COMMAND) {
+            main_target_lock();
+            dap_command_num = DAP_ExecuteCommand(dap_command_request, dap_command_response);
+            main_target_unlock();
+            osThreadFlagsSet(dap_task_id, FLAGS_DAP_COMMAND_DONE);
+        }
+#endif
+
+        if (flags & FLAGS_MAIN_DAP_EVENT) {
+            DAP_queue_send_pending();
+        }
+
+#if (SWO_STREAM != 0)
+        if (flags & FLAGS_MAIN_SWO_EVENT) {
+            USBD_BULK_SWO_Send_Event();
+        }
+#endif
+
         if (flags & FLAGS_MAIN_RESET) {
             target_set_state(RESET_RUN);
         }
@@ -396,6 +548,9 @@ void main_task(void * arg)
             // Update USB busy status
 #ifdef DRAG_N_DROP_SUPPORT
             vfs_mngr_periodic(90); // FLAGS_MAIN_90MS
+#ifdef TARGET_MEMORY_FILES
+            target_memory_file_periodic(90); // FLAGS_MAIN_90MS
+#endif
 #endif
             // Update USB connect status
             switch (usb_state) {
@@ -454,6 +609,11 @@ void main_task(void * arg)
 
             handle_reset_button();
 
+            // Bring stale image CRCs up to date once enumeration is out of the way
+            if ((usb_state != USB_CONNECTING) && (usb_state != USB_CHECK_CONNECTED)) {
+                info_crc_periodic();
+            }
+
 #ifdef PBON_BUTTON
             // handle PBON pressed
             if(gpio_get_pbon_btn())
@@ -564,6 +724,13 @@ int main(void)
     // Create application main thread
 #ifndef USE_LEGACY_CMSIS_RTOS
     main_task_id = osThreadNew(main_task, NULL, &k_main_thread_attr);
+    // DAP commands are executed by their own thread
+    dap_task_id = osThreadNew(dap_task, NULL, &k_dap_thread_attr);
+#if (SWO_STREAM != 0)
+    // Streaming trace is sent from its own thread
+    SWO_ThreadId = osThreadNew(SWO_Thread, NULL, &k_swo_thread_attr);
+#endif
+    target_mutex_id = osMutexNew(&k_target_mutex_attr);
 #else
     osThreadNew(main_task, NULL, NULL);
 #endif
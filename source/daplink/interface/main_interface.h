@@ -51,6 +51,12 @@ void main_powerdown_event(void);
 void main_board_event(void);
 void main_disable_debug_event(void);
 void main_cdc_send_event(void);
+void main_dap_execute_event(void);
+void main_dap_send_event(void);
+uint32_t main_dap_execute_command(const uint8_t *request, uint8_t *response);
+void main_swo_send_event(void);
+void main_target_lock(void);
+void main_target_unlock(void);
 void main_msc_disconnect_event(void);
 void main_msc_delay_disconnect_event(void);
 void main_force_msc_disconnect_event(void);
@@ -46,15 +46,22 @@
 #define MAX_SWD_RETRY 100//10
 #define MAX_TIMEOUT   1000000  // Timeout for syscalls on target
 
+#define SWD_QUEUE_SIZE 32      // Transfers collected before the queue is flushed
+
 // Use the CMSIS-Core definition if available.
 #if !defined(SCB_AIRCR_PRIGROUP_Pos)
 #define SCB_AIRCR_PRIGROUP_Pos              8U                                            /*!< SCB AIRCR: PRIGROUP Position */
 #define SCB_AIRCR_PRIGROUP_Msk             (7UL << SCB_AIRCR_PRIGROUP_Pos)                /*!< SCB AIRCR: PRIGROUP Mask */
 #endif
 
+// Shadow copies of DP/AP registers, used to skip redundant writes.
+// CSW and TAR belong to the MEM-AP selected by apsel.
 typedef struct {
     uint32_t select;
     uint32_t csw;
+    uint32_t tar;
+    uint32_t apsel;
+    uint8_t tar_valid;
 } DAP_STATE;
 
 typedef struct {
@@ -62,9 +69,22 @@ typedef struct {
     uint32_t xpsr;
 } DEBUG_STATE;
 
+typedef struct {
+    uint32_t req;
+    uint32_t data;
+    uint32_t *result;
+} SWD_QUEUE_ENTRY;
+
+typedef struct {
+    SWD_QUEUE_ENTRY entry[SWD_QUEUE_SIZE];
+    uint32_t count;
+    uint8_t failed;     // Sticky error for the current batch
+} SWD_QUEUE;
+
 static SWD_CONNECT_TYPE reset_connect = CONNECT_NORMAL;
 
 static DAP_STATE dap_state;
+static SWD_QUEUE swd_queue;
 static uint32_t  soft_reset = SYSRESETREQ;
 
 static uint32_t swd_get_apsel(uint32_t adr)
@@ -76,6 +96,61 @@ static uint32_t swd_get_apsel(uint32_t adr)
         return apsel;
 }
 
+// Forget all shadowed register values
+static void swd_invalidate_state(void)
+{
+    dap_state.select = 0xffffffff;
+    dap_state.csw = 0xffffffff;
+    dap_state.apsel = 0xffffffff;
+    dap_state.tar_valid = 0;
+}
+
+// CSW and TAR are per AP, so drop them when another MEM-AP is used
+static void swd_shadow_select_ap(uint32_t apsel)
+{
+    if (dap_state.apsel != apsel) {
+        dap_state.apsel = apsel;
+        dap_state.csw = 0xffffffff;
+        dap_state.tar_valid = 0;
+    }
+}
+
+static uint8_t swd_shadow_tar_matches(uint32_t addr)
+{
+    return dap_state.tar_valid && (dap_state.tar == addr);
+}
+
+static void swd_shadow_set_tar(uint32_t addr)
+{
+    dap_state.tar = addr;
+    dap_state.tar_valid = 1;
+}
+
+// Follow TAR auto-increment after count DRW accesses. Only 32-bit
+// increments inside a TARGET_AUTO_INCREMENT_PAGE_SIZE page are tracked.
+static void swd_shadow_drw_access(uint32_t count)
+{
+    uint32_t tar;
+
+    if (!dap_state.tar_valid) {
+        return;
+    }
+
+    if ((dap_state.csw & (CSW_SADDRINC | CSW_SIZE)) != (CSW_SADDRINC | CSW_SIZE32)) {
+        dap_state.tar_valid = 0;
+        return;
+    }
+
+    tar = dap_state.tar + count * 4;
+
+    if ((tar ^ dap_state.tar) & ~(TARGET_AUTO_INCREMENT_PAGE_SIZE - 1)) {
+        dap_state.tar_valid = 0;
+        return;
+    }
+
+    dap_state.tar = tar;
+}
+
 void swd_set_reset_connect(SWD_CONNECT_TYPE type)
 {
     reset_connect = type;
@@ -99,10 +174,15 @@ uint8_t swd_transfer_retry(uint32_t req, uint32_t *data)
 
         // if ack != WAIT
         if (ack != DAP_TRANSFER_WAIT) {
-            return ack;
+            break;
         }
     }
 
+    // The failed transfer may have left any register in an unknown state
+    if (ack != DAP_TRANSFER_OK) {
+        swd_invalidate_state();
+    }
+
     return ack;
 }
 
@@ -124,11 +204,15 @@ uint8_t swd_init(void)
 uint8_t swd_off(void)
 {
     PORT_OFF();
+    swd_invalidate_state();
     return 1;
 }
 
 uint8_t swd_clear_errors(void)
 {
+    // A cleared error means earlier transfers may not have completed
+    swd_invalidate_state();
+
     if (!swd_write_dp(DP_ABORT, STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR)) {
         return 0;
     }
@@ -190,6 +274,12 @@ uint8_t swd_read_ap(uint32_t adr, uint32_t *val)
         return 0;
     }
 
+    if (adr == AP_DRW) {
+        // Both reads below advance TAR
+        swd_shadow_select_ap(apsel);
+        swd_shadow_drw_access(2);
+    }
+
     tmp_in = SWD_REG_AP | SWD_REG_R | SWD_REG_ADR(adr);
     // first dummy read
     swd_transfer_retry(tmp_in, (uint32_t *)tmp_out);
@@ -220,6 +310,8 @@ uint8_t swd_write_ap(uint32_t adr, uint32_t val)
 
     switch (adr) {
         case AP_CSW:
+            swd_shadow_select_ap(apsel);
+
             if (dap_state.csw == val) {
                 return 1;
             }
@@ -227,6 +319,16 @@ uint8_t swd_write_ap(uint32_t adr, uint32_t val)
             dap_state.csw = val;
             break;
 
+        case AP_TAR:
+            swd_shadow_select_ap(apsel);
+            swd_shadow_set_tar(val);
+            break;
+
+        case AP_DRW:
+            swd_shadow_select_ap(apsel);
+            swd_shadow_drw_access(1);
+            break;
+
         default:
             break;
     }
@@ -244,6 +346,221 @@ uint8_t swd_write_ap(uint32_t adr, uint32_t val)
 }
 
 
+// Run the queued transfers as one posted stream. AP reads are pipelined so
+// each read returns the data of the previous one, and RDBUFF is only read to
+// collect the last posted read or to check the last write.
+static uint8_t swd_queue_flush(void)
+{
+    uint32_t i, data;
+    uint32_t *post_read = NULL;
+    uint8_t post_pending = 0;
+    uint8_t check_write = 0;
+    uint8_t ack = DAP_TRANSFER_OK;
+
+    for (i = 0; i < swd_queue.count; i++) {
+        SWD_QUEUE_ENTRY *entry = &swd_queue.entry[i];
+
+        if (entry->req & SWD_REG_R) {
+            if (entry->req & SWD_REG_AP) {
+                // Read previous AP data and post next AP read
+                ack = swd_transfer_retry(entry->req, &data);
+                if ((ack == DAP_TRANSFER_OK) && post_pending && post_read) {
+                    *post_read = data;
+                }
+                post_read = entry->result;
+                post_pending = 1;
+            } else {
+                if (post_pending) {
+                    ack = swd_transfer_retry(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF), &data);
+                    if (ack != DAP_TRANSFER_OK) {
+                        break;
+                    }
+                    if (post_read) {
+                        *post_read = data;
+                    }
+                    post_pending = 0;
+                }
+                ack = swd_transfer_retry(entry->req, &data);
+                if ((ack == DAP_TRANSFER_OK) && entry->result) {
+                    *entry->result = data;
+                }
+            }
+            check_write = 0;
+        } else {
+            if (post_pending) {
+                ack = swd_transfer_retry(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF), &data);
+                if (ack != DAP_TRANSFER_OK) {
+                    break;
+                }
+                if (post_read) {
+                    *post_read = data;
+                }
+                post_pending = 0;
+            }
+            ack = swd_transfer_retry(entry->req, &entry->data);
+            check_write = 1;
+        }
+
+        if (ack != DAP_TRANSFER_OK) {
+            break;
+        }
+    }
+
+    if (ack == DAP_TRANSFER_OK) {
+        if (post_pending) {
+            // Read last posted AP data
+            ack = swd_transfer_retry(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF), &data);
+            if ((ack == DAP_TRANSFER_OK) && post_read) {
+                *post_read = data;
+            }
+        } else if (check_write) {
+            // Check last write
+            ack = swd_transfer_retry(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF), NULL);
+        }
+    }
+
+    swd_queue.count = 0;
+    return (ack == DAP_TRANSFER_OK);
+}
+
+static void swd_queue_add(uint32_t req, uint32_t data, uint32_t *result)
+{
+    SWD_QUEUE_ENTRY *entry;
+
+    if (swd_queue.failed) {
+        return;
+    }
+
+    if (swd_queue.count >= SWD_QUEUE_SIZE) {
+        if (!swd_queue_flush()) {
+            swd_queue.failed = 1;
+            return;
+        }
+    }
+
+    entry = &swd_queue.entry[swd_queue.count++];
+    entry->req = req;
+    entry->data = data;
+    entry->result = result;
+}
+
+// Start a new batch of queued transfers.
+void swd_queue_start(void)
+{
+    swd_queue.count = 0;
+    swd_queue.failed = 0;
+}
+
+// Run all queued transfers. Returns 0 if any transfer in the batch failed.
+uint8_t swd_queue_execute(void)
+{
+    uint8_t ok = !swd_queue.failed;
+
+    if (ok && swd_queue.count) {
+        ok = swd_queue_flush();
+    }
+
+    if (!ok) {
+        // The shadow state was updated when the transfers were queued
+        swd_invalidate_state();
+    }
+
+    swd_queue.count = 0;
+    swd_queue.failed = 0;
+    return ok;
+}
+
+void swd_queue_write_dp(uint8_t adr, uint32_t val)
+{
+    //check if the right bank is already selected
+    if (adr == DP_SELECT) {
+        if (dap_state.select == val) {
+            return;
+        }
+        dap_state.select = val;
+    }
+
+    swd_queue_add(SWD_REG_DP | SWD_REG_W | SWD_REG_ADR(adr), val, NULL);
+}
+
+void swd_queue_read_dp(uint8_t adr, uint32_t *val)
+{
+    swd_queue_add(SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(adr), 0, val);
+}
+
+void swd_queue_write_ap(uint32_t adr, uint32_t val)
+{
+    uint32_t apsel = swd_get_apsel(adr);
+
+    swd_queue_write_dp(DP_SELECT, apsel | (adr & APBANKSEL));
+
+    switch (adr) {
+        case AP_CSW:
+            swd_shadow_select_ap(apsel);
+
+            if (dap_state.csw == val) {
+                return;
+            }
+
+            dap_state.csw = val;
+            break;
+
+        case AP_TAR:
+            swd_shadow_select_ap(apsel);
+            swd_shadow_set_tar(val);
+            break;
+
+        case AP_DRW:
+            swd_shadow_select_ap(apsel);
+            swd_shadow_drw_access(1);
+            break;
+
+        default:
+            break;
+    }
+
+    swd_queue_add(SWD_REG_AP | SWD_REG_W | SWD_REG_ADR(adr), val, NULL);
+}
+
+void swd_queue_read_ap(uint32_t adr, uint32_t *val)
+{
+    uint32_t apsel = swd_get_apsel(adr);
+
+    swd_queue_write_dp(DP_SELECT, apsel | (adr & APBANKSEL));
+
+    if (adr == AP_DRW) {
+        swd_shadow_select_ap(apsel);
+        swd_shadow_drw_access(1);
+    }
+
+    swd_queue_add(SWD_REG_AP | SWD_REG_R | SWD_REG_ADR(adr), 0, val);
+}
+
+// Queue a TAR update unless auto-increment already points at addr.
+static void swd_queue_set_tar(uint32_t addr)
+{
+    if (swd_shadow_tar_matches(addr)) {
+        return;
+    }
+
+    swd_queue_write_ap(AP_TAR, addr);
+}
+
+void swd_queue_write_word(uint32_t addr, uint32_t val)
+{
+    swd_queue_write_ap(AP_CSW, CSW_VALUE | CSW_SIZE32);
+    swd_queue_set_tar(addr);
+    swd_queue_write_ap(AP_DRW, val);
+}
+
+void swd_queue_read_word(uint32_t addr, uint32_t *val)
+{
+    swd_queue_write_ap(AP_CSW, CSW_VALUE | CSW_SIZE32);
+    swd_queue_set_tar(addr);
+    swd_queue_read_ap(AP_DRW, val);
+}
+
+
 // Write 32-bit word aligned values to target memory using address auto-increment.
 // size is in bytes.
 static uint8_t swd_write_block(uint32_t address, uint8_t *data, uint32_t size)
@@ -263,12 +580,16 @@ static uint8_t swd_write_block(uint32_t address, uint8_t *data, uint32_t size)
         return 0;
     }
 
-    // TAR write
-    req = SWD_REG_AP | SWD_REG_W | (1 << 2);
-    int2array(tmp_in, address, 4);
+    // TAR write, unless auto-increment already points here
+    if (!swd_shadow_tar_matches(address)) {
+        req = SWD_REG_AP | SWD_REG_W | (1 << 2);
+        int2array(tmp_in, address, 4);
 
-    if (swd_transfer_retry(req, (uint32_t *)tmp_in) != 0x01) {
-        return 0;
+        if (swd_transfer_retry(req, (uint32_t *)tmp_in) != 0x01) {
+            return 0;
+        }
+
+        swd_shadow_set_tar(address);
     }
 
     // DRW write
@@ -282,6 +603,8 @@ static uint8_t swd_write_block(uint32_t address, uint8_t *data, uint32_t size)
         data += 4;
     }
 
+    swd_shadow_drw_access(size_in_words);
+
     // dummy read
     req = SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF);
     ack = swd_transfer_retry(req, NULL);
@@ -306,12 +629,16 @@ static uint8_t swd_read_block(uint32_t address, uint8_t *data, uint32_t size)
         return 0;
     }
 
-    // TAR write
-    req = SWD_REG_AP | SWD_REG_W | AP_TAR;
-    int2array(tmp_in, address, 4);
+    // TAR write, unless auto-increment already points here
+    if (!swd_shadow_tar_matches(address)) {
+        req = SWD_REG_AP | SWD_REG_W | AP_TAR;
+        int2array(tmp_in, address, 4);
 
-    if (swd_transfer_retry(req, (uint32_t *)tmp_in) != DAP_TRANSFER_OK) {
-        return 0;
+        if (swd_transfer_retry(req, (uint32_t *)tmp_in) != DAP_TRANSFER_OK) {
+            return 0;
+        }
+
+        swd_shadow_set_tar(address);
     }
 
     // read data
@@ -330,6 +657,8 @@ static uint8_t swd_read_block(uint32_t address, uint8_t *data, uint32_t size)
         data += 4;
     }
 
+    swd_shadow_drw_access(size_in_words);
+
     // read last word
     req = SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF);
     ack = swd_transfer_retry(req, (uint32_t *)data);
@@ -339,93 +668,39 @@ static uint8_t swd_read_block(uint32_t address, uint8_t *data, uint32_t size)
 // Read target memory.
 static uint8_t swd_read_data(uint32_t addr, uint32_t *val)
 {
-    uint8_t tmp_in[4];
-    uint8_t tmp_out[4];
-    uint8_t req, ack;
-    uint32_t tmp;
+    swd_queue_start();
     // put addr in TAR register
-    int2array(tmp_in, addr, 4);
-    req = SWD_REG_AP | SWD_REG_W | (1 << 2);
-
-    if (swd_transfer_retry(req, (uint32_t *)tmp_in) != 0x01) {
-        return 0;
-    }
-
+    swd_queue_set_tar(addr);
     // read data
-    req = SWD_REG_AP | SWD_REG_R | (3 << 2);
-
-    if (swd_transfer_retry(req, (uint32_t *)tmp_out) != 0x01) {
-        return 0;
-    }
-
-    // dummy read
-    req = SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF);
-    ack = swd_transfer_retry(req, (uint32_t *)tmp_out);
-    *val = 0;
-    tmp = tmp_out[3];
-    *val |= (tmp << 24);
-    tmp = tmp_out[2];
-    *val |= (tmp << 16);
-    tmp = tmp_out[1];
-    *val |= (tmp << 8);
-    tmp = tmp_out[0];
-    *val |= (tmp << 0);
-    return (ack == 0x01);
+    swd_queue_read_ap(AP_DRW, val);
+    return swd_queue_execute();
 }
 
 // Write target memory.
 static uint8_t swd_write_data(uint32_t address, uint32_t data)
 {
-    uint8_t tmp_in[4];
-    uint8_t req, ack;
+    swd_queue_start();
     // put addr in TAR register
-    int2array(tmp_in, address, 4);
-    req = SWD_REG_AP | SWD_REG_W | (1 << 2);
-
-    if (swd_transfer_retry(req, (uint32_t *)tmp_in) != 0x01) {
-        return 0;
-    }
-
+    swd_queue_set_tar(address);
     // write data
-    int2array(tmp_in, data, 4);
-    req = SWD_REG_AP | SWD_REG_W | (3 << 2);
-
-    if (swd_transfer_retry(req, (uint32_t *)tmp_in) != 0x01) {
-        return 0;
-    }
-
-    // dummy read
-    req = SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF);
-    ack = swd_transfer_retry(req, NULL);
-    return (ack == 0x01) ? 1 : 0;
+    swd_queue_write_ap(AP_DRW, data);
+    return swd_queue_execute();
 }
 
 // Read 32-bit word from target memory.
 uint8_t swd_read_word(uint32_t addr, uint32_t *val)
 {
-    if (!swd_write_ap(AP_CSW, CSW_VALUE | CSW_SIZE32)) {
-        return 0;
-    }
-
-    if (!swd_read_data(addr, val)) {
-        return 0;
-    }
-
-    return 1;
+    swd_queue_start();
+    swd_queue_read_word(addr, val);
+    return swd_queue_execute();
 }
 
 // Write 32-bit word to target memory.
 uint8_t swd_write_word(uint32_t addr, uint32_t val)
 {
-    if (!swd_write_ap(AP_CSW, CSW_VALUE | CSW_SIZE32)) {
-        return 0;
-    }
-
-    if (!swd_write_data(addr, val)) {
-        return 0;
-    }
-
-    return 1;
+    swd_queue_start();
+    swd_queue_write_word(addr, val);
+    return swd_queue_execute();
 }
 
 // Read 8-bit byte from target memory.
@@ -594,16 +869,14 @@ static uint8_t swd_write_debug_state(DEBUG_STATE *state)
         return 0;
     }
 
-    if (!swd_write_word(DBG_HCSR, DBGKEY | C_DEBUGEN | C_MASKINTS | C_HALT)) {
-        return 0;
-    }
-
-    if (!swd_write_word(DBG_HCSR, DBGKEY | C_DEBUGEN | C_MASKINTS)) {
-        return 0;
-    }
+    swd_queue_start();
+    swd_queue_write_word(DBG_HCSR, DBGKEY | C_DEBUGEN | C_MASKINTS | C_HALT);
+    swd_queue_write_word(DBG_HCSR, DBGKEY | C_DEBUGEN | C_MASKINTS);
 
     // check status
-    if (!swd_read_dp(DP_CTRL_STAT, &status)) {
+    swd_queue_read_dp(DP_CTRL_STAT, &status);
+
+    if (!swd_queue_execute()) {
         return 0;
     }
 
@@ -617,18 +890,30 @@ static uint8_t swd_write_debug_state(DEBUG_STATE *state)
 uint8_t swd_read_core_register(uint32_t n, uint32_t *val)
 {
     int i = 0, timeout = 100;
+    uint32_t dhcsr;
 
-    if (!swd_write_word(DCRSR, n)) {
+    // Request the register and read it back in one batch. DCRDR is
+    // only valid if S_REGRDY was already set when DHCSR was read.
+    swd_queue_start();
+    swd_queue_write_word(DCRSR, n);
+    swd_queue_read_word(DHCSR, &dhcsr);
+    swd_queue_read_word(DCRDR, val);
+
+    if (!swd_queue_execute()) {
         return 0;
     }
 
+    if (dhcsr & S_REGRDY) {
+        return 1;
+    }
+
     // wait for S_REGRDY
     for (i = 0; i < timeout; i++) {
-        if (!swd_read_word(DHCSR, val)) {
+        if (!swd_read_word(DHCSR, &dhcsr)) {
             return 0;
         }
 
-        if (*val & S_REGRDY) {
+        if (dhcsr & S_REGRDY) {
             break;
         }
     }
@@ -648,12 +933,17 @@ uint8_t swd_write_core_register(uint32_t n, uint32_t val)
 {
     int i = 0, timeout = 100;
 
-    if (!swd_write_word(DCRDR, val)) {
+    swd_queue_start();
+    swd_queue_write_word(DCRDR, val);
+    swd_queue_write_word(DCRSR, n | REGWnR);
+    swd_queue_read_word(DHCSR, &val);
+
+    if (!swd_queue_execute()) {
         return 0;
     }
 
-    if (!swd_write_word(DCRSR, n | REGWnR)) {
-        return 0;
+    if (val & S_REGRDY) {
+        return 1;
     }
 
     // wait for S_REGRDY
@@ -688,10 +978,10 @@ static uint8_t swd_wait_until_halted(void)
     return 0;
 }
 
-uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, flash_algo_return_t return_type)
+uint8_t swd_flash_syscall_start(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
 {
     DEBUG_STATE state = {{0}, 0};
-    // Call flash algorithm function on target and wait for result.
+    // Call flash algorithm function on target without waiting for the result.
     state.r[0]     = arg1;                   // R0: Argument 1
     state.r[1]     = arg2;                   // R1: Argument 2
     state.r[2]     = arg3;                   // R2: Argument 3
@@ -706,11 +996,16 @@ uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t e
         return 0;
     }
 
+    return 1;
+}
+
+uint8_t swd_flash_syscall_wait(uint32_t *result)
+{
     if (!swd_wait_until_halted()) {
         return 0;
     }
 
-    if (!swd_read_core_register(0, &state.r[0])) {
+    if (!swd_read_core_register(0, result)) {
         return 0;
     }
 
@@ -719,15 +1014,30 @@ uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t e
         return 0;
     }
 
+    return 1;
+}
+
+uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, flash_algo_return_t return_type)
+{
+    uint32_t result;
+
+    if (!swd_flash_syscall_start(sysCallParam, entry, arg1, arg2, arg3, arg4)) {
+        return 0;
+    }
+
+    if (!swd_flash_syscall_wait(&result)) {
+        return 0;
+    }
+
     if ( return_type == FLASHALGO_RETURN_POINTER ) {
         // Flash verify functions return pointer to byte following the buffer if successful.
-        if (state.r[0] != (arg1 + arg2)) {
+        if (result != (arg1 + arg2)) {
             return 0;
         }
     }
     else {
         // Flash functions return 0 if successful.
-        if (state.r[0] != 0) {
+        if (result != 0) {
             return 0;
         }
     }
@@ -780,6 +1090,9 @@ uint8_t JTAG2SWD()
 {
     uint32_t tmp = 0;
 
+    // A line reset puts the DP back in its reset state
+    swd_invalidate_state();
+
     if (!swd_reset()) {
         return 0;
     }
@@ -805,8 +1118,7 @@ uint8_t swd_init_debug(void)
     int i = 0;
     int timeout = 100;
     // init dap state with fake values
-    dap_state.select = 0xffffffff;
-    dap_state.csw = 0xffffffff;
+    swd_invalidate_state();
 
     int8_t retries = 4;
     int8_t do_abort = 0;
@@ -894,6 +1206,8 @@ uint8_t swd_set_target_state_hw(target_state_t state)
 {
     uint32_t val;
     int8_t ap_retries = 2;
+    // The target or another debugger may have changed the DAP since last use
+    swd_invalidate_state();
     /* Calling swd_init prior to entering RUN state causes operations to fail. */
     if (state != RUN) {
         swd_init();
@@ -1035,6 +1349,8 @@ uint8_t swd_set_target_state_sw(target_state_t state)
 {
     uint32_t val;
     int8_t ap_retries = 2;
+    // The target or another debugger may have changed the DAP since last use
+    swd_invalidate_state();
     /* Calling swd_init prior to enterring RUN state causes operations to fail. */
     if (state != RUN) {
         swd_init();
@@ -54,6 +54,18 @@ uint8_t swd_read_dp(uint8_t adr, uint32_t *val);
 uint8_t swd_write_dp(uint8_t adr, uint32_t val);
 uint8_t swd_read_ap(uint32_t adr, uint32_t *val);
 uint8_t swd_write_ap(uint32_t adr, uint32_t val);
+#ifndef TARGET_MCU_CORTEX_A
+// Queued transfers are sent as one posted stream by swd_queue_execute().
+// Read results are only valid once it returns 1.
+void swd_queue_start(void);
+uint8_t swd_queue_execute(void);
+void swd_queue_write_dp(uint8_t adr, uint32_t val);
+void swd_queue_read_dp(uint8_t adr, uint32_t *val);
+void swd_queue_write_ap(uint32_t adr, uint32_t val);
+void swd_queue_read_ap(uint32_t adr, uint32_t *val);
+void swd_queue_write_word(uint32_t addr, uint32_t val);
+void swd_queue_read_word(uint32_t addr, uint32_t *val);
+#endif
 uint8_t swd_read_word(uint32_t addr, uint32_t *val);
 uint8_t swd_write_word(uint32_t addr, uint32_t val);
 uint8_t swd_read_byte(uint32_t addr, uint8_t *val);
@@ -62,6 +74,8 @@ uint8_t swd_read_memory(uint32_t address, uint8_t *data, uint32_t size);
 uint8_t swd_write_memory(uint32_t address, uint8_t *data, uint32_t size);
 uint8_t swd_read_core_register(uint32_t n, uint32_t *val);
 uint8_t swd_write_core_register(uint32_t n, uint32_t val);
+uint8_t swd_flash_syscall_start(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
+uint8_t swd_flash_syscall_wait(uint32_t *result);
 uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, flash_algo_return_t return_type);
 uint8_t swd_set_target_state_hw(target_state_t state);
 uint8_t swd_set_target_state_sw(target_state_t state);
@@ -620,10 +620,10 @@ static uint8_t swd_wait_until_halted(void)
     return 0;
 }
 
-uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, flash_algo_return_t return_type)
+uint8_t swd_flash_syscall_start(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
 {
     DEBUG_STATE state = {{0}, 0};
-    // Call flash algorithm function on target and wait for result.
+    // Call flash algorithm function on target without waiting for the result.
     state.r[0]     = arg1;                   // R0: Argument 1
     state.r[1]     = arg2;                   // R1: Argument 2
     state.r[2]     = arg3;                   // R2: Argument 3
@@ -638,6 +638,11 @@ uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t e
         return 0;
     }
 
+    return 1;
+}
+
+uint8_t swd_flash_syscall_wait(uint32_t *result)
+{
     if (!swd_wait_until_halted()) {
         return 0;
     }
@@ -646,19 +651,34 @@ uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t e
         return 0;
     }
 
-    if (!swd_read_core_register(0, &state.r[0])) {
+    if (!swd_read_core_register(0, result)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, flash_algo_return_t return_type)
+{
+    uint32_t result;
+
+    if (!swd_flash_syscall_start(sysCallParam, entry, arg1, arg2, arg3, arg4)) {
+        return 0;
+    }
+
+    if (!swd_flash_syscall_wait(&result)) {
         return 0;
     }
 
     if ( return_type == FLASHALGO_RETURN_POINTER ) {
         // Flash verify functions return pointer to byte following the buffer if successful.
-        if (state.r[0] != (arg1 + arg2)) {
+        if (result != (arg1 + arg2)) {
             return 0;
         }
     }
     else {
         // Flash functions return 0 if successful.
-        if (state.r[0] != 0) {
+        if (result != 0) {
             return 0;
         }
     }
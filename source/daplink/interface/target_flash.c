@@ -30,9 +30,11 @@
 #include "swd_host.h"
 #include "flash_intf.h"
 #include "util.h"
+#include "crc.h"
 #include "settings.h"
 #include "target_family.h"
 #include "target_board.h"
+#include "main_interface.h"
 
 #define DEFAULT_PROGRAM_PAGE_MIN_SIZE   (256u)
 
@@ -51,6 +53,11 @@ static uint32_t target_flash_program_page_min_size(uint32_t addr);
 static uint32_t target_flash_erase_sector_size(uint32_t addr);
 static uint8_t target_flash_busy(void);
 static error_t target_flash_set(uint32_t addr);
+static error_t target_flash_compare(uint32_t addr, const uint8_t *buf, uint32_t size, bool *match);
+static error_t target_flash_erase_sector_start(uint32_t addr, bool *started);
+static bool target_flash_algo_loaded(uint32_t addr);
+static uint8_t target_flash_crc(program_target_t * flash, uint32_t buffer, uint32_t addr, uint32_t size, uint32_t *crc);
+static error_t target_flash_verify(uint32_t addr, uint32_t size, uint32_t buffer, uint32_t crc);
 
 static const flash_intf_t flash_intf = {
     target_flash_init,
@@ -62,6 +69,9 @@ static const flash_intf_t flash_intf = {
     target_flash_erase_sector_size,
     target_flash_busy,
     target_flash_set,
+    target_flash_compare,
+    target_flash_erase_sector_start,
+    target_flash_algo_loaded,
 };
 
 static state_t state = STATE_CLOSED;
@@ -73,34 +83,141 @@ static flash_func_t last_flash_func = FLASH_FUNC_NOP;
 //saved flash algo
 static program_target_t * current_flash_algo = NULL;
 
+//flash algo last downloaded to the target, kept across sessions
+static program_target_t * resident_flash_algo = NULL;
+
+//set once the resident algo is known to be intact this session
+static bool resident_flash_algo_checked = false;
+
 //saved default region for default flash algo
 static region_info_t * default_region = NULL;
 
 //saved flash start from flash algo
 static uint32_t flash_start = 0;
 
-static program_target_t * get_flash_algo(uint32_t addr)
+//flash regions, by bit, whose chip erase waits for their algo to be loaded
+static uint32_t chip_erase_pending = 0;
+
+//flash algo call still running on the target and the error to report if it fails
+static bool syscall_pending = false;
+static error_t syscall_pending_error = ERROR_SUCCESS;
+
+//program buffer to load next when pipelining
+static uint8_t program_buffer_index = 0;
+
+//page programmed by the pending call, checked once it has finished
+static bool verify_pending = false;
+static uint32_t verify_addr;
+static uint32_t verify_size;
+static uint32_t verify_buffer;
+static uint32_t verify_crc;
+
+//set when the target side CRC routine could not be run
+static bool crc_verify_failed = false;
+
+//target held against DAP commands for the whole programming session
+static bool target_locked = false;
+
+#ifndef TARGET_MCU_CORTEX_A
+// Thumb code computing the same CRC-32 as crc32() over R1 bytes at R0.
+// The result is returned in R0 and LR leads back to the algo breakpoint.
+//
+//      push    {r4, r5}
+//      movs    r2, #0
+//      mvns    r2, r2
+//      ldr     r3, poly
+//  byte_loop:
+//      cmp     r1, #0
+//      beq     done
+//      ldrb    r4, [r0]
+//      adds    r0, #1
+//      subs    r1, #1
+//      eors    r2, r4
+//      movs    r5, #8
+//  bit_loop:
+//      lsrs    r2, r2, #1
+//      bcc     skip
+//      eors    r2, r3
+//  skip:
+//      subs    r5, #1
+//      bne     bit_loop
+//      b       byte_loop
+//  done:
+//      mvns    r0, r2
+//      pop     {r4, r5}
+//      bx      lr
+//  poly:
+//      .word   0xEDB88320
+static const uint32_t crc32_routine[] = {
+    0x2200b430, 0x4b0843d2, 0xd00a2900, 0x30017804,
+    0x40623901, 0x08522508, 0x405ad300, 0xd1fa3d01,
+    0x43d0e7f2, 0x4770bc30, 0xedb88320,
+};
+#endif
+
+static region_info_t * get_flash_region(uint32_t addr)
 {
     region_info_t * flash_region = g_board_info.target_cfg->flash_regions;
 
     for (; flash_region->start != 0 || flash_region->end != 0; ++flash_region) {
         if (addr >= flash_region->start && addr <= flash_region->end) {
-            flash_start = flash_region->start; //save the flash start
-            if (flash_region->flash_algo) {
-                return flash_region->flash_algo;
-            }else{
-                return NULL;
-            }
+            return flash_region;
         }
     }
 
     //could not find a flash algo for the region; use default
-    if (default_region) {
-        flash_start = default_region->start;
-        return default_region->flash_algo;
-    } else {
+    return default_region;
+}
+
+static program_target_t * get_flash_algo(uint32_t addr)
+{
+    region_info_t * flash_region = get_flash_region(addr);
+
+    if (!flash_region) {
         return NULL;
     }
+
+    flash_start = flash_region->start; //save the flash start
+    return flash_region->flash_algo;
+}
+
+// Check if addr is handled by the loaded algo with the same init
+// parameters, without switching to it
+static bool target_flash_algo_loaded(uint32_t addr)
+{
+    uint32_t saved_flash_start = flash_start;
+    bool loaded;
+
+    if (!current_flash_algo) {
+        return false;
+    }
+
+    loaded = (get_flash_algo(addr) == current_flash_algo) && (flash_start == saved_flash_start);
+    flash_start = saved_flash_start;
+    return loaded;
+}
+
+static error_t flash_syscall_wait(void)
+{
+    uint32_t result;
+
+    if (!syscall_pending) {
+        return ERROR_SUCCESS;
+    }
+
+    syscall_pending = false;
+
+    if (!swd_flash_syscall_wait(&result) || (result != 0)) {
+        verify_pending = false;
+        return syscall_pending_error;
+    }
+
+    if (verify_pending) {
+        verify_pending = false;
+        return target_flash_verify(verify_addr, verify_size, verify_buffer, verify_crc);
+    }
+
+    return ERROR_SUCCESS;
 }
 
 static error_t flash_func_start(flash_func_t func)
@@ -109,6 +226,17 @@ static error_t flash_func_start(flash_func_t func)
 
     if (last_flash_func != func)
     {
+        // The core must be halted before another function can run.
+        error_t status = flash_syscall_wait();
+        if (status != ERROR_SUCCESS) {
+            return status;
+        }
+
+        // Verifying the pending page may have switched function already
+        if (last_flash_func == func) {
+            return ERROR_SUCCESS;
+        }
+
         // Finish the currently active function.
         if (FLASH_FUNC_NOP != last_flash_func &&
             ((flash->algo_flags & kAlgoSingleInitType) == 0 || FLASH_FUNC_NOP == func ) &&
@@ -129,37 +257,149 @@ static error_t flash_func_start(flash_func_t func)
     return ERROR_SUCCESS;
 }
 
+// Size of the code and read only data at the start of the blob of flash.
+// Running the algo changes the RW data from static_base on, so only this
+// part can be checked. Returns 0 if the blob has no such part.
+static uint32_t flash_algo_ro_size(program_target_t * flash)
+{
+    uint32_t static_base = flash->sys_call_s.static_base;
+
+    if (static_base <= flash->algo_start) {
+        return 0;
+    }
+
+    return MIN(static_base - flash->algo_start, flash->algo_size);
+}
+
+// Check if the blob of flash is still loaded, either from an earlier session
+// or from a region sharing the same algo. The first check each session runs
+// a CRC over the code on the target since the target may have used the RAM
+// since.
+static bool flash_algo_resident(program_target_t * flash)
+{
+    program_target_t * resident = resident_flash_algo;
+    uint32_t header;
+    uint32_t crc;
+    uint32_t ro_size;
+
+    if ((resident == NULL) ||
+        (resident->algo_blob != flash->algo_blob) ||
+        (resident->algo_start != flash->algo_start) ||
+        (resident->algo_size != flash->algo_size)) {
+        return false;
+    }
+
+    ro_size = flash_algo_ro_size(flash);
+    if (ro_size == 0) {
+        return false;
+    }
+
+    if (!resident_flash_algo_checked) {
+        // The CRC routine returns to the breakpoint in the blob header
+        if (!swd_read_word(flash->algo_start, &header) || (header != flash->algo_blob[0])) {
+            return false;
+        }
+
+        if (!target_flash_crc(flash, flash->program_buffer, flash->algo_start, ro_size, &crc) ||
+            (crc != crc32(flash->algo_blob, ro_size))) {
+            return false;
+        }
+
+        resident_flash_algo_checked = true;
+    }
+
+    // Put back the RW data the previous run may have changed
+    if ((ro_size < flash->algo_size) &&
+        !swd_write_memory(flash->algo_start + ro_size, (uint8_t *)flash->algo_blob + ro_size, flash->algo_size - ro_size)) {
+        return false;
+    }
+
+    return true;
+}
+
+// Run the chip erase of the loaded algo over its region
+static error_t flash_erase_region(void)
+{
+    error_t status = flash_func_start(FLASH_FUNC_ERASE);
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+    status = flash_syscall_wait();
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+    if (0 == swd_flash_syscall_exec(&current_flash_algo->sys_call_s, current_flash_algo->erase_chip, 0, 0, 0, 0, FLASHALGO_RETURN_BOOL)) {
+        return ERROR_ERASE_ALL;
+    }
+    return ERROR_SUCCESS;
+}
+
 static error_t target_flash_set(uint32_t addr)
 {
     program_target_t * new_flash_algo = get_flash_algo(addr);
+    uint32_t region_bit;
+
     if (new_flash_algo == NULL) {
         return ERROR_ALGO_MISSING;
     }
+    region_bit = 1 << (get_flash_region(addr) - g_board_info.target_cfg->flash_regions);
     if(current_flash_algo != new_flash_algo){
         //run uninit to last func
         error_t status = flash_func_start(FLASH_FUNC_NOP);
         if (status != ERROR_SUCCESS) {
             return status;
         }
-        // Download flash programming algorithm to target
-        if (0 == swd_write_memory(new_flash_algo->algo_start, (uint8_t *)new_flash_algo->algo_blob, new_flash_algo->algo_size)) {
-            return ERROR_ALGO_DL;
+        // Download flash programming algorithm to target unless it is already there
+        if (!flash_algo_resident(new_flash_algo)) {
+            resident_flash_algo = NULL;
+            if (0 == swd_write_memory(new_flash_algo->algo_start, (uint8_t *)new_flash_algo->algo_blob, new_flash_algo->algo_size)) {
+                return ERROR_ALGO_DL;
+            }
+            resident_flash_algo = new_flash_algo;
+            resident_flash_algo_checked = true;
         }
 
         current_flash_algo = new_flash_algo;
 
     }
+    // Do the chip erase left for this region before anything is written
+    if (chip_erase_pending & region_bit) {
+        chip_erase_pending &= ~region_bit;
+        return flash_erase_region();
+    }
     return ERROR_SUCCESS;
 }
 
+static void target_flash_lock(bool lock)
+{
+    if (lock && !target_locked) {
+        main_target_lock();
+        target_locked = true;
+    } else if (!lock && target_locked) {
+        target_locked = false;
+        main_target_unlock();
+    }
+}
+
 static error_t target_flash_init()
 {
     if (g_board_info.target_cfg) {
+        target_flash_lock(true);
+
         last_flash_func = FLASH_FUNC_NOP;
 
         current_flash_algo = NULL;
+        resident_flash_algo_checked = false;
+        chip_erase_pending = 0;
+
+        syscall_pending = false;
+        program_buffer_index = 0;
+        verify_pending = false;
+
+        crc_verify_failed = false;
 
         if (0 == target_set_state(RESET_PROGRAM)) {
+            target_flash_lock(false);
             return ERROR_RESET;
         }
 
@@ -183,8 +423,21 @@ static error_t target_flash_init()
 static error_t target_flash_uninit(void)
 {
     if (g_board_info.target_cfg) {
-        error_t status = flash_func_start(FLASH_FUNC_NOP);
+        error_t status = ERROR_SUCCESS;
+        region_info_t * flash_region = g_board_info.target_cfg->flash_regions;
+
+        // Finish a chip erase over the regions nothing was written to
+        for (; (status == ERROR_SUCCESS) && (flash_region->start != 0 || flash_region->end != 0); ++flash_region) {
+            if (chip_erase_pending & (1 << (flash_region - g_board_info.target_cfg->flash_regions))) {
+                status = target_flash_set(flash_region->start);
+            }
+        }
+
+        if (status == ERROR_SUCCESS) {
+            status = flash_func_start(FLASH_FUNC_NOP);
+        }
         if (status != ERROR_SUCCESS) {
+            target_flash_lock(false);
             return status;
         }
         if (config_get_auto_rst()) {
@@ -200,12 +453,89 @@ static error_t target_flash_uninit(void)
 
         state = STATE_CLOSED;
         swd_off();
+        target_flash_lock(false);
         return ERROR_SUCCESS;
     } else {
         return ERROR_FAILURE;
     }
 }
 
+// Compute the CRC of target memory on the target, running from the program
+// buffer of flash at buffer. Returns 0 if the routine could not be run, in
+// which case the data must be read back.
+static uint8_t target_flash_crc(program_target_t * flash, uint32_t buffer, uint32_t addr, uint32_t size, uint32_t *crc)
+{
+#ifndef TARGET_MCU_CORTEX_A
+    if (crc_verify_failed || (flash->program_buffer_size < sizeof(crc32_routine))) {
+        return 0;
+    }
+
+    // The program buffer is free again once program_page has returned
+    if (swd_write_memory(buffer, (uint8_t *)crc32_routine, sizeof(crc32_routine)) &&
+        swd_flash_syscall_start(&flash->sys_call_s, buffer + 1, addr, size, 0, 0) &&
+        swd_flash_syscall_wait(crc)) {
+        return 1;
+    }
+
+    // Don't try again this session and leave the core halted for the algo
+    crc_verify_failed = true;
+    target_set_state(HALT);
+#endif
+    return 0;
+}
+
+// Check a programmed page against the copy still held in the program buffer
+// at buffer. crc is the CRC of the data as it was sent. The core must be
+// halted.
+static error_t target_flash_verify(uint32_t addr, uint32_t size, uint32_t buffer, uint32_t crc)
+{
+    program_target_t * flash = current_flash_algo;
+    uint32_t target_crc;
+
+    if (flash->verify != 0) {
+        flash_algo_return_t return_type;
+        error_t status = flash_func_start(FLASH_FUNC_VERIFY);
+        if (status != ERROR_SUCCESS) {
+            return status;
+        }
+        if ((flash->algo_flags & kAlgoVerifyReturnsAddress) != 0) {
+            return_type = FLASHALGO_RETURN_POINTER;
+        } else {
+            return_type = FLASHALGO_RETURN_BOOL;
+        }
+        if (!swd_flash_syscall_exec(&flash->sys_call_s,
+                                    flash->verify,
+                                    addr,
+                                    size,
+                                    buffer,
+                                    0,
+                                    return_type)) {
+            return ERROR_WRITE_VERIFY;
+        }
+        return ERROR_SUCCESS;
+    }
+
+    if (!target_flash_crc(flash, buffer, addr, size, &target_crc)) {
+        target_crc = 0;
+        while (size > 0) {
+            uint8_t rb_buf[16];
+            uint32_t read_size = MIN(size, sizeof(rb_buf));
+            if (!swd_read_memory(addr, rb_buf, read_size)) {
+                return ERROR_ALGO_DATA_SEQ;
+            }
+            target_crc = crc32_continue(target_crc, rb_buf, read_size);
+            addr += read_size;
+            size -= read_size;
+        }
+    }
+
+    if (target_crc != crc) {
+        return ERROR_WRITE_VERIFY;
+    }
+
+    return ERROR_SUCCESS;
+}
+
 static error_t target_flash_program_page(uint32_t addr, const uint8_t *buf, uint32_t size)
 {
     if (g_board_info.target_cfg) {
@@ -223,75 +553,63 @@ static error_t target_flash_program_page(uint32_t addr, const uint8_t *buf, uint
             }
         }
 
-        status = flash_func_start(FLASH_FUNC_PROGRAM);
-
-        if (status != ERROR_SUCCESS) {
-            return status;
-        }
-
         while (size > 0) {
             uint32_t write_size = MIN(size, flash->program_buffer_size);
+            uint32_t program_buffer = program_buffer_index ? flash->program_buffer_alt : flash->program_buffer;
 
-            // Write page to buffer
-            if (!swd_write_memory(flash->program_buffer, (uint8_t *)buf, write_size)) {
+            // Write page to the buffer not in use by a pending call. This
+            // may be a sector erase started ahead, which uses neither.
+            if (!swd_write_memory(program_buffer, (uint8_t *)buf, write_size)) {
                 return ERROR_ALGO_DATA_SEQ;
             }
 
-            // Run flash programming
-            if (!swd_flash_syscall_exec(&flash->sys_call_s,
-                                        flash->program_page,
-                                        addr,
-                                        write_size,
-                                        flash->program_buffer,
-                                        0,
-                                        FLASHALGO_RETURN_BOOL)) {
+            // Collect and verify the previous page
+            status = flash_syscall_wait();
+            if (status != ERROR_SUCCESS) {
+                return status;
+            }
+
+            // Verifying may have switched to another function
+            status = flash_func_start(FLASH_FUNC_PROGRAM);
+            if (status != ERROR_SUCCESS) {
+                return status;
+            }
+
+            // Start flash programming
+            if (!swd_flash_syscall_start(&flash->sys_call_s,
+                                         flash->program_page,
+                                         addr,
+                                         write_size,
+                                         program_buffer,
+                                         0)) {
                 return ERROR_WRITE;
             }
 
+            syscall_pending = true;
+            syscall_pending_error = ERROR_WRITE;
+
             if (config_get_automation_allowed()) {
                 // Verify data flashed if in automation mode
-                if (flash->verify != 0) {
-                    status = flash_func_start(FLASH_FUNC_VERIFY);
-                    if (status != ERROR_SUCCESS) {
-                        return status;
-                    }
-                    flash_algo_return_t return_type;
-                    if ((flash->algo_flags & kAlgoVerifyReturnsAddress) != 0) {
-                        return_type = FLASHALGO_RETURN_POINTER;
-                    } else {
-                        return_type = FLASHALGO_RETURN_BOOL;
-                    }
-                    if (!swd_flash_syscall_exec(&flash->sys_call_s,
-                                        flash->verify,
-                                        addr,
-                                        write_size,
-                                        flash->program_buffer,
-                                        0,
-                                        return_type)) {
-                        return ERROR_WRITE_VERIFY;
-                    }
-                } else {
-                    while (write_size > 0) {
-                        uint8_t rb_buf[16];
-                        uint32_t verify_size = MIN(write_size, sizeof(rb_buf));
-                        if (!swd_read_memory(addr, rb_buf, verify_size)) {
-                            return ERROR_ALGO_DATA_SEQ;
-                        }
-                        if (memcmp(buf, rb_buf, verify_size) != 0) {
-                            return ERROR_WRITE_VERIFY;
-                        }
-                        addr += verify_size;
-                        buf += verify_size;
-                        size -= verify_size;
-                        write_size -= verify_size;
-                    }
-                    continue;
+                verify_pending = true;
+                verify_addr = addr;
+                verify_size = write_size;
+                verify_buffer = program_buffer;
+                verify_crc = crc32(buf, write_size);
+            }
+
+            if (flash->program_buffer_alt != 0) {
+                // Leave the call running while the next page is loaded
+                program_buffer_index ^= 1;
+            } else {
+                status = flash_syscall_wait();
+                if (status != ERROR_SUCCESS) {
+                    return status;
                 }
             }
+
             addr += write_size;
             buf += write_size;
             size -= write_size;
-
         }
 
         return ERROR_SUCCESS;
@@ -322,6 +640,12 @@ static error_t target_flash_erase_sector(uint32_t addr)
             return status;
         }
 
+        status = flash_syscall_wait();
+
+        if (status != ERROR_SUCCESS) {
+            return status;
+        }
+
         if (0 == swd_flash_syscall_exec(&flash->sys_call_s, flash->erase_sector, addr, 0, 0, 0, FLASHALGO_RETURN_BOOL)) {
             return ERROR_ERASE_SECTOR;
         }
@@ -332,6 +656,9 @@ static error_t target_flash_erase_sector(uint32_t addr)
     }
 }
 
+// Erase every flash region. Unless the target must be reset afterwards, a
+// region is only erased once its algo is loaded to program it, or at
+// uninit, so each algo is downloaded once for the whole image.
 static error_t target_flash_erase_chip(void)
 {
     if (g_board_info.target_cfg){
@@ -344,16 +671,12 @@ static error_t target_flash_erase_chip(void)
                 // skip flash region
                 continue;
             }
-            status = target_flash_set(flash_region->start);
-            if (status != ERROR_SUCCESS) {
-                return status;
-            }
-            status = flash_func_start(FLASH_FUNC_ERASE);
-            if (status != ERROR_SUCCESS) {
-                return status;
-            }
-            if (0 == swd_flash_syscall_exec(&current_flash_algo->sys_call_s, current_flash_algo->erase_chip, 0, 0, 0, 0, FLASHALGO_RETURN_BOOL)) {
-                return ERROR_ERASE_ALL;
+            chip_erase_pending |= 1 << (flash_region - g_board_info.target_cfg->flash_regions);
+            if (g_board_info.target_cfg->erase_reset) {
+                status = target_flash_set(flash_region->start);
+                if (status != ERROR_SUCCESS) {
+                    return status;
+                }
             }
         }
 
@@ -368,6 +691,49 @@ static error_t target_flash_erase_chip(void)
     }
 }
 
+// Start a sector erase and leave it running on the target. It is only
+// started if the sector uses the flash algo that is already loaded.
+static error_t target_flash_erase_sector_start(uint32_t addr, bool *started)
+{
+    *started = false;
+
+    if (g_board_info.target_cfg) {
+        error_t status = ERROR_SUCCESS;
+        program_target_t * flash = current_flash_algo;
+
+        if (!flash) {
+            return ERROR_INTERNAL;
+        }
+
+        if (!target_flash_algo_loaded(addr) || ((addr % target_flash_erase_sector_size(addr)) != 0)) {
+            return ERROR_SUCCESS;
+        }
+
+        status = flash_func_start(FLASH_FUNC_ERASE);
+
+        if (status != ERROR_SUCCESS) {
+            return status;
+        }
+
+        status = flash_syscall_wait();
+
+        if (status != ERROR_SUCCESS) {
+            return status;
+        }
+
+        if (!swd_flash_syscall_start(&flash->sys_call_s, flash->erase_sector, addr, 0, 0, 0)) {
+            return ERROR_ERASE_SECTOR;
+        }
+
+        syscall_pending = true;
+        syscall_pending_error = ERROR_ERASE_SECTOR;
+        *started = true;
+        return ERROR_SUCCESS;
+    } else {
+        return ERROR_FAILURE;
+    }
+}
+
 static uint32_t target_flash_program_page_min_size(uint32_t addr)
 {
     if (g_board_info.target_cfg){
@@ -403,4 +769,47 @@ static uint32_t target_flash_erase_sector_size(uint32_t addr)
 static uint8_t target_flash_busy(void){
     return (state == STATE_OPEN);
 }
+static error_t target_flash_compare(uint32_t addr, const uint8_t *buf, uint32_t size, bool *match)
+{
+    uint32_t crc;
+
+    if (g_board_info.target_cfg) {
+        error_t status;
+
+        if (!current_flash_algo) {
+            return ERROR_INTERNAL;
+        }
+
+        // The core and program buffers must be free
+        status = flash_syscall_wait();
+        if (status != ERROR_SUCCESS) {
+            return status;
+        }
+
+        if (target_flash_crc(current_flash_algo, current_flash_algo->program_buffer, addr, size, &crc)) {
+            *match = (crc == crc32(buf, size));
+            return ERROR_SUCCESS;
+        }
+
+        *match = true;
+        while (size > 0) {
+            uint8_t rb_buf[16];
+            uint32_t verify_size = MIN(size, sizeof(rb_buf));
+            if (!swd_read_memory(addr, rb_buf, verify_size)) {
+                return ERROR_ALGO_DATA_SEQ;
+            }
+            if (memcmp(buf, rb_buf, verify_size) != 0) {
+                *match = false;
+                break;
+            }
+            addr += verify_size;
+            buf += verify_size;
+            size -= verify_size;
+        }
+
+        return ERROR_SUCCESS;
+    } else {
+        return ERROR_FAILURE;
+    }
+}
 #endif
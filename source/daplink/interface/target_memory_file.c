@@ -0,0 +1,269 @@
+/**
+ * @file    target_memory_file.c
+ * @brief   Implementation of target_memory_file.h
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2021, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef TARGET_MEMORY_FILES
+
+#include <string.h>
+#include "target_memory_file.h"
+#include "virtual_fs.h"
+#include "target_config.h"
+#include "target_family.h"
+#include "target_board.h"
+#include "swd_host.h"
+#include "main_interface.h"
+#include "vfs_manager.h"
+#include "flash_intf.h"
+#include "DAP.h"
+#include "util.h"
+
+// Largest read-ahead. Hosts read files front to back in runs of sectors, so
+// the window doubles on every sequential read until it reaches this size.
+#ifndef TARGET_MEMORY_CACHE_SIZE
+#define TARGET_MEMORY_CACHE_SIZE    TARGET_AUTO_INCREMENT_PAGE_SIZE
+#endif
+
+COMPILER_ASSERT((TARGET_MEMORY_CACHE_SIZE % VFS_SECTOR_SIZE) == 0);
+
+// How long the debug port stays attached after the last read
+#ifndef TARGET_MEMORY_IDLE_MS
+#define TARGET_MEMORY_IDLE_MS       500
+#endif
+
+typedef enum {
+    TARGET_MEMORY_FLASH = 0,
+    TARGET_MEMORY_RAM,
+
+    TARGET_MEMORY_COUNT
+} target_memory_id_t;
+
+typedef struct {
+    uint32_t start;
+    uint32_t size;
+} target_memory_t;
+
+typedef struct {
+    uint32_t data[TARGET_MEMORY_CACHE_SIZE / sizeof(uint32_t)];
+    target_memory_id_t memory;      // Memory the file offsets below refer to
+    uint32_t offset;                // File offset of data
+    uint32_t size;                  // Bytes valid in data, 0 when empty
+    uint32_t next;                  // File offset a sequential read continues at
+    uint32_t window;                // Bytes to fetch on the next miss
+} target_memory_cache_t;
+
+static target_memory_t memories[TARGET_MEMORY_COUNT];
+static target_memory_cache_t cache;
+// Whether the debug port was left attached by the last read, and how long ago
+// that was. Both are only touched with the target lock held.
+static bool attached;
+static uint32_t idle_ms;
+
+static uint32_t read_file_flash_bin(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
+static uint32_t read_file_ram_bin(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
+static void target_memory_release(void);
+
+static void memory_from_region(target_memory_id_t id, const region_info_t *region)
+{
+    memories[id].start = region->start;
+    memories[id].size = (region->end > region->start) ? region->end - region->start : 0;
+}
+
+void target_memory_file_create(void)
+{
+    const target_cfg_t *cfg = g_board_info.target_cfg;
+    const region_info_t *flash_region;
+    uint32_t i;
+
+    // Target memory may have changed since the last mount
+    target_memory_release();
+    memset(&cache, 0, sizeof(cache));
+    cache.memory = TARGET_MEMORY_COUNT;
+    memset(memories, 0, sizeof(memories));
+
+    if (!cfg) {
+        return;
+    }
+
+    flash_region = &cfg->flash_regions[0];
+    for (i = 0; i < MAX_REGIONS; i++) {
+        if ((cfg->flash_regions[i].start == 0) && (cfg->flash_regions[i].end == 0)) {
+            break;
+        }
+        if (cfg->flash_regions[i].flags & kRegionIsDefault) {
+            flash_region = &cfg->flash_regions[i];
+            break;
+        }
+    }
+
+    memory_from_region(TARGET_MEMORY_FLASH, flash_region);
+    memory_from_region(TARGET_MEMORY_RAM, &cfg->ram_regions[0]);
+
+    if (memories[TARGET_MEMORY_FLASH].size > 0) {
+        vfs_create_file("FLASH   BIN", read_file_flash_bin, 0, memories[TARGET_MEMORY_FLASH].size);
+    }
+
+    if (memories[TARGET_MEMORY_RAM].size > 0) {
+        vfs_create_file("RAM     BIN", read_file_ram_bin, 0, memories[TARGET_MEMORY_RAM].size);
+    }
+}
+
+// The pins are only ours while the target is neither programmed nor debugged,
+// since attaching would reset the debug port state those rely on
+static bool target_memory_pins_free(void)
+{
+    return !vfs_mngr_transfer_in_progress() && !flash_intf_target->flash_busy() &&
+           (DAP_Data.debug_port == DAP_PORT_DISABLED);
+}
+
+// Turn the pins off if the last read left them on. Whoever has taken them over
+// since keeps them. Call with the target lock held.
+static void target_memory_detach(void)
+{
+    if (attached && target_memory_pins_free()) {
+        swd_off();
+    }
+    attached = false;
+}
+
+static void target_memory_release(void)
+{
+    main_target_lock();
+    target_memory_detach();
+    main_target_unlock();
+}
+
+// Read from the running target. Only the debug port and the memory access
+// port are used, so the core is neither halted nor resumed and keeps the run
+// state it had. The debug port stays attached for the next read, and if
+// someone else used the pins in between, the read fails and is tried once
+// more on a fresh attach.
+static bool target_memory_read(uint32_t addr, uint8_t *data, uint32_t size)
+{
+    bool status = false;
+
+    main_target_lock();
+
+    if (target_memory_pins_free()) {
+        status = attached && swd_read_memory(addr, data, size);
+        if (!status) {
+            attached = true;
+            status = swd_init_debug() && swd_read_memory(addr, data, size);
+        }
+        if (!status) {
+            target_memory_detach();
+        }
+        idle_ms = 0;
+    } else {
+        attached = false;
+    }
+
+    main_target_unlock();
+    return status;
+}
+
+void target_memory_file_periodic(uint32_t elapsed_ms)
+{
+    main_target_lock();
+
+    if (attached) {
+        idle_ms += elapsed_ms;
+        if (idle_ms >= TARGET_MEMORY_IDLE_MS) {
+            target_memory_detach();
+        }
+    }
+
+    main_target_unlock();
+}
+
+static uint32_t read_memory(target_memory_id_t id, uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
+{
+    const target_memory_t *memory = &memories[id];
+    uint32_t offset = sector_offset * VFS_SECTOR_SIZE;
+    uint32_t end;
+    uint32_t pos;
+    uint32_t page;
+    uint32_t n;
+
+    if (offset >= memory->size) {
+        return 0;
+    }
+
+    end = offset + MIN(num_sectors * VFS_SECTOR_SIZE, memory->size - offset);
+
+    if ((id == cache.memory) && (offset == cache.next)) {
+        // Sequential read, look further ahead
+        cache.window = MIN(cache.window * 2, TARGET_MEMORY_CACHE_SIZE);
+    } else {
+        // Start over so a later read of the same file sees fresh data, and
+        // let go of the target until it is needed
+        target_memory_release();
+        cache.memory = id;
+        cache.size = 0;
+        cache.window = VFS_SECTOR_SIZE;
+    }
+
+    cache.next = end;
+
+    for (pos = offset; pos < end; pos += n) {
+        if ((pos >= cache.offset) && (pos < cache.offset + cache.size)) {
+            n = MIN(cache.offset + cache.size, end) - pos;
+            memcpy(data + (pos - offset), (uint8_t *)cache.data + (pos - cache.offset), n);
+        } else if (end - pos >= TARGET_MEMORY_CACHE_SIZE) {
+            // Large requests go straight into the caller's buffer
+            n = end - pos;
+            if (!target_memory_read(memory->start + pos, data + (pos - offset), n)) {
+                break;
+            }
+        } else {
+            // Read ahead by the window, but stop at an auto-increment page
+            // boundary past the request so the next miss starts on one
+            n = MIN(MAX(cache.window, end - pos), memory->size - pos);
+            page = (memory->start + pos + n) & (TARGET_AUTO_INCREMENT_PAGE_SIZE - 1);
+            if ((page < n) && (pos + n - page >= end)) {
+                n -= page;
+            }
+            cache.size = 0;
+            if (!target_memory_read(memory->start + pos, (uint8_t *)cache.data, n)) {
+                break;
+            }
+            cache.offset = pos;
+            cache.size = n;
+            // Copy out of the cache on the next pass
+            n = 0;
+        }
+    }
+
+    // Anything that could not be read stays zero
+    return end - offset;
+}
+
+// File callback to be used with vfs_add_file to return file contents
+static uint32_t read_file_flash_bin(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
+{
+    return read_memory(TARGET_MEMORY_FLASH, sector_offset, data, num_sectors);
+}
+
+// File callback to be used with vfs_add_file to return file contents
+static uint32_t read_file_ram_bin(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
+{
+    return read_memory(TARGET_MEMORY_RAM, sector_offset, data, num_sectors);
+}
+
+#endif
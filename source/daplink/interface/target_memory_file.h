@@ -0,0 +1,55 @@
+/**
+ * @file    target_memory_file.h
+ * @brief   Target flash and RAM contents as files on the MSC drive
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2021, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TARGET_MEMORY_FILE_H
+#define TARGET_MEMORY_FILE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The files are only added when TARGET_MEMORY_FILES is defined for the
+// project. Every read of them goes out over SWD, so file indexers on the
+// host will touch the target as well.
+
+//! @brief Add read only FLASH.BIN and RAM.BIN files to the virtual filesystem.
+//!
+//! FLASH.BIN covers the default flash region of the target and RAM.BIN its
+//! first RAM region. Reads are fetched from the running target without
+//! halting it, through a read-ahead cache that only serves sequential reads.
+//! Any other read starts over with fresh data. While the target is being
+//! programmed or a debugger is connected, the unreadable parts read as zero.
+void target_memory_file_create(void);
+
+//! @brief Let go of the target once the files have not been read for a while.
+//!
+//! Sequential reads keep the debug port attached. It is released on a read
+//! elsewhere, on a remount, or by this after TARGET_MEMORY_IDLE_MS without reads.
+//! Call every elapsed_ms from the main task.
+void target_memory_file_periodic(uint32_t elapsed_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
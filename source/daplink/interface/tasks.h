@@ -30,4 +30,18 @@
 #endif
 #define MAIN_TASK_PRIORITY  (osPriorityNormal)
 
+// DAP commands run below the USB handling in the main task so that the next
+// request can be received while the current one is on the wire
+#ifndef DAP_TASK_STACK
+#define DAP_TASK_STACK      (MAIN_TASK_STACK)
+#endif
+#define DAP_TASK_PRIORITY   (osPriorityBelowNormal)
+
+// SWO streaming only queues USB transfers. At the main task priority it never
+// preempts USB handling but is not held up by long DAP commands
+#ifndef SWO_TASK_STACK
+#define SWO_TASK_STACK      (256)
+#endif
+#define SWO_TASK_PRIORITY   (osPriorityNormal)
+
 #endif
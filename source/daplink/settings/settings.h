@@ -43,10 +43,20 @@ void config_set_auto_rst(bool on);
 void config_set_automation_allowed(bool on);
 void config_set_overflow_detect(bool on);
 void config_set_detect_incompatible_target(bool on);
+void config_set_adaptive_swd_clock(bool on);
+void config_set_swd_clock(uint32_t idcode, uint32_t clock);
+void config_set_crc_bootloader(uint32_t key, uint32_t crc);
+void config_set_crc_interface(uint32_t key, uint32_t crc);
 bool config_get_auto_rst(void);
 bool config_get_automation_allowed(void);
 bool config_get_overflow_detect(void);
 bool config_get_detect_incompatible_target(void);
+bool config_get_adaptive_swd_clock(void);
+// Stored SWD clock for the target with this DPIDR, 0 if none
+uint32_t config_get_swd_clock(uint32_t idcode);
+// Cached CRC of the image with this fingerprint, 0 if none
+uint32_t config_get_crc_bootloader(uint32_t key);
+uint32_t config_get_crc_interface(uint32_t key);
 
 // Get/set settings residing in shared ram
 void config_ram_set_hold_in_bl(bool hold);
@@ -61,6 +71,8 @@ void config_ram_set_disable_msd(bool disable_msd);
 uint8_t config_ram_get_disable_msd(void);
 void config_ram_set_page_erase(bool page_erase_enable);
 bool config_ram_get_page_erase(void);
+void config_ram_set_incremental(bool incremental_enable);
+bool config_ram_get_incremental(void);
 
 // Private - should only be called from settings.c
 void config_rom_init(void);
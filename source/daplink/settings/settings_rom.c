@@ -29,7 +29,7 @@
 
 // 'kvld' in hex - key valid
 #define CFG_KEY             0x6b766c64
-#define SECTOR_BUFFER_SIZE  16
+#define SECTOR_BUFFER_SIZE  64
 
 // WARNING - THIS STRUCTURE RESIDES IN NON-VOLATILE STORAGE!
 // Be careful with changes:
@@ -45,13 +45,20 @@ typedef struct __attribute__((__packed__)) cfg_setting {
     uint8_t automation_allowed;
     uint8_t overflow_detect;
     uint8_t detect_incompatible_target;
+    uint8_t adaptive_swd_clock;
+    uint32_t swd_clock_idcode;  // DPIDR of the target swd_clock belongs to
+    uint32_t swd_clock;         // Fastest stable SWD clock, 0 if not known
+    uint32_t crc_bootloader_key;    // Fingerprint of the bootloader crc_bootloader belongs to
+    uint32_t crc_bootloader;        // Cached CRC of the bootloader, 0 if not known
+    uint32_t crc_interface_key;     // Fingerprint of the interface crc_interface belongs to
+    uint32_t crc_interface;         // Cached CRC of the interface, 0 if not known
 
     // Add new members here
 
 } cfg_setting_t;
 
 // Make sure FORMAT in generate_config.py is updated if size changes
-COMPILER_ASSERT(sizeof(cfg_setting_t) == 10);
+COMPILER_ASSERT(sizeof(cfg_setting_t) == 35);
 
 // Sector buffer must be as big or bigger than settings
 COMPILER_ASSERT(sizeof(cfg_setting_t) < SECTOR_BUFFER_SIZE);
@@ -75,7 +82,14 @@ static const cfg_setting_t config_default = {
     .auto_rst = 1,
     .automation_allowed = 1,
     .overflow_detect = 1,
-    .detect_incompatible_target = 0
+    .detect_incompatible_target = 0,
+    .adaptive_swd_clock = 0,
+    .swd_clock_idcode = 0,
+    .swd_clock = 0,
+    .crc_bootloader_key = 0,
+    .crc_bootloader = 0,
+    .crc_interface_key = 0,
+    .crc_interface = 0
 };
 
 // Check if the configuration in flash needs to be updated
@@ -177,6 +191,41 @@ void config_set_detect_incompatible_target(bool on)
     program_cfg(&config_rom_copy);
 }
 
+void config_set_adaptive_swd_clock(bool on)
+{
+    config_rom_copy.adaptive_swd_clock = on;
+    program_cfg(&config_rom_copy);
+}
+
+void config_set_swd_clock(uint32_t idcode, uint32_t clock)
+{
+    config_rom_copy.swd_clock_idcode = idcode;
+    config_rom_copy.swd_clock = clock;
+    program_cfg(&config_rom_copy);
+}
+
+void config_set_crc_bootloader(uint32_t key, uint32_t crc)
+{
+    // Skip the erase when nothing changed
+    if ((config_rom_copy.crc_bootloader_key == key) && (config_rom_copy.crc_bootloader == crc)) {
+        return;
+    }
+    config_rom_copy.crc_bootloader_key = key;
+    config_rom_copy.crc_bootloader = crc;
+    program_cfg(&config_rom_copy);
+}
+
+void config_set_crc_interface(uint32_t key, uint32_t crc)
+{
+    // Skip the erase when nothing changed
+    if ((config_rom_copy.crc_interface_key == key) && (config_rom_copy.crc_interface == crc)) {
+        return;
+    }
+    config_rom_copy.crc_interface_key = key;
+    config_rom_copy.crc_interface = crc;
+    program_cfg(&config_rom_copy);
+}
+
 bool config_get_auto_rst()
 {
     return config_rom_copy.auto_rst;
@@ -196,3 +245,32 @@ bool config_get_detect_incompatible_target()
 {
     return config_rom_copy.detect_incompatible_target;
 }
+
+bool config_get_adaptive_swd_clock(void)
+{
+    return config_rom_copy.adaptive_swd_clock;
+}
+
+uint32_t config_get_swd_clock(uint32_t idcode)
+{
+    if (config_rom_copy.swd_clock_idcode != idcode) {
+        return 0;
+    }
+    return config_rom_copy.swd_clock;
+}
+
+uint32_t config_get_crc_bootloader(uint32_t key)
+{
+    if (config_rom_copy.crc_bootloader_key != key) {
+        return 0;
+    }
+    return config_rom_copy.crc_bootloader;
+}
+
+uint32_t config_get_crc_interface(uint32_t key)
+{
+    if (config_rom_copy.crc_interface_key != key) {
+        return 0;
+    }
+    return config_rom_copy.crc_interface;
+}
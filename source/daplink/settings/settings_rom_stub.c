@@ -46,6 +46,16 @@ void config_set_detect_incompatible_target(bool on)
     // Do nothing
 }
 
+void config_set_crc_bootloader(uint32_t key, uint32_t crc)
+{
+    // Do nothing
+}
+
+void config_set_crc_interface(uint32_t key, uint32_t crc)
+{
+    // Do nothing
+}
+
 bool config_get_auto_rst()
 {
     return false;
@@ -65,3 +75,13 @@ bool config_get_detect_incompatible_target()
 {
     return false;
 }
+
+uint32_t config_get_crc_bootloader(uint32_t key)
+{
+    return 0;
+}
+
+uint32_t config_get_crc_interface(uint32_t key)
+{
+    return 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file    uart_rx_dma.c
+ * @brief   UART receive by circular DMA with idle line detection
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "uart.h"
+#include "circ_buf.h"
+#include "util.h"
+#include "settings.h" // for config_get_overflow_detect
+
+#define RX_OVRF_MSG         "<DAPLink:Overflow>\n"
+#define RX_OVRF_MSG_SIZE    (sizeof(RX_OVRF_MSG) - 1)
+
+// The buffer the DMA writes, and where it writes next
+static circ_buf_t *rx_buffer;
+static uint32_t (*rx_position)(void);
+// Set when received data was dropped, reported on the next read
+static volatile bool rx_overflow;
+// How much of the overflow marker has been read since the last data
+static uint32_t rx_overflow_msg_pos;
+
+void uart_rx_dma_init(circ_buf_t *buffer, uint32_t (*position)(void))
+{
+    rx_buffer = buffer;
+    rx_position = position;
+    rx_overflow = false;
+    rx_overflow_msg_pos = 0;
+}
+
+// The tail of the buffer only moves here, the DMA keeps writing up to a
+// half buffer ahead of it
+void uart_rx_dma_event(void)
+{
+    if (circ_buf_advance_tail(rx_buffer, rx_position())) {
+        rx_overflow = true;
+    }
+}
+
+// The number of the n bytes at the head of the buffer that the DMA has
+// since come round to and overwritten
+static uint32_t rx_overwritten(uint32_t n)
+{
+    uint32_t tail = rx_buffer->tail;
+    uint32_t written = tail + ((rx_position() - tail) & (rx_buffer->size - 1));
+    uint32_t behind = written - rx_buffer->head;
+
+    if (behind <= rx_buffer->size) {
+        return 0;
+    }
+    return MIN(behind - rx_buffer->size, n);
+}
+
+int32_t uart_rx_dma_read(uint8_t *data, uint16_t size)
+{
+    uint32_t cnt = 0;
+
+    while (cnt < size) {
+        const uint8_t *src;
+        uint32_t n;
+        uint32_t lost;
+
+        // The oldest data was dropped, mark the gap in the stream. The
+        // marker is split over reads too small for all of it, and a marker
+        // with no data after it yet covers the next gap too.
+        if (rx_overflow) {
+            if (config_get_overflow_detect() && (rx_overflow_msg_pos < RX_OVRF_MSG_SIZE)) {
+                n = MIN(size - cnt, RX_OVRF_MSG_SIZE - rx_overflow_msg_pos);
+                memcpy(data + cnt, RX_OVRF_MSG + rx_overflow_msg_pos, n);
+                cnt += n;
+                rx_overflow_msg_pos += n;
+                if (rx_overflow_msg_pos < RX_OVRF_MSG_SIZE) {
+                    break;
+                }
+            }
+            rx_overflow = false;
+            continue;
+        }
+
+        src = circ_buf_peek(rx_buffer, &n);
+        n = MIN(n, size - cnt);
+        if (!n) {
+            break;
+        }
+        memcpy(data + cnt, src, n);
+
+        // Check after copying, so bytes the DMA overwrote while they were
+        // copied are caught too. Those are dropped like any other overflow.
+        lost = rx_overwritten(n);
+        if (lost) {
+            circ_buf_pop_n(rx_buffer, lost);
+            rx_overflow = true;
+            continue;
+        }
+        circ_buf_pop_n(rx_buffer, n);
+        cnt += n;
+        rx_overflow_msg_pos = 0;
+    }
+
+    return cnt;
+}
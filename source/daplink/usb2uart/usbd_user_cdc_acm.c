@@ -155,39 +155,44 @@ int32_t USBD_CDC_ACM_PortSetControlLineState(uint16_t ctrl_bmp)
 
 void cdc_process_event()
 {
-    int32_t len_data = 0;
-    uint8_t data[64];
-
-    len_data = USBD_CDC_ACM_DataFree();
-
-    if (len_data > sizeof(data)) {
-        len_data = sizeof(data);
-    }
-
-    if (len_data) {
-        len_data = uart_read_data(data, len_data);
-    }
+    int32_t len_data;
+    int32_t len_free;
+    uint8_t *buf;
+    uint32_t i;
+
+    // UART to USB, straight into the CDC send buffer. Sending starts right
+    // away when the endpoint is idle and the next data is collected while
+    // a packet is in flight. A second pass picks up data past the buffer wrap.
+    for (i = 0; i < 2; i++) {
+        len_data = USBD_CDC_ACM_DataSendBuf(&buf);
+
+        if (len_data) {
+            len_data = uart_read_data(buf, len_data);
+        }
 
-    if (len_data) {
-        if (USBD_CDC_ACM_DataSend(data , len_data)) {
-            main_blink_cdc_led(MAIN_LED_FLASH);
+        if (!len_data) {
+            break;
         }
+
+        USBD_CDC_ACM_DataSendCommit(len_data);
+        main_blink_cdc_led(MAIN_LED_FLASH);
     }
 
-    len_data = uart_write_free();
+    // USB to UART, straight from the CDC receive buffer
+    len_data = USBD_CDC_ACM_DataReadBuf(&buf);
+    len_free = uart_write_free();
 
-    if (len_data > sizeof(data)) {
-        len_data = sizeof(data);
+    if (len_data > len_free) {
+        len_data = len_free;
     }
 
     if (len_data) {
-        len_data = USBD_CDC_ACM_DataRead(data, len_data);
+        len_data = uart_write_data(buf, len_data);
     }
 
     if (len_data) {
-        if (uart_write_data(data, len_data)) {
-            main_blink_cdc_led(MAIN_LED_FLASH);
-        }
+        USBD_CDC_ACM_DataReadCommit(len_data);
+        main_blink_cdc_led(MAIN_LED_FLASH);
     }
 
     // Always process events
@@ -94,5 +94,6 @@ static const program_target_t flash_nrf52833 = {
     .algo_start = 0x20000000,
     sizeof(nRF52833_flash_algo),
     .algo_blob = nRF52833_flash_algo,
-    .program_buffer_size = 512 // should be USBD_MSC_BlockSize
+    .program_buffer_size = 512, // should be USBD_MSC_BlockSize
+    .program_buffer_alt = 0x20000000 + 0x00000C00,
 };
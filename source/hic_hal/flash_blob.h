@@ -57,6 +57,7 @@ typedef struct __attribute__((__packed__)) {
     const uint32_t *algo_blob;
     const uint32_t  program_buffer_size;
     const uint32_t  algo_flags;         /*!< Combination of kAlgoVerifyReturnsAddress, kAlgoSingleInitType and kAlgoSkipChipErase*/
+    const uint32_t  program_buffer_alt; /*!< Optional second buffer of program_buffer_size bytes. When set, pages are loaded while the previous one is programming. */
 } program_target_t;
 
 typedef struct __attribute__((__packed__)) {
@@ -66,6 +66,9 @@ This information includes:
 /// This information is returned by the command \ref DAP_Info as part of <b>Capabilities</b>.
 #define DAP_JTAG                0               ///< JTAG Mode: 1 = available, 0 = not available.
 
+/// Shift whole bytes of SWD transfers through SPI0 (see swd_spi.c).
+#define DAP_SWD_SPI             1               ///< SWD over SPI: 1 = available, 0 = not available
+
 /// Configure maximum number of JTAG devices on the scan chain connected to the Debug Access Port.
 /// This setting impacts the RAM requirements of the Debug Unit. Valid range is 1 .. 255.
 #define DAP_JTAG_DEV_CNT        0               ///< Maximum number of JTAG devices on scan chain
@@ -112,8 +115,12 @@ This information includes:
 /// SWO Trace Buffer Size.
 #define SWO_BUFFER_SIZE         4096U           ///< SWO Trace Buffer Size in bytes (must be 2^n).
 
-/// SWO Streaming Trace.
+/// SWO Streaming Trace. Sent on an extra endpoint of the CMSIS-DAP v2 bulk interface.
+#if (defined(BULK_ENDPOINT) && (BULK_ENDPOINT != 0))
+#define SWO_STREAM              1               ///< SWO Streaming Trace: 1 = available, 0 = not available.
+#else
 #define SWO_STREAM              0               ///< SWO Streaming Trace: 1 = available, 0 = not available.
+#endif
 
 /// Clock frequency of the Test Domain Timer. Timer value is returned with \ref TIMESTAMP_GET.
 #define TIMESTAMP_CLOCK         1000000U      ///< Timestamp clock in Hz (0 = timestamps not supported).
@@ -0,0 +1,75 @@
+/**
+ * @file    crc.c
+ * @brief   CRC-32 using the CRC module
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fsl_device_registers.h"
+#include "crc.h"
+
+#define CRC32_POLYNOMIAL    (0x04C11DB7)
+
+//! 32-bit CRC with writes and reads transposed in bits and bytes. This makes the MSB first
+//! module consume little-endian words LSB first, i.e. compute the reflected CRC-32.
+#define CRC_CTRL_CRC32      (CRC_CTRL_TCRC_MASK | CRC_CTRL_TOT(2) | CRC_CTRL_TOTR(2))
+
+uint32_t crc32(const void *data, int nBytes)
+{
+    return crc32_continue(0, data, nBytes);
+}
+
+uint32_t crc32_continue(uint32_t prev_crc, const void *data, int nBytes)
+{
+    const uint8_t *message = (const uint8_t *)data;
+    uint32_t n;
+
+    if (nBytes <= 0) {
+        return prev_crc;
+    }
+
+    // The module is fed whole words, so the ragged edges go through the software CRC.
+    n = (0 - (uintptr_t)message) & 3;
+    if (n > (uint32_t)nBytes) {
+        n = nBytes;
+    }
+    prev_crc = crc32_sw_continue(prev_crc, message, n);
+    message += n;
+    nBytes -= n;
+
+    if (nBytes >= 4) {
+        const uint32_t *words = (const uint32_t *)message;
+
+        SIM->SCGC6 |= SIM_SCGC6_CRC_MASK;
+
+        // Write the seed untransposed, straight into the module's MSB first remainder.
+        CRC0->CTRL = CRC_CTRL_TCRC_MASK | CRC_CTRL_WAS_MASK;
+        CRC0->GPOLY = CRC32_POLYNOMIAL;
+        CRC0->DATA = __RBIT(prev_crc ^ 0xFFFFFFFF);
+        CRC0->CTRL = CRC_CTRL_CRC32;
+
+        for (n = nBytes / 4; n; --n) {
+            CRC0->DATA = *words++;
+        }
+
+        prev_crc = CRC0->DATA ^ 0xFFFFFFFF;
+        message = (const uint8_t *)words;
+        nBytes &= 3;
+    }
+
+    return crc32_sw_continue(prev_crc, message, nBytes);
+}
@@ -0,0 +1,126 @@
+/**
+ * @file    swd_spi.c
+ * @brief   SPI assisted SWD on SPI0 (PTC5 SCK, PTC6 SOUT, PTC7 SIN)
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fsl_device_registers.h"
+#include "DAP_config.h"
+#include "DAP.h"
+#include "util.h"
+
+#if (DAP_SWD_SPI != 0)
+
+// The SWD pins are SPI0 on ALT2 and only borrowed for the bytes being
+// shifted, so the bit-banged code keeps owning them in between.
+#define SWD_SPI_MUX         PORT_PCR_MUX(2)
+
+// CTAR0 writes (change on falling edge), CTAR1 reads (sample on falling
+// edge, which is while SWCLK is low before the target shifts again)
+#define SWD_SPI_CTAR_WRITE  0U
+#define SWD_SPI_CTAR_READ   1U
+
+static const uint8_t spi_pbr[] = {2, 3, 5, 7};
+static const uint16_t spi_br[] = {2, 4, 6, 8, 16, 32, 64, 128, 256, 512,
+                                  1024, 2048, 4096, 8192, 16384, 32768};
+
+static uint32_t bus_clock(void)
+{
+    uint32_t div1 = ((SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV1_MASK) >> SIM_CLKDIV1_OUTDIV1_SHIFT) + 1;
+    uint32_t div2 = ((SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV2_MASK) >> SIM_CLKDIV1_OUTDIV2_SHIFT) + 1;
+    return SystemCoreClock * div1 / div2;
+}
+
+static void spi_transfer(uint32_t ctas, uint32_t data, uint32_t count)
+{
+    uint32_t i;
+
+    SPI0->SR = SPI_SR_TCF_MASK | SPI_SR_EOQF_MASK | SPI_SR_RFDF_MASK;
+    for (i = 0; i < count; i++) {
+        uint32_t pushr = SPI_PUSHR_CTAS(ctas) | SPI_PUSHR_TXDATA((data >> (i * 8)) & 0xFF);
+        pushr |= (i + 1 < count) ? SPI_PUSHR_CONT_MASK : SPI_PUSHR_EOQ_MASK;
+        SPI0->PUSHR = pushr;
+    }
+    while (!(SPI0->SR & SPI_SR_EOQF_MASK));
+}
+
+uint32_t SWD_SPI_Clock(uint32_t clock)
+{
+    uint32_t bus = bus_clock();
+    uint32_t best = 0;
+    uint32_t best_ctar = 0;
+    uint32_t pbr;
+    uint32_t br;
+    uint32_t dbr;
+
+    // SCK = bus / PBR * (1 + DBR) / BR
+    for (pbr = 0; pbr < ARRAY_SIZE(spi_pbr); pbr++) {
+        for (br = 0; br < ARRAY_SIZE(spi_br); br++) {
+            for (dbr = 0; dbr < 2; dbr++) {
+                uint32_t sck = bus / spi_pbr[pbr] * (1 + dbr) / spi_br[br];
+                if ((sck <= clock) && (sck > best)) {
+                    best = sck;
+                    best_ctar = SPI_CTAR_PBR(pbr) | SPI_CTAR_BR(br) | SPI_CTAR_DBR(dbr);
+                }
+            }
+        }
+    }
+    if (best == 0) {
+        return 0;
+    }
+
+    SIM->SCGC6 |= SIM_SCGC6_SPI0_MASK;
+    SPI0->MCR = SPI_MCR_MSTR_MASK | SPI_MCR_PCSIS(0x3F) | SPI_MCR_HALT_MASK |
+                SPI_MCR_CLR_TXF_MASK | SPI_MCR_CLR_RXF_MASK;
+    SPI0->CTAR[SWD_SPI_CTAR_WRITE] = SPI_CTAR_FMSZ(7) | SPI_CTAR_CPOL_MASK |
+                                     SPI_CTAR_CPHA_MASK | SPI_CTAR_LSBFE_MASK | best_ctar;
+    SPI0->CTAR[SWD_SPI_CTAR_READ] = SPI_CTAR_FMSZ(7) | SPI_CTAR_CPOL_MASK |
+                                    SPI_CTAR_LSBFE_MASK | best_ctar;
+    SPI0->MCR &= ~SPI_MCR_HALT_MASK;
+    return best;
+}
+
+void SWD_SPI_Write(uint32_t data, uint32_t count)
+{
+    PIN_SWCLK_PORT->PCR[PIN_SWCLK_BIT] = SWD_SPI_MUX | PORT_PCR_DSE_MASK;
+    PIN_SWDIO_OUT_PORT->PCR[PIN_SWDIO_OUT_BIT] = SWD_SPI_MUX | PORT_PCR_DSE_MASK;
+    spi_transfer(SWD_SPI_CTAR_WRITE, data, count);
+    SPI0->MCR |= SPI_MCR_CLR_RXF_MASK;
+    // Hand SWDIO back holding the last bit, as SW_WRITE_BIT would leave it
+    PIN_SWDIO_OUT((data >> (count * 8 - 1)) & 1);
+    PIN_SWDIO_OUT_PORT->PCR[PIN_SWDIO_OUT_BIT] = PORT_PCR_MUX(1) | PORT_PCR_DSE_MASK;
+    PIN_SWCLK_PORT->PCR[PIN_SWCLK_BIT] = PORT_PCR_MUX(1) | PORT_PCR_DSE_MASK;
+}
+
+uint32_t SWD_SPI_Read(uint32_t count)
+{
+    uint32_t data = 0;
+    uint32_t i;
+
+    PIN_SWCLK_PORT->PCR[PIN_SWCLK_BIT] = SWD_SPI_MUX | PORT_PCR_DSE_MASK;
+    PIN_SWDIO_IN_PORT->PCR[PIN_SWDIO_IN_BIT] = SWD_SPI_MUX | PORT_PCR_PE_MASK | PORT_PCR_PS_MASK;
+    spi_transfer(SWD_SPI_CTAR_READ, 0, count);
+    for (i = 0; i < count; i++) {
+        data |= (SPI0->POPR & 0xFF) << (i * 8);
+    }
+    PIN_SWDIO_IN_PORT->PCR[PIN_SWDIO_IN_BIT] = PORT_PCR_MUX(1) | PORT_PCR_PE_MASK | PORT_PCR_PS_MASK;
+    PIN_SWCLK_PORT->PCR[PIN_SWCLK_BIT] = PORT_PCR_MUX(1) | PORT_PCR_DSE_MASK;
+    return data;
+}
+
+#endif
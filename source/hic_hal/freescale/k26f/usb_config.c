@@ -405,6 +405,7 @@
 #define USBD_BULK_ENABLE             BULK_ENDPOINT
 #define USBD_BULK_EP_BULKIN          5
 #define USBD_BULK_EP_BULKOUT         5
+#define USBD_BULK_EP_BULKIN_SWO      6
 #define USBD_BULK_WMAXPACKETSIZE     64
 #define USBD_BULK_HS_ENABLE          1
 #define USBD_BULK_HS_WMAXPACKETSIZE  512
@@ -424,7 +425,8 @@
 #define USBD_EP_NUM_CALC5           MAX(USBD_EP_NUM_CALC2, USBD_EP_NUM_CALC3)
 #define USBD_EP_NUM_CALC6           MAX(USBD_EP_NUM_CALC4, USBD_EP_NUM_CALC5)
 #define USBD_EP_NUM_CALC7           MAX((USBD_BULK_ENABLE*(USBD_BULK_EP_BULKIN)), (USBD_BULK_ENABLE*(USBD_BULK_EP_BULKOUT)))
-#define USBD_EP_NUM                 MAX(USBD_EP_NUM_CALC6, USBD_EP_NUM_CALC7)
+#define USBD_EP_NUM_CALC8           MAX(USBD_EP_NUM_CALC7, (USBD_BULK_ENABLE*(USBD_BULK_EP_BULKIN_SWO)))
+#define USBD_EP_NUM                 MAX(USBD_EP_NUM_CALC6, USBD_EP_NUM_CALC8)
 
 #if    (USBD_HID_ENABLE)
 #if    (USBD_MSC_ENABLE)
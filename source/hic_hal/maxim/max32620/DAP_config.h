@@ -63,6 +63,9 @@ This information includes:
 /// This information is returned by the command \ref DAP_Info as part of <b>Capabilities</b>.
 #define DAP_JTAG                0               ///< JTAG Mode: 1 = available, 0 = not available.
 
+/// Unroll the data phase of the fast SWD transfer (see SW_DP.c).
+#define DAP_SWD_UNROLLED        1               ///< Unrolled SWD: 1 = data phase unrolled, 0 = loops
+
 /// Configure maximum number of JTAG devices on the scan chain connected to the Debug Access Port.
 /// This setting impacts the RAM requirements of the Debug Unit. Valid range is 1 .. 255.
 #define DAP_JTAG_DEV_CNT        0               ///< Maximum number of JTAG devices on scan chain
@@ -68,6 +68,9 @@ This information includes:
 /// This information is returned by the command \ref DAP_Info as part of <b>Capabilities</b>.
 #define DAP_JTAG                1               ///< JTAG Mode: 1 = available, 0 = not available.
 
+/// Unroll the data phase of the fast SWD transfer (see SW_DP.c).
+#define DAP_SWD_UNROLLED        1               ///< Unrolled SWD: 1 = data phase unrolled, 0 = loops
+
 /// Configure maximum number of JTAG devices on the scan chain connected to the Debug Access Port.
 /// This setting impacts the RAM requirements of the Debug Unit. Valid range is 1 .. 255.
 #define DAP_JTAG_DEV_CNT        4               ///< Maximum number of JTAG devices on scan chain
@@ -115,8 +118,14 @@ This information includes:
 /// SWO Trace Buffer Size.
 #define SWO_BUFFER_SIZE         8192U           ///< SWO Trace Buffer Size in bytes (must be 2^n).
 
-/// SWO Streaming Trace.
+/// SWO Streaming Trace. Sent on an extra endpoint of the CMSIS-DAP v2 bulk interface.
+/// The USB1 controller has no IN endpoint left for it when HID is enabled too, so only
+/// the bulk-only projects (lpc55s69_bulk_if, lpc55s69_mculink_bulk_if) stream trace.
+#if (defined(BULK_ENDPOINT) && (BULK_ENDPOINT != 0)) && (!defined(HID_ENDPOINT) || (HID_ENDPOINT == 0))
+#define SWO_STREAM              1               ///< SWO Streaming Trace: 1 = available, 0 = not available.
+#else
 #define SWO_STREAM              0               ///< SWO Streaming Trace: 1 = available, 0 = not available.
+#endif
 
 /// Clock frequency of the Test Domain Timer. Timer value is returned with \ref TIMESTAMP_GET.
 #define TIMESTAMP_CLOCK         1000000U      ///< Timestamp clock in Hz (0 = timestamps not supported).
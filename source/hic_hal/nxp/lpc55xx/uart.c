@@ -26,18 +26,21 @@
 #include "util.h"
 #include "cortex_m.h"
 #include "circ_buf.h"
-#include "settings.h" // for config_get_overflow_detect
 
 #define USART_INSTANCE (Driver_USART0)
 #define USART_IRQ      (FLEXCOMM0_IRQn)
 
+// USART0 receive requests DMA0 channel 4
+#define RX_DMA         (DMA0)
+#define RX_DMA_CH      (4)
+#define RX_DMA_IRQ     (DMA0_IRQn)
+
 extern uint32_t SystemCoreClock;
 
 static void clear_buffers(void);
 
-#define RX_OVRF_MSG         "<DAPLink:Overflow>\n"
-#define RX_OVRF_MSG_SIZE    (sizeof(RX_OVRF_MSG) - 1)
 #define BUFFER_SIZE         (512)
+#define RX_DMA_HALF         (BUFFER_SIZE / 2)
 
 circ_buf_t write_buffer;
 uint8_t write_buffer_data[BUFFER_SIZE];
@@ -48,20 +51,139 @@ struct {
     // Number of bytes pending to be transferred. This is 0 if there is no
     // ongoing transfer and the uart_handler processed the last transfer.
     volatile uint32_t tx_size;
-
-    uint8_t rx;
 } cb_buf;
 
+// A DMA descriptor as the controller reads it, either the channel's entry
+// in the table at SRAMBASE or one it links to
+typedef struct {
+    volatile uint32_t xfercfg;
+    volatile const void *src_end;
+    void *dst_end;
+    void *next;
+} rx_dma_desc_t;
+
+// The table only has to reach the receive channel, but must be 512 byte
+// aligned. Each half of read_buffer has a descriptor that reloads the
+// other, so the DMA runs round read_buffer for as long as it is enabled.
+static rx_dma_desc_t rx_dma_table[RX_DMA_CH + 1] __ALIGNED(512);
+static rx_dma_desc_t rx_dma_desc[2] __ALIGNED(16);
+// The half the DMA writes, as of the last interrupt taken
+static volatile uint32_t rx_dma_half;
+
 void uart_handler(uint32_t event);
 
+// Received data is written by DMA straight into read_buffer, bypassing the
+// USART driver, and made readable by uart_rx_dma_event(). The USART has no
+// receive idle interrupt, so that is called from uart_read_data() as well
+// as on each half done interrupt.
+static uint32_t rx_dma_xfercfg(uint32_t half)
+{
+    return DMA_CHANNEL_XFERCFG_CFGVALID_MASK | DMA_CHANNEL_XFERCFG_RELOAD_MASK |
+           DMA_CHANNEL_XFERCFG_SWTRIG_MASK |
+           (half ? DMA_CHANNEL_XFERCFG_SETINTB_MASK : DMA_CHANNEL_XFERCFG_SETINTA_MASK) |
+           DMA_CHANNEL_XFERCFG_WIDTH(0) | DMA_CHANNEL_XFERCFG_SRCINC(0) |
+           DMA_CHANNEL_XFERCFG_DSTINC(1) | DMA_CHANNEL_XFERCFG_XFERCOUNT(RX_DMA_HALF - 1);
+}
+
+static void rx_dma_stop(void)
+{
+    const uint32_t ch = 1UL << RX_DMA_CH;
+
+    USART0->FIFOCFG &= ~USART_FIFOCFG_DMARX_MASK;
+    RX_DMA->COMMON[0].ENABLECLR = ch;
+    while (RX_DMA->COMMON[0].BUSY & ch);
+    RX_DMA->COMMON[0].ABORT = ch;
+    RX_DMA->COMMON[0].INTENCLR = ch;
+    RX_DMA->COMMON[0].INTA = ch;
+    RX_DMA->COMMON[0].INTB = ch;
+}
+
+static void rx_dma_start(void)
+{
+    const uint32_t ch = 1UL << RX_DMA_CH;
+    uint32_t i;
+
+    for (i = 0; i < 2; i++) {
+        rx_dma_desc[i].xfercfg = rx_dma_xfercfg(i);
+        rx_dma_desc[i].src_end = &USART0->FIFORD;
+        rx_dma_desc[i].dst_end = &read_buffer_data[(i + 1) * RX_DMA_HALF - 1];
+        rx_dma_desc[i].next = &rx_dma_desc[i ^ 1];
+    }
+    // The channel starts on the first half, which goes on to the second
+    rx_dma_table[RX_DMA_CH].src_end = rx_dma_desc[0].src_end;
+    rx_dma_table[RX_DMA_CH].dst_end = rx_dma_desc[0].dst_end;
+    rx_dma_table[RX_DMA_CH].next = &rx_dma_desc[1];
+    rx_dma_half = 0;
+
+    RX_DMA->SRAMBASE = (uint32_t)rx_dma_table;
+    RX_DMA->CTRL = DMA_CTRL_ENABLE_MASK;
+    RX_DMA->CHANNEL[RX_DMA_CH].CFG = DMA_CHANNEL_CFG_PERIPHREQEN_MASK;
+    RX_DMA->COMMON[0].INTENSET = ch;
+    RX_DMA->COMMON[0].ENABLESET = ch;
+    RX_DMA->CHANNEL[RX_DMA_CH].XFERCFG = rx_dma_xfercfg(0);
+    USART0->FIFOCFG |= USART_FIFOCFG_DMARX_MASK;
+}
+
+// Bit n set when half n is done and its interrupt not yet taken
+static uint32_t rx_dma_done(void)
+{
+    return ((RX_DMA->COMMON[0].INTA >> RX_DMA_CH) & 1) |
+           (((RX_DMA->COMMON[0].INTB >> RX_DMA_CH) & 1) << 1);
+}
+
+// The half after the given one, for each of the halves done
+static uint32_t rx_dma_next_half(uint32_t half, uint32_t done)
+{
+    if (done & (1UL << half)) {
+        half ^= 1;
+        if (done & (1UL << half)) {
+            half ^= 1;
+        }
+    }
+    return half;
+}
+
+// Offset in read_buffer the DMA writes next. The count in the channel is
+// for the half after rx_dma_half when that half is done but its interrupt
+// not yet taken, so all three are read again if either moved meanwhile.
+static uint32_t rx_dma_pos(void)
+{
+    const uint32_t all_ones = DMA_CHANNEL_XFERCFG_XFERCOUNT_MASK >> DMA_CHANNEL_XFERCFG_XFERCOUNT_SHIFT;
+    uint32_t half;
+    uint32_t done;
+    uint32_t count;
+
+    do {
+        half = rx_dma_half;
+        done = rx_dma_done();
+        count = (RX_DMA->CHANNEL[RX_DMA_CH].XFERCFG & DMA_CHANNEL_XFERCFG_XFERCOUNT_MASK) >>
+                DMA_CHANNEL_XFERCFG_XFERCOUNT_SHIFT;
+    } while ((half != rx_dma_half) || (done != rx_dma_done()));
+    half = rx_dma_next_half(half, done);
+    // The count is one less than the transfers left, and all ones from a
+    // half finishing until the next is loaded
+    if (all_ones == count) {
+        return half * RX_DMA_HALF;
+    }
+    return half * RX_DMA_HALF + RX_DMA_HALF - (count + 1);
+}
+
 void clear_buffers(void)
 {
+    const bool running = (USART0->FIFOCFG & USART_FIFOCFG_DMARX_MASK) != 0;
+
+    rx_dma_stop();
     circ_buf_init(&write_buffer, write_buffer_data, sizeof(write_buffer_data));
     circ_buf_init(&read_buffer, read_buffer_data, sizeof(read_buffer_data));
+    uart_rx_dma_init(&read_buffer, rx_dma_pos);
+    if (running) {
+        rx_dma_start();
+    }
 }
 
 int32_t uart_initialize(void)
 {
+    CLOCK_EnableClock(kCLOCK_Dma0);
     clear_buffers();
     cb_buf.tx_size = 0;
     USART_INSTANCE.Initialize(uart_handler);
@@ -72,8 +194,9 @@ int32_t uart_initialize(void)
 
 int32_t uart_uninitialize(void)
 {
+    NVIC_DisableIRQ(RX_DMA_IRQ);
+    rx_dma_stop();
     USART_INSTANCE.Control(ARM_USART_CONTROL_RX, 0);
-    USART_INSTANCE.Control(ARM_USART_ABORT_RECEIVE, 0U);
     USART_INSTANCE.PowerControl(ARM_POWER_OFF);
     USART_INSTANCE.Uninitialize();
     clear_buffers();
@@ -86,12 +209,14 @@ int32_t uart_reset(void)
 {
     // disable interrupt
     NVIC_DisableIRQ(USART_IRQ);
+    NVIC_DisableIRQ(RX_DMA_IRQ);
     clear_buffers();
     if (cb_buf.tx_size != 0) {
         USART_INSTANCE.Control(ARM_USART_ABORT_SEND, 0U);
         cb_buf.tx_size = 0;
     }
     // enable interrupt
+    NVIC_EnableIRQ(RX_DMA_IRQ);
     NVIC_EnableIRQ(USART_IRQ);
 
     return 1;
@@ -162,15 +287,14 @@ int32_t uart_set_configuration(UART_Configuration *config)
     }
 
     NVIC_DisableIRQ(USART_IRQ);
+    NVIC_DisableIRQ(RX_DMA_IRQ);
+    rx_dma_stop();
     clear_buffers();
     if (cb_buf.tx_size != 0) {
         USART_INSTANCE.Control(ARM_USART_ABORT_SEND, 0U);
         cb_buf.tx_size = 0;
     }
-
-    // If there was no Receive() call in progress aborting it is harmless.
     USART_INSTANCE.Control(ARM_USART_CONTROL_RX, 0U);
-    USART_INSTANCE.Control(ARM_USART_ABORT_RECEIVE, 0U);
 
     uint32_t r = USART_INSTANCE.Control(control, config->Baudrate);
     if (r != ARM_DRIVER_OK) {
@@ -178,8 +302,10 @@ int32_t uart_set_configuration(UART_Configuration *config)
     }
     USART_INSTANCE.Control(ARM_USART_CONTROL_TX, 1);
     USART_INSTANCE.Control(ARM_USART_CONTROL_RX, 1);
-    USART_INSTANCE.Receive(&(cb_buf.rx), 1);
+    rx_dma_start();
 
+    NVIC_ClearPendingIRQ(RX_DMA_IRQ);
+    NVIC_EnableIRQ(RX_DMA_IRQ);
     NVIC_ClearPendingIRQ(USART_IRQ);
     NVIC_EnableIRQ(USART_IRQ);
 
@@ -241,22 +367,26 @@ int32_t uart_write_data(uint8_t *data, uint16_t size)
 
 int32_t uart_read_data(uint8_t *data, uint16_t size)
 {
-    return circ_buf_read(&read_buffer, data, size);
+    // The CDC bridge reads continually, which stands in for the idle
+    // interrupt the USART lacks
+    NVIC_DisableIRQ(RX_DMA_IRQ);
+    uart_rx_dma_event();
+    NVIC_EnableIRQ(RX_DMA_IRQ);
+    return uart_rx_dma_read(data, size);
 }
 
-void uart_handler(uint32_t event) {
-   if (event & ARM_USART_EVENT_RECEIVE_COMPLETE) {
-        uint32_t free = circ_buf_count_free(&read_buffer);
-        if (free > RX_OVRF_MSG_SIZE) {
-            circ_buf_push(&read_buffer, cb_buf.rx);
-        } else if ((RX_OVRF_MSG_SIZE == free) && config_get_overflow_detect()) {
-            circ_buf_write(&read_buffer, (uint8_t*)RX_OVRF_MSG, RX_OVRF_MSG_SIZE);
-        } else {
-            // Drop character
-        }
-        USART_INSTANCE.Receive(&(cb_buf.rx), 1);
-    }
+void DMA0_IRQHandler(void)
+{
+    uint32_t done = rx_dma_done();
+
+    // Half done, cleared by writing 1
+    RX_DMA->COMMON[0].INTA = (done & 1) << RX_DMA_CH;
+    RX_DMA->COMMON[0].INTB = ((done >> 1) & 1) << RX_DMA_CH;
+    rx_dma_half = rx_dma_next_half(rx_dma_half, done);
+    uart_rx_dma_event();
+}
 
+void uart_handler(uint32_t event) {
     if (event & ARM_USART_EVENT_SEND_COMPLETE) {
         circ_buf_pop_n(&write_buffer, cb_buf.tx_size);
         uart_start_tx_transfer();
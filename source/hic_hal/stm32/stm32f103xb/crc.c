@@ -0,0 +1,89 @@
+/**
+ * @file    crc.c
+ * @brief   CRC-32 using the CRC calculation unit
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stm32f1xx.h"
+#include "crc.h"
+
+#define CRC32_POLYNOMIAL    (0x04C11DB7)
+
+//! The F1 unit has no INIT register, a reset always restarts it from 0xFFFFFFFF. To resume
+//! a previous CRC, return the word that takes it from 0xFFFFFFFF to the given remainder. This
+//! is found by running the remainder backwards through the 32 shifts of one word.
+static uint32_t crc_seed_word(uint32_t remainder)
+{
+    uint32_t bit;
+
+    for (bit = 0; bit < 32; ++bit) {
+        if (remainder & 1) {
+            remainder = ((remainder ^ CRC32_POLYNOMIAL) >> 1) | 0x80000000;
+        } else {
+            remainder = remainder >> 1;
+        }
+    }
+
+    return remainder ^ 0xFFFFFFFF;
+}
+
+uint32_t crc32(const void *data, int nBytes)
+{
+    return crc32_continue(0, data, nBytes);
+}
+
+uint32_t crc32_continue(uint32_t prev_crc, const void *data, int nBytes)
+{
+    const uint8_t *message = (const uint8_t *)data;
+    uint32_t n;
+
+    if (nBytes <= 0) {
+        return prev_crc;
+    }
+
+    // The unit only takes whole words, so the ragged edges go through the software CRC.
+    n = (0 - (uintptr_t)message) & 3;
+    if (n > (uint32_t)nBytes) {
+        n = nBytes;
+    }
+    prev_crc = crc32_sw_continue(prev_crc, message, n);
+    message += n;
+    nBytes -= n;
+
+    if (nBytes >= 4) {
+        const uint32_t *words = (const uint32_t *)message;
+        // The unit computes MSB first, so its remainder is the bit reverse of ours.
+        uint32_t remainder = __RBIT(prev_crc ^ 0xFFFFFFFF);
+
+        RCC->AHBENR |= RCC_AHBENR_CRCEN;
+        CRC->CR = CRC_CR_RESET;
+        if (remainder != 0xFFFFFFFF) {
+            CRC->DR = crc_seed_word(remainder);
+        }
+
+        for (n = nBytes / 4; n; --n) {
+            CRC->DR = __RBIT(*words++);
+        }
+
+        prev_crc = __RBIT(CRC->DR) ^ 0xFFFFFFFF;
+        message = (const uint8_t *)words;
+        nBytes &= 3;
+    }
+
+    return crc32_sw_continue(prev_crc, message, nBytes);
+}
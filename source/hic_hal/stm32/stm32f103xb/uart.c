@@ -35,6 +35,13 @@
 #define CDC_UART_IRQn                USART2_IRQn
 #define CDC_UART_IRQn_Handler        USART2_IRQHandler
 
+// USART2 RX is wired to DMA1 channel 6
+#define CDC_UART_RX_DMA              DMA1_Channel6
+#define CDC_UART_RX_DMA_ENABLE()     __HAL_RCC_DMA1_CLK_ENABLE()
+#define CDC_UART_RX_DMA_IRQn         DMA1_Channel6_IRQn
+#define CDC_UART_RX_DMA_IRQn_Handler DMA1_Channel6_IRQHandler
+#define CDC_UART_RX_DMA_FLAGS        DMA_IFCR_CGIF6
+
 #define UART_PINS_PORT_ENABLE()      __HAL_RCC_GPIOA_CLK_ENABLE()
 #define UART_PINS_PORT_DISABLE()     __HAL_RCC_GPIOA_CLK_DISABLE()
 
@@ -50,9 +57,6 @@
 #define UART_RTS_PORT                GPIOA
 #define UART_RTS_PIN                 GPIO_PIN_1
 
-
-#define RX_OVRF_MSG         "<DAPLink:Overflow>\n"
-#define RX_OVRF_MSG_SIZE    (sizeof(RX_OVRF_MSG) - 1)
 #define BUFFER_SIZE         (512)
 
 circ_buf_t write_buffer;
@@ -72,17 +76,53 @@ extern uint32_t SystemCoreClock;
 
 
 
+// Received data is written by DMA straight into read_buffer, which runs in
+// circular mode. The half, full and line idle interrupts make it readable
+// through uart_rx_dma_event().
+static void rx_dma_stop(void)
+{
+    CDC_UART_RX_DMA->CCR &= ~DMA_CCR_EN;
+    DMA1->IFCR = CDC_UART_RX_DMA_FLAGS;
+}
+
+static void rx_dma_start(void)
+{
+    CDC_UART_RX_DMA->CPAR = (uint32_t)&CDC_UART->DR;
+    CDC_UART_RX_DMA->CMAR = (uint32_t)read_buffer_data;
+    CDC_UART_RX_DMA->CNDTR = sizeof(read_buffer_data);
+    CDC_UART_RX_DMA->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE;
+    CDC_UART_RX_DMA->CCR |= DMA_CCR_EN;
+}
+
+static uint32_t rx_dma_pos(void)
+{
+    uint32_t pos = sizeof(read_buffer_data) - CDC_UART_RX_DMA->CNDTR;
+
+    if (pos >= sizeof(read_buffer_data)) {
+        pos = 0;
+    }
+    return pos;
+}
+
 static void clear_buffers(void)
 {
+    const uint32_t ccr = CDC_UART_RX_DMA->CCR;
+
+    rx_dma_stop();
     circ_buf_init(&write_buffer, write_buffer_data, sizeof(write_buffer_data));
     circ_buf_init(&read_buffer, read_buffer_data, sizeof(read_buffer_data));
+    uart_rx_dma_init(&read_buffer, rx_dma_pos);
+    if (ccr & DMA_CCR_EN) {
+        rx_dma_start();
+    }
 }
 
 int32_t uart_initialize(void)
 {
     GPIO_InitTypeDef GPIO_InitStructure;
 
-    CDC_UART->CR1 &= ~(USART_IT_TXE | USART_IT_RXNE);
+    CDC_UART->CR1 &= ~(USART_IT_TXE | USART_CR1_IDLEIE);
+    CDC_UART_RX_DMA_ENABLE();
     clear_buffers();
 
     CDC_UART_ENABLE();
@@ -113,13 +153,16 @@ int32_t uart_initialize(void)
     HAL_GPIO_Init(UART_RTS_PORT, &GPIO_InitStructure);
 
     NVIC_EnableIRQ(CDC_UART_IRQn);
+    NVIC_EnableIRQ(CDC_UART_RX_DMA_IRQn);
 
     return 1;
 }
 
 int32_t uart_uninitialize(void)
 {
-    CDC_UART->CR1 &= ~(USART_IT_TXE | USART_IT_RXNE);
+    CDC_UART->CR1 &= ~(USART_IT_TXE | USART_CR1_IDLEIE);
+    CDC_UART->CR3 &= ~USART_CR3_DMAR;
+    rx_dma_stop();
     clear_buffers();
     return 1;
 }
@@ -127,7 +170,7 @@ int32_t uart_uninitialize(void)
 int32_t uart_reset(void)
 {
     const uint32_t cr1 = CDC_UART->CR1;
-    CDC_UART->CR1 = cr1 & ~(USART_IT_TXE | USART_IT_RXNE);
+    CDC_UART->CR1 = cr1 & ~(USART_IT_TXE | USART_CR1_IDLEIE);
     clear_buffers();
     CDC_UART->CR1 = cr1 & ~USART_IT_TXE;
     return 1;
@@ -188,7 +231,8 @@ int32_t uart_set_configuration(UART_Configuration *config)
     uart_handle.Init.Mode = UART_MODE_TX_RX;
     
     // Disable uart and tx/rx interrupt
-    CDC_UART->CR1 &= ~(USART_IT_TXE | USART_IT_RXNE);
+    CDC_UART->CR1 &= ~(USART_IT_TXE | USART_CR1_IDLEIE);
+    rx_dma_stop();
 
     clear_buffers();
 
@@ -198,7 +242,9 @@ int32_t uart_set_configuration(UART_Configuration *config)
     util_assert(HAL_OK == status);
     (void)status;
 
-    CDC_UART->CR1 |= USART_IT_RXNE;
+    CDC_UART->CR3 |= USART_CR3_DMAR;
+    rx_dma_start();
+    CDC_UART->CR1 |= USART_CR1_IDLEIE;
 
     return 1;
 }
@@ -233,23 +279,24 @@ int32_t uart_write_data(uint8_t *data, uint16_t size)
 
 int32_t uart_read_data(uint8_t *data, uint16_t size)
 {
-    return circ_buf_read(&read_buffer, data, size);
+    return uart_rx_dma_read(data, size);
+}
+
+void CDC_UART_RX_DMA_IRQn_Handler(void)
+{
+    // Half or full transfer
+    DMA1->IFCR = CDC_UART_RX_DMA_FLAGS;
+    uart_rx_dma_event();
 }
 
 void CDC_UART_IRQn_Handler(void)
 {
     const uint32_t sr = CDC_UART->SR;
 
-    if (sr & USART_SR_RXNE) {
-        uint8_t dat = CDC_UART->DR;
-        uint32_t free = circ_buf_count_free(&read_buffer);
-        if (free > RX_OVRF_MSG_SIZE) {
-            circ_buf_push(&read_buffer, dat);
-        } else if (RX_OVRF_MSG_SIZE == free) {
-            circ_buf_write(&read_buffer, (uint8_t*)RX_OVRF_MSG, RX_OVRF_MSG_SIZE);
-        } else {
-            // Drop character
-        }
+    if (sr & USART_SR_IDLE) {
+        // Cleared by reading SR followed by DR
+        (void)CDC_UART->DR;
+        uart_rx_dma_event();
     }
 
     if (sr & USART_SR_TXE) {
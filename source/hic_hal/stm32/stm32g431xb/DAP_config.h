@@ -106,8 +106,12 @@ This information includes:
 /// SWO Trace Buffer Size.
 #define SWO_BUFFER_SIZE         4096U           ///< SWO Trace Buffer Size in bytes (must be 2^n).
 
-/// SWO Streaming Trace.
+/// SWO Streaming Trace. Sent on an extra endpoint of the CMSIS-DAP v2 bulk interface.
+#if (defined(BULK_ENDPOINT) && (BULK_ENDPOINT != 0))
+#define SWO_STREAM              1               ///< SWO Streaming Trace: 1 = available, 0 = not available.
+#else
 #define SWO_STREAM              0               ///< SWO Streaming Trace: 1 = available, 0 = not available.
+#endif
 
 /// Clock frequency of the Test Domain Timer. Timer value is returned with \ref TIMESTAMP_GET.
 #define TIMESTAMP_CLOCK         1000000U      ///< Timestamp clock in Hz (0 = timestamps not supported).
@@ -0,0 +1,71 @@
+/**
+ * @file    crc.c
+ * @brief   CRC-32 using the CRC calculation unit
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stm32g4xx.h"
+#include "crc.h"
+
+#define CRC32_POLYNOMIAL    (0x04C11DB7)
+
+uint32_t crc32(const void *data, int nBytes)
+{
+    return crc32_continue(0, data, nBytes);
+}
+
+uint32_t crc32_continue(uint32_t prev_crc, const void *data, int nBytes)
+{
+    const uint8_t *message = (const uint8_t *)data;
+    uint32_t n;
+
+    if (nBytes <= 0) {
+        return prev_crc;
+    }
+
+    // The unit is fed whole words, so the ragged edges go through the software CRC.
+    n = (0 - (uintptr_t)message) & 3;
+    if (n > (uint32_t)nBytes) {
+        n = nBytes;
+    }
+    prev_crc = crc32_sw_continue(prev_crc, message, n);
+    message += n;
+    nBytes -= n;
+
+    if (nBytes >= 4) {
+        const uint32_t *words = (const uint32_t *)message;
+
+        RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN;
+
+        // Input is bit reversed by word and the output reversed, which turns the MSB first
+        // engine into reflected CRC-32. INIT is in the engine's unreversed domain.
+        CRC->POL = CRC32_POLYNOMIAL;
+        CRC->INIT = __RBIT(prev_crc ^ 0xFFFFFFFF);
+        CRC->CR = CRC_CR_REV_IN | CRC_CR_REV_OUT | CRC_CR_RESET;
+
+        for (n = nBytes / 4; n; --n) {
+            CRC->DR = *words++;
+        }
+
+        prev_crc = CRC->DR ^ 0xFFFFFFFF;
+        message = (const uint8_t *)words;
+        nBytes &= 3;
+    }
+
+    return crc32_sw_continue(prev_crc, message, nBytes);
+}
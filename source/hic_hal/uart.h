@@ -24,6 +24,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "circ_buf.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -87,6 +88,20 @@ extern void uart_set_control_line_state(uint16_t ctrl_bmp);
 extern void uart_software_flow_control(void);
 extern void uart_enable_flow_control(bool enabled);
 
+/* Receive by DMA with idle line detection, shared by the HICs whose UART
+ * receives by DMA straight into a circular buffer. The HIC keeps the DMA
+ * running and leaves the buffer to these:
+ *   uart_rx_dma_init: hand over the buffer whenever receiving starts over,
+ *       with a function giving the offset in it the DMA writes next
+ *   uart_rx_dma_event: make what the DMA has written readable. Called from
+ *       the half and full transfer and line idle interrupts, or with those
+ *       masked where the UART has no idle interrupt to call it from
+ *   uart_rx_dma_read: the HIC's uart_read_data, which marks where data was
+ *       dropped for being overwritten before it was read */
+extern void uart_rx_dma_init(circ_buf_t *buffer, uint32_t (*position)(void));
+extern void uart_rx_dma_event(void);
+extern int32_t uart_rx_dma_read(uint8_t *data, uint16_t size);
+
 #ifdef __cplusplus
 }
 #endif
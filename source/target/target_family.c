@@ -20,6 +20,7 @@
  */
 
 #include "daplink.h"
+#include DAPLINK_MAIN_HEADER
 #include "DAP_config.h"
 #include "swd_host.h"
 #include "target_family.h"
@@ -122,7 +123,7 @@ void init_family(void)
     }
 }
 
-uint8_t target_set_state(target_state_t state)
+static uint8_t target_set_state_locked(target_state_t state)
 {
     if (g_board_info.target_set_state) { //target specific
         g_board_info.target_set_state(state);
@@ -150,6 +151,17 @@ uint8_t target_set_state(target_state_t state)
     }
 }
 
+uint8_t target_set_state(target_state_t state)
+{
+    uint8_t status;
+
+    // Don't change state in the middle of a DAP command
+    main_target_lock();
+    status = target_set_state_locked(state);
+    main_target_unlock();
+    return status;
+}
+
 void swd_set_target_reset(uint8_t asserted)
 {
     if (g_target_family && g_target_family->swd_set_target_reset) {
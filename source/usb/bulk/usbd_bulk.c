@@ -28,20 +28,40 @@
 #include "daplink.h"
 #include DAPLINK_MAIN_HEADER
 
+static U8 *ptrDataStart;
 static U8 *ptrDataIn;
 static U16 DataInReceLen;
 static DAP_queue DAP_Cmd_queue;
 
 static volatile uint8_t  USB_ResponseIdle;
 
+static void usbd_bulk_send_response(void);
+
 void usbd_bulk_init(void)
 {
-    ptrDataIn     = USBD_Bulk_BulkOutBuf;
+    // Requests are read from the endpoint straight into the DAP_queue slots
+    util_assert(USBD_Bulk_BulkBufSize <= DAP_PACKET_SIZE);
+    ptrDataStart  = NULL;
+    ptrDataIn     = NULL;
     DataInReceLen = 0;
-    DAP_queue_init(&DAP_Cmd_queue);
+    DAP_queue_init(&DAP_Cmd_queue, usbd_bulk_send_response);
     USB_ResponseIdle = 1;
 }
 
+/*
+ *  Start sending the DAP responses if the Bulk In endpoint is idle
+ *    Parameters:      None
+ *    Return Value:    None
+ */
+
+static void usbd_bulk_send_response(void)
+{
+    if (USB_ResponseIdle) {
+        USB_ResponseIdle = 0;
+        USBD_BULK_EP_BULKIN_Event(0);
+    }
+}
+
 /*
  *  USB Device Bulk In Endpoint Event Callback
  *    Parameters:      event: not used (just for compatibility)
@@ -53,6 +73,7 @@ void USBD_BULK_EP_BULKIN_Event(U32 event)
     uint8_t * sbuf = 0;
     int slen;
     if(DAP_queue_get_send_buf(&DAP_Cmd_queue, &sbuf, &slen)){
+        // Copied to the endpoint buffer, which frees the slot again
         USBD_WriteEP(usbd_bulk_ep_bulkin | 0x80, sbuf, slen);
     } else {
         USB_ResponseIdle = 1;
@@ -69,7 +90,14 @@ void USBD_BULK_EP_BULKIN_Event(U32 event)
 void USBD_BULK_EP_BULKOUT_Event(U32 event)
 {
     U16 bytes_rece;
-    uint8_t * rbuf;
+
+    if (ptrDataStart == NULL) {
+        // Without a free slot the request is read out and dropped
+        if (!DAP_queue_get_recv_buf(&DAP_Cmd_queue, &ptrDataStart)) {
+            ptrDataStart = USBD_Bulk_BulkOutBuf;
+        }
+        ptrDataIn = ptrDataStart;
+    }
 
     bytes_rece      = USBD_ReadEP(usbd_bulk_ep_bulkout, ptrDataIn, USBD_Bulk_BulkBufSize - DataInReceLen);
     ptrDataIn      += bytes_rece;
@@ -77,16 +105,17 @@ void USBD_BULK_EP_BULKOUT_Event(U32 event)
 
     if ((DataInReceLen >= USBD_Bulk_BulkBufSize) ||
             (bytes_rece    <  usbd_bulk_maxpacketsize[USBD_HighSpeed])) {
-        if (DAP_queue_execute_buf(&DAP_Cmd_queue, USBD_Bulk_BulkOutBuf, DataInReceLen, &rbuf)) {
-            //Trigger the BULKIn for the reply
-            if (USB_ResponseIdle) {
-                USBD_BULK_EP_BULKIN_Event(0);
-                USB_ResponseIdle = 0;
-            }
+        if (ptrDataStart[0] == ID_DAP_TransferAbort) {
+            // Abort the transfer in progress on the DAP thread
+            DAP_TransferAbort = 1;
+        } else if (ptrDataStart != USBD_Bulk_BulkOutBuf) {
+            DAP_queue_commit_recv_buf(&DAP_Cmd_queue);
+            //Trigger the BULKIn if the reply is already there, otherwise the DAP thread will
+            usbd_bulk_send_response();
         }
         //revert the input pointers
         DataInReceLen = 0;
-        ptrDataIn     = USBD_Bulk_BulkOutBuf;
+        ptrDataStart  = NULL;
     }
 }
 
@@ -109,3 +138,110 @@ void USBD_BULK_EP_BULK_Event(U32 event)
         USBD_BULK_EP_BULKIN_Event(0);
     }
 }
+
+#if (SWO_STREAM != 0)
+
+static U8 *SWO_DataIn;
+static volatile U32 SWO_DataInLen;
+static volatile U8 SWO_TransferActive;
+static volatile U8 SWO_PacketBusy;
+
+/*
+ *  Write the next packet of the SWO trace transfer
+ *    Parameters:      None
+ *    Return Value:    None
+ */
+
+static void usbd_bulk_swo_send_packet(void)
+{
+    U32 len = MIN(SWO_DataInLen, usbd_bulk_maxpacketsize[USBD_HighSpeed]);
+
+    SWO_PacketBusy = 1;
+    USBD_WriteEP(usbd_bulk_ep_bulkin_swo | 0x80, SWO_DataIn, len);
+    SWO_DataIn    += len;
+    SWO_DataInLen -= len;
+}
+
+/*
+ *  Start sending SWO trace data on the Bulk SWO In endpoint. Called by the SWO
+ *  thread, SWO_TransferComplete is called once all of it has been sent. The
+ *  endpoint is only written from the main task, which runs the USB stack.
+ *    Parameters:      buf: trace data
+ *                     num: number of bytes
+ *    Return Value:    None
+ */
+
+void SWO_QueueTransfer(uint8_t *buf, uint32_t num)
+{
+    SWO_DataIn         = buf;
+    SWO_DataInLen      = num;
+    SWO_TransferActive = 1;
+    main_swo_send_event();
+}
+
+/*
+ *  USB Device Bulk SWO Send Event, the main task starts a queued SWO transfer
+ *    Parameters:      None
+ *    Return Value:    None
+ */
+
+void USBD_BULK_SWO_Send_Event(void)
+{
+    // A packet left over from an aborted transfer is still on the endpoint,
+    // its completion starts this transfer
+    if (SWO_TransferActive && !SWO_PacketBusy) {
+        usbd_bulk_swo_send_packet();
+    }
+}
+
+/*
+ *  Abort the SWO trace transfer in progress
+ *    Parameters:      None
+ *    Return Value:    None
+ */
+
+void SWO_AbortTransfer(void)
+{
+    SWO_TransferActive = 0;
+    SWO_DataInLen      = 0;
+}
+
+/*
+ *  USB Device Bulk SWO In Endpoint Event Callback
+ *    Parameters:      event: not used (just for compatibility)
+ *    Return Value:    None
+ */
+
+void USBD_BULK_EP_BULKIN_SWO_Event(U32 event)
+{
+    SWO_PacketBusy = 0;
+    if (!SWO_TransferActive) {
+        return;
+    }
+    if (SWO_DataInLen) {
+        usbd_bulk_swo_send_packet();
+    } else {
+        SWO_TransferActive = 0;
+        SWO_TransferComplete();
+    }
+}
+
+/*
+ *  USB Device Reset Event for the Bulk SWO In endpoint. A reset cancels the
+ *  packet on the endpoint, so complete the transfer to keep the SWO thread
+ *  going.
+ *    Parameters:      None
+ *    Return Value:    None
+ */
+
+void USBD_BULK_SWO_Reset_Event(void)
+{
+    SWO_PacketBusy = 0;
+    if (SWO_TransferActive) {
+        SWO_TransferActive = 0;
+        SWO_DataInLen      = 0;
+        SWO_TransferComplete();
+    }
+}
+
+#endif
@@ -127,6 +127,8 @@ __WEAK int32_t USBD_CDC_ACM_SendBreak(uint16_t dur)
 /* Local function prototypes                                                  */
 static void USBD_CDC_ACM_EP_BULKOUT_HandleData(void);
 static void USBD_CDC_ACM_EP_BULKIN_HandleData(void);
+static void USBD_CDC_ACM_ReceiveProcess(void);
+static void USBD_CDC_ACM_SendStart(void);
 
 
 /*----------------- USB CDC ACM class handling functions ---------------------*/
@@ -347,6 +349,62 @@ int32_t USBD_CDC_ACM_DataSend(const uint8_t *buf, int32_t len)
 }
 
 
+/** \brief  Gets free space in the send intermediate buffer
+
+    The function returns the contiguous free space in the send intermediate
+    buffer so the caller can place data there directly, followed by a call
+    to USBD_CDC_ACM_DataSendCommit.
+
+    \param [out]        buf      Pointer to the free space.
+    \return                      Number of bytes that can be written to buf.
+ */
+
+int32_t USBD_CDC_ACM_DataSendBuf(uint8_t **buf)
+{
+    int32_t len_available, len_before_wrap;
+
+    len_available = ((int32_t)usbd_cdc_acm_sendbuf_sz) - (data_to_send_wr - data_to_send_rd);
+
+    if (len_available <= 0) {             /* If no space for data to send       */
+        return (0);
+    }
+
+    len_before_wrap = USBD_CDC_ACM_SendBuf + usbd_cdc_acm_sendbuf_sz - ptr_data_to_send;
+
+    if (len_available > len_before_wrap) {/* Only up to the end of the buffer   */
+        len_available = len_before_wrap;
+    }
+
+    *buf = ptr_data_to_send;
+    return (len_available);
+}
+
+
+/** \brief  Sends data placed in the send intermediate buffer
+
+    The function queues data written to the space returned by
+    USBD_CDC_ACM_DataSendBuf. Sending starts right away if the Bulk In
+    endpoint is idle, otherwise the data goes out with the following packets.
+    Must be called from the same context as the USB event handlers.
+
+    \param [in]         len      Number of bytes written.
+    \return                      Number of bytes accepted to be sent.
+ */
+
+int32_t USBD_CDC_ACM_DataSendCommit(int32_t len)
+{
+    ptr_data_to_send += len;              /* Correct position of write pointer  */
+
+    if (ptr_data_to_send == USBD_CDC_ACM_SendBuf + usbd_cdc_acm_sendbuf_sz) {
+        ptr_data_to_send = USBD_CDC_ACM_SendBuf;
+    }
+
+    data_to_send_wr += len;               /* Bytes prepared to send counter     */
+    USBD_CDC_ACM_SendStart();             /* Send now if not already sending    */
+    return (len);
+}
+
+
 /** \brief  Sends a single character over the USB CDC ACM Virtual COM Port
 
     The function puts requested data character to the send intermediate buffer
@@ -398,6 +456,41 @@ int32_t USBD_CDC_ACM_DataRead(uint8_t *buf, int32_t len)
 }
 
 
+/** \brief  Gets data received over the USB CDC ACM Virtual COM Port
+
+    The function returns the unread data in the receive intermediate buffer
+    so the caller can use it in place, followed by a call to
+    USBD_CDC_ACM_DataReadCommit.
+
+    \param [out]        buf      Pointer to the received data.
+    \return                      Number of bytes available at buf.
+ */
+
+int32_t USBD_CDC_ACM_DataReadBuf(uint8_t **buf)
+{
+    *buf = ptr_data_read;
+    return (ptr_data_received - ptr_data_read);
+}
+
+
+/** \brief  Releases data received over the USB CDC ACM Virtual COM Port
+
+    The function marks data returned by USBD_CDC_ACM_DataReadBuf as read.
+    Packets waiting for space are received right away. Must be called from
+    the same context as the USB event handlers.
+
+    \param [in]         len      Number of bytes used.
+    \return                      Number of bytes released.
+ */
+
+int32_t USBD_CDC_ACM_DataReadCommit(int32_t len)
+{
+    ptr_data_read += len;                 /* Correct position of read pointer   */
+    USBD_CDC_ACM_ReceiveProcess();        /* Make room for pending packets      */
+    return (len);
+}
+
+
 /** \brief  Reads one character of data received over the USB CDC ACM Virtual COM Port
 
     The function reads data character from the receive intermediate buffer that
@@ -486,17 +579,16 @@ void USBD_CDC_ACM_Reset_Event(void)
 }
 
 
-/** \brief  Handle SOF Events
+/** \brief  Handle Received Data
 
-    The function handles Start Of Frame events. It checks if there is pending
-    data on the Bulk Out endpoint and handles it
+    The function rewinds the receive intermediate buffer once all data was
+    read, and handles pending data on the Bulk Out endpoint
     (USBD_CDC_ACM_EP_BULKOUT_HandleData) if there is enough space in the
     intermediate receive buffer and it calls received function callback
-    (USBD_CDC_ACM_DataReceived) it also activates data send over the Bulk In
-    endpoint if there is data to be sent (USBD_CDC_ACM_EP_BULKIN_HandleData).
+    (USBD_CDC_ACM_DataReceived).
  */
 
-void USBD_CDC_ACM_SOF_Event(void)
+static void USBD_CDC_ACM_ReceiveProcess(void)
 {
     if (!USBD_Configuration) {
         // Don't process events until CDC is
@@ -537,7 +629,23 @@ void USBD_CDC_ACM_SOF_Event(void)
 
                                            received callback                  */
     }
+}
+
 
+/** \brief  Start Sending Data
+
+    The function activates data send over the Bulk In endpoint if there is
+    data to be sent and sending is not already active
+    (USBD_CDC_ACM_EP_BULKIN_HandleData). While the endpoint is busy new data
+    is collected in the send intermediate buffer and goes out with the
+    following packets.
+ */
+
+static void USBD_CDC_ACM_SendStart(void)
+{
+    if (!USBD_Configuration) {
+        return;
+    }
     if ((!data_send_access)         &&    /* If send data is not being accessed */
             (!data_send_active)         &&    /* and send is not active             */
             (data_to_send_wr - data_to_send_rd) /* and if there is data to be sent    */
@@ -551,6 +659,20 @@ void USBD_CDC_ACM_SOF_Event(void)
 }
 
 
+/** \brief  Handle SOF Events
+
+    The function handles Start Of Frame events. Data passed through
+    USBD_CDC_ACM_DataSendCommit and USBD_CDC_ACM_DataReadCommit is moved
+    right away, this catches anything else.
+ */
+
+void USBD_CDC_ACM_SOF_Event(void)
+{
+    USBD_CDC_ACM_ReceiveProcess();
+    USBD_CDC_ACM_SendStart();
+}
+
+
 /** \brief  Handle Interrupt In Endpoint Events
 
     The function handles Interrupt In endpoint events.
@@ -40,7 +40,7 @@
 static volatile uint8_t  USB_ResponseIdle;
 static DAP_queue DAP_Cmd_queue;
 
-void hid_send_packet()
+BOOL hid_send_packet()
 {
     uint8_t * sbuf;
     int slen;
@@ -49,15 +49,25 @@ void hid_send_packet()
             util_assert(0);
         }else {
             usbd_hid_get_report_trigger(0, sbuf, USBD_HID_OUTREPORT_MAX_SZ);
+            return (__TRUE);
         }
     }
+    return (__FALSE);
+}
+
+// DAP_queue Callback: when a response is ready to be sent
+static void hid_send_response(void)
+{
+    if (USB_ResponseIdle && hid_send_packet()) {
+        USB_ResponseIdle = 0;
+    }
 }
 
 // USB HID Callback: when system initializes
 void usbd_hid_init(void)
 {
     USB_ResponseIdle = 1;
-    DAP_queue_init(&DAP_Cmd_queue);
+    DAP_queue_init(&DAP_Cmd_queue, hid_send_response);
 }
 
 // USB HID Callback: when data needs to be prepared for the host
@@ -98,7 +108,6 @@ int usbd_hid_get_report(U8 rtype, U8 rid, U8 *buf, U8 req)
 // USB HID Callback: when data is received from the host
 void usbd_hid_set_report(U8 rtype, U8 rid, U8 *buf, int len, U8 req)
 {
-    uint8_t * rbuf;
     switch (rtype) {
         case HID_REPORT_OUTPUT:
             if (len == 0) {
@@ -110,12 +119,9 @@ void usbd_hid_set_report(U8 rtype, U8 rid, U8 *buf, int len, U8 req)
                 break;
             }
 
-            // execute and store to DAP_queue
-            if (DAP_queue_execute_buf(&DAP_Cmd_queue, buf, len, &rbuf)) {
-                if (USB_ResponseIdle) {
-                    hid_send_packet();
-                    USB_ResponseIdle = 0;
-                }
+            // store to DAP_queue, the DAP thread executes it and sends the response
+            if (DAP_queue_submit_buf(&DAP_Cmd_queue, buf, len)) {
+                hid_send_response();
             } else {
                 util_assert(0);
             }
@@ -45,6 +45,7 @@ U32 Length;     /* R/W Length */
 
 U8 BulkStage;   /* Bulk Stage */
 U32 BulkLen;    /* Bulk In/Out Length */
+BOOL BulkDirect;    /* Bulk Out data received straight into Block Buffer */
 
 
 /* Dummy Weak Functions that need to be provided by user */
@@ -63,6 +64,10 @@ __WEAK void usbd_msc_write_sect(U32 block, U8 *buf, U32 num_of_blocks)
 __WEAK void usbd_msc_start_stop(BOOL start)
 {
 
+}
+__WEAK void usbd_msc_sync_cache(void)
+{
+
 }
 
 
@@ -249,14 +254,14 @@ void USBD_MSC_MemoryWrite(void)
         BulkLen = 0;
     }
 
-    if (Offset + BulkLen > USBD_MSC_BlockSize) {
+    if (Offset + BulkLen > USBD_MSC_BlockGroup * USBD_MSC_BlockSize) {
         // This write would have overflowed USBD_MSC_BlockBuf
         util_assert(0);
         return;
     }
 
-    for (n = 0; n < BulkLen; n++) {
-        USBD_MSC_BlockBuf[Offset + n] = USBD_MSC_BulkBuf[n];
+    if (!BulkDirect) {
+        memcpy(&USBD_MSC_BlockBuf[Offset], USBD_MSC_BulkBuf, BulkLen);
     }
 
     Offset += BulkLen;
@@ -326,11 +331,8 @@ void USBD_MSC_MemoryVerify(void)
             usbd_msc_read_sect(Block, USBD_MSC_BlockBuf, n);
         }
 
-        for (n = 0; n < BulkLen; n++) {
-            if (USBD_MSC_BlockBuf[Offset + n] != USBD_MSC_BulkBuf[n]) {
-                MemOK = __FALSE;
-                break;
-            }
+        if (memcmp(&USBD_MSC_BlockBuf[Offset], USBD_MSC_BulkBuf, BulkLen) != 0) {
+            MemOK = __FALSE;
         }
     }
 
@@ -781,7 +783,8 @@ void USBD_MSC_ReadFormatCapacity(void)
 void USBD_MSC_SynchronizeCache(void)
 {
     /* Synchronize check always passes as we always write data dirrectly
-       so cache is always synchronized                                          */
+       so cache is always synchronized, the user is only told of the flush      */
+    usbd_msc_sync_cache();
     USBD_MSC_CSW.bStatus = CSW_CMD_PASSED;
     USBD_MSC_SetCSW();
 }
@@ -1137,7 +1140,22 @@ void USBD_MSC_EP_BULKIN_Event(U32 event)
 
 void USBD_MSC_EP_BULKOUT_Event(U32 event)
 {
-    BulkLen = USBD_ReadEP(usbd_msc_ep_bulkout, USBD_MSC_BulkBuf, USBD_MSC_BulkBufSize);
+    U32 space = USBD_MSC_BlockGroup * USBD_MSC_BlockSize - Offset;
+
+    /* Write data goes straight into the Block Buffer when a whole packet fits,
+       saving the copy out of the Bulk Buffer */
+    BulkDirect = (BulkStage == MSC_BS_DATA_OUT) &&
+                 ((USBD_MSC_CBW.CB[0] == SCSI_WRITE10) || (USBD_MSC_CBW.CB[0] == SCSI_WRITE12)) &&
+                 USBD_MSC_MediaReady && (Block < USBD_MSC_BlockCount) &&
+                 (Offset < USBD_MSC_BlockGroup * USBD_MSC_BlockSize) &&
+                 (space >= usbd_msc_maxpacketsize[USBD_HighSpeed]);
+
+    if (BulkDirect) {
+        BulkLen = USBD_ReadEP(usbd_msc_ep_bulkout, &USBD_MSC_BlockBuf[Offset], space);
+    } else {
+        BulkLen = USBD_ReadEP(usbd_msc_ep_bulkout, USBD_MSC_BulkBuf, USBD_MSC_BulkBufSize);
+    }
+
     USBD_MSC_BulkOut();
 }
 
@@ -50,6 +50,7 @@ extern void  usbd_msc_init(void);
 extern void  usbd_msc_read_sect(U32 block, U8 *buf, U32 num_of_blocks);
 extern void  usbd_msc_write_sect(U32 block, U8 *buf, U32 num_of_blocks);
 extern void  usbd_msc_start_stop(BOOL start);
+extern void  usbd_msc_sync_cache(void);
 
 /* USB Device user functions imported to USB Audio Class module               */
 extern void  usbd_adc_init(void);
@@ -67,10 +68,14 @@ extern int32_t  USBD_CDC_ACM_PortGetLineCoding(CDC_LINE_CODING *line_coding);
 extern int32_t  USBD_CDC_ACM_PortSetControlLineState(uint16_t ctrl_bmp);
 extern int32_t  USBD_CDC_ACM_DataSend(const uint8_t *buf, int32_t len);
 extern int32_t  USBD_CDC_ACM_DataFree(void);
+extern int32_t  USBD_CDC_ACM_DataSendBuf(uint8_t **buf);
+extern int32_t  USBD_CDC_ACM_DataSendCommit(int32_t len);
 extern int32_t  USBD_CDC_ACM_PutChar(const uint8_t  ch);
 extern int32_t  USBD_CDC_ACM_DataRead(uint8_t *buf, int32_t len);
 extern int32_t  USBD_CDC_ACM_GetChar(void);
 extern int32_t  USBD_CDC_ACM_DataAvailable(void);
+extern int32_t  USBD_CDC_ACM_DataReadBuf(uint8_t **buf);
+extern int32_t  USBD_CDC_ACM_DataReadCommit(int32_t len);
 extern int32_t  USBD_CDC_ACM_Notify(uint16_t stat);
 /* USB Device CDC ACM class overridable functions                             */
 extern int32_t  USBD_CDC_ACM_SendEncapsulatedCommand(void);
@@ -27,6 +27,9 @@
 extern void USBD_BULK_EP_BULKIN_Event(U32 event);
 extern void USBD_BULK_EP_BULKOUT_Event(U32 event);
 extern void USBD_BULK_EP_BULK_Event(U32 event);
+extern void USBD_BULK_EP_BULKIN_SWO_Event(U32 event);
+extern void USBD_BULK_SWO_Reset_Event(void);
+extern void USBD_BULK_SWO_Send_Event(void);
 
 
 #endif  /* __USBD_BULK_H__ */
@@ -43,6 +43,20 @@
 
 #if    (USBD_ENABLE)
 
+#if    (USBD_BULK_ENABLE)
+#include "DAP_config.h"
+#endif
+
+// The bulk interface gets a second IN endpoint for streaming SWO trace
+#if    (USBD_BULK_ENABLE) && (SWO_STREAM != 0)
+#define USBD_BULK_SWO_ENABLE          1
+#ifndef USBD_BULK_EP_BULKIN_SWO
+#error "SWO streaming requires USBD_BULK_EP_BULKIN_SWO"
+#endif
+#else
+#define USBD_BULK_SWO_ENABLE          0
+#endif
+
 U8 USBD_AltSetting[USBD_IF_NUM_MAX];
 U8 USBD_EP0Buf[USBD_MAX_PACKET0];
 const U8 usbd_power = USBD_POWER;
@@ -150,6 +164,9 @@ const U8 usbd_winusb_vendor_code;
 U8 usbd_bulk_if_num  = 0; //assigned during runtime init
 const U8 usbd_bulk_ep_bulkin = USBD_BULK_EP_BULKIN;
 const U8 usbd_bulk_ep_bulkout = USBD_BULK_EP_BULKOUT;
+#if    (USBD_BULK_SWO_ENABLE)
+const U8 usbd_bulk_ep_bulkin_swo = USBD_BULK_EP_BULKIN_SWO;
+#endif
 const U16 usbd_bulk_maxpacketsize[2] = {USBD_BULK_WMAXPACKETSIZE, USBD_BULK_HS_WMAXPACKETSIZE};
 const U16 USBD_Bulk_BulkBufSize = USBD_BULK_MAX_PACKET;
 U8 USBD_Bulk_BulkInBuf[USBD_BULK_MAX_PACKET];
@@ -1024,6 +1041,40 @@ BOOL USBD_EndPoint0_Out_CDC_ReqToIF(void)
 #endif
 #endif
 
+#if    (USBD_BULK_SWO_ENABLE)
+#if    (USBD_BULK_EP_BULKIN_SWO == 1)
+#define USBD_EndPoint1                 USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 2)
+#define USBD_EndPoint2                 USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 3)
+#define USBD_EndPoint3                 USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 4)
+#define USBD_EndPoint4                 USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 5)
+#define USBD_EndPoint5                 USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 6)
+#define USBD_EndPoint6                 USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 7)
+#define USBD_EndPoint7                 USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 8)
+#define USBD_EndPoint8                 USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 9)
+#define USBD_EndPoint9                 USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 10)
+#define USBD_EndPoint10                USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 11)
+#define USBD_EndPoint11                USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 12)
+#define USBD_EndPoint12                USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 13)
+#define USBD_EndPoint13                USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 14)
+#define USBD_EndPoint14                USBD_BULK_EP_BULKIN_SWO_Event
+#elif  (USBD_BULK_EP_BULKIN_SWO == 15)
+#define USBD_EndPoint15                USBD_BULK_EP_BULKIN_SWO_Event
+#endif
+#endif
+
 #endif  /* (USBD_BULK_ENABLE) */
 
 #if    (USBD_CLS_ENABLE)
@@ -1064,6 +1115,9 @@ __WEAK void USBD_Reset_Event(void)
 #if    (USBD_MSC_ENABLE)
     USBD_MSC_Reset_Event();
 #endif
+#if    (USBD_BULK_SWO_ENABLE)
+    USBD_BULK_SWO_Reset_Event();
+#endif
 }
 #endif
 #endif  /* ((USBD_CDC_ACM_ENABLE)) */
@@ -1589,7 +1643,7 @@ void USBD_RTX_TaskInit(void)
                                            USB_INTERFACE_DESC_SIZE + USB_ENDPOINT_DESC_SIZE + USB_ENDPOINT_DESC_SIZE)
 #define USBD_HID_DESC_LEN                 (USB_INTERFACE_DESC_SIZE + USB_HID_DESC_SIZE                                                          + \
                                           (USB_ENDPOINT_DESC_SIZE*((USBD_HID_EP_INTIN != 0)+(USBD_HID_EP_INTOUT != 0))))
-#define USBD_BULK_DESC_LEN                (USB_INTERFACE_DESC_SIZE + 2*USB_ENDPOINT_DESC_SIZE)
+#define USBD_BULK_DESC_LEN                (USB_INTERFACE_DESC_SIZE + (2+USBD_BULK_SWO_ENABLE)*USB_ENDPOINT_DESC_SIZE)
 
 #define USBD_HID_DESC_OFS                 (USB_CONFIGUARTION_DESC_SIZE + USB_INTERFACE_DESC_SIZE                                                + \
                                            USBD_MSC_ENABLE * USBD_MSC_DESC_LEN + USBD_CDC_ACM_ENABLE * USBD_CDC_ACM_DESC_LEN)
@@ -2030,7 +2084,7 @@ const U8 USBD_BinaryObjectStoreDescriptor[] = { 0 };
   USB_INTERFACE_DESCRIPTOR_TYPE,        /* bDescriptorType */                                               \
   0x00,                                 /* bInterfaceNumber USBD_BULK_IF_NUM*/                             \
   0x00,                                 /* bAlternateSetting */                                             \
-  0x02,                                 /* bNumEndpoints */                                                 \
+  (0x02+USBD_BULK_SWO_ENABLE),          /* bNumEndpoints */                                                 \
   USB_DEVICE_CLASS_VENDOR_SPECIFIC,     /* bInterfaceClass */                                               \
   0x00,                                 /* bInterfaceSubClass */                                            \
   0x00,                                 /* bInterfaceProtocol */                                            \
@@ -2070,6 +2124,24 @@ const U8 USBD_BinaryObjectStoreDescriptor[] = { 0 };
   WBVAL(USBD_BULK_HS_WMAXPACKETSIZE),       /* wMaxPacketSize */                                                \
   0x00,                                 /* bInterval: ignore for Bulk transfer */
 
+#define BULK_SWO_EP                      /* SWO Endpoint for Low-speed/Full-speed */                         \
+/* Endpoint, EP Bulk IN */                                                                                  \
+  USB_ENDPOINT_DESC_SIZE,               /* bLength */                                                       \
+  USB_ENDPOINT_DESCRIPTOR_TYPE,         /* bDescriptorType */                                               \
+  USB_ENDPOINT_IN(USBD_BULK_EP_BULKIN_SWO),/* bEndpointAddress */                                           \
+  USB_ENDPOINT_TYPE_BULK,               /* bmAttributes */                                                  \
+  WBVAL(USBD_BULK_WMAXPACKETSIZE),       /* wMaxPacketSize */                                                \
+  0x00,                                 /* bInterval: ignore for Bulk transfer */
+
+#define BULK_SWO_EP_HS                   /* SWO Endpoint for High-speed */                                   \
+/* Endpoint, EP Bulk IN */                                                                                  \
+  USB_ENDPOINT_DESC_SIZE,               /* bLength */                                                       \
+  USB_ENDPOINT_DESCRIPTOR_TYPE,         /* bDescriptorType */                                               \
+  USB_ENDPOINT_IN(USBD_BULK_EP_BULKIN_SWO),/* bEndpointAddress */                                           \
+  USB_ENDPOINT_TYPE_BULK,               /* bmAttributes */                                                  \
+  WBVAL(USBD_BULK_HS_WMAXPACKETSIZE),       /* wMaxPacketSize */                                                \
+  0x00,                                 /* bInterval: ignore for Bulk transfer */
+
 #define ADC_DESC_IAD(first,num_of_ifs)  /* ADC: Interface Association Descriptor */                         \
   USB_INTERFACE_ASSOC_DESC_SIZE,        /* bLength */                                                       \
   USB_INTERFACE_ASSOCIATION_DESCRIPTOR_TYPE,  /* bDescriptorType */                                         \
@@ -2647,6 +2719,9 @@ static U16 bulk_desc_fill(U8 * config_desc, U8 * config_desc_hs, U8 if_num) {
     const U8 bulk_desc[] = {
         BULK_DESC
         BULK_EP
+#if (USBD_BULK_SWO_ENABLE)
+        BULK_SWO_EP
+#endif
     };
     pD = config_desc;
     memcpy(pD, bulk_desc, sizeof(bulk_desc));
@@ -2655,6 +2730,9 @@ static U16 bulk_desc_fill(U8 * config_desc, U8 * config_desc_hs, U8 if_num) {
     const U8 bulk_desc_hs[] = {
         BULK_DESC
         BULK_EP_HS
+#if (USBD_BULK_SWO_ENABLE)
+        BULK_SWO_EP_HS
+#endif
     };
      pD = config_desc_hs;
     memcpy(pD, bulk_desc_hs, sizeof(bulk_desc_hs));
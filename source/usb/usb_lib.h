@@ -101,6 +101,7 @@ extern const U8 usbd_bulk_enable;
 extern U8 usbd_bulk_if_num;
 extern const U8 usbd_bulk_ep_bulkin;
 extern const U8 usbd_bulk_ep_bulkout;
+extern const U8 usbd_bulk_ep_bulkin_swo;
 extern const U16 usbd_bulk_maxpacketsize[2];
 extern const U16 USBD_Bulk_BulkBufSize;
 extern       U8 USBD_Bulk_BulkInBuf[];
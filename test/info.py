@@ -105,6 +105,8 @@ PROJECT_RELEASE_INFO = [
     ('lpc4322_if',                                  False,      0x0000,     "bin"       ),
     ('lpc55s69_if',                                 False,      0x10000,    "bin"       ),
     ('lpc55s69_mculink_if',                         False,      0x10000,    "bin"       ),
+    ('lpc55s69_bulk_if',                            False,      0x10000,    "bin"       ),
+    ('lpc55s69_mculink_bulk_if',                    False,      0x10000,    "bin"       ),
     ('max32620_if',                                 False,      0x0000,     "bin"       ),
     ('max32625_if',                                 False,      0x0000,     "bin"       ),
     ('nrf52820_if',                                 False,      0x0000,     "bin"       ),
@@ -242,6 +244,7 @@ SUPPORTED_CONFIGURATIONS = [
     (   0x0000,     VENDOR_TO_FAMILY('Stub', 1),        'lpc11u35_if',                              None,               None                                    ),
     (   0x0000,     VENDOR_TO_FAMILY('Stub', 1),        'lpc4322_if',                               None,               None                                    ),
     (   0x0000,     VENDOR_TO_FAMILY('Stub', 1),        'lpc55s69_if',                              None,               None                                    ),
+    (   0x0000,     VENDOR_TO_FAMILY('Stub', 1),        'lpc55s69_bulk_if',                         None,               None                                    ),
     (   0x0000,     VENDOR_TO_FAMILY('Stub', 1),        'max32620_if',                              None,               None                                    ),
     (   0x0000,     VENDOR_TO_FAMILY('Stub', 1),        'max32625_if',                              None,               None                                    ),
     (   0x0000,     VENDOR_TO_FAMILY('Stub', 1),        'nrf52820_if',                              None,               None                                    ),
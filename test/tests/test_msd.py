@@ -21,6 +21,7 @@ from __future__ import division
 import os
 import time
 import shutil
+import struct
 import six
 import info
 import intelhex
@@ -41,6 +42,31 @@ def _same(d1, d2):
     return True
 
 
+def _bin_to_srec(data, start):
+    """Convert a binary image to S3 records"""
+    srec = bytearray()
+    for offset in range(0, len(data), 32):
+        chunk = data[offset:offset + 32]
+        record = bytearray(struct.pack('>BI', len(chunk) + 5, start + offset)) + chunk
+        record.append(~sum(record) & 0xFF)
+        srec += b'S3' + bytearray(''.join('%02X' % b for b in record).encode()) + b'\r\n'
+    record = bytearray(struct.pack('>BI', 5, start))
+    record.append(~sum(record) & 0xFF)
+    srec += b'S7' + bytearray(''.join('%02X' % b for b in record).encode()) + b'\r\n'
+    return srec
+
+
+def _bin_to_elf(data, start):
+    """Wrap a binary image in an ELF executable with one PT_LOAD segment"""
+    segment_offset = 0x100
+    elf = bytearray(b'\x7fELF\x01\x01\x01' + b'\x00' * 9)
+    elf += struct.pack('<HHIIIIIHHHHHH', 2, 40, 1, start, 52, 0, 0, 52, 32, 1, 40, 0, 0)
+    elf += struct.pack('<IIIIIIII', 1, segment_offset, start, start, len(data), len(data), 5, 4)
+    elf += bytearray(segment_offset - len(elf))
+    elf += data
+    return elf
+
+
 MOCK_DIR_LIST = [
     "test",
     "blarg",
@@ -380,6 +406,22 @@ def test_mass_storage(workspace, parent_test, quick=False):
         test.set_flush_size(0x1000)
         test.run()
 
+    # Test loading an S-record file with flushes
+    if not quick:
+        test = MassStorageTester(board, test_info, "Load srec with flushes")
+        test.set_programming_data(_bin_to_srec(bin_file_contents, start), 'image.srec')
+        test.set_expected_data(bin_file_contents, start)
+        test.set_flush_size(0x1000)
+        test.run()
+
+    # Test loading an ELF file with flushes
+    if not quick:
+        test = MassStorageTester(board, test_info, "Load elf with flushes")
+        test.set_programming_data(_bin_to_elf(bin_file_contents, start), 'image.elf')
+        test.set_expected_data(bin_file_contents, start)
+        test.set_flush_size(0x1000)
+        test.run()
+
     # Test loading a binary smaller than a sector
     if not bad_vector_table and not quick:
         test = MassStorageTester(board, test_info, "Load .bin smaller than sector")
@@ -0,0 +1,51 @@
+/**
+ * @file    device.h
+ * @brief   Host stand-in for the HIC device header
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include "cmsis_compiler.h"
+
+// The tests run as a single thread outside any interrupt
+__STATIC_FORCEINLINE uint32_t __get_PRIMASK(void)
+{
+    return 0;
+}
+
+__STATIC_FORCEINLINE void __set_PRIMASK(uint32_t primask)
+{
+    (void)primask;
+}
+
+__STATIC_FORCEINLINE void __disable_irq(void)
+{
+}
+
+__STATIC_FORCEINLINE void __enable_irq(void)
+{
+}
+
+__STATIC_FORCEINLINE uint32_t __get_xPSR(void)
+{
+    return 0;
+}
+
+#endif
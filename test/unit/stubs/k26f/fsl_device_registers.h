@@ -0,0 +1,67 @@
+/**
+ * @file    fsl_device_registers.h
+ * @brief   Host stand-in for the k26f registers crc.c uses
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FSL_DEVICE_REGISTERS_H
+#define FSL_DEVICE_REGISTERS_H
+
+#include <stdint.h>
+#include "cmsis_compiler.h"
+#include "model_register.h"
+
+// The registers are model_register, the test plays the CRC module. Only
+// the registers crc.c touches are here.
+
+enum {
+    SIM_SCGC6_REG,
+    CRC_DATA_REG,
+    CRC_GPOLY_REG,
+    CRC_CTRL_REG,
+};
+
+#define SIM_SCGC6_CRC_MASK      (0x40000U)
+
+#define CRC_CTRL_TCRC_MASK      (0x1000000U)
+#define CRC_CTRL_WAS_MASK       (0x2000000U)
+#define CRC_CTRL_FXOR_MASK      (0x4000000U)
+#define CRC_CTRL_TOTR_SHIFT     (28U)
+#define CRC_CTRL_TOTR(x)        (((uint32_t)(x) << CRC_CTRL_TOTR_SHIFT) & 0x30000000U)
+#define CRC_CTRL_TOT_SHIFT      (30U)
+#define CRC_CTRL_TOT(x)         (((uint32_t)(x) << CRC_CTRL_TOT_SHIFT) & 0xC0000000U)
+
+#ifdef __cplusplus
+typedef struct {
+    model_register<SIM_SCGC6_REG> SCGC6;
+} SIM_Type;
+
+typedef struct {
+    model_register<CRC_DATA_REG> DATA;
+    model_register<CRC_GPOLY_REG> GPOLY;
+    model_register<CRC_CTRL_REG> CTRL;
+} CRC_Type;
+
+inline SIM_Type sim_regs;
+inline CRC_Type crc0_regs;
+
+#define SIM                     (&sim_regs)
+#define CRC0                    (&crc0_regs)
+#endif
+
+#endif
@@ -0,0 +1,105 @@
+/**
+ * @file    fsl_device_registers.h
+ * @brief   Host stand-in for the LPC55S69 registers used by uart.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FSL_DEVICE_REGISTERS_H
+#define FSL_DEVICE_REGISTERS_H
+
+#include <stdint.h>
+#include "cmsis_compiler.h"
+
+// The registers are plain memory defined by the test, which plays the
+// USART and DMA hardware and calls the interrupt handlers. Only the
+// registers uart.c touches are here, so the layouts differ from the part.
+
+typedef struct {
+    volatile uint32_t FIFOCFG;
+    volatile uint32_t FIFORD;
+} USART_Type;
+
+typedef struct {
+    volatile uint32_t CTRL;
+    volatile uint32_t SRAMBASE;
+    struct {
+        volatile uint32_t ENABLESET;
+        volatile uint32_t ENABLECLR;
+        volatile uint32_t BUSY;
+        volatile uint32_t INTENSET;
+        volatile uint32_t INTENCLR;
+        volatile uint32_t INTA;
+        volatile uint32_t INTB;
+        volatile uint32_t ABORT;
+    } COMMON[1];
+    struct {
+        volatile uint32_t CFG;
+        volatile uint32_t XFERCFG;
+    } CHANNEL[23];
+} DMA_Type;
+
+extern USART_Type usart0_regs;
+extern DMA_Type dma0_regs;
+
+#define USART0                  (&usart0_regs)
+#define DMA0                    (&dma0_regs)
+
+typedef enum {
+    DMA0_IRQn = 1,
+    FLEXCOMM0_IRQn = 14,
+} IRQn_Type;
+
+#define USART_FIFOCFG_ENABLERX_MASK             (0x2U)
+#define USART_FIFOCFG_DMARX_MASK                (0x2000U)
+
+#define DMA_CTRL_ENABLE_MASK                    (0x1U)
+#define DMA_CHANNEL_CFG_PERIPHREQEN_MASK        (0x1U)
+#define DMA_CHANNEL_XFERCFG_CFGVALID_MASK       (0x1U)
+#define DMA_CHANNEL_XFERCFG_RELOAD_MASK         (0x2U)
+#define DMA_CHANNEL_XFERCFG_SWTRIG_MASK         (0x4U)
+#define DMA_CHANNEL_XFERCFG_SETINTA_MASK        (0x10U)
+#define DMA_CHANNEL_XFERCFG_SETINTB_MASK        (0x20U)
+#define DMA_CHANNEL_XFERCFG_WIDTH(x)            (((uint32_t)(x) << 8) & 0x300U)
+#define DMA_CHANNEL_XFERCFG_SRCINC(x)           (((uint32_t)(x) << 12) & 0x3000U)
+#define DMA_CHANNEL_XFERCFG_DSTINC(x)           (((uint32_t)(x) << 14) & 0xC000U)
+#define DMA_CHANNEL_XFERCFG_XFERCOUNT_MASK      (0x3FF0000U)
+#define DMA_CHANNEL_XFERCFG_XFERCOUNT_SHIFT     (16U)
+#define DMA_CHANNEL_XFERCFG_XFERCOUNT(x)        (((uint32_t)(x) << 16) & 0x3FF0000U)
+
+// fsl_clock.h
+typedef enum {
+    kCLOCK_Dma0,
+} clock_ip_name_t;
+
+static inline void CLOCK_EnableClock(clock_ip_name_t clk)
+{
+}
+
+static inline void NVIC_EnableIRQ(IRQn_Type irq)
+{
+}
+
+static inline void NVIC_DisableIRQ(IRQn_Type irq)
+{
+}
+
+static inline void NVIC_ClearPendingIRQ(IRQn_Type irq)
+{
+}
+
+#endif
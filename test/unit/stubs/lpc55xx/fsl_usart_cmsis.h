@@ -0,0 +1,30 @@
+/**
+ * @file    fsl_usart_cmsis.h
+ * @brief   Host stand-in for the LPC55S69 CMSIS USART driver
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FSL_USART_CMSIS_H
+#define FSL_USART_CMSIS_H
+
+#include "Driver_USART.h"
+
+// Defined by the test, which records what uart.c asks of it
+extern ARM_DRIVER_USART Driver_USART0;
+
+#endif
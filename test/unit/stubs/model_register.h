@@ -0,0 +1,68 @@
+/**
+ * @file    model_register.h
+ * @brief   Registers whose accesses go to a model in the test
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MODEL_REGISTER_H
+#define MODEL_REGISTER_H
+
+#include <stdint.h>
+
+// Plain memory registers only show the test the last value written. For
+// a peripheral that acts on every write, such as a CRC engine, the
+// firmware source is built as C++ and its registers are model_register,
+// which hands each read and write to the test by register number.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t model_register_read(uint32_t reg);
+void model_register_write(uint32_t reg, uint32_t value);
+
+#ifdef __cplusplus
+}
+
+template <uint32_t reg>
+class model_register {
+public:
+    operator uint32_t() const
+    {
+        return model_register_read(reg);
+    }
+
+    model_register &operator=(uint32_t value)
+    {
+        model_register_write(reg, value);
+        return *this;
+    }
+
+    model_register &operator|=(uint32_t value)
+    {
+        return *this = model_register_read(reg) | value;
+    }
+
+    model_register &operator&=(uint32_t value)
+    {
+        return *this = model_register_read(reg) & value;
+    }
+};
+#endif
+
+#endif
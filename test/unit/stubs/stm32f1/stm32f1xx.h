@@ -0,0 +1,197 @@
+/**
+ * @file    stm32f1xx.h
+ * @brief   Host stand-in for the stm32f1 registers and HAL used by uart.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef STM32F1XX_H
+#define STM32F1XX_H
+
+#include <stdint.h>
+#include "cmsis_compiler.h"
+#include "model_register.h"
+
+// The registers are plain memory defined by the test, which plays the
+// USART and DMA hardware and calls the interrupt handlers. The CRC unit
+// acts on every write, so its registers are model_register and only
+// there when crc.c is built as C++.
+
+typedef struct {
+    volatile uint32_t SR;
+    volatile uint32_t DR;
+    volatile uint32_t BRR;
+    volatile uint32_t CR1;
+    volatile uint32_t CR2;
+    volatile uint32_t CR3;
+    volatile uint32_t GTPR;
+} USART_TypeDef;
+
+typedef struct {
+    volatile uint32_t ISR;
+    volatile uint32_t IFCR;
+} DMA_TypeDef;
+
+typedef struct {
+    volatile uint32_t CCR;
+    volatile uint32_t CNDTR;
+    volatile uint32_t CPAR;
+    volatile uint32_t CMAR;
+} DMA_Channel_TypeDef;
+
+typedef struct {
+    volatile uint32_t CRL;
+} GPIO_TypeDef;
+
+extern USART_TypeDef usart2_regs;
+extern DMA_TypeDef dma1_regs;
+extern DMA_Channel_TypeDef dma1_channel6_regs;
+extern GPIO_TypeDef gpioa_regs;
+
+#define USART2                  (&usart2_regs)
+#define DMA1                    (&dma1_regs)
+#define DMA1_Channel6           (&dma1_channel6_regs)
+#define GPIOA                   (&gpioa_regs)
+
+typedef enum {
+    DMA1_Channel6_IRQn = 16,
+    USART2_IRQn = 38,
+} IRQn_Type;
+
+#define USART_SR_IDLE           (1U << 4)
+#define USART_SR_TXE            (1U << 7)
+#define USART_CR1_IDLEIE        (1U << 4)
+#define USART_IT_TXE            (1U << 7)
+#define USART_CR3_DMAR          (1U << 6)
+
+#define DMA_CCR_EN              (1U << 0)
+#define DMA_CCR_TCIE            (1U << 1)
+#define DMA_CCR_HTIE            (1U << 2)
+#define DMA_CCR_CIRC            (1U << 5)
+#define DMA_CCR_MINC            (1U << 7)
+#define DMA_ISR_GIF6            (1U << 20)
+#define DMA_ISR_TCIF6           (1U << 21)
+#define DMA_ISR_HTIF6           (1U << 22)
+#define DMA_IFCR_CGIF6          (1U << 20)
+
+enum {
+    RCC_AHBENR_REG,
+    CRC_DR_REG,
+    CRC_CR_REG,
+};
+
+#define RCC_AHBENR_CRCEN        (1U << 6)
+#define CRC_CR_RESET            (1U << 0)
+
+#ifdef __cplusplus
+typedef struct {
+    model_register<RCC_AHBENR_REG> AHBENR;
+} RCC_TypeDef;
+
+typedef struct {
+    model_register<CRC_DR_REG> DR;
+    model_register<CRC_CR_REG> CR;
+} CRC_TypeDef;
+
+inline RCC_TypeDef rcc_regs;
+inline CRC_TypeDef crc_regs;
+
+#define RCC                     (&rcc_regs)
+#define CRC                     (&crc_regs)
+#endif
+
+#define __HAL_RCC_USART2_CLK_ENABLE()
+#define __HAL_RCC_USART2_CLK_DISABLE()
+#define __HAL_RCC_DMA1_CLK_ENABLE()
+#define __HAL_RCC_GPIOA_CLK_ENABLE()
+#define __HAL_RCC_GPIOA_CLK_DISABLE()
+
+typedef enum {
+    HAL_OK = 0,
+    HAL_ERROR,
+} HAL_StatusTypeDef;
+
+#define GPIO_PIN_0              (1U << 0)
+#define GPIO_PIN_1              (1U << 1)
+#define GPIO_PIN_2              (1U << 2)
+#define GPIO_PIN_3              (1U << 3)
+#define GPIO_MODE_INPUT         0U
+#define GPIO_MODE_OUTPUT_PP     1U
+#define GPIO_MODE_AF_PP         2U
+#define GPIO_PULLUP             1U
+#define GPIO_SPEED_FREQ_HIGH    3U
+
+typedef enum {
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET,
+} GPIO_PinState;
+
+typedef struct {
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+} GPIO_InitTypeDef;
+
+#define HAL_UART_PARITY_NONE    0U
+#define HAL_UART_PARITY_EVEN    1U
+#define HAL_UART_PARITY_ODD     2U
+#define UART_STOPBITS_1         0U
+#define UART_STOPBITS_2         1U
+#define UART_WORDLENGTH_8B      0U
+#define UART_WORDLENGTH_9B      1U
+#define UART_HWCONTROL_NONE     0U
+#define UART_MODE_TX_RX         3U
+
+typedef struct {
+    uint32_t BaudRate;
+    uint32_t WordLength;
+    uint32_t StopBits;
+    uint32_t Parity;
+    uint32_t Mode;
+    uint32_t HwFlowCtl;
+} UART_InitTypeDef;
+
+typedef struct {
+    USART_TypeDef *Instance;
+    UART_InitTypeDef Init;
+} UART_HandleTypeDef;
+
+static inline void NVIC_EnableIRQ(IRQn_Type irq)
+{
+}
+
+static inline void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init)
+{
+}
+
+static inline void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint32_t pin, GPIO_PinState state)
+{
+}
+
+static inline HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *handle)
+{
+    return HAL_OK;
+}
+
+static inline HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *handle)
+{
+    handle->Instance->BRR = handle->Init.BaudRate;
+    return HAL_OK;
+}
+
+#endif
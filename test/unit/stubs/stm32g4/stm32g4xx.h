@@ -0,0 +1,66 @@
+/**
+ * @file    stm32g4xx.h
+ * @brief   Host stand-in for the stm32g431xb registers crc.c uses
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef STM32G4XX_H
+#define STM32G4XX_H
+
+#include <stdint.h>
+#include "cmsis_compiler.h"
+#include "model_register.h"
+
+// The registers are model_register, the test plays the CRC calculation
+// unit. Only the registers crc.c touches are here.
+
+enum {
+    RCC_AHB1ENR_REG,
+    CRC_DR_REG,
+    CRC_CR_REG,
+    CRC_INIT_REG,
+    CRC_POL_REG,
+};
+
+#define RCC_AHB1ENR_CRCEN       (1U << 12)
+
+#define CRC_CR_RESET            (1U << 0)
+#define CRC_CR_POLYSIZE         (3U << 3)
+#define CRC_CR_REV_IN           (3U << 5)
+#define CRC_CR_REV_OUT          (1U << 7)
+
+#ifdef __cplusplus
+typedef struct {
+    model_register<RCC_AHB1ENR_REG> AHB1ENR;
+} RCC_TypeDef;
+
+typedef struct {
+    model_register<CRC_DR_REG> DR;
+    model_register<CRC_CR_REG> CR;
+    model_register<CRC_INIT_REG> INIT;
+    model_register<CRC_POL_REG> POL;
+} CRC_TypeDef;
+
+inline RCC_TypeDef rcc_regs;
+inline CRC_TypeDef crc_regs;
+
+#define RCC                     (&rcc_regs)
+#define CRC                     (&crc_regs)
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ * @file    DAP_config.h
+ * @brief   Host stand-in for the HIC DAP configuration, with modelled pins
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DAP_CONFIG_H__
+#define __DAP_CONFIG_H__
+
+#include <stdint.h>
+
+// SW_DP.c drives the pins below; the test behind them records the wire
+// and plays the target
+
+#define CPU_CLOCK               72000000U
+#define IO_PORT_WRITE_CYCLES    2U
+#define DAP_SWD                 1
+#define DAP_JTAG                0
+#define DAP_JTAG_DEV_CNT        8U
+#define DAP_DEFAULT_PORT        1U
+#define DAP_DEFAULT_SWJ_CLOCK   5000000U
+#define DAP_PACKET_SIZE         64U
+#define DAP_PACKET_COUNT        4U
+#define SWO_UART                0
+#define SWO_MANCHESTER          0
+#define SWO_STREAM              0
+#define TIMESTAMP_CLOCK         0U
+
+#ifndef DAP_SWD_SPI
+#define DAP_SWD_SPI             0
+#endif
+
+#ifndef DAP_SWD_UNROLLED
+#define DAP_SWD_UNROLLED        0
+#endif
+
+extern void     pin_swclk(uint32_t level);
+extern void     pin_swdio_out(uint32_t bit);
+extern void     pin_swdio_oe(uint32_t enable);
+extern uint32_t pin_swdio_in(void);
+extern uint32_t pin_timestamp(void);
+
+static inline void PIN_SWCLK_TCK_SET(void)
+{
+    pin_swclk(1U);
+}
+
+static inline void PIN_SWCLK_TCK_CLR(void)
+{
+    pin_swclk(0U);
+}
+
+static inline void PIN_SWDIO_TMS_SET(void)
+{
+    pin_swdio_out(1U);
+}
+
+static inline void PIN_SWDIO_TMS_CLR(void)
+{
+    pin_swdio_out(0U);
+}
+
+static inline uint32_t PIN_SWDIO_IN(void)
+{
+    return pin_swdio_in();
+}
+
+static inline void PIN_SWDIO_OUT(uint32_t bit)
+{
+    pin_swdio_out(bit & 1U);
+}
+
+static inline void PIN_SWDIO_OUT_ENABLE(void)
+{
+    pin_swdio_oe(1U);
+}
+
+static inline void PIN_SWDIO_OUT_DISABLE(void)
+{
+    pin_swdio_oe(0U);
+}
+
+static inline uint32_t TIMESTAMP_GET(void)
+{
+    return pin_timestamp();
+}
+
+#endif
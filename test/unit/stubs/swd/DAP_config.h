@@ -0,0 +1,58 @@
+/**
+ * @file    DAP_config.h
+ * @brief   Host stand-in for the HIC DAP configuration, with no pins
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DAP_CONFIG_H__
+#define __DAP_CONFIG_H__
+
+#include <stdint.h>
+
+// Tests that use this header provide SWD_Transfer() and SWJ_Sequence()
+// themselves, so only the port control used by swd_host.c is needed
+
+#define CPU_CLOCK               72000000U
+#define IO_PORT_WRITE_CYCLES    2U
+#define DAP_SWD                 1
+#define DAP_JTAG                0
+#define DAP_JTAG_DEV_CNT        8U
+#define DAP_DEFAULT_PORT        1U
+#define DAP_DEFAULT_SWJ_CLOCK   5000000U
+#define DAP_PACKET_SIZE         64U
+#define DAP_PACKET_COUNT        4U
+#define SWO_UART                0
+#define SWO_MANCHESTER          0
+#define SWO_STREAM              0
+#define TIMESTAMP_CLOCK         0U
+
+#ifdef SWD_PORT_MODEL
+// The test keeps track of whether the pins are driven
+void PORT_SWD_SETUP(void);
+void PORT_OFF(void);
+#else
+static inline void PORT_SWD_SETUP(void)
+{
+}
+
+static inline void PORT_OFF(void)
+{
+}
+#endif
+
+#endif
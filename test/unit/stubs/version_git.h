@@ -0,0 +1,29 @@
+/**
+ * @file    version_git.h
+ * @brief   Host stand-in for the header generated from git
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VERSION_GIT_H
+#define VERSION_GIT_H
+
+#define GIT_DESCRIPTION         "unit test"
+#define GIT_COMMIT_SHA          "0000000000000000000000000000000000000000"
+#define GIT_LOCAL_MODS          0
+
+#endif
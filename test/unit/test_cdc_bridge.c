@@ -0,0 +1,439 @@
+/**
+ * @file    test_cdc_bridge.c
+ * @brief   Host tests for the UART to CDC bridge in usbd_user_cdc_acm.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unit_test.h"
+#include "util.h"
+#include "rl_usb.h"
+#include "usb_for_lib.h"
+#include "usbd_cdc_acm.h"
+#include "uart.h"
+#include "main_interface.h"
+#include "target_family.h"
+#include "cmsis_os2.h"
+
+// The stm32f103xb configuration: 16 byte packets, 64 byte CDC buffers and
+// a 512 byte UART ring each way
+#define MAX_PACKET          16
+#define CDC_BUF_SIZE        64
+#define UART_BUF_SIZE       512
+
+#define LOOP_NS             20000       // main task pass while CDC events keep coming
+#define SOF_NS              1000000
+#define PACKET_NS(len)      (12000 + (len) * 667)   // a full speed bulk transaction
+#define STREAM_MAX          (256 * 1024)
+
+// USB device state owned by usbd_core.c and usb_lib.c in the firmware
+U8 USBD_EP0Buf[64];
+U8 USBD_Configuration = 1;
+U8 USBD_HighSpeed;
+const U8 usbd_cdc_acm_ep_intin = 3;
+const U8 usbd_cdc_acm_ep_bulkin = 4;
+const U8 usbd_cdc_acm_ep_bulkout = 4;
+const U16 usbd_cdc_acm_sendbuf_sz = CDC_BUF_SIZE;
+const U16 usbd_cdc_acm_receivebuf_sz = CDC_BUF_SIZE;
+const U16 usbd_cdc_acm_maxpacketsize[2] = {16, 16};
+const U16 usbd_cdc_acm_maxpacketsize1[2] = {MAX_PACKET, MAX_PACKET};
+U8 USBD_CDC_ACM_SendBuf[CDC_BUF_SIZE];
+U8 USBD_CDC_ACM_ReceiveBuf[CDC_BUF_SIZE];
+U8 USBD_CDC_ACM_NotifyBuf[10];
+
+extern void cdc_process_event(void);
+
+static uint64_t now_ns;
+
+// The host: bytes it still has to send, the OUT packet sitting in the
+// endpoint, the IN packet armed by the device, and what came back
+static struct {
+    uint32_t out_left;
+    uint32_t out_seq;
+    uint64_t out_next_ns;
+    uint8_t out_packet[MAX_PACKET];
+    uint32_t out_size;
+    bool out_full;
+    uint8_t in_packet[MAX_PACKET];
+    uint32_t in_size;
+    bool in_armed;
+    uint64_t in_done_ns;
+    uint32_t received;
+    uint32_t misordered;
+    uint32_t packets;
+    uint64_t last_ns;
+} host;
+
+// The UART: a TX ring drained onto the line, a line that either loops TX
+// back or carries a log from the target, and an RX ring the bridge reads.
+// Bytes on the line are numbered so the host can check their order.
+static struct {
+    uint32_t baud;
+    uint8_t tx[UART_BUF_SIZE];
+    uint64_t tx_ns[UART_BUF_SIZE];
+    uint32_t tx_head;
+    uint32_t tx_count;
+    uint8_t rx[UART_BUF_SIZE];
+    uint32_t rx_head;
+    uint32_t rx_count;
+    uint32_t rx_lost;
+    uint64_t line_end_ns;
+    uint32_t log_left;
+    uint32_t log_seq;
+    uint32_t line_bytes;
+} uart;
+
+// When each byte finished arriving at the UART, by its place in the stream
+static uint64_t arrival_ns[STREAM_MAX];
+static uint64_t latency_max_ns;
+static uint64_t latency_sum_ns;
+
+static uint64_t byte_ns(void)
+{
+    return 10000000000ull / uart.baud;
+}
+
+int32_t uart_initialize(void)
+{
+    return 1;
+}
+
+int32_t uart_uninitialize(void)
+{
+    return 1;
+}
+
+int32_t uart_reset(void)
+{
+    return 1;
+}
+
+int32_t uart_set_configuration(UART_Configuration *config)
+{
+    uart.baud = config->Baudrate;
+    return 1;
+}
+
+void uart_set_control_line_state(uint16_t ctrl_bmp)
+{
+}
+
+int32_t uart_write_free(void)
+{
+    return UART_BUF_SIZE - uart.tx_count;
+}
+
+int32_t uart_write_data(uint8_t *data, uint16_t size)
+{
+    uint32_t i;
+
+    CHECK(size <= UART_BUF_SIZE - uart.tx_count);
+    for (i = 0; (i < size) && (uart.tx_count < UART_BUF_SIZE); i++) {
+        uint32_t pos = (uart.tx_head + uart.tx_count) % UART_BUF_SIZE;
+
+        uart.tx[pos] = data[i];
+        uart.tx_ns[pos] = now_ns;
+        uart.tx_count++;
+    }
+    return i;
+}
+
+int32_t uart_read_data(uint8_t *data, uint16_t size)
+{
+    uint32_t i;
+
+    for (i = 0; (i < size) && uart.rx_count; i++) {
+        data[i] = uart.rx[uart.rx_head];
+        uart.rx_head = (uart.rx_head + 1) % UART_BUF_SIZE;
+        uart.rx_count--;
+    }
+    return i;
+}
+
+void main_cdc_send_event(void)
+{
+}
+
+void main_blink_cdc_led(main_led_state_t state)
+{
+}
+
+void main_reset_target(uint8_t send_unique_id)
+{
+}
+
+uint8_t target_set_state(target_state_t state)
+{
+    return 1;
+}
+
+uint32_t osKernelGetSysTimerCount(void)
+{
+    return now_ns / 1000;
+}
+
+U32 USBD_ReadEP(U32 EPNum, U8 *pData, U32 cnt)
+{
+    uint32_t size = host.out_size;
+
+    CHECK_EQUAL(usbd_cdc_acm_ep_bulkout, EPNum);
+    if (!host.out_full) {
+        return 0;
+    }
+    CHECK(cnt >= size);
+    memcpy(pData, host.out_packet, size);
+    host.out_full = false;
+    host.out_next_ns = now_ns + PACKET_NS(MAX_PACKET);
+    return size;
+}
+
+U32 USBD_WriteEP(U32 EPNum, U8 *pData, U32 cnt)
+{
+    CHECK_EQUAL(usbd_cdc_acm_ep_bulkin | 0x80, EPNum);
+    CHECK(!host.in_armed);
+    CHECK(cnt <= MAX_PACKET);
+    memcpy(host.in_packet, pData, cnt);
+    host.in_size = cnt;
+    host.in_armed = true;
+    host.in_done_ns = now_ns + PACKET_NS(cnt);
+    return cnt;
+}
+
+// Move bytes along the line up to time t. A byte starts once the previous
+// one has ended and it is available: TX bytes from when they were written,
+// log bytes straight away.
+static void uart_advance(uint64_t t)
+{
+    while (true) {
+        uint64_t start = uart.line_end_ns;
+        uint8_t value;
+
+        if (uart.tx_count) {
+            start = MAX(start, uart.tx_ns[uart.tx_head]);
+            value = uart.tx[uart.tx_head];
+        } else if (uart.log_left) {
+            value = uart.log_seq % 251;
+        } else {
+            uart.line_end_ns = MAX(uart.line_end_ns, t);
+            return;
+        }
+        if (start + byte_ns() > t) {
+            return;
+        }
+        if (uart.tx_count) {
+            uart.tx_head = (uart.tx_head + 1) % UART_BUF_SIZE;
+            uart.tx_count--;
+        } else {
+            uart.log_left--;
+            uart.log_seq++;
+        }
+        uart.line_end_ns = start + byte_ns();
+        if (uart.line_bytes < STREAM_MAX) {
+            arrival_ns[uart.line_bytes] = uart.line_end_ns;
+        }
+        uart.line_bytes++;
+        if (uart.rx_count < UART_BUF_SIZE) {
+            uart.rx[(uart.rx_head + uart.rx_count) % UART_BUF_SIZE] = value;
+            uart.rx_count++;
+        } else {
+            uart.rx_lost++;
+        }
+    }
+}
+
+static void host_receive(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < host.in_size; i++) {
+        uint64_t latency;
+
+        if (host.in_packet[i] != host.received % 251) {
+            host.misordered++;
+        }
+        if (host.received < STREAM_MAX) {
+            latency = now_ns - arrival_ns[host.received];
+            latency_max_ns = MAX(latency_max_ns, latency);
+            latency_sum_ns += latency;
+        }
+        host.received++;
+    }
+    host.packets += (host.in_size != 0);
+    host.last_ns = now_ns;
+}
+
+// Reset both ends at the given baud rate
+static void start(uint32_t baud)
+{
+    CDC_LINE_CODING coding = {baud, 0, 0, 8};
+
+    memset(&host, 0, sizeof(host));
+    memset(&uart, 0, sizeof(uart));
+    latency_max_ns = 0;
+    latency_sum_ns = 0;
+    now_ns = 0;
+    USBD_CDC_ACM_Initialize();
+    USBD_CDC_ACM_PortSetLineCoding(&coding);
+    CHECK_EQUAL(baud, uart.baud);
+}
+
+// Run the main task, the USB events and the line until every byte the host
+// sent or the target logged has reached the host, or until the deadline
+static void run(uint64_t deadline_ns)
+{
+    uint64_t next_loop_ns = now_ns;
+    uint64_t next_sof_ns = now_ns + SOF_NS;
+
+    while (now_ns < deadline_ns) {
+        uint64_t next = MIN(next_loop_ns, next_sof_ns);
+        bool out_ready = host.out_left && !host.out_full;
+
+        if (host.in_armed) {
+            next = MIN(next, host.in_done_ns);
+        }
+        if (out_ready) {
+            next = MIN(next, MAX(host.out_next_ns, now_ns));
+        }
+        uart_advance(next);
+        now_ns = next;
+
+        if (host.in_armed && (host.in_done_ns <= now_ns)) {
+            host.in_armed = false;
+            host_receive();
+            USBD_CDC_ACM_EP_BULKIN_Event(USBD_EVT_IN);
+        } else if (out_ready && (host.out_next_ns <= now_ns)) {
+            uint32_t i;
+
+            host.out_size = MIN(host.out_left, MAX_PACKET);
+            for (i = 0; i < host.out_size; i++) {
+                host.out_packet[i] = host.out_seq++ % 251;
+            }
+            host.out_left -= host.out_size;
+            host.out_full = true;
+            USBD_CDC_ACM_EP_BULKOUT_Event(USBD_EVT_OUT);
+        } else if (next_sof_ns <= now_ns) {
+            next_sof_ns += SOF_NS;
+            USBD_CDC_ACM_SOF_Event();
+        } else {
+            next_loop_ns += LOOP_NS;
+            cdc_process_event();
+        }
+
+        if (!host.out_left && !uart.log_left && !host.in_armed &&
+                (host.received == host.out_seq + uart.log_seq)) {
+            return;
+        }
+    }
+}
+
+// A key typed into a shell and echoed by the target comes back well
+// within a USB frame, instead of waiting for the next SOF
+static void test_keystroke(void)
+{
+    static const uint32_t bauds[] = {9600, 115200, 921600};
+    uint32_t b;
+    uint32_t k;
+
+    for (b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++) {
+        uint64_t worst_ns = 0;
+
+        start(bauds[b]);
+        for (k = 0; k < 20; k++) {
+            uint64_t sent_ns = now_ns + 123457 * (k + 1);
+
+            host.out_left = 1;
+            host.out_next_ns = sent_ns;
+            run(sent_ns + 100000000);
+            CHECK_EQUAL(k + 1, host.received);
+            worst_ns = MAX(worst_ns, host.last_ns - sent_ns);
+        }
+        CHECK_EQUAL(0, host.misordered);
+        printf("%7u baud: key echoed in %4u us at worst, %3u us of it on the line\n",
+               (unsigned)bauds[b], (unsigned)(worst_ns / 1000), (unsigned)(byte_ns() / 1000));
+        CHECK(worst_ns < byte_ns() + PACKET_NS(1) * 2 + LOOP_NS * 2 + 20000);
+    }
+}
+
+// A target logging flat out: every byte reaches the host in order at line
+// rate, in small packets at low rates and full ones at high rates
+static void test_log_stream(void)
+{
+    static const uint32_t bauds[] = {115200, 921600, 3000000, 6000000};
+    uint32_t b;
+
+    for (b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++) {
+        uint32_t bytes = MIN(bauds[b] / 10 / 5, STREAM_MAX);
+        uint64_t line_ns;
+        uint32_t mean_packet;
+
+        start(bauds[b]);
+        uart.log_left = bytes;
+        run(1000000000000ull);
+        line_ns = bytes * byte_ns();
+        mean_packet = host.received / MAX(host.packets, 1);
+        printf("%7u baud log: %6u bytes, %3u%% of line rate, %2u bytes a packet, latency %4u us mean %4u us worst, %u lost\n",
+               (unsigned)bauds[b], (unsigned)host.received, (unsigned)(line_ns * 100 / host.last_ns),
+               (unsigned)mean_packet, (unsigned)(latency_sum_ns / MAX(host.received, 1) / 1000),
+               (unsigned)(latency_max_ns / 1000), (unsigned)uart.rx_lost);
+        CHECK_EQUAL(0, uart.rx_lost);
+        CHECK_EQUAL(bytes, host.received);
+        CHECK_EQUAL(0, host.misordered);
+        CHECK(host.last_ns < line_ns + 1000000);
+        if (byte_ns() < PACKET_NS(1)) {
+            // Bytes arriving while a packet is on the bus go in the next one
+            CHECK(mean_packet >= PACKET_NS(1) / byte_ns());
+        } else {
+            CHECK(latency_max_ns < 200000);
+        }
+    }
+}
+
+// Host data looped back through the target's UART: the OUT path keeps the
+// line busy and the IN path keeps up with it
+static void test_loopback_stream(void)
+{
+    static const uint32_t bauds[] = {115200, 921600, 3000000};
+    uint32_t b;
+
+    for (b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++) {
+        uint32_t bytes = MIN(bauds[b] / 10 / 5, STREAM_MAX);
+        uint64_t line_ns;
+
+        start(bauds[b]);
+        host.out_left = bytes;
+        run(1000000000000ull);
+        line_ns = bytes * byte_ns();
+        printf("%7u baud loopback: %6u bytes, %3u%% of line rate, %u lost\n",
+               (unsigned)bauds[b], (unsigned)host.received, (unsigned)(line_ns * 100 / host.last_ns),
+               (unsigned)uart.rx_lost);
+        CHECK_EQUAL(0, uart.rx_lost);
+        CHECK_EQUAL(bytes, host.received);
+        CHECK_EQUAL(0, host.misordered);
+        CHECK(host.last_ns < line_ns + line_ns / 10 + 1000000);
+    }
+}
+
+int main(void)
+{
+    test_keystroke();
+    test_log_stream();
+    test_loopback_stream();
+    return unit_test_result();
+}
@@ -0,0 +1,612 @@
+/**
+ * @file    test_circ_buf.c
+ * @brief   Host tests for circ_buf.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "unit_test.h"
+#include "circ_buf.h"
+#include "cortex_m.h"
+#include "util.h"
+
+#define BUF_SIZE    64
+// Bytes each thread moves in test_threads
+#define STRESS_BYTES    (1u << 20)
+// Bytes moved through the ring by each mode in test_throughput. Timing
+// under the thread sanitizer means nothing, so it only moves a little.
+#ifdef __SANITIZE_THREAD__
+#define BENCH_BYTES     (1u << 20)
+#else
+#define BENCH_BYTES     (8u << 20)
+#endif
+#define BENCH_RING      512
+#define BENCH_BLOCK     64
+
+static uint8_t buffer[BUF_SIZE];
+static circ_buf_t circ_buf;
+
+// What each thread moved in each mode: 0 a byte at a time, 1 in blocks,
+// 2 in place through peek
+static struct {
+    uint32_t produced[3];
+    uint32_t consumed[3];
+    uint32_t bad;
+    uint32_t overfull;
+} stress;
+
+// The ring as it was before it went lock-free, kept to compare speed: every
+// call masked interrupts, read and write went a byte at a time, and one slot
+// was always left empty. Masking costs nothing on the host, so only the
+// copying shows. noinline, as circ_buf.c is built on its own.
+
+typedef struct {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t size;
+    uint8_t *buf;
+} ref_circ_buf_t;
+
+__attribute__((noinline)) static void ref_circ_buf_init(ref_circ_buf_t *circ_buf, uint8_t *buffer, uint32_t size)
+{
+    cortex_int_state_t state;
+    state = cortex_int_get_and_disable();
+
+    circ_buf->buf = buffer;
+    circ_buf->size = size;
+    circ_buf->head = 0;
+    circ_buf->tail = 0;
+
+    cortex_int_restore(state);
+}
+
+__attribute__((noinline)) static void ref_circ_buf_push(ref_circ_buf_t *circ_buf, uint8_t data)
+{
+    cortex_int_state_t state;
+    state = cortex_int_get_and_disable();
+
+    circ_buf->buf[circ_buf->tail] = data;
+    circ_buf->tail += 1;
+    if (circ_buf->tail >= circ_buf->size) {
+        util_assert(circ_buf->tail == circ_buf->size);
+        circ_buf->tail = 0;
+    }
+
+    // Assert no overflow
+    util_assert(circ_buf->head != circ_buf->tail);
+
+    cortex_int_restore(state);
+}
+
+__attribute__((noinline)) static uint8_t ref_circ_buf_pop(ref_circ_buf_t *circ_buf)
+{
+    uint8_t data;
+    cortex_int_state_t state;
+
+    state = cortex_int_get_and_disable();
+
+    // Assert buffer isn't empty
+    util_assert(circ_buf->head != circ_buf->tail);
+
+    data = circ_buf->buf[circ_buf->head];
+    circ_buf->head += 1;
+    if (circ_buf->head >= circ_buf->size) {
+        util_assert(circ_buf->head == circ_buf->size);
+        circ_buf->head = 0;
+    }
+
+    cortex_int_restore(state);
+
+    return data;
+}
+
+__attribute__((noinline)) static uint32_t ref_circ_buf_count_used(ref_circ_buf_t *circ_buf)
+{
+    uint32_t cnt;
+    cortex_int_state_t state;
+
+    state = cortex_int_get_and_disable();
+
+    if (circ_buf->tail >= circ_buf->head) {
+        cnt = circ_buf->tail - circ_buf->head;
+    } else {
+        cnt = circ_buf->tail + circ_buf->size - circ_buf->head;
+    }
+
+    cortex_int_restore(state);
+    return cnt;
+}
+
+__attribute__((noinline)) static uint32_t ref_circ_buf_count_free(ref_circ_buf_t *circ_buf)
+{
+    uint32_t cnt;
+    cortex_int_state_t state;
+
+    state = cortex_int_get_and_disable();
+
+    cnt = circ_buf->size - ref_circ_buf_count_used(circ_buf) - 1;
+
+    cortex_int_restore(state);
+    return cnt;
+}
+
+__attribute__((noinline)) static uint32_t ref_circ_buf_read(ref_circ_buf_t *circ_buf, uint8_t *data, uint32_t size)
+{
+    uint32_t cnt;
+    uint32_t i;
+
+    cnt = ref_circ_buf_count_used(circ_buf);
+    cnt = MIN(size, cnt);
+    for (i = 0; i < cnt; i++) {
+        data[i] = ref_circ_buf_pop(circ_buf);
+    }
+
+    return cnt;
+}
+
+__attribute__((noinline)) static uint32_t ref_circ_buf_write(ref_circ_buf_t *circ_buf, const uint8_t *data, uint32_t size)
+{
+    uint32_t cnt;
+    uint32_t i;
+
+    cnt = ref_circ_buf_count_free(circ_buf);
+    cnt = MIN(size, cnt);
+    for (i = 0; i < cnt; i++) {
+        ref_circ_buf_push(circ_buf, data[i]);
+    }
+
+    return cnt;
+}
+
+// Start with the free running counters just short of wrapping
+static void init_near_wrap(uint32_t start)
+{
+    circ_buf_init(&circ_buf, buffer, sizeof(buffer));
+    circ_buf.head = start;
+    circ_buf.tail = start;
+}
+
+// All of the buffer is usable and bytes come out in order across the wrap
+static void test_push_pop(void)
+{
+    uint8_t next_in = 0;
+    uint8_t next_out = 0;
+    uint32_t round;
+    uint32_t i;
+
+    init_near_wrap(0xFFFFFFF0);
+    for (round = 0; round < 4; round++) {
+        for (i = 0; i < BUF_SIZE; i++) {
+            circ_buf_push(&circ_buf, next_in++);
+        }
+        CHECK_EQUAL(BUF_SIZE, circ_buf_count_used(&circ_buf));
+        CHECK_EQUAL(0, circ_buf_count_free(&circ_buf));
+        for (i = 0; i < BUF_SIZE - 3; i++) {
+            CHECK_EQUAL(next_out++, circ_buf_pop(&circ_buf));
+        }
+        CHECK_EQUAL(3, circ_buf_count_used(&circ_buf));
+        while (circ_buf_count_used(&circ_buf)) {
+            CHECK_EQUAL(next_out++, circ_buf_pop(&circ_buf));
+        }
+    }
+    CHECK(circ_buf.head < 0x100);
+}
+
+// Block copies split at the end of the buffer memory
+static void test_read_write(void)
+{
+    uint8_t in[BUF_SIZE + 8];
+    uint8_t out[BUF_SIZE + 8];
+    uint8_t next_in = 0;
+    uint8_t next_out = 0;
+    uint32_t i;
+    uint32_t n;
+    uint32_t got;
+    uint32_t iter;
+
+    init_near_wrap(0xFFFFFFC5);
+    srand(1);
+    for (iter = 0; iter < 20000; iter++) {
+        n = rand() % sizeof(in);
+        for (i = 0; i < n; i++) {
+            in[i] = next_in + i;
+        }
+        got = circ_buf_write(&circ_buf, in, n);
+        CHECK(got <= n);
+        next_in += got;
+        CHECK(circ_buf_count_used(&circ_buf) <= BUF_SIZE);
+
+        n = rand() % sizeof(out);
+        got = circ_buf_read(&circ_buf, out, n);
+        for (i = 0; i < got; i++) {
+            if (!CHECK_EQUAL(next_out, out[i])) {
+                return;
+            }
+            next_out++;
+        }
+        CHECK_EQUAL(BUF_SIZE, circ_buf_count_used(&circ_buf) + circ_buf_count_free(&circ_buf));
+    }
+}
+
+// peek stops at the end of the buffer memory, pop_n and push_n move on
+static void test_peek(void)
+{
+    const uint8_t *data;
+    uint8_t *free_data;
+    uint32_t size;
+    uint32_t i;
+
+    circ_buf_init(&circ_buf, buffer, sizeof(buffer));
+    free_data = circ_buf_peek_free(&circ_buf, &size);
+    CHECK(free_data == buffer);
+    CHECK_EQUAL(BUF_SIZE, size);
+    for (i = 0; i < BUF_SIZE - 4; i++) {
+        free_data[i] = i;
+    }
+    circ_buf_push_n(&circ_buf, BUF_SIZE - 4);
+    circ_buf_pop_n(&circ_buf, BUF_SIZE - 8);
+
+    // 4 bytes left to the end of the memory, then 52 at its start
+    free_data = circ_buf_peek_free(&circ_buf, &size);
+    CHECK(free_data == buffer + BUF_SIZE - 4);
+    CHECK_EQUAL(4, size);
+    memset(free_data, 0xAA, size);
+    circ_buf_push_n(&circ_buf, size);
+    free_data = circ_buf_peek_free(&circ_buf, &size);
+    CHECK(free_data == buffer);
+    CHECK_EQUAL(BUF_SIZE - 8, size);
+    memset(free_data, 0xBB, 2);
+    circ_buf_push_n(&circ_buf, 2);
+
+    data = circ_buf_peek(&circ_buf, &size);
+    CHECK(data == buffer + BUF_SIZE - 8);
+    CHECK_EQUAL(8, size);
+    CHECK_EQUAL(BUF_SIZE - 8, data[0]);
+    CHECK_EQUAL(0xAA, data[4]);
+    circ_buf_pop_n(&circ_buf, size);
+    data = circ_buf_peek(&circ_buf, &size);
+    CHECK(data == buffer);
+    CHECK_EQUAL(2, size);
+    CHECK_EQUAL(0xBB, data[0]);
+    circ_buf_pop_n(&circ_buf, size);
+    CHECK_EQUAL(0, circ_buf_count_used(&circ_buf));
+}
+
+// A producer writing the memory directly, such as circular DMA, overruns a
+// slow consumer. Every byte is either read in order or counted as dropped,
+// and the consumer always resumes with the oldest byte still in memory.
+static void test_advance_tail(void)
+{
+    uint8_t out[BUF_SIZE];
+    uint32_t pos = 0;
+    uint8_t seq = 0;
+    uint8_t expect = 0;
+    uint32_t written = 0;
+    uint32_t read = 0;
+    uint32_t dropped = 0;
+    uint32_t iter;
+    uint32_t i;
+    uint32_t n;
+    uint32_t got;
+    uint32_t drop;
+
+    init_near_wrap(0xFFFFF000);
+    srand(2);
+    for (iter = 0; iter < 200000; iter++) {
+        // Less than a whole buffer between calls, as the contract requires
+        n = rand() % ((rand() % 4) ? 8 : BUF_SIZE);
+        for (i = 0; i < n; i++) {
+            buffer[pos] = seq++;
+            pos = (pos + 1) % BUF_SIZE;
+        }
+        written += n;
+        drop = circ_buf_advance_tail(&circ_buf, pos);
+        dropped += drop;
+        expect += drop;
+        CHECK(circ_buf_count_used(&circ_buf) <= BUF_SIZE);
+
+        n = rand() % ((rand() % 3) ? 16 : BUF_SIZE);
+        got = circ_buf_read(&circ_buf, out, n);
+        for (i = 0; i < got; i++) {
+            if (!CHECK_EQUAL(expect, out[i])) {
+                return;
+            }
+            expect++;
+        }
+        read += got;
+        if (!CHECK_EQUAL(written, read + dropped + circ_buf_count_used(&circ_buf))) {
+            return;
+        }
+    }
+    CHECK(dropped > 0);
+}
+
+// Pushing into a full buffer is a caller bug
+static void test_overflow_asserts(void)
+{
+    uint32_t i;
+
+    circ_buf_init(&circ_buf, buffer, sizeof(buffer));
+    for (i = 0; i < BUF_SIZE; i++) {
+        circ_buf_push(&circ_buf, i);
+    }
+    CHECK_EQUAL(0, circ_buf_write(&circ_buf, buffer, 1));
+    unit_test_expect_asserts(true);
+    circ_buf_push(&circ_buf, 0);
+    CHECK_EQUAL(1, unit_test_asserts());
+    unit_test_expect_asserts(false);
+}
+
+static uint8_t stress_value(uint32_t seq)
+{
+    return seq % 251;
+}
+
+// The producer, a UART interrupt say: a run of bytes at a time, pushed one
+// by one, written as a block or filled in place, whichever comes up
+static void *producer_thread(void *arg)
+{
+    uint8_t block[BUF_SIZE];
+    uint32_t seed = 1;
+    uint32_t seq = 0;
+
+    while (seq < STRESS_BYTES) {
+        uint32_t mode = rand_r(&seed) % 3;
+        uint32_t n = MIN(1 + rand_r(&seed) % BUF_SIZE, STRESS_BYTES - seq);
+        uint32_t start = seq;
+        uint32_t size;
+        uint8_t *dst;
+        uint32_t i;
+
+        switch (mode) {
+            case 0:
+                for (i = 0; (i < n) && circ_buf_count_free(&circ_buf); i++) {
+                    circ_buf_push(&circ_buf, stress_value(seq++));
+                }
+                break;
+
+            case 1:
+                for (i = 0; i < n; i++) {
+                    block[i] = stress_value(seq + i);
+                }
+                seq += circ_buf_write(&circ_buf, block, n);
+                break;
+
+            default:
+                dst = circ_buf_peek_free(&circ_buf, &size);
+                n = MIN(n, size);
+                for (i = 0; i < n; i++) {
+                    dst[i] = stress_value(seq + i);
+                }
+                circ_buf_push_n(&circ_buf, n);
+                seq += n;
+                break;
+        }
+        stress.produced[mode] += seq - start;
+        // Let the consumer run when the ring is full, even on one CPU. A
+        // sleep, unlike a lock, tells the sanitizer nothing about ordering.
+        if (seq == start) {
+            usleep(1);
+        }
+    }
+    return NULL;
+}
+
+// The consumer, the CDC thread say, taking whatever is there the same
+// three ways and counting bytes out of order
+static void *consumer_thread(void *arg)
+{
+    uint8_t block[BUF_SIZE];
+    uint32_t seed = 2;
+    uint32_t seq = 0;
+
+    while (seq < STRESS_BYTES) {
+        uint32_t mode = rand_r(&seed) % 3;
+        uint32_t n = 1 + rand_r(&seed) % BUF_SIZE;
+        uint32_t start = seq;
+        const uint8_t *src;
+        uint32_t size;
+        uint32_t i;
+
+        switch (mode) {
+            case 0:
+                for (i = 0; (i < n) && circ_buf_count_used(&circ_buf); i++) {
+                    stress.bad += circ_buf_pop(&circ_buf) != stress_value(seq++);
+                }
+                break;
+
+            case 1:
+                n = circ_buf_read(&circ_buf, block, n);
+                for (i = 0; i < n; i++) {
+                    stress.bad += block[i] != stress_value(seq++);
+                }
+                break;
+
+            default:
+                src = circ_buf_peek(&circ_buf, &size);
+                n = MIN(n, size);
+                for (i = 0; i < n; i++) {
+                    stress.bad += src[i] != stress_value(seq++);
+                }
+                circ_buf_pop_n(&circ_buf, n);
+                break;
+        }
+        stress.overfull += circ_buf_count_used(&circ_buf) > BUF_SIZE;
+        stress.consumed[mode] += seq - start;
+        if (seq == start) {
+            usleep(1);
+        }
+    }
+    return NULL;
+}
+
+// A producer and a consumer on their own threads, with the counters about
+// to wrap: every byte arrives once and in order whichever way each side
+// moves it. Run under the thread sanitizer this also checks that the
+// counters order the data accesses.
+static void test_threads(void)
+{
+    pthread_t producer;
+    pthread_t consumer;
+    uint32_t mode;
+
+    init_near_wrap(0xFFFFF000);
+    memset(&stress, 0, sizeof(stress));
+    pthread_create(&consumer, NULL, consumer_thread, NULL);
+    pthread_create(&producer, NULL, producer_thread, NULL);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    printf("threads: %u bytes, produced %u/%u/%u and consumed %u/%u/%u by byte/block/span\n",
+           (unsigned)STRESS_BYTES, (unsigned)stress.produced[0], (unsigned)stress.produced[1],
+           (unsigned)stress.produced[2], (unsigned)stress.consumed[0],
+           (unsigned)stress.consumed[1], (unsigned)stress.consumed[2]);
+    CHECK_EQUAL(0, stress.bad);
+    CHECK_EQUAL(0, stress.overfull);
+    CHECK_EQUAL(0, circ_buf_count_used(&circ_buf));
+    for (mode = 0; mode < 3; mode++) {
+        CHECK(stress.produced[mode] > STRESS_BYTES / 8);
+        CHECK(stress.consumed[mode] > STRESS_BYTES / 8);
+    }
+}
+
+static uint64_t wall_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint32_t mb_per_s(uint64_t ns)
+{
+    return (uint32_t)(BENCH_BYTES * 1000ull / ns);
+}
+
+// Blocks of BENCH_BLOCK bytes through a UART sized ring, a byte at a time
+// as an interrupt does, and as blocks as the CDC side does, on the old ring
+// and the current one. A byte of each block is summed so that none of the
+// copying is optimized away.
+static void test_throughput(void)
+{
+    static uint8_t ring[BENCH_RING];
+    uint8_t in[BENCH_BLOCK];
+    uint8_t out[BENCH_BLOCK];
+    ref_circ_buf_t ref;
+    circ_buf_t cur;
+    uint32_t rate[5] = {0};
+    uint32_t sum[5] = {0};
+    uint64_t start;
+    uint32_t done;
+    uint32_t run;
+    uint32_t i;
+
+    for (i = 0; i < sizeof(in); i++) {
+        in[i] = i;
+    }
+
+    // Best of a few runs of each
+    for (run = 0; run < 5; run++) {
+        memset(sum, 0, sizeof(sum));
+
+        ref_circ_buf_init(&ref, ring, sizeof(ring));
+        start = wall_ns();
+        for (done = 0; done < BENCH_BYTES; done += BENCH_BLOCK) {
+            for (i = 0; i < BENCH_BLOCK; i++) {
+                ref_circ_buf_push(&ref, in[i]);
+            }
+            while (ref_circ_buf_count_used(&ref)) {
+                sum[0] += ref_circ_buf_pop(&ref);
+            }
+        }
+        rate[0] = MAX(rate[0], mb_per_s(wall_ns() - start));
+
+        circ_buf_init(&cur, ring, sizeof(ring));
+        start = wall_ns();
+        for (done = 0; done < BENCH_BYTES; done += BENCH_BLOCK) {
+            for (i = 0; i < BENCH_BLOCK; i++) {
+                circ_buf_push(&cur, in[i]);
+            }
+            while (circ_buf_count_used(&cur)) {
+                sum[1] += circ_buf_pop(&cur);
+            }
+        }
+        rate[1] = MAX(rate[1], mb_per_s(wall_ns() - start));
+
+        ref_circ_buf_init(&ref, ring, sizeof(ring));
+        start = wall_ns();
+        for (done = 0; done < BENCH_BYTES; done += BENCH_BLOCK) {
+            ref_circ_buf_write(&ref, in, sizeof(in));
+            ref_circ_buf_read(&ref, out, sizeof(out));
+            sum[2] += out[(done / BENCH_BLOCK) % BENCH_BLOCK];
+        }
+        rate[2] = MAX(rate[2], mb_per_s(wall_ns() - start));
+
+        circ_buf_init(&cur, ring, sizeof(ring));
+        start = wall_ns();
+        for (done = 0; done < BENCH_BYTES; done += BENCH_BLOCK) {
+            circ_buf_write(&cur, in, sizeof(in));
+            circ_buf_read(&cur, out, sizeof(out));
+            sum[3] += out[(done / BENCH_BLOCK) % BENCH_BLOCK];
+        }
+        rate[3] = MAX(rate[3], mb_per_s(wall_ns() - start));
+
+        circ_buf_init(&cur, ring, sizeof(ring));
+        start = wall_ns();
+        for (done = 0; done < BENCH_BYTES; done += BENCH_BLOCK) {
+            uint32_t size;
+            uint8_t *dst = circ_buf_peek_free(&cur, &size);
+            const uint8_t *src;
+
+            memcpy(dst, in, BENCH_BLOCK);
+            circ_buf_push_n(&cur, BENCH_BLOCK);
+            src = circ_buf_peek(&cur, &size);
+            sum[4] += src[(done / BENCH_BLOCK) % BENCH_BLOCK];
+            circ_buf_pop_n(&cur, size);
+        }
+        rate[4] = MAX(rate[4], mb_per_s(wall_ns() - start));
+
+        CHECK_EQUAL(sum[0], sum[1]);
+        CHECK_EQUAL(sum[2], sum[3]);
+        CHECK_EQUAL(sum[2], sum[4]);
+    }
+
+    printf("%u MB in %u byte blocks: bytes old %u MB/s new %u MB/s, blocks old %u MB/s new %u MB/s, "
+           "span %u MB/s\n", (unsigned)(BENCH_BYTES >> 20), (unsigned)BENCH_BLOCK,
+           (unsigned)rate[0], (unsigned)rate[1], (unsigned)rate[2],
+           (unsigned)rate[3], (unsigned)rate[4]);
+#ifndef __SANITIZE_THREAD__
+    CHECK(rate[3] > rate[2]);
+#endif
+}
+
+int main(void)
+{
+    test_push_pop();
+    test_read_write();
+    test_peek();
+    test_advance_tail();
+    test_overflow_asserts();
+    test_threads();
+    test_throughput();
+    return unit_test_result();
+}
@@ -0,0 +1,418 @@
+/**
+ * @file    test_crc32.c
+ * @brief   Host tests for crc32.c, built once per CRC32_TABLE_SLICES value
+ *          and once per HIC crc.c against a model of its CRC engine
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "unit_test.h"
+#include "util.h"
+#include "crc.h"
+
+#if defined(CRC_ENGINE_K26F)
+#include "fsl_device_registers.h"
+#elif defined(CRC_ENGINE_STM32F1)
+#include "stm32f1xx.h"
+#elif defined(CRC_ENGINE_STM32G4)
+#include "stm32g4xx.h"
+#endif
+
+#if defined(CRC_ENGINE_K26F) || defined(CRC_ENGINE_STM32F1) || defined(CRC_ENGINE_STM32G4)
+#define CRC_ENGINE
+#endif
+
+// The F1 unit cannot be seeded, resuming a CRC costs it one more word
+#if defined(CRC_ENGINE_STM32F1)
+#define ENGINE_SEED_WORDS   1
+#else
+#define ENGINE_SEED_WORDS   0
+#endif
+
+#ifdef __SANITIZE_THREAD__
+#define BENCH_BYTES     (256u << 10)
+#else
+#define BENCH_BYTES     (4u << 20)
+#endif
+
+// Bit at a time CRC-32 the table driven versions must agree with
+static uint32_t crc32_reference(uint32_t crc, const uint8_t *data, uint32_t size)
+{
+    uint32_t bit;
+
+    crc = ~crc;
+    while (size--) {
+        crc ^= *data++;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+#ifdef CRC_ENGINE
+#define CRC32_POLYNOMIAL    0x04C11DB7
+
+// The engine: its clock gate, registers and MSB first remainder, and the
+// number of words it has taken
+static struct {
+    uint32_t clock;
+    uint32_t ctrl;
+    uint32_t poly;
+    uint32_t init;
+    uint32_t remainder;
+    uint32_t words;
+} engine;
+
+// One word into an MSB first engine
+static uint32_t engine_word(uint32_t remainder, uint32_t poly, uint32_t word)
+{
+    uint32_t bit;
+
+    remainder ^= word;
+    for (bit = 0; bit < 32; bit++) {
+        remainder = (remainder << 1) ^ (poly & (0 - (remainder >> 31)));
+    }
+    return remainder;
+}
+#endif
+
+#if defined(CRC_ENGINE_K26F) || defined(CRC_ENGINE_STM32G4)
+static uint32_t reverse_bits_in_bytes(uint32_t value)
+{
+    return __RBIT(__builtin_bswap32(value));
+}
+#endif
+
+#if defined(CRC_ENGINE_K26F)
+// The K26 CRC module, in 32-bit mode only. Transpose types are none, bits
+// in bytes, bits and bytes, and bytes. With WAS set a write is the seed.
+static uint32_t transpose(uint32_t value, uint32_t type)
+{
+    switch (type & 3) {
+        case 1:
+            return reverse_bits_in_bytes(value);
+        case 2:
+            return __RBIT(value);
+        case 3:
+            return __builtin_bswap32(value);
+        default:
+            return value;
+    }
+}
+
+static void engine_reset(void)
+{
+    memset(&engine, 0, sizeof(engine));
+    engine.poly = 0x1021;
+    engine.remainder = 0xFFFFFFFF;
+}
+
+uint32_t model_register_read(uint32_t reg)
+{
+    uint32_t value;
+
+    if (SIM_SCGC6_REG == reg) {
+        return engine.clock;
+    }
+    CHECK(engine.clock & SIM_SCGC6_CRC_MASK);
+    switch (reg) {
+        case CRC_DATA_REG:
+            value = transpose(engine.remainder, engine.ctrl >> CRC_CTRL_TOTR_SHIFT);
+            return (engine.ctrl & CRC_CTRL_FXOR_MASK) ? ~value : value;
+        case CRC_GPOLY_REG:
+            return engine.poly;
+        case CRC_CTRL_REG:
+            return engine.ctrl;
+    }
+    return 0;
+}
+
+void model_register_write(uint32_t reg, uint32_t value)
+{
+    if (SIM_SCGC6_REG == reg) {
+        engine.clock = value;
+        return;
+    }
+    CHECK(engine.clock & SIM_SCGC6_CRC_MASK);
+    switch (reg) {
+        case CRC_DATA_REG:
+            value = transpose(value, engine.ctrl >> CRC_CTRL_TOT_SHIFT);
+            if (engine.ctrl & CRC_CTRL_WAS_MASK) {
+                engine.remainder = value;
+                break;
+            }
+            CHECK(engine.ctrl & CRC_CTRL_TCRC_MASK);
+            CHECK_EQUAL(CRC32_POLYNOMIAL, engine.poly);
+            engine.remainder = engine_word(engine.remainder, engine.poly, value);
+            engine.words++;
+            break;
+        case CRC_GPOLY_REG:
+            engine.poly = value;
+            break;
+        case CRC_CTRL_REG:
+            engine.ctrl = value;
+            break;
+    }
+}
+#elif defined(CRC_ENGINE_STM32F1)
+// The F1 CRC unit: fixed polynomial, no reversal, a reset to all ones
+static void engine_reset(void)
+{
+    memset(&engine, 0, sizeof(engine));
+    engine.remainder = 0xFFFFFFFF;
+}
+
+uint32_t model_register_read(uint32_t reg)
+{
+    if (RCC_AHBENR_REG == reg) {
+        return engine.clock;
+    }
+    CHECK(engine.clock & RCC_AHBENR_CRCEN);
+    return (CRC_DR_REG == reg) ? engine.remainder : 0;
+}
+
+void model_register_write(uint32_t reg, uint32_t value)
+{
+    if (RCC_AHBENR_REG == reg) {
+        engine.clock = value;
+        return;
+    }
+    CHECK(engine.clock & RCC_AHBENR_CRCEN);
+    if (CRC_DR_REG == reg) {
+        engine.remainder = engine_word(engine.remainder, CRC32_POLYNOMIAL, value);
+        engine.words++;
+    } else if ((CRC_CR_REG == reg) && (value & CRC_CR_RESET)) {
+        engine.remainder = 0xFFFFFFFF;
+    }
+}
+#elif defined(CRC_ENGINE_STM32G4)
+// The G4 CRC unit, in 32-bit mode only. Input is reversed by byte, half
+// word or word, and a reset or a write to INIT loads INIT.
+static uint32_t reverse_in(uint32_t value, uint32_t type)
+{
+    switch (type & 3) {
+        case 1:
+            return reverse_bits_in_bytes(value);
+        case 2:
+            value = __RBIT(value);
+            return (value >> 16) | (value << 16);
+        case 3:
+            return __RBIT(value);
+        default:
+            return value;
+    }
+}
+
+static void engine_reset(void)
+{
+    memset(&engine, 0, sizeof(engine));
+    engine.poly = CRC32_POLYNOMIAL;
+    engine.init = 0xFFFFFFFF;
+    engine.remainder = 0xFFFFFFFF;
+}
+
+uint32_t model_register_read(uint32_t reg)
+{
+    if (RCC_AHB1ENR_REG == reg) {
+        return engine.clock;
+    }
+    CHECK(engine.clock & RCC_AHB1ENR_CRCEN);
+    switch (reg) {
+        case CRC_DR_REG:
+            return (engine.ctrl & CRC_CR_REV_OUT) ? __RBIT(engine.remainder) : engine.remainder;
+        case CRC_CR_REG:
+            return engine.ctrl;
+        case CRC_INIT_REG:
+            return engine.init;
+        case CRC_POL_REG:
+            return engine.poly;
+    }
+    return 0;
+}
+
+void model_register_write(uint32_t reg, uint32_t value)
+{
+    if (RCC_AHB1ENR_REG == reg) {
+        engine.clock = value;
+        return;
+    }
+    CHECK(engine.clock & RCC_AHB1ENR_CRCEN);
+    switch (reg) {
+        case CRC_DR_REG:
+            CHECK_EQUAL(0, engine.ctrl & CRC_CR_POLYSIZE);
+            CHECK_EQUAL(CRC32_POLYNOMIAL, engine.poly);
+            value = reverse_in(value, (engine.ctrl & CRC_CR_REV_IN) >> 5);
+            engine.remainder = engine_word(engine.remainder, engine.poly, value);
+            engine.words++;
+            break;
+        case CRC_CR_REG:
+            engine.ctrl = value & ~CRC_CR_RESET;
+            if (value & CRC_CR_RESET) {
+                engine.remainder = engine.init;
+            }
+            break;
+        case CRC_INIT_REG:
+            engine.init = value;
+            engine.remainder = value;
+            break;
+        case CRC_POL_REG:
+            engine.poly = value;
+            break;
+    }
+}
+#endif
+
+static void test_known_answers(void)
+{
+    static const struct {
+        const char *message;
+        uint32_t crc;
+    } answers[] = {
+        {"", 0x00000000},
+        {"a", 0xE8B7BE43},
+        {"123456789", 0xCBF43926},
+        {"The quick brown fox jumps over the lazy dog", 0x414FA339},
+    };
+    uint32_t i;
+
+    for (i = 0; i < sizeof(answers) / sizeof(answers[0]); i++) {
+        CHECK_EQUAL(answers[i].crc, crc32(answers[i].message, strlen(answers[i].message)));
+        CHECK_EQUAL(answers[i].crc, crc32_sw_continue(0, answers[i].message, strlen(answers[i].message)));
+    }
+    CHECK_EQUAL(0xCBF43926, crc32_continue(crc32("1234", 4), "56789", 5));
+}
+
+// Every alignment, length and split point, so each slicing loop is entered
+// and left at every offset
+static void test_alignment_and_splits(void)
+{
+    static uint8_t data[512 + 8];
+    uint32_t offset;
+    uint32_t size;
+    uint32_t split;
+    uint32_t expected;
+    uint32_t i;
+
+    srand(1);
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = rand();
+    }
+
+    for (offset = 0; offset < 8; offset++) {
+        for (size = 0; size <= 64; size++) {
+            expected = crc32_reference(0, data + offset, size);
+            if (!CHECK_EQUAL(expected, crc32(data + offset, size))) {
+                return;
+            }
+            for (split = 0; split <= size; split++) {
+                if (!CHECK_EQUAL(expected, crc32_continue(crc32(data + offset, split),
+                                                          data + offset + split, size - split))) {
+                    return;
+                }
+            }
+        }
+        size = sizeof(data) - 8;
+        CHECK_EQUAL(crc32_reference(0, data + offset, size), crc32(data + offset, size));
+    }
+}
+
+// Erased flash, as CRCed for empty sectors and config regions
+static void test_erased(void)
+{
+    static uint8_t erased[4096];
+
+    memset(erased, 0xFF, sizeof(erased));
+    CHECK_EQUAL(crc32_reference(0, erased, sizeof(erased)), crc32(erased, sizeof(erased)));
+}
+
+#ifdef CRC_ENGINE
+// Whole aligned words go through the engine, only the ragged edges through
+// the software CRC, whose result the engine then resumes from
+static void test_engine_used(void)
+{
+    static uint32_t words[64 + 1];
+    uint32_t offset;
+
+    for (offset = 0; offset < 4; offset++) {
+        engine.words = 0;
+        CHECK_EQUAL(crc32_reference(0, (uint8_t *)words + offset, 256),
+                    crc32((uint8_t *)words + offset, 256));
+        CHECK_EQUAL(offset ? 63 + ENGINE_SEED_WORDS : 64, engine.words);
+    }
+}
+#else
+static uint64_t wall_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Host time per byte of crc32() and of the bit at a time CRC it replaced,
+// over an image sized buffer, best of five
+static void test_throughput(void)
+{
+    static uint8_t data[BENCH_BYTES];
+    uint64_t best[2] = {UINT64_MAX, UINT64_MAX};
+    uint64_t start;
+    uint32_t crc[2];
+    uint32_t run;
+    uint32_t i;
+
+    srand(2);
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = rand();
+    }
+    for (run = 0; run < 5; run++) {
+        start = wall_ns();
+        crc[0] = crc32_reference(0, data, sizeof(data));
+        best[0] = MIN(best[0], wall_ns() - start);
+        start = wall_ns();
+        crc[1] = crc32(data, sizeof(data));
+        best[1] = MIN(best[1], wall_ns() - start);
+        CHECK_EQUAL(crc[0], crc[1]);
+    }
+    printf("%u kB: bitwise %.2f ns/byte, CRC32_TABLE_SLICES=%u %.2f ns/byte\n",
+           (unsigned)(BENCH_BYTES >> 10), (double)best[0] / BENCH_BYTES,
+           (unsigned)CRC32_TABLE_SLICES, (double)best[1] / BENCH_BYTES);
+#ifndef __SANITIZE_THREAD__
+    CHECK(best[1] < best[0]);
+#endif
+}
+#endif
+
+int main(void)
+{
+#ifdef CRC_ENGINE
+    engine_reset();
+#endif
+    test_known_answers();
+    test_alignment_and_splits();
+    test_erased();
+#ifdef CRC_ENGINE
+    test_engine_used();
+#else
+    test_throughput();
+#endif
+    return unit_test_result();
+}
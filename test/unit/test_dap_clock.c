@@ -0,0 +1,227 @@
+/**
+ * @file    test_dap_clock.c
+ * @brief   Host tests for DAP_clock.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "unit_test.h"
+#include "DAP_config.h"
+#include "DAP.h"
+#include "DAP_clock.h"
+#include "settings.h"
+
+#define IDCODE_A        0x2BA01477
+#define IDCODE_B        0x0BC11477
+#define DPIDR_READ      DAP_TRANSFER_RnW
+#define MEM_AP_READ     (DAP_TRANSFER_APnDP | DAP_TRANSFER_RnW | (3U << 2))
+
+static uint32_t swd_clock;
+static bool adaptive;
+static uint32_t saved_idcode;
+static uint32_t saved_clock;
+
+void DAP_SetClock(uint32_t clock)
+{
+    swd_clock = clock;
+}
+
+bool config_get_adaptive_swd_clock(void)
+{
+    return adaptive;
+}
+
+void config_set_adaptive_swd_clock(bool on)
+{
+    adaptive = on;
+}
+
+void config_set_swd_clock(uint32_t idcode, uint32_t clock)
+{
+    saved_idcode = idcode;
+    saved_clock = clock;
+}
+
+uint32_t config_get_swd_clock(uint32_t idcode)
+{
+    return (idcode == saved_idcode) ? saved_clock : 0;
+}
+
+static void reset(bool enable, uint32_t requested)
+{
+    adaptive = false;
+    saved_idcode = 0;
+    saved_clock = 0;
+    DAP_clock_init(DAP_DEFAULT_SWJ_CLOCK);
+    if (enable) {
+        DAP_clock_enable(true);
+    }
+    DAP_SetClock(DAP_clock_request(requested));
+}
+
+static void transfers(uint32_t count, uint8_t ack)
+{
+    uint32_t data = 0;
+
+    while (count--) {
+        DAP_clock_transfer(MEM_AP_READ, &data, ack);
+    }
+}
+
+static void connect(uint32_t idcode)
+{
+    DAP_clock_transfer(DPIDR_READ, &idcode, DAP_TRANSFER_OK);
+}
+
+// Disabled, the host's clock is used whatever happens on the wire
+static void test_disabled(void)
+{
+    reset(false, 8000000);
+    CHECK_EQUAL(8000000, swd_clock);
+    transfers(100, DAP_TRANSFER_ERROR);
+    transfers(1000, DAP_TRANSFER_WAIT);
+    CHECK_EQUAL(8000000, swd_clock);
+    CHECK_EQUAL(0, DAP_clock_get()->steps_down);
+    CHECK(!DAP_clock_enabled());
+}
+
+// Two protocol errors in a window lower the clock by a quarter and make
+// the failed clock the ceiling; FAULT is the target's answer, not an error
+static void test_step_down(void)
+{
+    reset(true, 8000000);
+    transfers(1000, DAP_TRANSFER_FAULT);
+    CHECK_EQUAL(8000000, swd_clock);
+    transfers(1, DAP_TRANSFER_ERROR);
+    CHECK_EQUAL(8000000, swd_clock);
+    transfers(1, 7);
+    CHECK_EQUAL(6000000, swd_clock);
+    CHECK_EQUAL(8000000, DAP_clock_get()->ceiling);
+    CHECK_EQUAL(1, DAP_clock_get()->steps_down);
+
+    // A WAIT storm lowers it too, an occasional WAIT does not
+    transfers(DAP_CLOCK_WAITS - 1, DAP_TRANSFER_WAIT);
+    CHECK_EQUAL(6000000, swd_clock);
+    transfers(1, DAP_TRANSFER_WAIT);
+    CHECK_EQUAL(4500000, swd_clock);
+
+    // Never below the minimum
+    transfers(200, DAP_TRANSFER_ERROR);
+    CHECK_EQUAL(DAP_CLOCK_MIN, swd_clock);
+}
+
+// Clean windows raise the clock again, but never up to a clock that has
+// failed and never above the request
+static void test_step_up(void)
+{
+    reset(true, 8000000);
+    transfers(2, DAP_TRANSFER_ERROR);
+    CHECK_EQUAL(6000000, swd_clock);
+    transfers(DAP_CLOCK_WINDOW * DAP_CLOCK_PROBE - 1, DAP_TRANSFER_OK);
+    CHECK_EQUAL(6000000, swd_clock);
+    CHECK_EQUAL(6000000, DAP_clock_get()->stable);
+    transfers(1, DAP_TRANSFER_OK);
+    CHECK_EQUAL(7500000, swd_clock);
+
+    // One error per window holds the clock without lowering it
+    transfers(DAP_CLOCK_WINDOW - 1, DAP_TRANSFER_OK);
+    transfers(1, DAP_TRANSFER_ERROR);
+    CHECK_EQUAL(7500000, swd_clock);
+
+    reset(true, 1000000);
+    transfers(DAP_CLOCK_WINDOW * DAP_CLOCK_PROBE * 10, DAP_TRANSFER_OK);
+    CHECK_EQUAL(1000000, swd_clock);
+    CHECK_EQUAL(0, DAP_clock_get()->steps_up);
+}
+
+// The stable clock is stored against the DPIDR and used from the next
+// connection to that target, but not for another one
+static void test_saved_clock(void)
+{
+    reset(true, 8000000);
+    CHECK(!DAP_clock_save());
+    connect(IDCODE_A);
+    transfers(2, DAP_TRANSFER_ERROR);
+    transfers(DAP_CLOCK_WINDOW, DAP_TRANSFER_OK);
+    CHECK(DAP_clock_save());
+    CHECK_EQUAL(IDCODE_A, saved_idcode);
+    CHECK_EQUAL(6000000, saved_clock);
+
+    DAP_SetClock(DAP_clock_request(8000000));
+    CHECK_EQUAL(6000000, swd_clock);
+    connect(IDCODE_B);
+    CHECK_EQUAL(8000000, swd_clock);
+    connect(IDCODE_A);
+    CHECK_EQUAL(6000000, swd_clock);
+
+    // Not applied while disabled, and gone once forgotten
+    DAP_clock_enable(false);
+    CHECK_EQUAL(8000000, swd_clock);
+    DAP_clock_enable(true);
+    CHECK_EQUAL(6000000, swd_clock);
+    DAP_clock_forget();
+    CHECK_EQUAL(8000000, swd_clock);
+}
+
+// A target whose bit error rate climbs above a knee clock, driven for two
+// million transfers: the clock settles just under the knee, or at the
+// request if that is lower
+static void test_convergence(void)
+{
+    static const uint32_t knees[] = {1000000, 2500000, 4000000, 7000000, 12000000};
+    const uint32_t requested = 10000000;
+    uint32_t k;
+    uint32_t i;
+
+    for (k = 0; k < sizeof(knees) / sizeof(knees[0]); k++) {
+        uint32_t expected = (knees[k] < requested) ? knees[k] : requested;
+        uint32_t late_errors = 0;
+
+        srand(k + 1);
+        reset(true, requested);
+        connect(IDCODE_A);
+        for (i = 0; i < 2200000; i++) {
+            double bit_error = (swd_clock <= knees[k]) ? 0 : 1e-8 * (swd_clock - knees[k]);
+            uint8_t ack = DAP_TRANSFER_OK;
+            uint32_t data = 0;
+
+            if (rand() < 46 * bit_error * RAND_MAX) {
+                ack = (rand() % 2) ? DAP_TRANSFER_ERROR : 7;
+                late_errors += (i >= 2000000);
+            }
+            DAP_clock_transfer(MEM_AP_READ, &data, ack);
+        }
+        printf("knee %8u: clock %8u, %u steps down, %u up, %u errors in the last 200000 transfers\n",
+               (unsigned)knees[k], (unsigned)swd_clock, (unsigned)DAP_clock_get()->steps_down,
+               (unsigned)DAP_clock_get()->steps_up, (unsigned)late_errors);
+        CHECK(swd_clock <= expected + expected / 20);
+        CHECK(swd_clock >= expected - expected / 5);
+        CHECK(late_errors < 100);
+    }
+}
+
+int main(void)
+{
+    test_disabled();
+    test_step_down();
+    test_step_up();
+    test_saved_clock();
+    test_convergence();
+    return unit_test_result();
+}
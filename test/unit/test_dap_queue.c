@@ -0,0 +1,370 @@
+/**
+ * @file    test_dap_queue.c
+ * @brief   Host tests for DAP_queue.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unit_test.h"
+#include "DAP_queue.h"
+#include "daplink_vendor_commands.h"
+#include "main_interface.h"
+
+// Requests carry their sequence number and queue, and random payload that
+// the response echoes inverted, so any slot reused too early shows up as
+// a request or response that is not the one expected
+#define HISTORY         256
+#define REQUESTS        100000
+
+// The USB thread owns everything but executed, which the DAP thread owns.
+// requests[] is written before a request is committed and read by the DAP
+// thread after, so the queue itself orders the two.
+typedef struct {
+    DAP_queue queue;
+    uint8_t requests[HISTORY][DAP_PACKET_SIZE];
+    uint32_t received;          // requests committed
+    uint32_t executed;          // requests executed
+    uint32_t sent;              // responses taken for sending
+    uint8_t *recv_buf;          // slot being received into, NULL if none
+    uint32_t send_cbs;
+} usb_side_t;
+
+static usb_side_t sides[DAP_QUEUE_MAX];
+static uint32_t usb_done;
+static bool usb_failed;
+static bool dap_failed;
+
+// DAP thread state
+static bool msd_open;
+static uint32_t main_task_requests;
+static uint32_t dap_thread_requests;
+static uint32_t send_events;
+static bool target_locked;
+static unsigned int dap_seed;
+
+// USB thread state
+static uint32_t execute_events;
+static unsigned int usb_seed;
+
+static void send_cb_0(void)
+{
+    sides[0].send_cbs++;
+}
+
+static void send_cb_1(void)
+{
+    sides[1].send_cbs++;
+}
+
+static uint8_t random_command(void)
+{
+    static const uint8_t main_task[] = {
+        ID_DAP_UART_Read, ID_DAP_UART_Write, ID_DAP_MSD_Write, ID_DAP_ExecuteCommands,
+    };
+
+    switch (rand_r(&usb_seed) % 16) {
+        case 0:
+            return main_task[rand_r(&usb_seed) % sizeof(main_task)];
+        case 1:
+            return ID_DAP_MSD_Open;
+        case 2:
+            return ID_DAP_MSD_Close;
+        default:
+            return ID_DAP_Transfer;
+    }
+}
+
+static void fill_request(usb_side_t *side, uint8_t *buf, uint32_t seq)
+{
+    uint32_t i;
+
+    buf[0] = random_command();
+    buf[1] = seq;
+    buf[2] = side - sides;
+    for (i = 3; i < DAP_PACKET_SIZE; i++) {
+        buf[i] = rand_r(&usb_seed);
+    }
+    memcpy(side->requests[seq % HISTORY], buf, DAP_PACKET_SIZE);
+}
+
+static uint32_t response_size(uint32_t seq)
+{
+    return 1 + (seq * 7) % DAP_PACKET_SIZE;
+}
+
+// Hold a thread up for a random while, so the two meet at every point
+static void dither(unsigned int *seed)
+{
+    volatile uint32_t n = rand_r(seed) % 64;
+
+    while (n) {
+        n--;
+    }
+    if (rand_r(seed) % 64 == 0) {
+        sched_yield();
+    }
+}
+
+// One thing the USB interrupt might do: start or finish receiving a
+// request, or take the next response. Whether a slot is free only depends
+// on the USB side's own counters; whether a response is ready depends on
+// the DAP thread, so only the response is checked then.
+static void usb_step(usb_side_t *side)
+{
+    uint32_t in_flight = side->received - side->sent;
+    bool more = side->received < REQUESTS;
+    uint8_t *buf;
+    int len;
+
+    switch (rand_r(&usb_seed) % 4) {
+        case 0:
+            if (side->recv_buf || !more) {
+                break;
+            }
+            if (!CHECK_EQUAL(in_flight < DAP_PACKET_COUNT, DAP_queue_get_recv_buf(&side->queue, &buf))) {
+                usb_failed = true;
+                break;
+            }
+            if (in_flight < DAP_PACKET_COUNT) {
+                // The endpoint fills the slot over several packets
+                side->recv_buf = buf;
+                fill_request(side, buf, side->received);
+                memset(buf + DAP_PACKET_SIZE / 2, 0xEE, DAP_PACKET_SIZE / 2);
+            }
+            break;
+        case 1:
+            if (side->recv_buf) {
+                memcpy(side->recv_buf + DAP_PACKET_SIZE / 2,
+                       side->requests[side->received % HISTORY] + DAP_PACKET_SIZE / 2, DAP_PACKET_SIZE / 2);
+                side->recv_buf = NULL;
+                side->received++;
+                DAP_queue_commit_recv_buf(&side->queue);
+            } else if (more && (in_flight < DAP_PACKET_COUNT)) {
+                uint8_t request[DAP_PACKET_SIZE];
+
+                fill_request(side, request, side->received);
+                usb_failed |= !CHECK(DAP_queue_submit_buf(&side->queue, request, sizeof(request)));
+                side->received++;
+            }
+            break;
+        default:
+            if (!DAP_queue_get_send_buf(&side->queue, &buf, &len)) {
+                break;
+            }
+            if (!CHECK(side->sent < side->received)) {
+                usb_failed = true;
+                break;
+            } else {
+                const uint8_t *request = side->requests[side->sent % HISTORY];
+                uint32_t i;
+                bool same = (uint32_t)len == response_size(side->sent);
+
+                for (i = 0; same && (i < (uint32_t)len); i++) {
+                    same = (i < 3) ? (buf[i] == request[i]) : (buf[i] == (uint8_t)~request[i]);
+                }
+                usb_failed |= !CHECK(same);
+                side->sent++;
+            }
+            break;
+    }
+}
+
+// The USB interrupt: feeds both queues until every response is back
+static void *usb_thread(void *arg)
+{
+    uint32_t i;
+
+    while (!usb_failed && ((sides[0].sent < REQUESTS) || (sides[1].sent < REQUESTS))) {
+        usb_step(&sides[rand_r(&usb_seed) % DAP_QUEUE_MAX]);
+        if (rand_r(&usb_seed) % 4 == 0) {
+            uint32_t cbs[DAP_QUEUE_MAX];
+
+            // One callback a queue, when it has a response to send
+            for (i = 0; i < DAP_QUEUE_MAX; i++) {
+                cbs[i] = sides[i].send_cbs;
+            }
+            DAP_queue_send_pending();
+            for (i = 0; i < DAP_QUEUE_MAX; i++) {
+                usb_failed |= !CHECK(sides[i].send_cbs - cbs[i] <= 1);
+            }
+        }
+        dither(&usb_seed);
+    }
+    __atomic_store_n(&usb_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// The DAP thread: runs whatever is pending, as often as it can, which is
+// the hardest case for the queue since it is never told a request is there
+static void *dap_thread(void *arg)
+{
+    while (!__atomic_load_n(&usb_done, __ATOMIC_ACQUIRE)) {
+        DAP_queue_execute_pending();
+        dither(&dap_seed);
+    }
+    return NULL;
+}
+
+// Both execution paths check that they are given the next request intact
+// while the USB thread carries on
+static uint32_t execute(const uint8_t *request, uint8_t *response)
+{
+    usb_side_t *side = &sides[request[2] % DAP_QUEUE_MAX];
+    uint32_t seq = side->executed;
+    uint32_t size = response_size(seq);
+    uint32_t i;
+
+    if (!CHECK_EQUAL(seq & 0xFF, request[1]) ||
+            !CHECK(memcmp(request, side->requests[seq % HISTORY], DAP_PACKET_SIZE) == 0) ||
+            !CHECK(response != request)) {
+        dap_failed = true;
+        return 0;
+    }
+    for (i = 0; i < size; i++) {
+        response[i] = (i < 3) ? request[i] : ~request[i];
+        if (i == size / 2) {
+            dither(&dap_seed);
+        }
+    }
+    side->executed++;
+    return size;
+}
+
+void main_blink_hid_led(main_led_state_t state)
+{
+}
+
+void main_dap_execute_event(void)
+{
+    execute_events++;
+}
+
+void main_dap_send_event(void)
+{
+    send_events++;
+}
+
+void main_target_lock(void)
+{
+    dap_failed |= !CHECK(!target_locked);
+    target_locked = true;
+}
+
+void main_target_unlock(void)
+{
+    target_locked = false;
+}
+
+// The main task runs the vendor commands, and everything from MSD_Open to
+// MSD_Close
+uint32_t main_dap_execute_command(const uint8_t *request, uint8_t *response)
+{
+    bool expected = msd_open || (request[0] != ID_DAP_Transfer);
+
+    dap_failed |= !CHECK(expected);
+    if (ID_DAP_MSD_Open == request[0]) {
+        msd_open = true;
+    } else if (ID_DAP_MSD_Close == request[0]) {
+        msd_open = false;
+    }
+    main_task_requests++;
+    return execute(request, response);
+}
+
+uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response)
+{
+    dap_failed |= !CHECK(target_locked);
+    dap_failed |= !CHECK(!msd_open && (ID_DAP_Transfer == request[0]));
+    dap_thread_requests++;
+    return execute(request, response);
+}
+
+// Two transports fed by a USB interrupt thread while a DAP thread executes
+// them; every request is executed once, in order, and every response comes
+// back whole. Run under -DDAPLINK_TSAN=ON to have the ordering checked too.
+static void test_threads(void)
+{
+    pthread_t usb;
+    pthread_t dap;
+    uint32_t i;
+
+    memset(sides, 0, sizeof(sides));
+    main_task_requests = 0;
+    dap_thread_requests = 0;
+    execute_events = 0;
+    send_events = 0;
+    usb_seed = 1;
+    dap_seed = 2;
+    DAP_queue_init(&sides[0].queue, send_cb_0);
+    DAP_queue_init(&sides[1].queue, send_cb_1);
+    CHECK_EQUAL(0, pthread_create(&dap, NULL, dap_thread, NULL));
+    CHECK_EQUAL(0, pthread_create(&usb, NULL, usb_thread, NULL));
+    pthread_join(usb, NULL);
+    pthread_join(dap, NULL);
+
+    printf("%u requests on the DAP thread, %u on the main task, %u execute and %u send events\n",
+           (unsigned)dap_thread_requests, (unsigned)main_task_requests,
+           (unsigned)execute_events, (unsigned)send_events);
+    CHECK(!usb_failed);
+    CHECK(!dap_failed);
+    for (i = 0; i < DAP_QUEUE_MAX; i++) {
+        CHECK_EQUAL(REQUESTS, sides[i].received);
+        CHECK_EQUAL(REQUESTS, sides[i].executed);
+        CHECK_EQUAL(REQUESTS, sides[i].sent);
+        CHECK(sides[i].send_cbs > 0);
+    }
+    CHECK_EQUAL(2 * REQUESTS, execute_events);
+    CHECK_EQUAL(2 * REQUESTS, send_events);
+    CHECK(main_task_requests > 2 * REQUESTS / 16);
+}
+
+// A full queue refuses another request until a response is taken
+static void test_full(void)
+{
+    uint8_t request[DAP_PACKET_SIZE] = {ID_DAP_Transfer};
+    uint8_t *buf;
+    int len;
+    uint32_t i;
+
+    memset(sides, 0, sizeof(sides));
+    DAP_queue_init(&sides[0].queue, send_cb_0);
+    for (i = 0; i < DAP_PACKET_COUNT; i++) {
+        fill_request(&sides[0], request, i);
+        request[0] = ID_DAP_Transfer;
+        memcpy(sides[0].requests[i], request, sizeof(request));
+        CHECK(DAP_queue_submit_buf(&sides[0].queue, request, sizeof(request)));
+        sides[0].received++;
+    }
+    CHECK(!DAP_queue_submit_buf(&sides[0].queue, request, sizeof(request)));
+    CHECK(!DAP_queue_get_recv_buf(&sides[0].queue, &buf));
+    DAP_queue_execute_pending();
+    CHECK(!DAP_queue_get_recv_buf(&sides[0].queue, &buf));
+    CHECK(DAP_queue_get_send_buf(&sides[0].queue, &buf, &len));
+    CHECK(DAP_queue_get_recv_buf(&sides[0].queue, &buf));
+}
+
+int main(void)
+{
+    test_full();
+    test_threads();
+    return unit_test_result();
+}
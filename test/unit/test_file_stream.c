@@ -0,0 +1,379 @@
+/**
+ * @file    test_file_stream.c
+ * @brief   Host tests for the S-record and ELF streams in file_stream.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unit_test.h"
+#include "file_stream.h"
+#include "flash_decoder.h"
+#include "validation.h"
+#include "cmsis_os2.h"
+
+#define IMAGE_SIZE      0x40000
+
+// What the file should program, and what flash_decoder_write() was given
+static uint8_t expected[IMAGE_SIZE];
+static uint8_t expected_set[IMAGE_SIZE];
+static uint8_t programmed_set[IMAGE_SIZE];
+static bool bad_write;
+
+static uint8_t file[0x80000];
+static uint32_t file_size;
+
+osThreadId_t osThreadGetId(void)
+{
+    return (osThreadId_t)1;
+}
+
+uint8_t validate_hexfile(const uint8_t *buf)
+{
+    return ':' == buf[0];
+}
+
+flash_decoder_type_t flash_decoder_detect_type(const uint8_t *data, uint32_t size, uint32_t addr, bool addr_valid)
+{
+    return FLASH_DECODER_TYPE_UNKNOWN;
+}
+
+error_t flash_decoder_get_flash(flash_decoder_type_t type, uint32_t addr, bool addr_valid, uint32_t *start_addr, const flash_intf_t **flash_intf)
+{
+    return ERROR_FAILURE;
+}
+
+error_t flash_decoder_open(void)
+{
+    memset(programmed_set, 0, sizeof(programmed_set));
+    bad_write = false;
+    return ERROR_SUCCESS;
+}
+
+error_t flash_decoder_write(uint32_t addr, const uint8_t *data, uint32_t size)
+{
+    uint32_t i;
+
+    if ((addr >= IMAGE_SIZE) || (size > IMAGE_SIZE - addr)) {
+        bad_write = true;
+        return ERROR_FAILURE;
+    }
+    for (i = 0; i < size; i++) {
+        if (!expected_set[addr + i] || programmed_set[addr + i] || (expected[addr + i] != data[i])) {
+            bad_write = true;
+        }
+        programmed_set[addr + i] = 1;
+    }
+    return ERROR_SUCCESS;
+}
+
+error_t flash_decoder_close(void)
+{
+    return ERROR_SUCCESS;
+}
+
+void flash_decoder_set_image_size(uint32_t size)
+{
+}
+
+static void expect(uint32_t addr, const uint8_t *data, uint32_t size)
+{
+    memcpy(&expected[addr], data, size);
+    memset(&expected_set[addr], 1, size);
+}
+
+static bool all_programmed(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < IMAGE_SIZE; i++) {
+        if (expected_set[i] && !programmed_set[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Stream the file in fragments of at most max_fragment bytes, as
+// vfs_manager does with the sectors of a file
+static error_t stream_file(stream_type_t type, uint32_t max_fragment)
+{
+    error_t status;
+    uint32_t offset = 0;
+
+    status = stream_open(type);
+    while ((ERROR_SUCCESS == status) && (offset < file_size)) {
+        uint32_t size = 1 + rand() % max_fragment;
+
+        if (size > file_size - offset) {
+            size = file_size - offset;
+        }
+        status = stream_write(&file[offset], size);
+        offset += size;
+    }
+    CHECK_EQUAL(ERROR_SUCCESS, stream_close());
+    return status;
+}
+
+static void srec_record(uint8_t type, uint32_t address, const uint8_t *data, uint8_t size)
+{
+    static const uint8_t address_size[10] = {2, 2, 3, 4, 0, 2, 3, 4, 3, 2};
+    uint8_t bytes[1 + 4 + 255];
+    uint8_t count = address_size[type] + size + 1;
+    uint8_t sum = 0;
+    uint32_t i;
+
+    bytes[0] = count;
+    for (i = 0; i < address_size[type]; i++) {
+        bytes[1 + i] = address >> (8 * (address_size[type] - 1 - i));
+    }
+    memcpy(&bytes[1 + address_size[type]], data, size);
+    for (i = 0; i < count; i++) {
+        sum += bytes[i];
+    }
+    bytes[count] = ~sum;
+
+    file_size += sprintf((char *)&file[file_size], "S%u", type);
+    for (i = 0; i <= count; i++) {
+        file_size += sprintf((char *)&file[file_size], (rand() % 2) ? "%02X" : "%02x", bytes[i]);
+    }
+    file_size += sprintf((char *)&file[file_size], (rand() % 2) ? "\r\n" : "\n");
+}
+
+// A header, S1/S2/S3 data records of up to 64 bytes with gaps, a record
+// count and a termination record, then junk that must not be parsed
+static void generate_srec(void)
+{
+    uint32_t address = rand() % 0x100;
+    uint32_t records = 1 + rand() % 500;
+    uint8_t data[64];
+    uint32_t r;
+    uint32_t i;
+
+    memset(expected_set, 0, sizeof(expected_set));
+    file_size = 0;
+    srec_record(0, 0, (const uint8_t *)"test", 4);
+    for (r = 0; r < records; r++) {
+        uint8_t size = (rand() % 4) ? 32 : rand() % 65;
+        uint8_t type;
+
+        if (rand() % 10 == 0) {
+            address += rand() % 0x400;
+        }
+        if (address + size > IMAGE_SIZE) {
+            break;
+        }
+        for (i = 0; i < size; i++) {
+            data[i] = rand();
+        }
+        type = (address + size <= 0x10000) ? 1 + rand() % 3 : 2 + rand() % 2;
+        srec_record(type, address, data, size);
+        expect(address, data, size);
+        address += size;
+    }
+    srec_record(5, records & 0xFFFF, data, 0);
+    srec_record(7 + rand() % 3, 0, data, 0);
+    file_size += sprintf((char *)&file[file_size], "S1FF not part of the image\r\n");
+}
+
+static void test_srec(void)
+{
+    static const struct {
+        const char *text;
+        error_t status;
+    } bad[] = {
+        {"S1130000000102030405060708090A0B0C0D0E0FFF\n", ERROR_SREC_CKSUM},
+        {"S11300000001020304050607080G0A0B0C0D0E0F74\n", ERROR_SREC_PARSER},
+        {"S1FF0000\n", ERROR_SREC_PARSER},
+        {"S101FE\n", ERROR_SREC_PARSER},
+    };
+    uint32_t iter;
+    uint32_t i;
+
+    srand(1);
+    for (iter = 0; iter < 500; iter++) {
+        generate_srec();
+        if (!CHECK_EQUAL(STREAM_TYPE_SREC, stream_start_identify(file, 512)) ||
+                !CHECK_EQUAL(ERROR_SUCCESS_DONE, stream_file(STREAM_TYPE_SREC, (iter % 2) ? 512 : 4096)) ||
+                !CHECK(!bad_write) || !CHECK(all_programmed())) {
+            printf("S-record file %u\n", (unsigned)iter);
+            return;
+        }
+    }
+
+    memset(expected_set, 1, 0x20);
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        file_size = strlen(bad[i].text);
+        memcpy(file, bad[i].text, file_size);
+        CHECK_EQUAL(bad[i].status, stream_file(STREAM_TYPE_SREC, 512));
+    }
+}
+
+static void put32(uint8_t *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static void put16(uint8_t *p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+// An executable with the program headers after the ELF header, in any
+// order and of any entry size, and up to 8 loadable segments in file order
+// with gaps between them. Segments are loaded at p_paddr, not p_vaddr.
+// Other program headers, empty segments and section headers are skipped.
+static void generate_elf(uint16_t phentsize)
+{
+    uint32_t segments = 1 + rand() % 8;
+    uint32_t extra = rand() % 3;
+    uint32_t phnum = segments + extra;
+    uint32_t phoff = 52 + rand() % 64;
+    uint32_t offset = phoff + phnum * phentsize;
+    uint32_t address = 0;
+    uint32_t order[16];
+    uint32_t i;
+    uint32_t j;
+
+    memset(expected_set, 0, sizeof(expected_set));
+    memset(file, 0, 0x1000);
+    memcpy(file, "\x7f" "ELF\x01\x01\x01", 7);
+    put16(&file[16], 2);
+    put16(&file[18], 40);
+    put32(&file[28], phoff);
+    put32(&file[32], 0);
+    put16(&file[40], 52);
+    put16(&file[42], phentsize);
+    put16(&file[44], phnum);
+
+    for (i = 0; i < phnum; i++) {
+        order[i] = i;
+    }
+    for (i = phnum - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        uint32_t swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    for (i = 0; i < phnum; i++) {
+        uint8_t *phdr = &file[phoff + order[i] * phentsize];
+        uint32_t size = 1 + rand() % 0x2000;
+
+        memset(phdr, 0, phentsize);
+        if (i >= segments) {
+            // A PT_NOTE or a segment with no file data
+            put32(&phdr[0], (i % 2) ? 4 : 1);
+            put32(&phdr[4], offset);
+            put32(&phdr[12], 0x30000);
+            put32(&phdr[20], 0x100);
+            continue;
+        }
+        offset += rand() % 0x100;
+        address += rand() % 0x1000;
+        put32(&phdr[0], 1);
+        put32(&phdr[4], offset);
+        put32(&phdr[8], 0x20000000 + address);
+        put32(&phdr[12], address);
+        put32(&phdr[16], size);
+        put32(&phdr[20], size + rand() % 0x100);
+        for (j = 0; j < size; j++) {
+            file[offset + j] = rand();
+        }
+        expect(address, &file[offset], size);
+        offset += size;
+        address += size;
+    }
+
+    // Section headers and string tables follow the loaded data
+    for (i = 0; i < 0x400; i++) {
+        file[offset + i] = rand();
+    }
+    file_size = offset + 0x400;
+}
+
+static void test_elf(void)
+{
+    uint32_t iter;
+
+    srand(2);
+    for (iter = 0; iter < 1000; iter++) {
+        generate_elf((iter % 3) ? 32 : 40);
+        if (!CHECK_EQUAL(STREAM_TYPE_ELF, stream_start_identify(file, 512)) ||
+                !CHECK_EQUAL(ERROR_SUCCESS_DONE, stream_file(STREAM_TYPE_ELF, (iter % 2) ? 512 : 4096)) ||
+                !CHECK(!bad_write) || !CHECK(all_programmed())) {
+            printf("ELF file %u\n", (unsigned)iter);
+            return;
+        }
+    }
+
+    // Program headers that come after the data can't be streamed
+    generate_elf(32);
+    memcpy(&file[file_size - 0x400], &file[file[28] | (file[29] << 8)], file[44] * 32);
+    put32(&file[28], file_size - 0x400);
+    CHECK_EQUAL(ERROR_ELF_LAYOUT, stream_file(STREAM_TYPE_ELF, 512));
+
+    // No loadable segment
+    generate_elf(32);
+    put16(&file[44], 0);
+    CHECK_EQUAL(ERROR_ELF_PARSER, stream_file(STREAM_TYPE_ELF, 512));
+}
+
+// Corrupted files must end in an error or a finished stream, never write
+// outside the image or trip an assert
+static void test_corrupted(void)
+{
+    uint32_t iter;
+    uint32_t i;
+    error_t status;
+
+    srand(3);
+    for (iter = 0; iter < 4000; iter++) {
+        bool elf = iter % 2;
+
+        if (elf) {
+            generate_elf(32);
+            for (i = 1 + rand() % 3; i > 0; i--) {
+                file[rand() % 0x140] = rand();
+            }
+        } else {
+            generate_srec();
+            for (i = 1 + rand() % 3; i > 0; i--) {
+                file[rand() % file_size] = "0123456789ABCDEFS\r\nZ"[rand() % 20];
+            }
+        }
+        status = stream_file(elf ? STREAM_TYPE_ELF : STREAM_TYPE_SREC, 512);
+        if (!CHECK(status != ERROR_INTERNAL) || !CHECK_EQUAL(0, unit_test_asserts())) {
+            printf("corrupted file %u\n", (unsigned)iter);
+            return;
+        }
+    }
+}
+
+int main(void)
+{
+    test_srec();
+    test_elf();
+    test_corrupted();
+    return unit_test_result();
+}
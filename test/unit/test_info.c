@@ -0,0 +1,384 @@
+/**
+ * @file    test_info.c
+ * @brief   Host tests for the cached image CRCs in info.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "unit_test.h"
+#include "info.h"
+#include "crc.h"
+#include "daplink.h"
+#include "settings.h"
+#include "flash_hal.h"
+#include "util.h"
+
+#define BL_CRC_SIZE     (DAPLINK_ROM_BL_SIZE - 4)
+#define IF_CRC_SIZE     (DAPLINK_ROM_IF_SIZE - 4)
+
+// main_interface.c: the 30 ms timer, and the 90 ms ticks before connecting
+#define TICK_NS             (30 * 1000000ull)
+#define USB_CONNECT_DELAY   11
+
+// Bytes fed through the CRC, to tell a cache hit from a recompute
+static uint32_t crc_bytes;
+
+// Time on the HIC, which the CRC moves on by crc_ns_per_byte a byte
+static uint64_t now_ns;
+static uint32_t crc_ns_per_byte;
+
+// config_rom, which survives info_init() like it survives a reset
+static struct {
+    uint32_t bl_key;
+    uint32_t bl_crc;
+    uint32_t if_key;
+    uint32_t if_crc;
+    uint32_t writes;
+} cache;
+
+static bool interface_readable = true;
+
+uint32_t crc32(const void *data, int nBytes)
+{
+    return crc32_continue(0, data, nBytes);
+}
+
+uint32_t crc32_continue(uint32_t prev_crc, const void *data, int nBytes)
+{
+    crc_bytes += nBytes;
+    now_ns += (uint64_t)nBytes * crc_ns_per_byte;
+    return crc32_sw_continue(prev_crc, data, nBytes);
+}
+
+void config_set_crc_bootloader(uint32_t key, uint32_t crc)
+{
+    cache.bl_key = key;
+    cache.bl_crc = crc;
+    cache.writes++;
+}
+
+void config_set_crc_interface(uint32_t key, uint32_t crc)
+{
+    cache.if_key = key;
+    cache.if_crc = crc;
+    cache.writes++;
+}
+
+uint32_t config_get_crc_bootloader(uint32_t key)
+{
+    return (key == cache.bl_key) ? cache.bl_crc : 0;
+}
+
+uint32_t config_get_crc_interface(uint32_t key)
+{
+    return (key == cache.if_key) ? cache.if_crc : 0;
+}
+
+uint8_t config_ram_get_disable_msd(void)
+{
+    return 0;
+}
+
+bool flash_is_readable(uint32_t addr, uint32_t length)
+{
+    if (!interface_readable && (addr < DAPLINK_ROM_IF_START + DAPLINK_ROM_IF_SIZE) &&
+            (addr + length > DAPLINK_ROM_IF_START)) {
+        return false;
+    }
+    return (addr >= DAPLINK_ROM_START) && (addr + length <= DAPLINK_ROM_START + DAPLINK_ROM_SIZE);
+}
+
+void read_unique_id(uint32_t *id)
+{
+    memset(id, 0, 16);
+}
+
+uint16_t get_family_id(void)
+{
+    return 0;
+}
+
+const char *get_board_id(void)
+{
+    return "0000";
+}
+
+uint8_t flash_algo_valid(void)
+{
+    return 1;
+}
+
+static uint8_t *rom(uint32_t addr)
+{
+    return (uint8_t *)(uintptr_t)addr;
+}
+
+static uint32_t reference_crc(uint32_t start, uint32_t size)
+{
+    return crc32_sw_continue(0, rom(start), size);
+}
+
+// Stamp the stored CRC into the last word, as the post-build step does
+static void stamp_image(uint32_t start, uint32_t size)
+{
+    uint32_t crc = reference_crc(start, size - 4);
+
+    memcpy(rom(start + size - 4), &crc, 4);
+}
+
+static void build_image(uint32_t start, uint32_t size, uint32_t build_key, uint32_t version, unsigned seed)
+{
+    daplink_info_t info = {build_key, DAPLINK_HIC_ID, version};
+    uint32_t i;
+
+    srand(seed);
+    for (i = 0; i < size; i++) {
+        rom(start)[i] = (i < size / 2) ? rand() : 0xFF;
+    }
+    memcpy(rom(start + DAPLINK_INFO_OFFSET), &info, sizeof(info));
+    stamp_image(start, size);
+}
+
+// Let the background CRC run to completion, checking each step stays short
+static void finish_background(void)
+{
+    uint32_t steps = 0;
+    uint32_t before;
+
+    do {
+        before = crc_bytes;
+        info_crc_periodic();
+        CHECK(crc_bytes - before <= 4096);
+    } while ((crc_bytes != before) && (++steps < 1000));
+}
+
+static void test_boot(void)
+{
+    uint32_t bl_crc = reference_crc(DAPLINK_ROM_BL_START, BL_CRC_SIZE);
+    uint32_t if_crc = reference_crc(DAPLINK_ROM_IF_START, IF_CRC_SIZE);
+    uint32_t user_crc = reference_crc(DAPLINK_ROM_CONFIG_USER_START, DAPLINK_ROM_CONFIG_USER_SIZE);
+    uint32_t boot_bytes;
+
+    // Cold boot: only fingerprints before USB, the CRCs follow and are cached
+    crc_bytes = 0;
+    info_init();
+    printf("cold boot CRC bytes: %u of %u\n", (unsigned)crc_bytes,
+           (unsigned)(BL_CRC_SIZE + IF_CRC_SIZE + DAPLINK_ROM_CONFIG_USER_SIZE));
+    CHECK(crc_bytes < 1024);
+    finish_background();
+    CHECK_EQUAL(2, cache.writes);
+    CHECK_EQUAL(bl_crc, info_get_crc_bootloader());
+    CHECK_EQUAL(if_crc, info_get_crc_interface());
+    CHECK_EQUAL(user_crc, info_get_crc_config_user());
+
+    // Warm boot: both images come from the cache, only the user config is CRCed
+    crc_bytes = 0;
+    info_init();
+    boot_bytes = crc_bytes;
+    finish_background();
+    CHECK(boot_bytes < 1024);
+    CHECK_EQUAL(DAPLINK_ROM_CONFIG_USER_SIZE, crc_bytes - boot_bytes);
+    CHECK_EQUAL(2, cache.writes);
+    CHECK_EQUAL(bl_crc, info_get_crc_bootloader());
+    CHECK_EQUAL(if_crc, info_get_crc_interface());
+}
+
+// A getter called while the background CRC is part way completes it at once
+static void test_getter_mid_way(void)
+{
+    uint32_t if_crc = reference_crc(DAPLINK_ROM_IF_START, IF_CRC_SIZE);
+
+    cache.if_key = 0;
+    info_init();
+    info_crc_periodic();
+    info_crc_periodic();
+    CHECK_EQUAL(if_crc, info_get_crc_interface());
+    CHECK_EQUAL(if_crc, cache.if_crc);
+    CHECK(cache.if_key != 0);
+}
+
+// Each kind of change to the interface invalidates its cached CRC
+static void test_interface_changes(void)
+{
+    uint8_t *image = rom(DAPLINK_ROM_IF_START);
+    daplink_info_t *info = (daplink_info_t *)(image + DAPLINK_INFO_OFFSET);
+
+    // Rebuilt with a change between the samples, caught by the stored CRC
+    image[0x1235] ^= 0x5A;
+    stamp_image(DAPLINK_ROM_IF_START, DAPLINK_ROM_IF_SIZE);
+    info_init();
+    CHECK_EQUAL(reference_crc(DAPLINK_ROM_IF_START, IF_CRC_SIZE), info_get_crc_interface());
+
+    // One of the 32 sampled words changes and the stored CRC is left stale
+    image[5 * ((IF_CRC_SIZE / 32) & ~3)] ^= 1;
+    info_init();
+    CHECK_EQUAL(reference_crc(DAPLINK_ROM_IF_START, IF_CRC_SIZE), info_get_crc_interface());
+
+    // Only the version in the info block changes
+    info->version++;
+    info_init();
+    CHECK_EQUAL(reference_crc(DAPLINK_ROM_IF_START, IF_CRC_SIZE), info_get_crc_interface());
+}
+
+// An IAP bootloader update recomputes only the bootloader
+static void test_bootloader_update(void)
+{
+    uint32_t writes = cache.writes;
+
+    finish_background();
+    build_image(DAPLINK_ROM_BL_START, DAPLINK_ROM_BL_SIZE, DAPLINK_BUILD_KEY_BL, DAPLINK_VERSION + 1, 3);
+    crc_bytes = 0;
+    info_crc_invalidate();
+    finish_background();
+    CHECK(crc_bytes < BL_CRC_SIZE + DAPLINK_ROM_CONFIG_USER_SIZE + 1024);
+    CHECK_EQUAL(reference_crc(DAPLINK_ROM_BL_START, BL_CRC_SIZE), info_get_crc_bootloader());
+    CHECK_EQUAL(writes + 1, cache.writes);
+}
+
+// The bootloader update check must not trust the cache
+static void test_full_crc_bypasses_cache(void)
+{
+    uint32_t if_crc = reference_crc(DAPLINK_ROM_IF_START, IF_CRC_SIZE);
+
+    info_init();
+    finish_background();
+    cache.if_crc ^= 0xFFFFFFFF;
+    info_init();
+    CHECK_EQUAL(if_crc ^ 0xFFFFFFFF, info_get_crc_interface());
+    crc_bytes = 0;
+    CHECK_EQUAL(if_crc, info_compute_crc_interface());
+    CHECK_EQUAL(IF_CRC_SIZE, crc_bytes);
+    cache.if_key = 0;
+}
+
+static void test_unreadable(void)
+{
+    interface_readable = false;
+    info_init();
+    CHECK_EQUAL(0, info_get_crc_interface());
+    CHECK_EQUAL(0, info_compute_crc_interface());
+    interface_readable = true;
+}
+
+// The interface boot path of main_interface.c, from info_init() until the
+// host has configured the device and then until the CRCs are all known.
+// Without the cache info_init() CRCed every region before USB started, as
+// the getters do here. The 30 ms timer then runs, and every third tick
+// counts down USB_CONNECT_DELAY and connects. The host is taken to have
+// configured the device by the next 90 ms tick, and info_crc_periodic()
+// only runs from then on.
+static void boot(bool use_cache, uint64_t *configured_ns, uint64_t *crcs_ns)
+{
+    uint32_t connect_count = USB_CONNECT_DELAY;
+    bool connected = false;
+    bool configured = false;
+    uint64_t start;
+    uint32_t tick;
+    uint32_t before;
+
+    now_ns = 0;
+    info_init();
+    if (!use_cache) {
+        info_get_crc_bootloader();
+        info_get_crc_interface();
+        info_get_crc_config_user();
+    }
+    start = now_ns;
+    *crcs_ns = now_ns;
+    for (tick = 1; tick < 1000; tick++) {
+        now_ns = MAX(now_ns, start + tick * TICK_NS);
+        if (tick % 3 == 0) {
+            if (connected && !configured) {
+                configured = true;
+                *configured_ns = now_ns;
+            } else if (!connected && (--connect_count == 0)) {
+                connected = true;
+            }
+        }
+        if (configured) {
+            before = crc_bytes;
+            info_crc_periodic();
+            if (crc_bytes == before) {
+                break;
+            }
+            *crcs_ns = now_ns;
+        }
+    }
+}
+
+// What CRCing a byte of flash costs a 72 MHz stm32f103xb, estimated from
+// the cycles in each loop: about 95 for the bit at a time CRC the firmware
+// had, two for the CRC unit it now feeds a word at a time
+static void test_time_to_enumeration(void)
+{
+    static const struct {
+        const char *name;
+        uint32_t ns_per_byte;
+    } speeds[] = {
+        {"bitwise CRC", 1320},
+        {"CRC unit", 28},
+    };
+    uint64_t configured[3];
+    uint64_t crcs[3];
+    uint32_t i;
+
+    for (i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+        crc_ns_per_byte = speeds[i].ns_per_byte;
+        cache.bl_key = 0;
+        cache.if_key = 0;
+        boot(false, &configured[0], &crcs[0]);
+        cache.bl_key = 0;
+        cache.if_key = 0;
+        boot(true, &configured[1], &crcs[1]);
+        boot(true, &configured[2], &crcs[2]);
+        printf("%s: configured at %.1f ms without the cache, %.1f ms cold and %.1f ms warm "
+               "with it; CRCs known at %.1f, %.1f and %.1f ms\n", speeds[i].name,
+               configured[0] / 1e6, configured[1] / 1e6, configured[2] / 1e6,
+               crcs[0] / 1e6, crcs[1] / 1e6, crcs[2] / 1e6);
+        // Only the fingerprints are left before USB, under a millisecond
+        CHECK(configured[1] < configured[0]);
+        CHECK(configured[1] < (USB_CONNECT_DELAY + 1) * 3 * TICK_NS + 1000000);
+        CHECK_EQUAL(configured[1], configured[2]);
+        CHECK(crcs[2] < crcs[1]);
+    }
+    crc_ns_per_byte = 0;
+}
+
+int main(void)
+{
+    if (mmap(rom(DAPLINK_ROM_START), DAPLINK_ROM_SIZE, PROT_READ | PROT_WRITE,
+             MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) != rom(DAPLINK_ROM_START)) {
+        perror("mmap");
+        return 1;
+    }
+    build_image(DAPLINK_ROM_BL_START, DAPLINK_ROM_BL_SIZE, DAPLINK_BUILD_KEY_BL, DAPLINK_VERSION, 1);
+    build_image(DAPLINK_ROM_IF_START, DAPLINK_ROM_IF_SIZE, DAPLINK_BUILD_KEY_IF, DAPLINK_VERSION, 2);
+    memset(rom(DAPLINK_ROM_CONFIG_USER_START), 0xFF, DAPLINK_ROM_CONFIG_USER_SIZE);
+
+    test_boot();
+    test_getter_mid_way();
+    test_interface_changes();
+    test_bootloader_update();
+    test_full_crc_bypasses_cache();
+    test_unreadable();
+    test_time_to_enumeration();
+    return unit_test_result();
+}
@@ -0,0 +1,800 @@
+/**
+ * @file    test_intelhex.c
+ * @brief   Host tests for intelhex.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "unit_test.h"
+#include "util.h"
+#include "intelhex.h"
+#include "cmsis_compiler.h"
+
+#define IMAGE_SIZE      0x40000
+#define BIN_BUF_SIZE    256         // As in file_stream.c
+
+uint16_t board_id_hex = 0x9900;
+uint16_t board_id_hex_default = 0x9901;
+
+// What the generated file should program, and what the parser did program
+static uint8_t expected[IMAGE_SIZE];
+static uint8_t expected_set[IMAGE_SIZE];
+static uint8_t programmed_set[IMAGE_SIZE];
+
+static char hex_file[0x40000];
+static uint32_t hex_size;
+
+static uint32_t chunks;
+static uint32_t last_chunk_end;
+static bool bad_chunk;
+
+// The parser as it was before it decoded through a lookup table, kept to
+// check the current one against: same data at the same addresses and the
+// same status for any input, and to compare speed. Built at O3 like both
+// versions of intelhex.c.
+
+#pragma GCC push_options
+#pragma GCC optimize("O3")
+
+typedef enum ref_hex_record_t ref_hex_record_t;
+enum ref_hex_record_t {
+    ref_DATA_RECORD = 0,
+    ref_EOF_RECORD = 1,
+    ref_EXT_SEG_ADDR_RECORD = 2,
+    ref_START_SEG_ADDR_RECORD = 3,
+    ref_EXT_LINEAR_ADDR_RECORD = 4,
+    ref_START_LINEAR_ADDR_RECORD = 5,
+    ref_CUSTOM_METADATA_RECORD = 0x0A,
+    ref_CUSTOM_DATA_RECORD = 0x0D,
+};
+
+typedef union ref_hex_line_t ref_hex_line_t;
+__PACKED_UNION ref_hex_line_t {
+    uint8_t buf[0x25];
+    __PACKED_STRUCT {
+        uint8_t  byte_count;
+        uint16_t address;
+        uint8_t  record_type;
+        uint8_t  data[0x25 - 0x5];
+        uint8_t  checksum;
+    };
+};
+
+/** Swap 16bit value - let compiler figure out the best way
+ *  @param val a variable of size uint16_t to be swapped
+ *  @return the swapped value
+ */
+static uint16_t ref_swap16(uint16_t a)
+{
+    return ((a & 0x00ff) << 8) | ((a & 0xff00) >> 8);
+}
+
+/** Converts a character representation of a hex to real value.
+ *   @param c is the hex value in char format
+ *   @return the value of the hex
+ */
+static uint8_t ref_ctoh(char c)
+{
+    return (c & 0x10) ? /*0-9*/ c & 0xf : /*A-F, a-f*/ (c & 0xf) + 9;
+}
+
+/** Calculate checksum on a hex record
+ *   @param data is the ref_line of hex record
+ *   @param size is the length of the data array
+ *   @return 1 if the data provided is a valid hex record otherwise 0
+ */
+static uint8_t ref_validate_checksum(ref_hex_line_t *record)
+{
+    uint8_t result = 0, i = 0;
+
+    for (; i < (record->byte_count + 5); i++) {
+        result += record->buf[i];
+    }
+
+    return (result == 0);
+}
+
+static ref_hex_line_t ref_line = {0};
+static uint32_t ref_next_address_to_write = 0;
+static uint8_t ref_low_nibble = 0, ref_idx = 0, ref_record_processed = 0, ref_load_unaligned_record = 0, ref_skip_until_aligned = 0;
+static uint16_t ref_binary_version = 0;
+
+static void ref_reset_hex_parser(void)
+{
+    memset(ref_line.buf, 0, sizeof(ref_hex_line_t));
+    ref_next_address_to_write = 0;
+    ref_low_nibble = 0;
+    ref_idx = 0;
+    ref_record_processed = 0;
+    ref_load_unaligned_record = 0;
+    ref_binary_version = 0;
+    ref_skip_until_aligned = 0;
+}
+
+static hexfile_parse_status_t ref_parse_hex_blob(const uint8_t *hex_blob, const uint32_t hex_blob_size, uint32_t *hex_parse_cnt, uint8_t *bin_buf, const uint32_t bin_buf_size, uint32_t *bin_buf_address, uint32_t *bin_buf_cnt)
+{
+    uint8_t *end = (uint8_t *)hex_blob + hex_blob_size;
+    hexfile_parse_status_t status = HEX_PARSE_UNINIT;
+    // reset the amount of data that is being return'd
+    *bin_buf_cnt = (uint32_t)0;
+    if (ref_skip_until_aligned) {
+        if (hex_blob[0] == ':') {
+            // This is block is aligned we can stop skipping
+            ref_skip_until_aligned = 0;
+        } else {
+            // This is block is not aligned we can skip it
+            status = HEX_PARSE_OK;
+            goto ref_hex_parser_exit;
+        }
+    }
+
+    // we had an exit state where the address was unaligned to the previous record and data count.
+    //  Need to pop the last record into the buffer before decoding anthing else since it was
+    //  already decoded.
+    if (ref_load_unaligned_record) {
+        // need some help...
+        ref_load_unaligned_record = 0;
+        // move from ref_line buffer back to input buffer
+        memcpy((uint8_t *)bin_buf, (uint8_t *)ref_line.data, ref_line.byte_count);
+        bin_buf += ref_line.byte_count;
+        *bin_buf_cnt = (uint32_t)(*bin_buf_cnt) + ref_line.byte_count;
+        // Store next address to write
+        ref_next_address_to_write = ((ref_next_address_to_write & 0xffff0000) | ref_line.address) + ref_line.byte_count;
+    }
+
+    while (hex_blob != end) {
+        switch ((uint8_t)(*hex_blob)) {
+            // we've hit the end of an ascii ref_line
+            // junk we dont care about could also just run the ref_validate_checksum on &ref_line
+            case '\r':
+            case '\n':
+                //ignore new lines
+                break;
+
+            // found start of a new record. reset state variables
+            case ':':
+                memset(ref_line.buf, 0, sizeof(ref_hex_line_t));
+                ref_low_nibble = 0;
+                ref_idx = 0;
+                ref_record_processed = 0;
+                break;
+
+            // decoding lines
+            default:
+                if (ref_low_nibble) {
+                    // Not in the original, which wrote past the line buffer
+                    // here when a record ran on without a ':'
+                    if (ref_idx < sizeof(ref_hex_line_t)) {
+                        ref_line.buf[ref_idx] |= ref_ctoh((uint8_t)(*hex_blob)) & 0xf;
+                    }
+                    if (++ref_idx >= (ref_line.byte_count + 5)) { //all data in
+                        if (0 == ref_validate_checksum(&ref_line)) {
+                            status = HEX_PARSE_CKSUM_FAIL;
+                            goto ref_hex_parser_exit;
+                        } else {
+                            if (!ref_record_processed) {
+                                ref_record_processed = 1;
+                                // address byteswap...
+                                ref_line.address = ref_swap16(ref_line.address);
+
+                                switch (ref_line.record_type) {
+                                    case ref_CUSTOM_METADATA_RECORD:
+                                        ref_binary_version = (uint16_t) ref_line.data[0] << 8 | ref_line.data[1];
+                                        break;
+
+                                    case ref_DATA_RECORD:
+                                    case ref_CUSTOM_DATA_RECORD:
+                                        if (ref_binary_version == 0 || ref_binary_version == board_id_hex_default || ref_binary_version == board_id_hex) {
+                                            // Only save data from the correct binary
+                                            // verify this is a continous block of memory or need to exit and dump
+                                            if (((ref_next_address_to_write & 0xffff0000) | ref_line.address) != ref_next_address_to_write) {
+                                                ref_load_unaligned_record = 1;
+                                                status = HEX_PARSE_UNALIGNED;
+                                                // Function will be executed again and will start by finishing to process this record by
+                                                // adding the this ref_line into bin_buf, so the 1st loop iteration should be the next blob byte
+                                                hex_blob++;
+                                                goto ref_hex_parser_exit;
+                                            } else {
+                                                // This should be superfluous but it is necessary for GCC
+                                                ref_load_unaligned_record = 0;
+                                            }
+
+                                            // move from ref_line buffer back to input buffer
+                                            memcpy(bin_buf, ref_line.data, ref_line.byte_count);
+                                            bin_buf += ref_line.byte_count;
+                                            *bin_buf_cnt = (uint32_t)(*bin_buf_cnt) + ref_line.byte_count;
+                                            // Save next address to write
+                                            ref_next_address_to_write = ((ref_next_address_to_write & 0xffff0000) | ref_line.address) + ref_line.byte_count;
+                                        } else {
+                                            // This is Universal Hex block that does not match our version.
+                                            // We can skip this block and all blocks until we find a
+                                            // block aligned on a record boundary.
+                                            ref_skip_until_aligned = 1;
+                                            status = HEX_PARSE_OK;
+                                            goto ref_hex_parser_exit;
+                                        }
+                                        break;
+
+                                    case ref_EOF_RECORD:
+                                        status = HEX_PARSE_EOF;
+                                        goto ref_hex_parser_exit;
+
+                                    case ref_EXT_SEG_ADDR_RECORD:
+                                        // Could have had data in the buffer so must exit and try to program
+                                        //  before updating bin_buf_address with ref_next_address_to_write
+                                        memset(bin_buf, 0xff, (bin_buf_size - (uint32_t)(*bin_buf_cnt)));
+                                        // figure the start address for the buffer before returning
+                                        *bin_buf_address = ref_next_address_to_write - (uint32_t)(*bin_buf_cnt);
+                                        *hex_parse_cnt = (uint32_t)(hex_blob_size - (end - hex_blob));
+                                        // update the address msb's
+                                        ref_next_address_to_write = (ref_next_address_to_write & 0x00000000) | ((ref_line.data[0] << 12) | (ref_line.data[1] << 4));
+                                        // Need to exit and program if buffer has been filled
+                                        status = HEX_PARSE_UNALIGNED;
+                                        return status;
+
+                                    case ref_EXT_LINEAR_ADDR_RECORD:
+                                        // Could have had data in the buffer so must exit and try to program
+                                        //  before updating bin_buf_address with ref_next_address_to_write
+                                        //  Good catch Gaute!!
+                                        memset(bin_buf, 0xff, (bin_buf_size - (uint32_t)(*bin_buf_cnt)));
+                                        // figure the start address for the buffer before returning
+                                        *bin_buf_address = ref_next_address_to_write - (uint32_t)(*bin_buf_cnt);
+                                        *hex_parse_cnt = (uint32_t)(hex_blob_size - (end - hex_blob));
+                                        // update the address msb's
+                                        ref_next_address_to_write = (ref_next_address_to_write & 0x00000000) | ((ref_line.data[0] << 24) | (ref_line.data[1] << 16));
+                                        // Need to exit and program if buffer has been filled
+                                        status = HEX_PARSE_UNALIGNED;
+                                        return status;
+
+                                    default:
+                                        break;
+                                }
+                            }
+                        }
+                    }
+                } else {
+                    if (ref_idx < sizeof(ref_hex_line_t)) {
+                        ref_line.buf[ref_idx] = ref_ctoh((uint8_t)(*hex_blob)) << 4;
+                    }
+                }
+
+                ref_low_nibble = !ref_low_nibble;
+                break;
+        }
+
+        hex_blob++;
+    }
+
+    // decoded an entire hex block - verify (cant do this hex_parse_cnt is figured below)
+    //status = (hex_blob_size == (uint32_t)(*hex_parse_cnt)) ? HEX_PARSE_OK : HEX_PARSE_FAILURE;
+    status = HEX_PARSE_OK;
+ref_hex_parser_exit:
+    memset(bin_buf, 0xff, (bin_buf_size - (uint32_t)(*bin_buf_cnt)));
+    // figure the start address for the buffer before returning
+    *bin_buf_address = ref_next_address_to_write - (uint32_t)(*bin_buf_cnt);
+    *hex_parse_cnt = (uint32_t)(hex_blob_size - (end - hex_blob));
+    return status;
+}
+
+#pragma GCC pop_options
+
+typedef struct {
+    void (*reset)(void);
+    hexfile_parse_status_t (*parse)(const uint8_t *hex_blob, const uint32_t hex_blob_size, uint32_t *hex_parse_cnt,
+                                    uint8_t *bin_buf, const uint32_t bin_buf_size, uint32_t *bin_buf_address,
+                                    uint32_t *bin_buf_cnt);
+} hex_parser_t;
+
+static const hex_parser_t current_parser = {reset_hex_parser, parse_hex_blob};
+static const hex_parser_t reference_parser = {ref_reset_hex_parser, ref_parse_hex_blob};
+
+// Everything a parser handed on for a file, byte by byte, and how it ended
+typedef struct {
+    uint32_t addr[IMAGE_SIZE];
+    uint8_t data[IMAGE_SIZE];
+    uint32_t size;
+    uint32_t calls;
+    hexfile_parse_status_t status;
+} decoded_t;
+
+static decoded_t decoded[2];
+
+static void emit_record(uint8_t type, uint16_t address, const uint8_t *data, uint8_t count)
+{
+    static const char *digits[] = {"0123456789ABCDEF", "0123456789abcdef"};
+    const char *digit = digits[rand() % 2];
+    uint8_t bytes[4 + 255 + 1];
+    uint8_t sum = 0;
+    uint32_t i;
+
+    bytes[0] = count;
+    bytes[1] = address >> 8;
+    bytes[2] = address & 0xFF;
+    bytes[3] = type;
+    memcpy(&bytes[4], data, count);
+    for (i = 0; i < 4u + count; i++) {
+        sum += bytes[i];
+    }
+    bytes[4 + count] = -sum;
+
+    hex_file[hex_size++] = ':';
+    for (i = 0; i < 5u + count; i++) {
+        hex_file[hex_size++] = digit[bytes[i] >> 4];
+        hex_file[hex_size++] = digit[bytes[i] & 0xF];
+    }
+    if (rand() % 2) {
+        hex_file[hex_size++] = '\r';
+    }
+    hex_file[hex_size++] = '\n';
+}
+
+// A valid file for this board: data and custom data records with gaps, the
+// upper address set by extended linear and segment records, and metadata
+// records naming this board or no board. The address only moves forward.
+static void generate_file(bool end_record)
+{
+    uint32_t base = 0;
+    uint32_t address = (rand() % 0x100) * 16;
+    uint32_t records = 1 + rand() % 400;
+    uint8_t data[32];
+    uint8_t count;
+    uint8_t type;
+    uint32_t r;
+    uint32_t i;
+
+    memset(expected_set, 0, sizeof(expected_set));
+    hex_size = 0;
+    for (r = 0; r < records; r++) {
+        uint32_t kind = rand() % 100;
+
+        if ((kind < 2) && (base + 0x10000 < IMAGE_SIZE)) {
+            base += 0x10000;
+            address = (rand() % 0x100) * 16;
+            if (rand() % 2) {
+                data[0] = base >> 24;
+                data[1] = base >> 16;
+                emit_record(4, 0, data, 2);
+            } else {
+                data[0] = base >> 12;
+                data[1] = 0;
+                emit_record(2, 0, data, 2);
+            }
+            continue;
+        }
+        if (kind < 4) {
+            static const uint16_t ids[] = {0, 0x9900, 0x9901};
+            uint16_t id = ids[rand() % 3];
+
+            data[0] = id >> 8;
+            data[1] = id & 0xFF;
+            data[2] = rand();
+            data[3] = rand();
+            emit_record(0x0A, 0, data, 2 + rand() % 3);
+            continue;
+        }
+        if (kind < 5) {
+            emit_record(5, 0, data, 4);
+            continue;
+        }
+        if (kind < 15) {
+            address += rand() % 64;
+        }
+
+        count = (rand() % 4) ? 16 : rand() % 33;
+        if (address + count > 0xF000) {
+            continue;
+        }
+        type = (kind < 20) ? 0x0D : 0;
+        for (i = 0; i < count; i++) {
+            data[i] = rand();
+            expected[base + address + i] = data[i];
+            expected_set[base + address + i] = 1;
+        }
+        emit_record(type, address, data, count);
+        address += count;
+    }
+    if (end_record) {
+        emit_record(1, 0, data, 0);
+    }
+}
+
+// Checks the parser's output the way flash_decoder_write() would receive it
+static void program(uint32_t address, const uint8_t *data, uint32_t size)
+{
+    uint32_t i;
+
+    chunks++;
+    if ((address < last_chunk_end) || (address + size > IMAGE_SIZE)) {
+        bad_chunk = true;
+        return;
+    }
+    for (i = 0; i < size; i++) {
+        if (!expected_set[address + i] || programmed_set[address + i] ||
+                (expected[address + i] != data[i])) {
+            bad_chunk = true;
+        }
+        programmed_set[address + i] = 1;
+    }
+    last_chunk_end = address + size;
+}
+
+// Feed the file in blocks, following write_records() in file_stream.c
+static hexfile_parse_status_t parse_file(uint32_t block_size, bool fixed_block_size)
+{
+    hexfile_parse_status_t status = HEX_PARSE_OK;
+    uint8_t bin_buf[BIN_BUF_SIZE];
+    uint32_t offset = 0;
+    uint32_t i;
+
+    memset(programmed_set, 0, sizeof(programmed_set));
+    chunks = 0;
+    last_chunk_end = 0;
+    bad_chunk = false;
+    reset_hex_parser();
+
+    while ((offset < hex_size) && (HEX_PARSE_OK == status || HEX_PARSE_UNALIGNED == status)) {
+        uint32_t size = fixed_block_size ? block_size : 1 + rand() % block_size;
+        const uint8_t *data = (const uint8_t *)&hex_file[offset];
+        uint32_t calls = 0;
+
+        if (size > hex_size - offset) {
+            size = hex_size - offset;
+        }
+        offset += size;
+
+        while (1) {
+            uint32_t parsed = 0;
+            uint32_t address = 0;
+            uint32_t written = 0;
+
+            status = parse_hex_blob(data, size, &parsed, bin_buf, sizeof(bin_buf), &address, &written);
+            if (!CHECK(written <= sizeof(bin_buf)) || !CHECK(parsed <= size) || !CHECK(++calls < 10000)) {
+                return HEX_PARSE_FAILURE;
+            }
+            for (i = written; (i < sizeof(bin_buf)) && (0xFF == bin_buf[i]); i++) {
+            }
+            if (!CHECK_EQUAL(sizeof(bin_buf), i)) {
+                return HEX_PARSE_FAILURE;
+            }
+            if (written > 0) {
+                program(address, bin_buf, written);
+            }
+            if (HEX_PARSE_UNALIGNED != status) {
+                break;
+            }
+            data += parsed;
+            size -= parsed;
+        }
+    }
+    return status;
+}
+
+static bool all_programmed(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < IMAGE_SIZE; i++) {
+        if (expected_set[i] && !programmed_set[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_known_record(void)
+{
+    static const char record[] = ":10010000214601360121470136007EFE09D2190140\r\n:00000001FF\r\n";
+    static const uint8_t data[] = {0x21, 0x46, 0x01, 0x36, 0x01, 0x21, 0x47, 0x01,
+                                   0x36, 0x00, 0x7E, 0xFE, 0x09, 0xD2, 0x19, 0x01};
+    uint8_t bin_buf[BIN_BUF_SIZE];
+    uint32_t parsed;
+    uint32_t address;
+    uint32_t written;
+
+    // The parser starts at address 0, so the record first ends the empty run
+    reset_hex_parser();
+    CHECK_EQUAL(HEX_PARSE_UNALIGNED, parse_hex_blob((const uint8_t *)record, strlen(record), &parsed,
+                                                    bin_buf, sizeof(bin_buf), &address, &written));
+    CHECK_EQUAL(0, written);
+    CHECK_EQUAL(HEX_PARSE_EOF, parse_hex_blob((const uint8_t *)record + parsed, strlen(record) - parsed, &parsed,
+                                              bin_buf, sizeof(bin_buf), &address, &written));
+    CHECK_EQUAL(0x100, address);
+    CHECK_EQUAL(sizeof(data), written);
+    CHECK(memcmp(bin_buf, data, sizeof(data)) == 0);
+}
+
+static void test_bad_records(void)
+{
+    static const char bad_sum[] = ":10010000214601360121470136007EFE09D2190141\r\n";
+    static const char too_long[] = ":2101000021460136012147013600\r\n";
+    uint8_t bin_buf[BIN_BUF_SIZE];
+    uint32_t parsed;
+    uint32_t address;
+    uint32_t written;
+
+    reset_hex_parser();
+    CHECK_EQUAL(HEX_PARSE_CKSUM_FAIL, parse_hex_blob((const uint8_t *)bad_sum, strlen(bad_sum), &parsed,
+                                                     bin_buf, sizeof(bin_buf), &address, &written));
+    reset_hex_parser();
+    CHECK_EQUAL(HEX_PARSE_LINE_OVERRUN, parse_hex_blob((const uint8_t *)too_long, strlen(too_long), &parsed,
+                                                       bin_buf, sizeof(bin_buf), &address, &written));
+}
+
+// Whole files in 512 byte sectors and in random splits, so records and the
+// hex digit pairs inside them break across blocks at every position
+static void test_generated_files(void)
+{
+    uint32_t iter;
+
+    srand(1);
+    for (iter = 0; iter < 2000; iter++) {
+        bool end_record = (iter % 4) != 0;
+
+        generate_file(end_record);
+        if (!CHECK_EQUAL(end_record ? HEX_PARSE_EOF : HEX_PARSE_OK, parse_file(512, true)) ||
+                !CHECK(!bad_chunk) || !CHECK(all_programmed())) {
+            printf("generated file %u, 512 byte blocks\n", (unsigned)iter);
+            return;
+        }
+        if (!CHECK_EQUAL(end_record ? HEX_PARSE_EOF : HEX_PARSE_OK, parse_file(600, false)) ||
+                !CHECK(!bad_chunk) || !CHECK(all_programmed())) {
+            printf("generated file %u, random blocks\n", (unsigned)iter);
+            return;
+        }
+    }
+}
+
+// Corrupted files must stop with an error or parse to something, never
+// overrun the buffers or return without making progress
+static void test_corrupted_files(void)
+{
+    static const char pool[] = "0123456789ABCDEFaf:\r\nGz ";
+    hexfile_parse_status_t status;
+    uint32_t iter;
+    uint32_t i;
+
+    srand(2);
+    for (iter = 0; iter < 5000; iter++) {
+        generate_file(true);
+        for (i = 1 + rand() % 4; i > 0; i--) {
+            hex_file[rand() % hex_size] = pool[rand() % (sizeof(pool) - 1)];
+        }
+        if (rand() % 8 == 0) {
+            hex_file[rand() % hex_size] = rand();
+        }
+        status = parse_file(512, true);
+        if (!CHECK(status != HEX_PARSE_UNINIT && status != HEX_PARSE_FAILURE)) {
+            printf("corrupted file %u\n", (unsigned)iter);
+            return;
+        }
+    }
+}
+
+static uint64_t wall_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Feed the file through a parser as write_records() does, in blocks whose
+// sizes follow split, and keep what it hands on
+static void decode(const hex_parser_t *parser, uint32_t split, decoded_t *out)
+{
+    uint8_t bin_buf[BIN_BUF_SIZE];
+    uint32_t offset = 0;
+
+    out->size = 0;
+    out->calls = 0;
+    out->status = HEX_PARSE_OK;
+    parser->reset();
+    while ((offset < hex_size) && ((HEX_PARSE_OK == out->status) || (HEX_PARSE_UNALIGNED == out->status))) {
+        uint32_t size;
+        const uint8_t *data = (const uint8_t *)&hex_file[offset];
+
+        // Any split from single bytes to whole sectors
+        split = split * 1103515245 + 12345;
+        size = MIN(1 + (split >> 16) % ((split & 0x10) ? 600 : 8), hex_size - offset);
+        offset += size;
+
+        do {
+            uint32_t parsed = 0;
+            uint32_t address = 0;
+            uint32_t written = 0;
+            uint32_t i;
+
+            out->status = parser->parse(data, size, &parsed, bin_buf, sizeof(bin_buf), &address, &written);
+            for (i = 0; (i < written) && (out->size < IMAGE_SIZE); i++) {
+                out->addr[out->size] = address + i;
+                out->data[out->size] = bin_buf[i];
+                out->size++;
+            }
+            data += parsed;
+            size -= parsed;
+        } while ((HEX_PARSE_UNALIGNED == out->status) && (++out->calls < 100000));
+    }
+}
+
+// Offsets in hex_file of the record starts
+static uint32_t record_starts(uint32_t *starts, uint32_t max)
+{
+    uint32_t count = 0;
+    uint32_t i;
+
+    for (i = 0; (i < hex_size) && (count < max); i++) {
+        if (':' == hex_file[i]) {
+            starts[count++] = i;
+        }
+    }
+    return count;
+}
+
+// Insert an extended segment or linear address record at offset, for any
+// upper address, forward or back
+static void insert_ext_record(uint32_t offset)
+{
+    static char tail[sizeof(hex_file)];
+    uint32_t tail_size = hex_size - offset;
+    uint8_t data[2] = {rand(), rand()};
+
+    memcpy(tail, &hex_file[offset], tail_size);
+    hex_size = offset;
+    emit_record((rand() % 2) ? 4 : 2, 0, data, sizeof(data));
+    memcpy(&hex_file[hex_size], tail, tail_size);
+    hex_size += tail_size;
+}
+
+// Generated files with broken checksums, extra extended address records
+// and stray characters, split at random, decode to the same data at the
+// same addresses with the same result through both parsers. The one
+// difference is a record too long for the line buffer, which used to be
+// read on past the buffer and now stops the file.
+static void test_matches_reference(void)
+{
+    static const char pool[] = "0123456789ABCDEFaf:\r\n ";
+    static uint32_t starts[0x4000];
+    uint32_t counts[HEX_PARSE_FAILURE + 1] = {0};
+    uint32_t iter;
+    uint32_t i;
+
+    srand(3);
+    for (iter = 0; iter < 4000; iter++) {
+        uint32_t kind = iter % 4;
+        uint32_t split = rand();
+        uint32_t records;
+
+        generate_file(rand() % 4 != 0);
+        records = record_starts(starts, ARRAY_SIZE(starts));
+        if (1 == kind) {
+            // A checksum digit or a data digit changed
+            uint32_t r = rand() % records;
+            uint32_t end = (r + 1 < records) ? starts[r + 1] : hex_size;
+            char *digit;
+
+            while (('\r' == hex_file[end - 1]) || ('\n' == hex_file[end - 1])) {
+                end--;
+            }
+            digit = &hex_file[(rand() % 2) ? end - 1 : starts[r] + 9 + rand() % (end - starts[r] - 9)];
+            *digit = (('F' == *digit) || ('f' == *digit)) ? '0' : ('9' == *digit) ? 'A' : *digit + 1;
+        } else if (2 == kind) {
+            for (i = 1 + rand() % 3; i > 0; i--) {
+                insert_ext_record(starts[rand() % records]);
+                records = record_starts(starts, ARRAY_SIZE(starts));
+            }
+        } else if (3 == kind) {
+            for (i = 1 + rand() % 4; i > 0; i--) {
+                hex_file[rand() % hex_size] = pool[rand() % (sizeof(pool) - 1)];
+            }
+        }
+
+        decode(&reference_parser, split, &decoded[0]);
+        decode(&current_parser, split, &decoded[1]);
+        counts[decoded[1].status]++;
+        if (HEX_PARSE_LINE_OVERRUN == decoded[1].status) {
+            decoded[0].status = HEX_PARSE_LINE_OVERRUN;
+            decoded[0].size = MIN(decoded[0].size, decoded[1].size);
+        }
+        if (!CHECK_EQUAL(decoded[0].status, decoded[1].status) ||
+                !CHECK_EQUAL(decoded[0].size, decoded[1].size) ||
+                !CHECK(memcmp(decoded[0].addr, decoded[1].addr, decoded[0].size * sizeof(decoded[0].addr[0])) == 0) ||
+                !CHECK(memcmp(decoded[0].data, decoded[1].data, decoded[0].size) == 0)) {
+            printf("file %u, kind %u\n", (unsigned)iter, (unsigned)kind);
+            return;
+        }
+    }
+    printf("same as reference: %u ok, %u eof, %u checksum failures, %u line overruns\n",
+           (unsigned)counts[HEX_PARSE_OK], (unsigned)counts[HEX_PARSE_EOF],
+           (unsigned)counts[HEX_PARSE_CKSUM_FAIL], (unsigned)counts[HEX_PARSE_LINE_OVERRUN]);
+}
+
+// Time to decode a file of 16 byte records, as most tools write, in
+// 512 byte blocks. Returns the best of a few runs.
+static uint64_t time_parser(const hex_parser_t *parser)
+{
+    uint8_t bin_buf[BIN_BUF_SIZE];
+    uint64_t best = UINT64_MAX;
+    uint32_t run;
+
+    for (run = 0; run < 20; run++) {
+        uint64_t start = wall_ns();
+        uint32_t offset;
+
+        parser->reset();
+        for (offset = 0; offset < hex_size; offset += 512) {
+            const uint8_t *data = (const uint8_t *)&hex_file[offset];
+            uint32_t size = MIN(512, hex_size - offset);
+            hexfile_parse_status_t status;
+
+            do {
+                uint32_t parsed = 0;
+                uint32_t address = 0;
+                uint32_t written = 0;
+
+                status = parser->parse(data, size, &parsed, bin_buf, sizeof(bin_buf), &address, &written);
+                data += parsed;
+                size -= parsed;
+            } while (HEX_PARSE_UNALIGNED == status);
+        }
+        best = MIN(best, wall_ns() - start);
+    }
+    return best;
+}
+
+static void test_throughput(void)
+{
+    uint64_t elapsed[2];
+    uint8_t data[16];
+    uint32_t address;
+    uint32_t i;
+
+    srand(4);
+    hex_size = 0;
+    for (address = 0; hex_size + 64 < sizeof(hex_file); address += sizeof(data)) {
+        if (0 == (address & 0xFFFF)) {
+            data[0] = address >> 24;
+            data[1] = address >> 16;
+            emit_record(4, 0, data, 2);
+        }
+        for (i = 0; i < sizeof(data); i++) {
+            data[i] = rand();
+        }
+        emit_record(0, address & 0xFFFF, data, sizeof(data));
+    }
+    emit_record(1, 0, data, 0);
+
+    elapsed[0] = time_parser(&reference_parser);
+    elapsed[1] = time_parser(&current_parser);
+    printf("%u kB of hex: reference %u MB/s, current %u MB/s\n", (unsigned)(hex_size / 1024),
+           (unsigned)(hex_size * 1000ull / elapsed[0]), (unsigned)(hex_size * 1000ull / elapsed[1]));
+    CHECK(elapsed[1] < elapsed[0]);
+}
+
+int main(void)
+{
+    test_known_record();
+    test_bad_records();
+    test_generated_files();
+    test_corrupted_files();
+    test_matches_reference();
+    test_throughput();
+    return unit_test_result();
+}
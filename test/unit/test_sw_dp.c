@@ -0,0 +1,427 @@
+/**
+ * @file    test_sw_dp.c
+ * @brief   Host tests for the SWD wire protocol in SW_DP.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "unit_test.h"
+#include "DAP_config.h"
+#include "DAP.h"
+
+#define WIRE_SIZE       256
+
+DAP_Data_t DAP_Data;
+
+// Pin state, and SWDIO as the target sees it at each rising edge of SWCLK:
+// '0' or '1' while the host drives it, 'z' while the host has let go
+static uint32_t swclk = 1;
+static uint32_t swdio_out = 1;
+static uint32_t swdio_oe = 1;
+static char wire[WIRE_SIZE];
+static uint32_t edges;
+
+// GPIO register accesses, as the port writes and reads of the real pins
+static uint32_t port_writes;
+static uint32_t port_reads;
+
+// Bits the target drives, one per host sample
+static uint32_t target_bits[WIRE_SIZE];
+static uint32_t target_count;
+static uint32_t target_next;
+static uint32_t bad_samples;
+
+void pin_swclk(uint32_t level)
+{
+    port_writes++;
+    if (level && !swclk) {
+        if (edges < WIRE_SIZE) {
+            wire[edges] = swdio_oe ? '0' + swdio_out : 'z';
+        }
+        edges++;
+    }
+    swclk = level;
+}
+
+void pin_swdio_out(uint32_t bit)
+{
+    port_writes++;
+    swdio_out = bit;
+}
+
+void pin_swdio_oe(uint32_t enable)
+{
+    port_writes++;
+    swdio_oe = enable;
+}
+
+// The target shifts on the rising edge, so the host must sample while
+// SWCLK is low, and never while it is driving the line itself
+uint32_t pin_swdio_in(void)
+{
+    port_reads++;
+    if (swclk || swdio_oe) {
+        bad_samples++;
+    }
+    if (target_next < target_count) {
+        return target_bits[target_next++];
+    }
+    return 1;
+}
+
+uint32_t pin_timestamp(void)
+{
+    return edges;
+}
+
+#if (DAP_SWD_SPI != 0)
+// SPI mode 3, LSB first: SWDIO changes on the falling edge when writing and
+// is sampled while SWCLK is low when reading
+void SWD_SPI_Write(uint32_t data, uint32_t count)
+{
+    uint32_t n;
+
+    for (n = count * 8; n; n--) {
+        pin_swclk(0);
+        pin_swdio_out(data & 1);
+        pin_swclk(1);
+        data >>= 1;
+    }
+}
+
+uint32_t SWD_SPI_Read(uint32_t count)
+{
+    uint32_t data = 0;
+    uint32_t n;
+
+    for (n = 0; n < count * 8; n++) {
+        pin_swclk(0);
+        data |= pin_swdio_in() << n;
+        pin_swclk(1);
+    }
+    return data;
+}
+#endif
+
+static uint32_t parity(uint32_t val)
+{
+    uint32_t p = 0;
+
+    while (val) {
+        p ^= val & 1;
+        val >>= 1;
+    }
+    return p;
+}
+
+static void put_bits(char *s, uint32_t *len, uint32_t val, uint32_t count)
+{
+    while (count--) {
+        s[(*len)++] = '0' + (val & 1);
+        val >>= 1;
+    }
+}
+
+static void put_chars(char *s, uint32_t *len, char c, uint32_t count)
+{
+    while (count--) {
+        s[(*len)++] = c;
+    }
+}
+
+static void target_put(uint32_t val, uint32_t count)
+{
+    while (count--) {
+        target_bits[target_count++] = val & 1;
+        val >>= 1;
+    }
+}
+
+static void wire_reset(void)
+{
+    edges = 0;
+    port_writes = 0;
+    port_reads = 0;
+    target_count = 0;
+    target_next = 0;
+    bad_samples = 0;
+}
+
+// One transfer against the SWD protocol as ADIv5 describes it. The target
+// answers with ack and, for a read, rdata followed by the given parity bit.
+static bool check_transfer(uint32_t request, uint32_t ack, uint32_t rdata, uint32_t rparity, uint32_t wdata)
+{
+    uint32_t turnaround = DAP_Data.swd_conf.turnaround;
+    bool read = (request & DAP_TRANSFER_RnW) != 0;
+    char expected[WIRE_SIZE];
+    uint32_t len = 0;
+    uint32_t data_edges = 0;
+    uint32_t expected_ack = ack;
+    uint32_t data = wdata;
+    uint32_t result;
+
+    put_bits(expected, &len, 1 | ((request & 0xF) << 1) | (parity(request & 0xF) << 5) | (1 << 7), 8);
+    put_chars(expected, &len, 'z', turnaround + 3);
+    if (DAP_TRANSFER_OK == ack) {
+        if (read) {
+            put_chars(expected, &len, 'z', 33 + turnaround);
+            if (rparity != parity(rdata)) {
+                expected_ack = DAP_TRANSFER_ERROR;
+            }
+        } else {
+            put_chars(expected, &len, 'z', turnaround);
+            put_bits(expected, &len, wdata, 32);
+            put_bits(expected, &len, parity(wdata), 1);
+        }
+        data_edges = len;
+        put_chars(expected, &len, '0', DAP_Data.transfer.idle_cycles);
+    } else if ((DAP_TRANSFER_WAIT == ack) || (DAP_TRANSFER_FAULT == ack)) {
+        if (DAP_Data.swd_conf.data_phase && read) {
+            put_chars(expected, &len, 'z', 33);
+        }
+        put_chars(expected, &len, 'z', turnaround);
+        if (DAP_Data.swd_conf.data_phase && !read) {
+            put_chars(expected, &len, '0', 33);
+        }
+    } else {
+        // Protocol error: back off for a whole data phase
+        put_chars(expected, &len, 'z', turnaround + 33);
+    }
+
+    wire_reset();
+    target_put(ack, 3);
+    target_put(rdata, 32);
+    target_put(rparity, 1);
+    DAP_Data.timestamp = 0;
+    result = SWD_Transfer(request, &data);
+
+    if (!CHECK_EQUAL(expected_ack, result) || !CHECK_EQUAL(len, edges) ||
+            !CHECK(memcmp(expected, wire, len) == 0) || !CHECK_EQUAL(0, bad_samples) ||
+            !CHECK_EQUAL(1, swclk) || !CHECK_EQUAL(1, swdio_oe) || !CHECK_EQUAL(1, swdio_out)) {
+        printf("request 0x%02x ack %u turnaround %u data_phase %u idle %u fast %u spi %u\n",
+               (unsigned)request, (unsigned)ack, (unsigned)turnaround, DAP_Data.swd_conf.data_phase,
+               DAP_Data.transfer.idle_cycles, DAP_Data.fast_clock, DAP_Data.spi_clock);
+        printf("expected %.*s\nactual   %.*s\n", (int)len, expected, (int)(edges < WIRE_SIZE ? edges : WIRE_SIZE), wire);
+        return false;
+    }
+    if ((DAP_TRANSFER_OK == ack) && read && !CHECK_EQUAL(rdata, data)) {
+        return false;
+    }
+    if ((DAP_TRANSFER_OK == ack) && (request & DAP_TRANSFER_TIMESTAMP) && !CHECK_EQUAL(data_edges, DAP_Data.timestamp)) {
+        return false;
+    }
+    return true;
+}
+
+static uint32_t random_word(void)
+{
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+// Each transfer kernel (unrolled with the default turnaround, unrolled with
+// a configured turnaround, the looped slow clock one and, when built with
+// DAP_SWD_SPI, the SPI one) against the model
+static void test_transfer_kernels(void)
+{
+    static const uint32_t acks[] = {
+        DAP_TRANSFER_OK, DAP_TRANSFER_OK, DAP_TRANSFER_OK, DAP_TRANSFER_OK,
+        DAP_TRANSFER_WAIT, DAP_TRANSFER_FAULT, 0, 3, 7,
+    };
+    uint32_t iter;
+
+    srand(1);
+    DAP_Data.clock_delay = 1;
+    for (iter = 0; iter < 20000; iter++) {
+        uint32_t request = rand() & (0x0F | DAP_TRANSFER_TIMESTAMP);
+        uint32_t ack = acks[rand() % (sizeof(acks) / sizeof(acks[0]))];
+        uint32_t rdata = random_word();
+        uint32_t rparity = (rand() % 8) ? parity(rdata) : !parity(rdata);
+
+        DAP_Data.fast_clock = rand() % 2;
+#if (DAP_SWD_SPI != 0)
+        DAP_Data.spi_clock = rand() % 2;
+#endif
+        DAP_Data.swd_conf.turnaround = (rand() % 2) ? 1 : 1 + rand() % 4;
+        DAP_Data.swd_conf.data_phase = rand() % 2;
+        DAP_Data.transfer.idle_cycles = (rand() % 2) ? 0 : rand() % 8;
+        if (!check_transfer(request, ack, rdata, rparity, random_word())) {
+            return;
+        }
+    }
+}
+
+// SWD_Sequence drives or captures whole bytes by SPI when it can and the
+// rest by GPIO; either way the wire is the same
+static void test_sequences(void)
+{
+    uint32_t iter;
+
+    srand(2);
+    DAP_Data.clock_delay = 1;
+    for (iter = 0; iter < 5000; iter++) {
+        uint32_t info = rand() & (SWD_SEQUENCE_CLK | SWD_SEQUENCE_DIN);
+        uint32_t count = (info & SWD_SEQUENCE_CLK) ? (info & SWD_SEQUENCE_CLK) : 64;
+        bool din = (info & SWD_SEQUENCE_DIN) != 0;
+        uint8_t swdo[8];
+        uint8_t swdi[8];
+        uint8_t expected_swdi[8];
+        char expected[WIRE_SIZE];
+        uint32_t len = 0;
+        uint32_t i;
+
+        for (i = 0; i < sizeof(swdo); i++) {
+            swdo[i] = rand();
+            expected_swdi[i] = 0;
+            swdi[i] = 0xA5;
+        }
+        wire_reset();
+        for (i = 0; i < count; i++) {
+            uint32_t bit = rand() & 1;
+
+            target_put(bit, 1);
+            expected_swdi[i / 8] |= bit << (i % 8);
+            if (din) {
+                put_chars(expected, &len, 'z', 1);
+            } else {
+                put_bits(expected, &len, swdo[i / 8] >> (i % 8), 1);
+            }
+        }
+
+        DAP_Data.fast_clock = rand() % 2;
+#if (DAP_SWD_SPI != 0)
+        DAP_Data.spi_clock = rand() % 2;
+#endif
+        swdio_oe = !din;
+        swdio_out = 1;
+        SWD_Sequence(info, swdo, swdi);
+
+        if (!CHECK_EQUAL(len, edges) || !CHECK(memcmp(expected, wire, len) == 0) ||
+                !CHECK_EQUAL(0, bad_samples) || !CHECK_EQUAL(1, swclk) ||
+                (din && !CHECK(memcmp(expected_swdi, swdi, (count + 7) / 8) == 0)) ||
+                (!din && !CHECK_EQUAL((swdo[(count - 1) / 8] >> ((count - 1) % 8)) & 1, swdio_out))) {
+            printf("sequence info 0x%02x spi %u\n", (unsigned)info, DAP_Data.spi_clock);
+            return;
+        }
+    }
+    swdio_oe = 1;
+    swdio_out = 1;
+}
+
+// Cortex-M cycles for an iteration of a data phase or turnaround loop: the
+// decrement and a taken branch, which refills the pipeline
+#define LOOP_CYCLES     3
+
+// Rising edges, port accesses and host time per OK transfer for each kernel.
+// Unrolling leaves the port accesses as they are and only drops the loops
+// around them, so the Cortex-M cycles are estimated as IO_PORT_WRITE_CYCLES
+// an access plus LOOP_CYCLES an iteration, looped and unrolled. The shifts
+// both do are left out, so the saving is an upper bound. The host time is
+// mostly the pin model's, so it only shows a kernel that grew extra work
+// between edges.
+static void test_transfer_cost(void)
+{
+    static const struct {
+        const char *name;
+        uint8_t fast_clock;
+        uint8_t spi_clock;
+        uint8_t turnaround;
+        uint8_t accesses;       // port accesses per read or write transfer
+        uint8_t loops;          // loop iterations when looped, 0 if not modelled
+    } kernels[] = {
+        {"fast, turnaround 1", 1, 0, 1, 139, 32},
+        {"fast, turnaround 2", 1, 0, 2, 143, 32 + 2 * 2},
+        {"slow clock", 0, 0, 1, 139, 0},
+#if (DAP_SWD_SPI != 0)
+        {"SPI", 1, 1, 1, 0, 0},
+#endif
+    };
+    const uint32_t count = 100000;
+    uint32_t k;
+    uint32_t i;
+
+    printf("data phase %s\n", DAP_SWD_UNROLLED ? "unrolled" : "looped");
+    DAP_Data.clock_delay = 1;
+    DAP_Data.transfer.idle_cycles = 0;
+    for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        uint32_t read_edges;
+        uint32_t write_edges;
+        uint32_t read_accesses;
+        uint32_t write_accesses;
+        uint32_t data = 0;
+        clock_t start;
+        double ns;
+
+        DAP_Data.fast_clock = kernels[k].fast_clock;
+        DAP_Data.spi_clock = kernels[k].spi_clock;
+        DAP_Data.swd_conf.turnaround = kernels[k].turnaround;
+
+        wire_reset();
+        target_put(DAP_TRANSFER_OK, 3);
+        SWD_Transfer(DAP_TRANSFER_RnW, &data);
+        read_edges = edges;
+        read_accesses = port_writes + port_reads;
+        wire_reset();
+        target_put(DAP_TRANSFER_OK, 3);
+        SWD_Transfer(0, &data);
+        write_edges = edges;
+        write_accesses = port_writes + port_reads;
+        CHECK_EQUAL(46 + 2 * (kernels[k].turnaround - 1), read_edges);
+        CHECK_EQUAL(46 + 2 * (kernels[k].turnaround - 1), write_edges);
+        if (!kernels[k].spi_clock) {
+            CHECK_EQUAL(kernels[k].accesses, read_accesses);
+            CHECK_EQUAL(kernels[k].accesses, write_accesses);
+        }
+
+        wire_reset();
+        target_put(DAP_TRANSFER_OK, 3);
+        target_put(0x12345678, 32);
+        target_put(parity(0x12345678), 1);
+        start = clock();
+        for (i = 0; i < count; i++) {
+            edges = 0;
+            target_next = 0;
+            SWD_Transfer((i & 1) ? DAP_TRANSFER_RnW : 0, &data);
+        }
+        ns = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / count;
+        if (kernels[k].spi_clock) {
+            printf("%-20s %u edges, %.0f ns per transfer\n", kernels[k].name, (unsigned)read_edges, ns);
+        } else {
+            printf("%-20s %u edges, %u port accesses per read, %u per write, %.0f ns per transfer\n",
+                   kernels[k].name, (unsigned)read_edges, (unsigned)read_accesses, (unsigned)write_accesses, ns);
+        }
+        if (kernels[k].loops) {
+            uint32_t port = read_accesses * IO_PORT_WRITE_CYCLES;
+            uint32_t looped = port + kernels[k].loops * LOOP_CYCLES;
+            uint32_t unrolled = looped - 32 * LOOP_CYCLES;
+
+            printf("%-20s %u cycles looped, %u unrolled, %.0f%% fewer\n", "",
+                   (unsigned)looped, (unsigned)unrolled, 100.0 * (looped - unrolled) / looped);
+        }
+    }
+}
+
+int main(void)
+{
+    test_transfer_kernels();
+    test_sequences();
+    test_transfer_cost();
+    return unit_test_result();
+}
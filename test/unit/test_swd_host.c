@@ -0,0 +1,410 @@
+/**
+ * @file    test_swd_host.c
+ * @brief   Host tests for the transfer queue and shadow registers in swd_host.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unit_test.h"
+#include "DAP_config.h"
+#include "DAP.h"
+#include "swd_host.h"
+#include "target_family.h"
+#include "target_config.h"
+#include "cmsis_os2.h"
+
+#define RAM_START   0x20000000
+#define RAM_SIZE    0x10000
+
+// Cortex-M debug registers, as swd_host.c defines them
+#define DHCSR       0xE000EDF0
+#define DCRSR       0xE000EDF4
+#define DCRDR       0xE000EDF8
+
+// A Cortex-M DP with one MEM-AP, modelled at the level of SWD_Transfer().
+// AP reads are posted: each returns the result of the previous AP read and
+// RDBUFF returns the last one. TAR increments wrap inside a 1 kB page.
+static struct {
+    uint32_t select;
+    uint32_t ctrl_stat;
+    uint32_t csw;
+    uint32_t tar;
+    uint32_t rdbuff;
+    uint32_t dcrdr;
+    uint32_t core[17];
+    uint8_t ram[RAM_SIZE];
+} target;
+
+// Transfers on the wire, and those of each kind
+static uint32_t transfers;
+static uint32_t tar_writes;
+static uint32_t csw_writes;
+static uint32_t select_writes;
+static uint32_t rdbuff_reads;
+
+// The transfer with this number gets a FAULT ack
+static uint32_t fault_at;
+
+const target_family_descriptor_t *g_target_family = NULL;
+
+static uint32_t mem_read(uint32_t addr)
+{
+    uint32_t value;
+
+    if (DCRDR == addr) {
+        return target.dcrdr;
+    }
+    if (DHCSR == addr) {
+        return S_REGRDY | S_HALT;
+    }
+    if (!CHECK((addr >= RAM_START) && (addr + 4 <= RAM_START + RAM_SIZE))) {
+        return 0;
+    }
+    memcpy(&value, &target.ram[(addr & ~3) - RAM_START], 4);
+    return value;
+}
+
+static void mem_write(uint32_t addr, uint32_t value)
+{
+    uint32_t size = target.csw & CSW_SIZE;
+
+    if (DCRDR == addr) {
+        target.dcrdr = value;
+        return;
+    }
+    if (DCRSR == addr) {
+        if (value & (1 << 16)) {
+            target.core[value & 0x1F] = target.dcrdr;
+        } else {
+            target.dcrdr = target.core[value & 0x1F];
+        }
+        return;
+    }
+    if (DHCSR == addr) {
+        return;
+    }
+    if (!CHECK((addr >= RAM_START) && (addr + 4 <= RAM_START + RAM_SIZE))) {
+        return;
+    }
+    if (CSW_SIZE8 == size) {
+        target.ram[addr - RAM_START] = value >> ((addr & 3) * 8);
+    } else {
+        CHECK_EQUAL(CSW_SIZE32, size);
+        memcpy(&target.ram[(addr & ~3) - RAM_START], &value, 4);
+    }
+}
+
+static void tar_increment(void)
+{
+    uint32_t size = 1 << (target.csw & CSW_SIZE);
+
+    if (target.csw & CSW_SADDRINC) {
+        target.tar = (target.tar & ~(TARGET_AUTO_INCREMENT_PAGE_SIZE - 1)) |
+                     ((target.tar + size) & (TARGET_AUTO_INCREMENT_PAGE_SIZE - 1));
+    }
+}
+
+uint8_t SWD_Transfer(uint32_t request, uint32_t *data)
+{
+    uint32_t adr = request & 0x0C;
+    uint32_t value = 0;
+
+    transfers++;
+    if (transfers == fault_at) {
+        target.ctrl_stat |= STICKYERR;
+        return DAP_TRANSFER_FAULT;
+    }
+    if (target.ctrl_stat & STICKYERR) {
+        // Everything but the DP is ignored until the error is cleared
+        if (request & SWD_REG_AP) {
+            return DAP_TRANSFER_FAULT;
+        }
+    }
+    if (data) {
+        memcpy(&value, data, 4);
+    }
+
+    if (!(request & SWD_REG_AP)) {
+        if (request & SWD_REG_R) {
+            if (DP_RDBUFF == adr) {
+                rdbuff_reads++;
+                value = target.rdbuff;
+            } else if (DP_CTRL_STAT == adr) {
+                value = target.ctrl_stat;
+            } else {
+                value = 0x2BA01477;
+            }
+        } else if (DP_SELECT == adr) {
+            select_writes++;
+            target.select = value;
+        } else if (DP_ABORT == adr) {
+            if (value & STKERRCLR) {
+                target.ctrl_stat &= ~STICKYERR;
+            }
+        }
+    } else {
+        CHECK_EQUAL(0, target.select & 0xFF000000);
+        adr |= target.select & APBANKSEL;
+        if (request & SWD_REG_R) {
+            uint32_t posted = target.rdbuff;
+
+            if (AP_DRW == adr) {
+                target.rdbuff = mem_read(target.tar);
+                tar_increment();
+            } else if (AP_CSW == adr) {
+                target.rdbuff = target.csw;
+            } else if (AP_TAR == adr) {
+                target.rdbuff = target.tar;
+            } else {
+                target.rdbuff = 0;
+            }
+            value = posted;
+        } else if (AP_CSW == adr) {
+            csw_writes++;
+            target.csw = value;
+        } else if (AP_TAR == adr) {
+            tar_writes++;
+            target.tar = value;
+        } else if (AP_DRW == adr) {
+            mem_write(target.tar, value);
+            tar_increment();
+        }
+    }
+
+    if (data && (request & SWD_REG_R)) {
+        memcpy(data, &value, 4);
+    }
+    return DAP_TRANSFER_OK;
+}
+
+void SWJ_Sequence(uint32_t count, const uint8_t *data)
+{
+}
+
+void DAP_Setup(void)
+{
+}
+
+osStatus_t osDelay(uint32_t ticks)
+{
+    return osOK;
+}
+
+void swd_set_target_reset(uint8_t asserted)
+{
+}
+
+uint32_t target_get_apsel(void)
+{
+    return 0;
+}
+
+static void count_reset(void)
+{
+    transfers = 0;
+    tar_writes = 0;
+    csw_writes = 0;
+    select_writes = 0;
+    rdbuff_reads = 0;
+}
+
+// Lose the shadow state, as after a reconnect
+static void reconnect(void)
+{
+    swd_off();
+    count_reset();
+}
+
+// One word after a reconnect sets up SELECT, CSW and TAR. The next word
+// follows TAR auto-increment, so it only costs the DRW access and RDBUFF.
+static void test_word_access(void)
+{
+    uint32_t value;
+
+    reconnect();
+    CHECK(swd_write_word(RAM_START + 0x100, 0x11223344));
+    printf("write word after reconnect: %u transfers\n", (unsigned)transfers);
+    CHECK_EQUAL(5, transfers);
+    CHECK_EQUAL(1, rdbuff_reads);
+
+    count_reset();
+    CHECK(swd_write_word(RAM_START + 0x104, 0x55667788));
+    printf("sequential write word: %u transfers\n", (unsigned)transfers);
+    // TAR, DRW and RDBUFF before TAR was shadowed
+    CHECK_EQUAL(2, transfers);
+    CHECK_EQUAL(0, tar_writes);
+
+    count_reset();
+    CHECK(swd_read_word(RAM_START + 0x100, &value));
+    CHECK_EQUAL(0x11223344, value);
+    CHECK_EQUAL(3, transfers);
+    CHECK_EQUAL(1, tar_writes);
+
+    count_reset();
+    CHECK(swd_read_word(RAM_START + 0x104, &value));
+    printf("sequential read word: %u transfers\n", (unsigned)transfers);
+    CHECK_EQUAL(0x55667788, value);
+    // TAR, DRW and RDBUFF before TAR was shadowed
+    CHECK_EQUAL(2, transfers);
+    CHECK_EQUAL(0, tar_writes);
+
+    // Auto-increment wraps at the end of a page, so TAR is sent again
+    CHECK(swd_write_word(RAM_START + 0x3FC, 1));
+    count_reset();
+    CHECK(swd_write_word(RAM_START + 0x400, 2));
+    CHECK_EQUAL(1, tar_writes);
+    CHECK_EQUAL(1, mem_read(RAM_START + 0x3FC));
+    CHECK_EQUAL(2, mem_read(RAM_START + 0x400));
+}
+
+// The 16 byte verify loop in target_flash_program_page
+static void test_verify_loop(void)
+{
+    uint32_t value;
+    uint32_t i;
+
+    reconnect();
+    for (i = 0; i < 4; i++) {
+        CHECK(swd_read_word(RAM_START + 0x200 + i * 4, &value));
+    }
+    printf("4 word verify: %u transfers, %u TAR writes\n", (unsigned)transfers, (unsigned)tar_writes);
+    CHECK_EQUAL(1, tar_writes);
+    CHECK_EQUAL(1, csw_writes);
+    CHECK_EQUAL(1, select_writes);
+    // 12 with SELECT and CSW already set up, and a TAR write per word,
+    // before TAR was shadowed
+    CHECK_EQUAL(11, transfers);
+}
+
+// A core register read is one batch, with S_REGRDY already set by the time
+// DHCSR is read
+static void test_core_registers(void)
+{
+    uint32_t value;
+    uint32_t i;
+
+    reconnect();
+    CHECK(swd_write_core_register(2, 0xCAFEF00D));
+    CHECK_EQUAL(0xCAFEF00D, target.core[2]);
+    printf("write core register: %u transfers\n", (unsigned)transfers);
+    count_reset();
+    CHECK(swd_read_core_register(2, &value));
+    CHECK_EQUAL(0xCAFEF00D, value);
+    printf("read core register: %u transfers\n", (unsigned)transfers);
+    // DCRSR follows the DHCSR read of the write on auto-increment, and
+    // the posted DHCSR read is collected before TAR moves to DCRDR
+    // 9 before, with a TAR write for each of the three registers
+    CHECK_EQUAL(7, transfers);
+    CHECK_EQUAL(2, rdbuff_reads);
+
+    for (i = 0; i < 16; i++) {
+        target.core[i] = i * 0x01010101;
+    }
+    for (i = 0; i < 16; i++) {
+        CHECK(swd_read_core_register(i, &value));
+        CHECK_EQUAL(i * 0x01010101, value);
+    }
+}
+
+// Unaligned reads and writes of any size match the memory of the model
+static void test_memory(void)
+{
+    static uint8_t data[0x1800];
+    static uint8_t readback[0x1800];
+    uint32_t iter;
+    uint32_t addr;
+    uint32_t size;
+    uint32_t i;
+
+    srand(1);
+    for (iter = 0; iter < 300; iter++) {
+        addr = RAM_START + rand() % 0x8000;
+        size = rand() % sizeof(data);
+        for (i = 0; i < size; i++) {
+            data[i] = rand();
+        }
+        if (iter % 4 == 0) {
+            reconnect();
+        }
+        CHECK(swd_write_memory(addr, data, size));
+        if (!CHECK(memcmp(&target.ram[addr - RAM_START], data, size) == 0)) {
+            printf("write of %u bytes at 0x%08x\n", (unsigned)size, (unsigned)addr);
+            return;
+        }
+        memset(readback, 0, size);
+        CHECK(swd_read_memory(addr, readback, size));
+        if (!CHECK(memcmp(readback, data, size) == 0)) {
+            printf("read of %u bytes at 0x%08x\n", (unsigned)size, (unsigned)addr);
+            return;
+        }
+    }
+}
+
+// A failed transfer may leave SELECT, CSW and TAR in any state, so they are
+// all sent again after the error is cleared
+static void test_fault_invalidates(void)
+{
+    uint32_t value;
+    uint32_t i;
+
+    // The write is the DRW access and the RDBUFF check, try a fault on each
+    for (i = 1; i <= 2; i++) {
+        reconnect();
+        CHECK(swd_write_word(RAM_START + 0x500, 0xA5A5A5A5));
+        CHECK(swd_read_word(RAM_START + 0x504, &value));
+
+        // Point TAR and CSW somewhere else behind the host's back, as a
+        // partly executed batch could
+        target.tar = RAM_START + 0x900;
+        target.csw = 0;
+        fault_at = transfers + i;
+        CHECK(!swd_write_word(RAM_START + 0x508, 0x12345678));
+        fault_at = 0;
+
+        CHECK(swd_clear_errors());
+        count_reset();
+        CHECK(swd_write_word(RAM_START + 0x508, 0x12345678));
+        CHECK_EQUAL(1, tar_writes);
+        CHECK_EQUAL(1, csw_writes);
+        CHECK_EQUAL(0x12345678, mem_read(RAM_START + 0x508));
+        CHECK(swd_read_word(RAM_START + 0x508, &value));
+        CHECK_EQUAL(0x12345678, value);
+    }
+
+    // Clearing errors without a failure also drops the shadow state
+    CHECK(swd_read_word(RAM_START + 0x500, &value));
+    CHECK(swd_clear_errors());
+    target.tar = 0;
+    count_reset();
+    CHECK(swd_read_word(RAM_START + 0x504, &value));
+    CHECK_EQUAL(1, tar_writes);
+    CHECK_EQUAL(value, mem_read(RAM_START + 0x504));
+}
+
+int main(void)
+{
+    target.select = 0xFFFFFFFF;
+    test_word_access();
+    test_verify_loop();
+    test_core_registers();
+    test_memory();
+    test_fault_invalidates();
+    return unit_test_result();
+}
@@ -0,0 +1,869 @@
+/**
+ * @file    test_target_flash.c
+ * @brief   Host tests for flash_manager.c over target_flash.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unit_test.h"
+#include "flash_manager.h"
+#include "swd_host.h"
+#include "target_board.h"
+#include "target_family.h"
+#include "settings.h"
+#include "crc.h"
+#include "intelhex.h"
+
+#define FLASH_START         0x00000000
+#define FLASH_SIZE          0x80000
+#define SECTOR_SIZE         0x1000
+#define RAM_START           0x20000000
+#define RAM_SIZE            0x4000
+#define PAGE_SIZE           0x400
+
+#define ALGO_START          RAM_START
+#define PROGRAM_BUFFER      (RAM_START + 0x1000)
+#define PROGRAM_BUFFER_ALT  (RAM_START + 0x1400)
+
+// A second region with its own algo, as QSPI flash beside internal flash.
+// Regions include their end address, hence the gap before it.
+#define QSPI_START          0x41000
+#define QSPI_END            (FLASH_START + FLASH_SIZE)
+
+// Time on the wire, for 32-bit transfers at an 8 MHz SWD clock
+#define WORD_NS             5750
+#define ACCESS_WORDS        3       // SELECT, CSW and TAR before a block
+#define CALL_WORDS          40      // core registers and the run for a call
+#define WAIT_WORDS          8       // DHCSR poll, R0 and the halt after a call
+
+// A 512 byte stream write takes 730 us to arrive over full speed MSC. The
+// host is held off while a write is being handled, so the next one only
+// starts arriving when it returns.
+#define CHUNK_SIZE          512
+#define CHUNK_NS            730000
+
+// Time on the target
+#define INIT_NS             50000
+#define PROGRAM_NS_PER_BYTE 2000
+#define ERASE_SECTOR_NS     20000000
+#define ERASE_CHIP_NS       400000000
+#define CRC_NS_PER_BYTE     600
+
+// First word of the CRC routine target_flash.c downloads
+#define CRC_ROUTINE         0x2200b430
+
+// The algo blobs are never run; calls are recognised by their entry point
+// and the blob in RAM tells which region's algo was loaded
+static const uint32_t algo_blob[64] = {
+    0xE00ABE00, 0x062D780D, 0x24084068, 0xD3000040,
+};
+
+static const uint32_t qspi_blob[64] = {
+    0xE00ABE00, 0x062D780D, 0x24084068, 0xD3000041,
+};
+
+#define ALGO_ENTRY(offset)  (ALGO_START + 0x20 + (offset) + 1)
+
+#define PROGRAM_TARGET(blob, buffer_alt)                                        \
+    {                                                                           \
+        ALGO_ENTRY(0x00), ALGO_ENTRY(0x10), ALGO_ENTRY(0x20), ALGO_ENTRY(0x30), \
+        ALGO_ENTRY(0x40), 0,                                                    \
+        {ALGO_START + 1, ALGO_START + 0xC0, ALGO_START + 0x800},                \
+        PROGRAM_BUFFER, ALGO_START, sizeof(blob), (blob), PAGE_SIZE,            \
+        0, (buffer_alt),                                                        \
+    }
+
+static program_target_t serial_algo = PROGRAM_TARGET(algo_blob, 0);
+static program_target_t pipelined_algo = PROGRAM_TARGET(algo_blob, PROGRAM_BUFFER_ALT);
+static program_target_t qspi_algo = PROGRAM_TARGET(qspi_blob, PROGRAM_BUFFER_ALT);
+
+static const sector_info_t sectors_info[] = {
+    {FLASH_START, SECTOR_SIZE},
+};
+
+// Sectors small enough for flash_manager to compare before erasing
+static const sector_info_t small_sectors_info[] = {
+    {FLASH_START, PAGE_SIZE},
+};
+
+target_cfg_t target_device = {
+    .version = kTargetConfigVersion,
+    .sectors_info = sectors_info,
+    .sector_info_length = 1,
+    .flash_regions[0] = {FLASH_START, FLASH_START + FLASH_SIZE, kRegionIsDefault, 0, &serial_algo},
+    .ram_regions[0] = {RAM_START, RAM_START + RAM_SIZE},
+};
+
+const board_info_t g_board_info = {
+    .info_version = kBoardInfoVersion,
+    .target_cfg = &target_device,
+};
+
+const target_family_descriptor_t *g_target_family = NULL;
+
+// A halted Cortex-M with flash that only programs ones to zeros. A call
+// takes effect when it finishes, so a program buffer reused too early
+// leaves the wrong data in flash.
+static struct {
+    uint8_t flash[FLASH_SIZE];
+    uint8_t ram[RAM_SIZE];
+    flash_func_t func;      // from the last Init, FLASH_FUNC_NOP after UnInit
+    bool running;
+    uint64_t done_ns;
+    uint32_t entry;
+    uint32_t args[3];
+} target;
+
+// Simulated time, and what was done on the wire and the target
+static uint64_t now_ns;
+static uint64_t target_busy_ns;
+static uint32_t words_written;
+static uint32_t words_read;
+static uint32_t sector_erases;
+static uint32_t chip_erases;
+static uint32_t pages_programmed;
+static uint32_t protocol_errors;
+
+// Algo downloads, and Inits for each function, by the region whose algo
+// is in RAM
+static uint32_t algo_downloads[2];
+static uint32_t algo_inits[2][FLASH_FUNC_VERIFY + 1];
+
+// Faults: a flash byte whose bit 0 won't program, and a CRC routine that
+// never returns to the breakpoint
+static uint32_t stuck_addr = UINT32_MAX;
+static bool crc_hangs;
+
+static bool automation;
+
+bool config_get_automation_allowed(void)
+{
+    return automation;
+}
+
+bool config_get_auto_rst(void)
+{
+    return false;
+}
+
+void config_ram_set_page_erase(bool page_erase_enable)
+{
+}
+
+void config_ram_set_incremental(bool incremental_enable)
+{
+}
+
+void main_target_lock(void)
+{
+}
+
+void main_target_unlock(void)
+{
+}
+
+uint8_t target_set_state(target_state_t state)
+{
+    target.running = false;
+    return 1;
+}
+
+uint8_t swd_off(void)
+{
+    return 1;
+}
+
+static uint8_t *memory(uint32_t addr, uint32_t size)
+{
+    if ((addr >= FLASH_START) && (addr + size <= FLASH_START + FLASH_SIZE)) {
+        return &target.flash[addr - FLASH_START];
+    }
+    if ((addr >= RAM_START) && (addr + size <= RAM_START + RAM_SIZE)) {
+        return &target.ram[addr - RAM_START];
+    }
+    return NULL;
+}
+
+// Flash can't be read while it is being programmed or erased, and the
+// buffer of a running program_page call must not be written
+// The region whose algo is in RAM, or -1 if there is none
+static int loaded_region(void)
+{
+    if (memcmp(memory(ALGO_START, sizeof(algo_blob)), algo_blob, sizeof(algo_blob)) == 0) {
+        return 0;
+    }
+    if (memcmp(memory(ALGO_START, sizeof(qspi_blob)), qspi_blob, sizeof(qspi_blob)) == 0) {
+        return 1;
+    }
+    return -1;
+}
+
+// The region whose algo must program and erase addr
+static int region_of(uint32_t addr)
+{
+    region_info_t *qspi = &target_device.flash_regions[1];
+
+    return (qspi->flash_algo && (addr >= qspi->start) && (addr <= qspi->end)) ? 1 : 0;
+}
+
+static void check_access(uint32_t addr, uint32_t size, bool write)
+{
+    bool flash = (addr < FLASH_START + FLASH_SIZE) && (addr + size > FLASH_START);
+    bool buffer = (target.entry == serial_algo.program_page) &&
+                  (addr < target.args[2] + target.args[1]) && (addr + size > target.args[2]);
+
+    if (target.running && !CHECK(!(flash || (write && buffer)))) {
+        protocol_errors++;
+    }
+}
+
+static void wire(uint32_t words)
+{
+    now_ns += (uint64_t)words * WORD_NS;
+}
+
+uint8_t swd_write_memory(uint32_t address, uint8_t *data, uint32_t size)
+{
+    uint8_t *dest = memory(address, size);
+
+    check_access(address, size, true);
+    if (!CHECK(dest && (address >= RAM_START))) {
+        protocol_errors++;
+        return 0;
+    }
+    memcpy(dest, data, size);
+    if ((address == ALGO_START) && (size == sizeof(algo_blob)) && (loaded_region() >= 0)) {
+        algo_downloads[loaded_region()]++;
+    }
+    words_written += (size + 3) / 4;
+    wire(ACCESS_WORDS + (size + 3) / 4);
+    return 1;
+}
+
+uint8_t swd_read_memory(uint32_t address, uint8_t *data, uint32_t size)
+{
+    uint8_t *src = memory(address, size);
+
+    check_access(address, size, false);
+    if (!CHECK(src != NULL)) {
+        protocol_errors++;
+        return 0;
+    }
+    memcpy(data, src, size);
+    words_read += (size + 3) / 4;
+    wire(ACCESS_WORDS + (size + 3) / 4);
+    return 1;
+}
+
+uint8_t swd_read_word(uint32_t addr, uint32_t *val)
+{
+    return swd_read_memory(addr, (uint8_t *)val, 4);
+}
+
+// How long the call at entry takes on the target
+static uint64_t call_ns(uint32_t entry, uint32_t arg1, uint32_t arg2)
+{
+    if (entry == serial_algo.erase_sector) {
+        return ERASE_SECTOR_NS;
+    }
+    if (entry == serial_algo.erase_chip) {
+        return ERASE_CHIP_NS;
+    }
+    if (entry == serial_algo.program_page) {
+        return (uint64_t)arg2 * PROGRAM_NS_PER_BYTE;
+    }
+    if ((entry != serial_algo.init) && (entry != serial_algo.uninit)) {
+        return (uint64_t)arg2 * CRC_NS_PER_BYTE;
+    }
+    return INIT_NS;
+}
+
+uint8_t swd_flash_syscall_start(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
+{
+    if (!CHECK(!target.running)) {
+        protocol_errors++;
+        return 0;
+    }
+    wire(CALL_WORDS);
+    target.running = true;
+    target.entry = entry;
+    target.args[0] = arg1;
+    target.args[1] = arg2;
+    target.args[2] = arg3;
+    target.done_ns = now_ns + call_ns(entry, arg1, arg2);
+    target_busy_ns += target.done_ns - now_ns;
+    return 1;
+}
+
+// The flash function the call at entry needs Init to have been run for
+static flash_func_t call_func(uint32_t entry)
+{
+    if ((entry == serial_algo.erase_sector) || (entry == serial_algo.erase_chip)) {
+        return FLASH_FUNC_ERASE;
+    }
+    if (entry == serial_algo.program_page) {
+        return FLASH_FUNC_PROGRAM;
+    }
+    return FLASH_FUNC_NOP;
+}
+
+// Run the call to completion and return what it leaves in R0
+static uint32_t call_finish(void)
+{
+    uint32_t entry = target.entry;
+    uint32_t addr = target.args[0];
+    uint32_t size = target.args[1];
+    uint8_t *mem;
+    uint32_t i;
+
+    if (entry == serial_algo.init) {
+        CHECK_EQUAL(FLASH_FUNC_NOP, target.func);
+        target.func = target.args[2];
+        if ((loaded_region() >= 0) && (target.func <= FLASH_FUNC_VERIFY)) {
+            algo_inits[loaded_region()][target.func]++;
+        }
+        return 0;
+    }
+    if (entry == serial_algo.uninit) {
+        CHECK_EQUAL(target.func, addr);
+        target.func = FLASH_FUNC_NOP;
+        return 0;
+    }
+    if (call_func(entry) != FLASH_FUNC_NOP) {
+        if (!CHECK_EQUAL(call_func(entry), target.func)) {
+            protocol_errors++;
+            return 1;
+        }
+        if ((entry != serial_algo.erase_chip) && !CHECK_EQUAL(region_of(addr), loaded_region())) {
+            protocol_errors++;
+            return 1;
+        }
+    }
+    if (entry == serial_algo.erase_chip) {
+        // Only the region the algo is for
+        if (1 == loaded_region()) {
+            memset(memory(QSPI_START, QSPI_END - QSPI_START), 0xFF, QSPI_END - QSPI_START);
+        } else if (target_device.flash_regions[1].flash_algo) {
+            memset(target.flash, 0xFF, QSPI_START - FLASH_START);
+        } else {
+            memset(target.flash, 0xFF, sizeof(target.flash));
+        }
+        chip_erases++;
+        return 0;
+    }
+    if (entry == serial_algo.erase_sector) {
+        uint32_t sector_size = target_device.sectors_info[0].size;
+
+        if (!CHECK_EQUAL(0, addr % sector_size) || !CHECK(memory(addr, sector_size))) {
+            return 1;
+        }
+        memset(memory(addr, sector_size), 0xFF, sector_size);
+        sector_erases++;
+        return 0;
+    }
+    if (entry == serial_algo.program_page) {
+        const uint8_t *src = memory(target.args[2], size);
+
+        mem = memory(addr, size);
+        if (!CHECK(mem && src && (target.args[2] >= RAM_START) && (size <= PAGE_SIZE))) {
+            return 1;
+        }
+        for (i = 0; i < size; i++) {
+            mem[i] &= src[i];
+            if (addr + i == stuck_addr) {
+                mem[i] |= 1;
+            }
+        }
+        pages_programmed++;
+        return 0;
+    }
+
+    // Anything else must be the CRC routine, run from a program buffer
+    mem = memory(addr, size);
+    if (!CHECK(memory(entry - 1, 4) && (*(uint32_t *)memory(entry - 1, 4) == CRC_ROUTINE)) || !CHECK(mem)) {
+        protocol_errors++;
+        return 0;
+    }
+    return crc32(mem, size);
+}
+
+uint8_t swd_flash_syscall_wait(uint32_t *result)
+{
+    if (!CHECK(target.running)) {
+        protocol_errors++;
+        return 0;
+    }
+    if (crc_hangs && (call_func(target.entry) == FLASH_FUNC_NOP) &&
+            (target.entry != serial_algo.init) && (target.entry != serial_algo.uninit)) {
+        // Left running until the caller halts it
+        now_ns += 1000000;
+        return 0;
+    }
+    if (now_ns < target.done_ns) {
+        now_ns = target.done_ns;
+    }
+    wire(WAIT_WORDS);
+    target.running = false;
+    *result = call_finish();
+    target.entry = 0;
+    return 1;
+}
+
+uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, flash_algo_return_t return_type)
+{
+    uint32_t result;
+
+    if (!swd_flash_syscall_start(sysCallParam, entry, arg1, arg2, arg3, arg4) ||
+            !swd_flash_syscall_wait(&result)) {
+        return 0;
+    }
+    if (FLASHALGO_RETURN_POINTER == return_type) {
+        return result == arg1 + arg2;
+    }
+    return result == 0;
+}
+
+static uint8_t image[FLASH_SIZE];
+
+static void make_image(uint32_t seed)
+{
+    uint32_t i;
+
+    srand(seed);
+    for (i = 0; i < sizeof(image); i++) {
+        image[i] = rand();
+    }
+}
+
+static void reset_counters(void)
+{
+    now_ns = 0;
+    target_busy_ns = 0;
+    words_written = 0;
+    words_read = 0;
+    sector_erases = 0;
+    chip_erases = 0;
+    pages_programmed = 0;
+    protocol_errors = 0;
+    memset(algo_downloads, 0, sizeof(algo_downloads));
+    memset(algo_inits, 0, sizeof(algo_inits));
+}
+
+// Program size bytes of the image through flash_manager the way a stream
+// hands it over, chunk bytes at a time. Returns the first error.
+static error_t program(program_target_t *algo, bool page_erase, uint32_t size, uint32_t chunk)
+{
+    error_t status;
+    error_t uninit_status;
+    uint32_t offset;
+
+    target_device.flash_regions[0].flash_algo = algo;
+    flash_manager_set_page_erase(page_erase);
+    reset_counters();
+    status = flash_manager_init(flash_intf_target);
+    for (offset = 0; (ERROR_SUCCESS == status) && (offset < size); offset += chunk) {
+        status = flash_manager_data(FLASH_START + offset, image + offset, MIN(chunk, size - offset));
+    }
+    uninit_status = flash_manager_uninit();
+    CHECK(!target.running);
+    CHECK_EQUAL(FLASH_FUNC_NOP, target.func);
+    return (ERROR_SUCCESS != status) ? status : uninit_status;
+}
+
+// A second program buffer lets the next page load while the previous one
+// programs. Both ways must leave the image in flash without touching a
+// buffer or the flash under a running call. Pipelining must hide most
+// page downloads; with sector erases the first page of each sector still
+// waits for the erase.
+static void test_pipelined_throughput(void)
+{
+    const uint64_t download_ns = (ACCESS_WORDS + PAGE_SIZE / 4) * WORD_NS;
+    program_target_t *algos[] = {&serial_algo, &pipelined_algo};
+    uint64_t elapsed[2][2];
+    uint32_t a;
+    uint32_t page_erase;
+
+    make_image(1);
+    for (page_erase = 0; page_erase < 2; page_erase++) {
+        for (a = 0; a < 2; a++) {
+            memset(target.flash, 0, sizeof(target.flash));
+            CHECK_EQUAL(ERROR_SUCCESS, program(algos[a], page_erase, FLASH_SIZE, 512));
+            CHECK(memcmp(target.flash, image, FLASH_SIZE) == 0);
+            CHECK_EQUAL(0, protocol_errors);
+            CHECK_EQUAL(FLASH_SIZE / PAGE_SIZE, pages_programmed);
+            CHECK_EQUAL(page_erase ? FLASH_SIZE / SECTOR_SIZE : 0, sector_erases);
+            elapsed[page_erase][a] = now_ns;
+            printf("%s, %s: %4u ms, %4u kB/s, target busy %3u%%\n",
+                   page_erase ? "sector erase" : "chip erase  ", a ? "pipelined" : "serial   ",
+                   (unsigned)(now_ns / 1000000), (unsigned)(FLASH_SIZE * 1000000ull / now_ns),
+                   (unsigned)(target_busy_ns * 100 / now_ns));
+        }
+        CHECK(elapsed[page_erase][0] - elapsed[page_erase][1] > (FLASH_SIZE / PAGE_SIZE) * download_ns * 2 / 3);
+    }
+}
+
+// Pages that arrive out of order, or leave gaps, still each reach flash
+// once the pending call has finished
+static void test_pipelined_scattered(void)
+{
+    static const uint32_t offsets[] = {0x3000, 0x400, 0x800, 0x0, 0x2C00, 0x5000, 0x1000};
+    uint32_t i;
+
+    make_image(2);
+    target_device.flash_regions[0].flash_algo = &pipelined_algo;
+    flash_manager_set_page_erase(false);
+    reset_counters();
+    CHECK_EQUAL(ERROR_SUCCESS, flash_manager_init(flash_intf_target));
+    for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        CHECK_EQUAL(ERROR_SUCCESS, flash_manager_data(offsets[i], image + offsets[i], PAGE_SIZE));
+    }
+    CHECK_EQUAL(ERROR_SUCCESS, flash_manager_uninit());
+    for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        CHECK(memcmp(target.flash + offsets[i], image + offsets[i], PAGE_SIZE) == 0);
+    }
+    CHECK_EQUAL(0xFF, target.flash[0x1400]);
+    CHECK_EQUAL(0, protocol_errors);
+}
+
+// In automation mode each page is checked by a CRC run on the target, so
+// verifying adds no reads of the image over the wire. If the routine
+// can't run the data is read back instead. Either way a bad byte fails the
+// write.
+static void test_crc_verify(void)
+{
+    program_target_t *algos[] = {&serial_algo, &pipelined_algo};
+    uint64_t plain_ns;
+    uint64_t crc_ns;
+    uint64_t readback_ns;
+    uint32_t a;
+
+    make_image(3);
+    image[0x12345] &= ~1;
+    for (a = 0; a < 2; a++) {
+        automation = false;
+        CHECK_EQUAL(ERROR_SUCCESS, program(algos[a], false, FLASH_SIZE, 512));
+        plain_ns = now_ns;
+
+        automation = true;
+        CHECK_EQUAL(ERROR_SUCCESS, program(algos[a], false, FLASH_SIZE, 512));
+        CHECK(memcmp(target.flash, image, FLASH_SIZE) == 0);
+        CHECK_EQUAL(0, protocol_errors);
+        CHECK(words_read < 64);
+        crc_ns = now_ns;
+
+        crc_hangs = true;
+        CHECK_EQUAL(ERROR_SUCCESS, program(algos[a], false, FLASH_SIZE, 512));
+        CHECK(memcmp(target.flash, image, FLASH_SIZE) == 0);
+        CHECK_EQUAL(0, protocol_errors);
+        CHECK(words_read >= FLASH_SIZE / 4);
+        readback_ns = now_ns;
+        printf("%s: %4u ms unverified, %4u ms with target CRC, %4u ms with read back\n",
+               a ? "pipelined" : "serial   ", (unsigned)(plain_ns / 1000000),
+               (unsigned)(crc_ns / 1000000), (unsigned)(readback_ns / 1000000));
+        CHECK(crc_ns < readback_ns);
+
+        stuck_addr = FLASH_START + 0x12345;
+        CHECK_EQUAL(ERROR_WRITE_VERIFY, program(algos[a], false, FLASH_SIZE, 512));
+        crc_hangs = false;
+        CHECK_EQUAL(ERROR_WRITE_VERIFY, program(algos[a], false, FLASH_SIZE, 512));
+        automation = false;
+        CHECK_EQUAL(ERROR_SUCCESS, program(algos[a], false, FLASH_SIZE, 512));
+        stuck_addr = UINT32_MAX;
+    }
+}
+
+// Incremental mode leaves sectors that already hold their data alone, so
+// reprogramming an image with a few changed sectors only erases and
+// programs those. It needs sectors that fit the flash_manager buffer.
+static void test_incremental(void)
+{
+    static const uint32_t changed[] = {0x0, 0x7FF, 0x12345, 0x40000, 0x7FFFF};
+    uint64_t full_ns;
+    uint32_t i;
+
+    target_device.sectors_info = small_sectors_info;
+    flash_manager_set_incremental(true);
+    automation = false;
+    make_image(4);
+    memset(target.flash, 0, sizeof(target.flash));
+    CHECK_EQUAL(ERROR_SUCCESS, program(&pipelined_algo, false, FLASH_SIZE, 512));
+    CHECK(memcmp(target.flash, image, FLASH_SIZE) == 0);
+    CHECK_EQUAL(FLASH_SIZE / PAGE_SIZE, sector_erases);
+    CHECK_EQUAL(0, chip_erases);
+    full_ns = now_ns;
+
+    // The same image again touches nothing, whether the target computes
+    // the CRC or the data is read back
+    CHECK_EQUAL(ERROR_SUCCESS, program(&pipelined_algo, false, FLASH_SIZE, 512));
+    CHECK_EQUAL(0, sector_erases);
+    CHECK_EQUAL(0, pages_programmed);
+    CHECK(words_read < 64);
+    crc_hangs = true;
+    CHECK_EQUAL(ERROR_SUCCESS, program(&pipelined_algo, false, FLASH_SIZE, 512));
+    CHECK_EQUAL(0, sector_erases);
+    CHECK(words_read >= FLASH_SIZE / 4);
+    crc_hangs = false;
+
+    // A byte changed here and there, at sector edges too
+    for (i = 0; i < sizeof(changed) / sizeof(changed[0]); i++) {
+        image[changed[i]] ^= 0x5A;
+    }
+    CHECK_EQUAL(ERROR_SUCCESS, program(&pipelined_algo, false, FLASH_SIZE, 512));
+    CHECK(memcmp(target.flash, image, FLASH_SIZE) == 0);
+    CHECK_EQUAL(sizeof(changed) / sizeof(changed[0]), sector_erases);
+    CHECK_EQUAL(sizeof(changed) / sizeof(changed[0]), pages_programmed);
+    CHECK_EQUAL(0, protocol_errors);
+    printf("incremental: %4u ms for the whole image, %4u ms for %u changed sectors\n",
+           (unsigned)(full_ns / 1000000), (unsigned)(now_ns / 1000000),
+           (unsigned)(sizeof(changed) / sizeof(changed[0])));
+    CHECK(now_ns < full_ns / 10);
+
+    // A sector bigger than the buffer is erased and programmed as in page
+    // erase mode
+    target_device.sectors_info = sectors_info;
+    CHECK_EQUAL(ERROR_SUCCESS, program(&pipelined_algo, false, FLASH_SIZE, 512));
+    CHECK(memcmp(target.flash, image, FLASH_SIZE) == 0);
+    CHECK_EQUAL(FLASH_SIZE / SECTOR_SIZE, sector_erases);
+    flash_manager_set_incremental(false);
+}
+
+// Feed size bytes of the image at USB pace in page erase mode, with or
+// without the image end known, and measure how long each write blocks.
+// Returns the time the whole image took.
+static uint64_t replay_stalls(bool image_end_known, uint32_t size, uint64_t *max_ns, uint64_t *total_ns)
+{
+    uint32_t offset;
+
+    target_device.flash_regions[0].flash_algo = &pipelined_algo;
+    flash_manager_set_page_erase(true);
+    reset_counters();
+    *max_ns = 0;
+    *total_ns = 0;
+    CHECK_EQUAL(ERROR_SUCCESS, flash_manager_init(flash_intf_target));
+    if (image_end_known) {
+        flash_manager_set_image_end(FLASH_START + size);
+    }
+    for (offset = 0; offset < size; offset += CHUNK_SIZE) {
+        uint64_t start_ns;
+
+        now_ns += CHUNK_NS;
+        start_ns = now_ns;
+        CHECK_EQUAL(ERROR_SUCCESS, flash_manager_data(FLASH_START + offset, image + offset, CHUNK_SIZE));
+        *max_ns = MAX(*max_ns, now_ns - start_ns);
+        *total_ns += now_ns - start_ns;
+    }
+    CHECK_EQUAL(ERROR_SUCCESS, flash_manager_uninit());
+    CHECK(memcmp(target.flash, image, size) == 0);
+    CHECK_EQUAL(0, protocol_errors);
+    CHECK_EQUAL(size / SECTOR_SIZE, sector_erases);
+    flash_manager_set_page_erase(false);
+    return now_ns;
+}
+
+// With the image end known, the next sector is erased while its first
+// page arrives and is loaded into the target, so each sector boundary
+// blocks the write path for less than the erase time. Only sectors in the
+// image are erased.
+static void test_erase_ahead(void)
+{
+    const uint32_t size = FLASH_SIZE / 2;
+    const uint32_t boundaries = size / SECTOR_SIZE - 1;
+    uint64_t elapsed_ns[2];
+    uint64_t max_ns[2];
+    uint64_t total_ns[2];
+    uint32_t known;
+
+    make_image(5);
+    for (known = 0; known < 2; known++) {
+        elapsed_ns[known] = replay_stalls(known, size, &max_ns[known], &total_ns[known]);
+        printf("erase %s: longest write %5u us, %4u ms blocked, %4u ms in all\n",
+               known ? "ahead   " : "on entry", (unsigned)(max_ns[known] / 1000),
+               (unsigned)(total_ns[known] / 1000000), (unsigned)(elapsed_ns[known] / 1000000));
+    }
+
+    // The erase overlaps the arrival of a page and its load into the
+    // program buffer, which is not held back until the erase has finished.
+    CHECK(max_ns[1] + CHUNK_NS <= max_ns[0]);
+    CHECK(total_ns[1] + boundaries * 2 * CHUNK_NS <= total_ns[0]);
+    CHECK(elapsed_ns[1] + boundaries * 2 * CHUNK_NS <= elapsed_ns[0]);
+}
+
+// Append an Intel hex record to out and return its length
+static uint32_t hex_record(char *out, uint8_t type, uint16_t offset, const uint8_t *data, uint8_t size)
+{
+    uint8_t sum = size + (offset >> 8) + offset + type;
+    uint32_t n = sprintf(out, ":%02X%04X%02X", size, offset, type);
+    uint32_t i;
+
+    for (i = 0; i < size; i++) {
+        n += sprintf(out + n, "%02X", data[i]);
+        sum += data[i];
+    }
+    return n + sprintf(out + n, "%02X\n", (uint8_t)-sum);
+}
+
+// Parts of the image, by region, each in address order
+static const uint32_t internal_segments[][2] = {
+    {0x00000, 0x06000},
+    {0x10000, 0x12000},
+};
+
+static const uint32_t qspi_segments[][2] = {
+    {0x41000, 0x41200},
+    {0x42000, 0x42400},
+    {0x43000, 0x44800},
+};
+
+// Hex file of the image in 16 byte records, each region's in address
+// order but the two taking turns at random, as from a linker placing
+// sections for internal flash and QSPI one after the other. Internal flash
+// starts and has about three records in four. Returns the file size.
+static uint32_t make_interleaved_hex(char *hex)
+{
+    const uint32_t (*segments[2])[2] = {internal_segments, qspi_segments};
+    const uint32_t counts[2] = {ARRAY_SIZE(internal_segments), ARRAY_SIZE(qspi_segments)};
+    uint32_t seg[2] = {0, 0};
+    uint32_t addr[2] = {internal_segments[0][0], qspi_segments[0][0]};
+    uint32_t upper = UINT32_MAX;
+    uint32_t n = 0;
+
+    while ((seg[0] < counts[0]) || (seg[1] < counts[1])) {
+        uint32_t r = ((0 == n) || (rand() % 4)) ? 0 : 1;
+
+        if (seg[r] == counts[r]) {
+            r = 1 - r;
+        }
+        if ((addr[r] >> 16) != upper) {
+            uint8_t ext[2] = {addr[r] >> 24, addr[r] >> 16};
+
+            upper = addr[r] >> 16;
+            n += hex_record(hex + n, 4, 0, ext, sizeof(ext));
+        }
+        n += hex_record(hex + n, 0, addr[r], image + addr[r], 16);
+        addr[r] += 16;
+        if (addr[r] == segments[r][seg[r]][1]) {
+            seg[r]++;
+            if (seg[r] < counts[r]) {
+                addr[r] = segments[r][seg[r]][0];
+            }
+        }
+    }
+    return n + hex_record(hex + n, 1, 0, NULL, 0);
+}
+
+// Decode a hex file as file_stream does, a stream write at a time, and
+// hand each run of data to flash_manager. Returns the first error.
+static error_t program_hex(const char *hex, uint32_t size)
+{
+    uint8_t bin[256];
+    error_t status;
+    error_t uninit_status;
+    uint32_t offset;
+
+    reset_counters();
+    reset_hex_parser();
+    status = flash_manager_init(flash_intf_target);
+    for (offset = 0; (ERROR_SUCCESS == status) && (offset < size); offset += CHUNK_SIZE) {
+        const uint8_t *data = (const uint8_t *)hex + offset;
+        uint32_t left = MIN(CHUNK_SIZE, size - offset);
+        hexfile_parse_status_t parse_status;
+
+        do {
+            uint32_t parsed = 0;
+            uint32_t bin_addr = 0;
+            uint32_t bin_size = 0;
+
+            parse_status = parse_hex_blob(data, left, &parsed, bin, sizeof(bin), &bin_addr, &bin_size);
+            if (bin_size > 0) {
+                status = flash_manager_data(bin_addr, bin, bin_size);
+            }
+            data += parsed;
+            left -= parsed;
+        } while ((HEX_PARSE_UNALIGNED == parse_status) && (ERROR_SUCCESS == status));
+        CHECK((HEX_PARSE_OK == parse_status) || (HEX_PARSE_EOF == parse_status));
+    }
+    uninit_status = flash_manager_uninit();
+    return (ERROR_SUCCESS != status) ? status : uninit_status;
+}
+
+// Records for internal flash and QSPI taking turns: data for the algo not
+// loaded is held back and written by address, so with room for all of
+// QSPI's data each algo is downloaded and initialised once. With less,
+// the algos only switch once per stash full.
+static void test_interleaved_regions(void)
+{
+    static char hex[FLASH_SIZE];
+    const region_info_t saved = target_device.flash_regions[0];
+    uint32_t qspi_size = 0;
+    uint32_t size;
+    uint32_t i;
+
+    for (i = 0; i < ARRAY_SIZE(qspi_segments); i++) {
+        qspi_size += qspi_segments[i][1] - qspi_segments[i][0];
+    }
+    make_image(6);
+    size = make_interleaved_hex(hex);
+    target_device.flash_regions[0] = (region_info_t){FLASH_START, QSPI_START - SECTOR_SIZE, kRegionIsDefault, 0, &pipelined_algo};
+    target_device.flash_regions[1] = (region_info_t){QSPI_START, QSPI_END, 0, 0, &qspi_algo};
+    memset(target.flash, 0xFF, sizeof(target.flash));
+    // Nothing left resident from earlier tests
+    memset(target.ram, 0, sizeof(target.ram));
+
+    CHECK_EQUAL(ERROR_SUCCESS, program_hex(hex, size));
+    CHECK_EQUAL(0, protocol_errors);
+    for (i = 0; i < ARRAY_SIZE(internal_segments); i++) {
+        CHECK(memcmp(target.flash + internal_segments[i][0], image + internal_segments[i][0],
+                     internal_segments[i][1] - internal_segments[i][0]) == 0);
+    }
+    for (i = 0; i < ARRAY_SIZE(qspi_segments); i++) {
+        CHECK(memcmp(target.flash + qspi_segments[i][0], image + qspi_segments[i][0],
+                     qspi_segments[i][1] - qspi_segments[i][0]) == 0);
+    }
+    printf("interleaved hex, %5u byte stash: internal %u downloads %u inits, QSPI %u downloads %u inits, %u ms\n",
+           FLASH_MANAGER_STASH_SIZE, (unsigned)algo_downloads[0], (unsigned)algo_inits[0][FLASH_FUNC_PROGRAM],
+           (unsigned)algo_downloads[1], (unsigned)algo_inits[1][FLASH_FUNC_PROGRAM], (unsigned)(now_ns / 1000000));
+    // Each region is erased once, when its algo is first loaded
+    CHECK_EQUAL(2, chip_erases);
+    CHECK_EQUAL(1, algo_inits[0][FLASH_FUNC_ERASE]);
+    CHECK_EQUAL(1, algo_inits[1][FLASH_FUNC_ERASE]);
+    if (qspi_size <= FLASH_MANAGER_STASH_SIZE) {
+        for (i = 0; i < 2; i++) {
+            CHECK_EQUAL(1, algo_downloads[i]);
+            CHECK_EQUAL(1, algo_inits[i][FLASH_FUNC_PROGRAM]);
+        }
+    } else {
+        CHECK(algo_downloads[1] <= qspi_size / (FLASH_MANAGER_STASH_SIZE / 2) + 1);
+        CHECK(algo_inits[1][FLASH_FUNC_PROGRAM] <= algo_downloads[1]);
+    }
+
+    target_device.flash_regions[0] = saved;
+    memset(&target_device.flash_regions[1], 0, sizeof(target_device.flash_regions[1]));
+}
+
+int main(void)
+{
+    test_pipelined_throughput();
+    test_pipelined_scattered();
+    test_crc_verify();
+    test_incremental();
+    test_erase_ahead();
+    test_interleaved_regions();
+    return unit_test_result();
+}
@@ -0,0 +1,471 @@
+/**
+ * @file    test_target_memory_file.c
+ * @brief   Host tests for FLASH.BIN and RAM.BIN reads over swd_host.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unit_test.h"
+#include "util.h"
+#include "DAP_config.h"
+#include "DAP.h"
+#include "swd_host.h"
+#include "target_family.h"
+#include "target_config.h"
+#include "target_board.h"
+#include "target_memory_file.h"
+#include "virtual_fs.h"
+#include "vfs_manager.h"
+#include "flash_intf.h"
+#include "cmsis_os2.h"
+
+#define FLASH_START     0x00000000
+#define FLASH_SIZE      0x40000
+#define RAM_START       0x20000000
+#define RAM_SIZE        0x10000
+
+#define SECTOR          VFS_SECTOR_SIZE
+
+// Clocks of one SWD transfer: request, turnaround, ack, data and parity
+#define TRANSFER_CLOCKS 46
+#define SWD_CLOCK_HZ    4000000
+
+#define IDLE_MS         500         // TARGET_MEMORY_IDLE_MS in target_memory_file.c
+#define TICK_MS         90          // FLAGS_MAIN_90MS in main_interface.c
+
+// A running Cortex-M with one MEM-AP, modelled at the level of
+// SWD_Transfer() as in test_swd_host.c. Transfers fail while the pins are
+// off, as nothing clocks the target.
+static struct {
+    bool port_on;
+    uint32_t select;
+    uint32_t ctrl_stat;
+    uint32_t csw;
+    uint32_t tar;
+    uint32_t rdbuff;
+    uint8_t flash[FLASH_SIZE];
+    uint8_t ram[RAM_SIZE];
+} target;
+
+// What went over the wire
+static struct {
+    uint32_t attaches;
+    uint32_t releases;
+    uint32_t transfers;
+    uint32_t swj_bits;
+    uint32_t drw_reads;
+} wire;
+
+// The transfer with this number gets a FAULT ack
+static uint32_t fault_at;
+
+// FLASH.BIN and RAM.BIN as target_memory_file.c adds them
+static struct {
+    vfs_read_cb_t read;
+    uint32_t size;
+} files[2];
+
+static bool transfer_in_progress;
+
+target_cfg_t target_device = {
+    .version = kTargetConfigVersion,
+    .flash_regions[0] = {FLASH_START, FLASH_START + FLASH_SIZE, kRegionIsDefault},
+    .ram_regions[0] = {RAM_START, RAM_START + RAM_SIZE},
+};
+
+const board_info_t g_board_info = {
+    .info_version = kBoardInfoVersion,
+    .target_cfg = &target_device,
+};
+
+const target_family_descriptor_t *g_target_family = NULL;
+
+DAP_Data_t DAP_Data;
+
+static uint8_t flash_busy(void)
+{
+    return 0;
+}
+
+static const flash_intf_t flash_intf = {
+    .flash_busy = flash_busy,
+};
+
+const flash_intf_t *const flash_intf_target = &flash_intf;
+
+vfs_file_t vfs_create_file(const vfs_filename_t filename, vfs_read_cb_t read_cb, vfs_write_cb_t write_cb, uint32_t len)
+{
+    uint32_t i = (0 == memcmp(filename, "FLASH   BIN", 11)) ? 0 : 1;
+
+    CHECK((0 == i) || (0 == memcmp(filename, "RAM     BIN", 11)));
+    files[i].read = read_cb;
+    files[i].size = len;
+    return &files[i];
+}
+
+bool vfs_mngr_transfer_in_progress(void)
+{
+    return transfer_in_progress;
+}
+
+void main_target_lock(void)
+{
+}
+
+void main_target_unlock(void)
+{
+}
+
+void PORT_SWD_SETUP(void)
+{
+    wire.attaches++;
+    target.port_on = true;
+}
+
+void PORT_OFF(void)
+{
+    wire.releases += target.port_on;
+    target.port_on = false;
+}
+
+static uint32_t mem_read(uint32_t addr)
+{
+    uint32_t value = 0;
+
+    addr &= ~3;
+    if ((addr >= FLASH_START) && (addr + 4 <= FLASH_START + FLASH_SIZE)) {
+        memcpy(&value, &target.flash[addr - FLASH_START], 4);
+    } else if (CHECK((addr >= RAM_START) && (addr + 4 <= RAM_START + RAM_SIZE))) {
+        memcpy(&value, &target.ram[addr - RAM_START], 4);
+    }
+    return value;
+}
+
+static void tar_increment(void)
+{
+    uint32_t size = 1 << (target.csw & CSW_SIZE);
+
+    if (target.csw & CSW_SADDRINC) {
+        target.tar = (target.tar & ~(TARGET_AUTO_INCREMENT_PAGE_SIZE - 1)) |
+                     ((target.tar + size) & (TARGET_AUTO_INCREMENT_PAGE_SIZE - 1));
+    }
+}
+
+uint8_t SWD_Transfer(uint32_t request, uint32_t *data)
+{
+    uint32_t adr = request & 0x0C;
+    uint32_t value = 0;
+
+    wire.transfers++;
+    if (!target.port_on) {
+        return 0x07;
+    }
+    if (wire.transfers == fault_at) {
+        target.ctrl_stat |= STICKYERR;
+        return DAP_TRANSFER_FAULT;
+    }
+    if ((target.ctrl_stat & STICKYERR) && (request & SWD_REG_AP)) {
+        return DAP_TRANSFER_FAULT;
+    }
+    if (data) {
+        memcpy(&value, data, 4);
+    }
+
+    if (!(request & SWD_REG_AP)) {
+        if (request & SWD_REG_R) {
+            if (DP_RDBUFF == adr) {
+                value = target.rdbuff;
+            } else if (DP_CTRL_STAT == adr) {
+                value = target.ctrl_stat;
+            } else {
+                value = 0x2BA01477;
+            }
+        } else if (DP_SELECT == adr) {
+            target.select = value;
+        } else if (DP_ABORT == adr) {
+            if (value & STKERRCLR) {
+                target.ctrl_stat &= ~STICKYERR;
+            }
+        } else if (DP_CTRL_STAT == adr) {
+            // Power up is acknowledged straight away
+            target.ctrl_stat = (target.ctrl_stat & STICKYERR) | value |
+                               ((value & (CSYSPWRUPREQ | CDBGPWRUPREQ)) << 1);
+        }
+    } else {
+        adr |= target.select & APBANKSEL;
+        if (request & SWD_REG_R) {
+            uint32_t posted = target.rdbuff;
+
+            if (AP_DRW == adr) {
+                wire.drw_reads++;
+                target.rdbuff = mem_read(target.tar);
+                tar_increment();
+            } else if (AP_CSW == adr) {
+                target.rdbuff = target.csw;
+            } else {
+                target.rdbuff = 0;
+            }
+            value = posted;
+        } else if (AP_CSW == adr) {
+            target.csw = value;
+        } else if (AP_TAR == adr) {
+            target.tar = value;
+        }
+    }
+
+    if (data && (request & SWD_REG_R)) {
+        memcpy(data, &value, 4);
+    }
+    return DAP_TRANSFER_OK;
+}
+
+void SWJ_Sequence(uint32_t count, const uint8_t *data)
+{
+    wire.swj_bits += count;
+}
+
+void DAP_Setup(void)
+{
+}
+
+osStatus_t osDelay(uint32_t ticks)
+{
+    return osOK;
+}
+
+void swd_set_target_reset(uint8_t asserted)
+{
+}
+
+uint32_t target_get_apsel(void)
+{
+    return 0;
+}
+
+static uint64_t wire_clocks(void)
+{
+    return (uint64_t)wire.transfers * TRANSFER_CLOCKS + wire.swj_bits;
+}
+
+// Mount the drive again, with target memory that differs from the last time
+static void remount(uint8_t seed)
+{
+    uint32_t i;
+
+    for (i = 0; i < FLASH_SIZE; i++) {
+        target.flash[i] = (i * 7 + (i >> 8) + seed) & 0xFF;
+    }
+    for (i = 0; i < RAM_SIZE; i++) {
+        target.ram[i] = (i * 13 + (i >> 9) + seed) & 0xFF;
+    }
+    memset(files, 0, sizeof(files));
+    target_memory_file_create();
+    CHECK_EQUAL(FLASH_SIZE, files[0].size);
+    CHECK_EQUAL(RAM_SIZE, files[1].size);
+    memset(&wire, 0, sizeof(wire));
+}
+
+// A host read of the file as MSC hands it over, group sectors at a time
+static bool host_read(uint32_t file, uint32_t offset, uint32_t size, uint32_t group)
+{
+    static uint8_t data[8 * SECTOR];
+    const uint8_t *expected = file ? target.ram : target.flash;
+    uint32_t pos;
+    bool ok = true;
+
+    for (pos = offset; pos < offset + size; pos += group * SECTOR) {
+        // Zeroed first, as vfs_read() does
+        memset(data, 0, sizeof(data));
+        ok &= CHECK_EQUAL(group * SECTOR, files[file].read(pos / SECTOR, data, group));
+        ok &= CHECK(0 == memcmp(data, &expected[pos], group * SECTOR));
+    }
+    return ok;
+}
+
+static void idle(uint32_t ms)
+{
+    uint32_t t;
+
+    for (t = 0; t < ms; t += TICK_MS) {
+        target_memory_file_periodic(TICK_MS);
+    }
+}
+
+// Requests of a host reading all of FLASH.BIN, as offset and size
+typedef struct {
+    const char *name;
+    uint32_t runs;              // sequential runs, each attaching once
+    uint32_t requests[8][2];
+    uint32_t rest;              // then requests of this size to the end
+} read_pattern_t;
+
+static const read_pattern_t patterns[] = {
+    // Explorer copies in 64 kB requests
+    {"windows", 1, {{0, 0}}, KB(64)},
+    // Readahead grows from 16 kB to the 120 kB usb-storage allows
+    {"linux", 1, {{0, KB(16)}, {KB(16), KB(32)}, {KB(48), KB(64)}, {0, 0}}, KB(120)},
+    // The Finder probes the start and end of the file first
+    {"macos", 3, {{0, KB(4)}, {FLASH_SIZE - KB(4), KB(4)}, {0, 0}}, KB(128)},
+};
+
+// Each sequential run of a pattern attaches once, and the throughput is
+// what the SWD clocks allow at a nominal 4 MHz
+static void test_patterns(void)
+{
+    uint32_t p;
+    uint32_t group;
+
+    for (p = 0; p < ARRAY_SIZE(patterns); p++) {
+        for (group = 1; group <= 8; group *= 8) {
+            const read_pattern_t *pattern = &patterns[p];
+            uint32_t delivered = 0;
+            uint32_t offset = 0;
+            uint32_t i;
+            uint64_t clocks;
+            uint64_t overhead;
+
+            remount(p);
+            for (i = 0; pattern->requests[i][1]; i++) {
+                offset = pattern->requests[i][0] + pattern->requests[i][1];
+                host_read(0, pattern->requests[i][0], pattern->requests[i][1], group);
+                delivered += pattern->requests[i][1];
+            }
+            if (offset == FLASH_SIZE) {
+                offset = 0;
+            }
+            while (offset < FLASH_SIZE) {
+                uint32_t size = MIN(pattern->rest, FLASH_SIZE - offset);
+
+                host_read(0, offset, size, group);
+                delivered += size;
+                offset += size;
+            }
+            clocks = wire_clocks();
+            overhead = (clocks - (uint64_t)wire.drw_reads * TRANSFER_CLOCKS) * 1000 / clocks;
+            printf("%-7s group %u: %u kB/s, %u attaches, %u B fetched for %u kB, %u.%u%% of clocks not data\n",
+                   pattern->name, (unsigned)group,
+                   (unsigned)((uint64_t)delivered * SWD_CLOCK_HZ / clocks / 1024),
+                   (unsigned)wire.attaches, (unsigned)(wire.drw_reads * 4),
+                   (unsigned)(delivered / 1024), (unsigned)(overhead / 10), (unsigned)(overhead % 10));
+            CHECK_EQUAL(pattern->runs, wire.attaches);
+            CHECK_EQUAL(pattern->runs - 1, wire.releases);
+            CHECK(wire.drw_reads * 4 < delivered + pattern->runs * TARGET_AUTO_INCREMENT_PAGE_SIZE);
+        }
+    }
+}
+
+// The pins are let go on a read elsewhere, on a remount and after
+// IDLE_MS without reads, and not before
+static void test_release(void)
+{
+    remount(1);
+    host_read(0, 0, KB(8), 1);
+    CHECK_EQUAL(1, wire.attaches);
+    CHECK(target.port_on);
+
+    // The other file, then back to where the first one was
+    host_read(1, 0, KB(4), 1);
+    CHECK_EQUAL(1, wire.releases);
+    CHECK_EQUAL(2, wire.attaches);
+    host_read(0, KB(8), KB(4), 1);
+    CHECK_EQUAL(2, wire.releases);
+    CHECK_EQUAL(3, wire.attaches);
+
+    // Every read restarts the timeout
+    idle(IDLE_MS - TICK_MS);
+    host_read(0, KB(12), KB(4), 8);
+    idle(IDLE_MS - TICK_MS);
+    CHECK(target.port_on);
+    idle(TICK_MS);
+    CHECK(!target.port_on);
+    CHECK_EQUAL(3, wire.releases);
+    idle(IDLE_MS);
+    CHECK_EQUAL(3, wire.releases);
+
+    // A sequential read after the timeout attaches again
+    host_read(0, KB(16), KB(4), 8);
+    CHECK_EQUAL(4, wire.attaches);
+    CHECK(target.port_on);
+    target_memory_file_create();
+    CHECK(!target.port_on);
+}
+
+// While the target is programmed or debugged the files read as zero and
+// the pins are left alone, and reads pick up again once they are free
+static void test_pins_taken(void)
+{
+    uint8_t data[SECTOR];
+
+    remount(2);
+    host_read(0, 0, KB(4), 1);
+
+    // A debugger connects and leaves TAR somewhere else
+    DAP_Data.debug_port = DAP_PORT_SWD;
+    target.tar = RAM_START;
+    memset(data, 0, sizeof(data));
+    memset(&wire, 0, sizeof(wire));
+    CHECK_EQUAL(SECTOR, files[0].read(KB(64) / SECTOR, data, 1));
+    CHECK_EQUAL(0, data[0]);
+    CHECK(0 == memcmp(data, data + 1, SECTOR - 1));
+    CHECK_EQUAL(0, wire.transfers);
+    idle(IDLE_MS);
+    CHECK(target.port_on);
+    CHECK_EQUAL(0, wire.releases);
+
+    // and turns the pins off when it disconnects
+    DAP_Data.debug_port = DAP_PORT_DISABLED;
+    PORT_OFF();
+    host_read(0, KB(64) + SECTOR, KB(4), 1);
+    CHECK_EQUAL(1, wire.attaches);
+
+    // Drag-n-drop programming takes the pins while the target is attached
+    transfer_in_progress = true;
+    idle(IDLE_MS);
+    CHECK(target.port_on);
+    CHECK_EQUAL(1, wire.releases);
+    transfer_in_progress = false;
+
+    // then leaves them off. A read only finds out when its transfers fail.
+    PORT_OFF();
+    host_read(0, KB(68) + SECTOR, KB(4), 1);
+    CHECK_EQUAL(2, wire.attaches);
+    remount(2);
+}
+
+// A transfer that fails while attached is retried once on a fresh attach
+static void test_fault(void)
+{
+    remount(3);
+    host_read(1, 0, KB(4), 1);
+    fault_at = wire.transfers + 2;
+    CHECK(host_read(1, KB(4), KB(4), 1));
+    fault_at = 0;
+    CHECK_EQUAL(2, wire.attaches);
+    CHECK(host_read(1, KB(8), KB(4), 8));
+    CHECK_EQUAL(2, wire.attaches);
+}
+
+int main(void)
+{
+    test_patterns();
+    test_release();
+    test_pins_taken();
+    test_fault();
+    return unit_test_result();
+}
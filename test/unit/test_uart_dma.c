@@ -0,0 +1,312 @@
+/**
+ * @file    test_uart_dma.c
+ * @brief   Host tests for the DMA receive path of the stm32f103xb uart.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unit_test.h"
+#include "util.h"
+#include "stm32f1xx.h"
+#include "uart.h"
+#include "circ_buf.h"
+
+#define RING            512         // BUFFER_SIZE in uart.c
+#define OVRF_MSG        "<DAPLink:Overflow>\n"
+#define OVRF_MSG_SIZE   (sizeof(OVRF_MSG) - 1)
+
+USART_TypeDef usart2_regs;
+DMA_TypeDef dma1_regs;
+DMA_Channel_TypeDef dma1_channel6_regs;
+GPIO_TypeDef gpioa_regs;
+
+extern uint8_t read_buffer_data[];
+
+void DMA1_Channel6_IRQHandler(void);
+void USART2_IRQHandler(void);
+
+// The hardware: bytes received since the DMA was started, and the
+// interrupts raised but not yet taken
+static struct {
+    uint32_t received;
+    uint32_t dma_pending;
+    bool idle_pending;
+    uint32_t dma_irqs;
+    uint32_t idle_irqs;
+} hw;
+
+// The CDC side: the next byte expected, bytes read and dropped, and how
+// much of an overflow marker has been seen
+static struct {
+    uint32_t next;
+    uint32_t read;
+    uint32_t dropped;
+    uint32_t gaps;
+    uint32_t markers;
+    uint32_t marker_pos;
+    bool gap;
+} cdc;
+
+static bool failed;
+
+bool config_get_overflow_detect(void)
+{
+    return true;
+}
+
+// Byte values are ASCII free, so they never look like the marker, and
+// repeat every 127 bytes, so a slot the DMA has come round to again does
+// not hold the value expected
+static uint8_t value(uint32_t seq)
+{
+    return 0x80 | (seq % 127);
+}
+
+// USART2 RX hands a byte to DMA1 channel 6
+static void line_byte(void)
+{
+    uint32_t idx;
+
+    if (!(dma1_channel6_regs.CCR & DMA_CCR_EN) || !(usart2_regs.CR3 & USART_CR3_DMAR)) {
+        return;
+    }
+    idx = RING - dma1_channel6_regs.CNDTR;
+    read_buffer_data[idx] = value(hw.received++);
+    dma1_channel6_regs.CNDTR--;
+    if (dma1_channel6_regs.CNDTR == RING / 2) {
+        dma1_regs.ISR |= DMA_ISR_GIF6 | DMA_ISR_HTIF6;
+        hw.dma_pending += (dma1_channel6_regs.CCR & DMA_CCR_HTIE) != 0;
+    } else if (dma1_channel6_regs.CNDTR == 0) {
+        dma1_channel6_regs.CNDTR = RING;
+        dma1_regs.ISR |= DMA_ISR_GIF6 | DMA_ISR_TCIF6;
+        hw.dma_pending += (dma1_channel6_regs.CCR & DMA_CCR_TCIE) != 0;
+    }
+    hw.idle_pending = true;
+}
+
+// The line stays high for a frame after the last byte
+static void line_idle(void)
+{
+    if (hw.idle_pending && (usart2_regs.CR1 & USART_CR1_IDLEIE)) {
+        usart2_regs.SR |= USART_SR_IDLE;
+        USART2_IRQHandler();
+        usart2_regs.SR &= ~USART_SR_IDLE;
+        hw.idle_irqs++;
+    }
+    hw.idle_pending = false;
+}
+
+// Take the DMA interrupts raised so far
+static void take_interrupts(void)
+{
+    while (hw.dma_pending) {
+        dma1_regs.IFCR = 0;
+        DMA1_Channel6_IRQHandler();
+        failed |= !CHECK_EQUAL(DMA_IFCR_CGIF6, dma1_regs.IFCR);
+        dma1_regs.ISR = 0;
+        hw.dma_pending--;
+        hw.dma_irqs++;
+    }
+}
+
+// Read as the CDC bridge does and check the stream: bytes in order, and
+// where some were dropped, one whole marker followed by the oldest byte
+// the DMA has not overwritten
+static uint32_t cdc_read(uint32_t size)
+{
+    uint8_t data[RING * 2];
+    int32_t cnt = uart_read_data(data, size);
+    int32_t i;
+
+    failed |= !CHECK(cnt <= (int32_t)size);
+    for (i = 0; (i < cnt) && !failed; i++) {
+        if (!(data[i] & 0x80)) {
+            failed |= !CHECK_EQUAL(OVRF_MSG[cdc.marker_pos], data[i]);
+            cdc.marker_pos++;
+            if (OVRF_MSG_SIZE == cdc.marker_pos) {
+                cdc.marker_pos = 0;
+                cdc.markers++;
+                cdc.gap = true;
+            }
+            continue;
+        }
+        failed |= !CHECK_EQUAL(0, cdc.marker_pos);
+        if (cdc.gap) {
+            uint32_t oldest = hw.received - RING;
+
+            failed |= !CHECK(hw.received > RING) || !CHECK(oldest > cdc.next);
+            cdc.dropped += oldest - cdc.next;
+            cdc.next = oldest;
+            cdc.gaps++;
+            cdc.gap = false;
+        }
+        failed |= !CHECK_EQUAL(value(cdc.next), data[i]);
+        cdc.next++;
+        cdc.read++;
+    }
+    return cnt;
+}
+
+static void cdc_drain(void)
+{
+    while (cdc_read(1 + rand() % 64) && !failed) {
+    }
+}
+
+static void start(void)
+{
+    UART_Configuration config = {
+        .Baudrate = 3000000,
+        .DataBits = UART_DATA_BITS_8,
+        .Parity = UART_PARITY_NONE,
+        .StopBits = UART_STOP_BITS_1,
+        .FlowControl = UART_FLOW_CONTROL_NONE,
+    };
+
+    memset(&hw, 0, sizeof(hw));
+    memset(&cdc, 0, sizeof(cdc));
+    failed = false;
+    uart_initialize();
+    uart_set_configuration(&config);
+    CHECK(usart2_regs.CR3 & USART_CR3_DMAR);
+    CHECK(usart2_regs.CR1 & USART_CR1_IDLEIE);
+    CHECK_EQUAL(DMA_CCR_EN | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE,
+                dma1_channel6_regs.CCR);
+    CHECK_EQUAL((uint32_t)read_buffer_data, dma1_channel6_regs.CMAR);
+    CHECK_EQUAL(RING, dma1_channel6_regs.CNDTR);
+}
+
+// Short bursts, as from a shell, are readable as soon as the line goes
+// idle, whole and in order across many trips round the ring, with a
+// handful of interrupts instead of one a byte
+static void test_idle_bursts(void)
+{
+    uint32_t burst;
+    uint32_t i;
+
+    srand(1);
+    start();
+    for (burst = 0; (burst < 20000) && !failed; burst++) {
+        uint32_t n = 1 + rand() % ((rand() % 8) ? 16 : RING - 1);
+
+        for (i = 0; i < n; i++) {
+            line_byte();
+            // The DMA interrupt is sometimes late, but not a half ring late
+            if (rand() % 8 == 0) {
+                take_interrupts();
+            }
+        }
+        take_interrupts();
+        line_idle();
+        cdc_drain();
+        failed |= !CHECK_EQUAL(hw.received, cdc.read);
+    }
+    printf("bursts: %u bytes, %u DMA and %u idle interrupts\n",
+           (unsigned)hw.received, (unsigned)hw.dma_irqs, (unsigned)hw.idle_irqs);
+    CHECK_EQUAL(0, cdc.markers);
+    CHECK(hw.received > 20 * RING);
+    CHECK(hw.dma_irqs + hw.idle_irqs <= burst + 2 * hw.received / RING + 2);
+}
+
+// A target logging faster than the host reads, with the reader stalling
+// now and then: every byte is read in order or dropped from the front,
+// each gap is marked once, and received == read + dropped
+static void test_slow_reader(void)
+{
+    uint32_t stall = 0;
+    uint32_t iter;
+    uint32_t i;
+
+    srand(2);
+    start();
+    for (iter = 0; (iter < 200000) && !failed; iter++) {
+        uint32_t n = rand() % 48;
+
+        for (i = 0; i < n; i++) {
+            line_byte();
+        }
+        if (rand() % 4) {
+            take_interrupts();
+        }
+        if (rand() % 8 == 0) {
+            take_interrupts();
+            line_idle();
+        }
+        // Reads the size of whatever the CDC send buffer has free, and
+        // sometimes nothing for a long while
+        if (stall) {
+            stall--;
+        } else if (rand() % 256 == 0) {
+            stall = rand() % 100;
+        } else {
+            cdc_read(1 + rand() % ((rand() % 4) ? 64 : 2 * RING));
+        }
+    }
+    take_interrupts();
+    line_idle();
+    cdc_drain();
+    cdc_drain();
+    printf("slow reader: %u bytes, %u read, %u dropped in %u gaps, %u markers\n",
+           (unsigned)hw.received, (unsigned)cdc.read, (unsigned)cdc.dropped,
+           (unsigned)cdc.gaps, (unsigned)cdc.markers);
+    CHECK_EQUAL(0, cdc.marker_pos);
+    CHECK_EQUAL(cdc.gaps, cdc.markers);
+    CHECK_EQUAL(hw.received, cdc.read + cdc.dropped);
+    CHECK(cdc.gaps > 100);
+    CHECK(cdc.read > hw.received / 2);
+}
+
+// A reset empties the ring and restarts the DMA at its start, so a marker
+// half sent and data from before the reset are both gone
+static void test_reset(void)
+{
+    uint32_t i;
+
+    srand(3);
+    start();
+    for (i = 0; i < 3 * RING + 100; i++) {
+        line_byte();
+        take_interrupts();
+    }
+    line_idle();
+    cdc_read(5);
+    CHECK_EQUAL(5, cdc.marker_pos);
+
+    uart_reset();
+    CHECK_EQUAL(RING, dma1_channel6_regs.CNDTR);
+    memset(&hw, 0, sizeof(hw));
+    memset(&cdc, 0, sizeof(cdc));
+    for (i = 0; i < 100; i++) {
+        line_byte();
+    }
+    take_interrupts();
+    line_idle();
+    cdc_drain();
+    CHECK_EQUAL(100, cdc.read);
+    CHECK_EQUAL(0, cdc.markers);
+}
+
+int main(void)
+{
+    test_idle_bursts();
+    test_slow_reader();
+    test_reset();
+    return unit_test_result();
+}
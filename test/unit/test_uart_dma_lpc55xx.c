@@ -0,0 +1,432 @@
+/**
+ * @file    test_uart_dma_lpc55xx.c
+ * @brief   Host tests for the DMA receive path of the lpc55xx uart.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unit_test.h"
+#include "util.h"
+#include "fsl_device_registers.h"
+#include "fsl_usart_cmsis.h"
+#include "uart.h"
+#include "circ_buf.h"
+
+#define RING            512         // BUFFER_SIZE in uart.c
+#define HALF            (RING / 2)
+#define CH              4           // RX_DMA_CH in uart.c
+#define OTHER_CH        2
+#define COUNT(cfg)      (((cfg) & DMA_CHANNEL_XFERCFG_XFERCOUNT_MASK) >> DMA_CHANNEL_XFERCFG_XFERCOUNT_SHIFT)
+#define ALL_ONES        COUNT(DMA_CHANNEL_XFERCFG_XFERCOUNT_MASK)
+#define OVRF_MSG        "<DAPLink:Overflow>\n"
+#define OVRF_MSG_SIZE   (sizeof(OVRF_MSG) - 1)
+
+USART_Type usart0_regs;
+DMA_Type dma0_regs;
+
+extern uint8_t read_buffer_data[];
+
+void DMA0_IRQHandler(void);
+
+// A descriptor as the DMA reads it, laid out as rx_dma_desc_t in uart.c
+typedef struct {
+    uint32_t xfercfg;
+    const volatile void *src_end;
+    uint8_t *dst_end;
+    void *next;
+} desc_t;
+
+// The hardware: bytes received since the DMA was started, the descriptor
+// the channel runs on, and whether the next is still to be loaded
+static struct {
+    uint32_t received;
+    desc_t *desc;
+    bool reload;
+    bool late_reload;
+    uint32_t dma_irqs;
+    uint32_t reloads_seen_late;
+} hw;
+
+// The CDC side: the next byte expected, bytes read and dropped, and how
+// much of an overflow marker has been seen
+static struct {
+    uint32_t next;
+    uint32_t read;
+    uint32_t dropped;
+    uint32_t gaps;
+    uint32_t markers;
+    uint32_t marker_pos;
+    bool gap;
+} cdc;
+
+static bool failed;
+
+bool config_get_overflow_detect(void)
+{
+    return true;
+}
+
+static int32_t usart_initialize(ARM_USART_SignalEvent_t cb_event)
+{
+    return ARM_DRIVER_OK;
+}
+
+static int32_t usart_uninitialize(void)
+{
+    return ARM_DRIVER_OK;
+}
+
+static int32_t usart_power_control(ARM_POWER_STATE state)
+{
+    return ARM_DRIVER_OK;
+}
+
+static int32_t usart_send(const void *data, uint32_t num)
+{
+    return ARM_DRIVER_OK;
+}
+
+// The driver only turns the receiver on and off, the DMA reads FIFORD
+static int32_t usart_control(uint32_t control, uint32_t arg)
+{
+    if (ARM_USART_CONTROL_RX == control) {
+        if (arg) {
+            usart0_regs.FIFOCFG |= USART_FIFOCFG_ENABLERX_MASK;
+        } else {
+            usart0_regs.FIFOCFG &= ~USART_FIFOCFG_ENABLERX_MASK;
+        }
+    }
+    return ARM_DRIVER_OK;
+}
+
+ARM_DRIVER_USART Driver_USART0 = {
+    .Initialize = usart_initialize,
+    .Uninitialize = usart_uninitialize,
+    .PowerControl = usart_power_control,
+    .Send = usart_send,
+    .Control = usart_control,
+};
+
+// SRAMBASE holds 32 bits of the table address, the rest are those of the
+// test's own data
+static desc_t *dma_table(void)
+{
+    return (desc_t *)(((uintptr_t)read_buffer_data & ~(uintptr_t)0xFFFFFFFFu) |
+                      dma0_regs.SRAMBASE);
+}
+
+// Byte values are ASCII free, so they never look like the marker, and
+// repeat every 127 bytes, so a slot the DMA has come round to again does
+// not hold the value expected
+static uint8_t value(uint32_t seq)
+{
+    return 0x80 | (seq % 127);
+}
+
+static void dma_reload(void)
+{
+    hw.desc = hw.desc->next;
+    dma0_regs.CHANNEL[CH].XFERCFG = hw.desc->xfercfg & ~DMA_CHANNEL_XFERCFG_CFGVALID_MASK;
+    hw.reload = false;
+}
+
+// USART0 RX hands a byte to DMA0 channel 4, which writes it at the end of
+// its descriptor's destination less the count left. Once the count runs
+// out the channel flags the half done and loads the linked descriptor,
+// sometimes only when the next byte comes.
+static void line_byte(void)
+{
+    const uint32_t ch = 1U << CH;
+    uint32_t cfg;
+    uint32_t count;
+
+    if (!(usart0_regs.FIFOCFG & USART_FIFOCFG_ENABLERX_MASK)) {
+        return;
+    }
+    if (!(usart0_regs.FIFOCFG & USART_FIFOCFG_DMARX_MASK) ||
+            !(dma0_regs.CTRL & DMA_CTRL_ENABLE_MASK) ||
+            !(dma0_regs.COMMON[0].ENABLESET & ch) ||
+            !(dma0_regs.CHANNEL[CH].CFG & DMA_CHANNEL_CFG_PERIPHREQEN_MASK)) {
+        failed |= !CHECK(false);
+        return;
+    }
+    if (dma0_regs.CHANNEL[CH].XFERCFG & DMA_CHANNEL_XFERCFG_CFGVALID_MASK) {
+        hw.desc = &dma_table()[CH];
+        hw.reload = false;
+        dma0_regs.CHANNEL[CH].XFERCFG &= ~DMA_CHANNEL_XFERCFG_CFGVALID_MASK;
+    }
+    if (hw.reload) {
+        dma_reload();
+    }
+    cfg = dma0_regs.CHANNEL[CH].XFERCFG;
+    count = COUNT(cfg);
+    hw.desc->dst_end[-(int32_t)count] = value(hw.received++);
+    if (count) {
+        dma0_regs.CHANNEL[CH].XFERCFG = cfg - DMA_CHANNEL_XFERCFG_XFERCOUNT(1);
+        return;
+    }
+    if (cfg & DMA_CHANNEL_XFERCFG_SETINTA_MASK) {
+        dma0_regs.COMMON[0].INTA |= ch;
+    }
+    if (cfg & DMA_CHANNEL_XFERCFG_SETINTB_MASK) {
+        dma0_regs.COMMON[0].INTB |= ch;
+    }
+    dma0_regs.CHANNEL[CH].XFERCFG = cfg | DMA_CHANNEL_XFERCFG_XFERCOUNT_MASK;
+    failed |= !CHECK(cfg & DMA_CHANNEL_XFERCFG_RELOAD_MASK);
+    hw.reload = true;
+    if (!hw.late_reload || (rand() % 2)) {
+        dma_reload();
+    }
+}
+
+// Take the DMA interrupt if raised. The flags are cleared by writing 1,
+// so the handler must write just the channel's own: a flag of another
+// channel is set alongside to catch it writing nothing.
+static void take_interrupts(void)
+{
+    const uint32_t ch = 1U << CH;
+    uint32_t inta = dma0_regs.COMMON[0].INTA & ch;
+    uint32_t intb = dma0_regs.COMMON[0].INTB & ch;
+
+    if (!(inta | intb) || !(dma0_regs.COMMON[0].INTENSET & ch)) {
+        return;
+    }
+    hw.reloads_seen_late += hw.reload;
+    dma0_regs.COMMON[0].INTA = inta | (1U << OTHER_CH);
+    dma0_regs.COMMON[0].INTB = intb | (1U << OTHER_CH);
+    DMA0_IRQHandler();
+    failed |= !CHECK_EQUAL(inta, dma0_regs.COMMON[0].INTA);
+    failed |= !CHECK_EQUAL(intb, dma0_regs.COMMON[0].INTB);
+    dma0_regs.COMMON[0].INTA = 0;
+    dma0_regs.COMMON[0].INTB = 0;
+    hw.dma_irqs++;
+}
+
+// Stopping the channel clears both its flags, by writing 1 to them
+static void stopped(void)
+{
+    const uint32_t ch = 1U << CH;
+
+    CHECK_EQUAL(ch, dma0_regs.COMMON[0].INTA);
+    CHECK_EQUAL(ch, dma0_regs.COMMON[0].INTB);
+    dma0_regs.COMMON[0].INTA = 0;
+    dma0_regs.COMMON[0].INTB = 0;
+}
+
+// Read as the CDC bridge does and check the stream: bytes in order, and
+// where some were dropped, one whole marker followed by the oldest byte
+// the DMA has not overwritten
+static uint32_t cdc_read(uint32_t size)
+{
+    uint8_t data[RING * 2];
+    int32_t cnt = uart_read_data(data, size);
+    int32_t i;
+
+    failed |= !CHECK(cnt <= (int32_t)size);
+    for (i = 0; (i < cnt) && !failed; i++) {
+        if (!(data[i] & 0x80)) {
+            failed |= !CHECK_EQUAL(OVRF_MSG[cdc.marker_pos], data[i]);
+            cdc.marker_pos++;
+            if (OVRF_MSG_SIZE == cdc.marker_pos) {
+                cdc.marker_pos = 0;
+                cdc.markers++;
+                cdc.gap = true;
+            }
+            continue;
+        }
+        failed |= !CHECK_EQUAL(0, cdc.marker_pos);
+        if (cdc.gap) {
+            uint32_t oldest = hw.received - RING;
+
+            failed |= !CHECK(hw.received > RING) || !CHECK(oldest > cdc.next);
+            cdc.dropped += oldest - cdc.next;
+            cdc.next = oldest;
+            cdc.gaps++;
+            cdc.gap = false;
+        }
+        failed |= !CHECK_EQUAL(value(cdc.next), data[i]);
+        cdc.next++;
+        cdc.read++;
+    }
+    return cnt;
+}
+
+static void cdc_drain(void)
+{
+    while (cdc_read(1 + rand() % 64) && !failed) {
+    }
+}
+
+// The channel starts on a copy of the first half's descriptor, and the
+// two halves link to each other
+static void start(bool late_reload)
+{
+    UART_Configuration config = {
+        .Baudrate = 3000000,
+        .DataBits = UART_DATA_BITS_8,
+        .Parity = UART_PARITY_NONE,
+        .StopBits = UART_STOP_BITS_1,
+        .FlowControl = UART_FLOW_CONTROL_NONE,
+    };
+    const uint32_t xfercfg = DMA_CHANNEL_XFERCFG_CFGVALID_MASK | DMA_CHANNEL_XFERCFG_RELOAD_MASK |
+                             DMA_CHANNEL_XFERCFG_SWTRIG_MASK | DMA_CHANNEL_XFERCFG_DSTINC(1) |
+                             DMA_CHANNEL_XFERCFG_XFERCOUNT(HALF - 1);
+    desc_t *first;
+    desc_t *second;
+
+    memset(&hw, 0, sizeof(hw));
+    memset(&cdc, 0, sizeof(cdc));
+    failed = false;
+    hw.late_reload = late_reload;
+    uart_initialize();
+    uart_set_configuration(&config);
+    stopped();
+    CHECK(usart0_regs.FIFOCFG & USART_FIFOCFG_DMARX_MASK);
+    CHECK_EQUAL(0, dma0_regs.SRAMBASE % 512);
+    CHECK_EQUAL(xfercfg | DMA_CHANNEL_XFERCFG_SETINTA_MASK, dma0_regs.CHANNEL[CH].XFERCFG);
+    first = &dma_table()[CH];
+    second = first->next;
+    CHECK(&usart0_regs.FIFORD == first->src_end);
+    CHECK(&read_buffer_data[HALF - 1] == first->dst_end);
+    CHECK_EQUAL(xfercfg | DMA_CHANNEL_XFERCFG_SETINTB_MASK, second->xfercfg);
+    CHECK(&usart0_regs.FIFORD == second->src_end);
+    CHECK(&read_buffer_data[RING - 1] == second->dst_end);
+    CHECK_EQUAL(xfercfg | DMA_CHANNEL_XFERCFG_SETINTA_MASK, ((desc_t *)second->next)->xfercfg);
+    CHECK(&read_buffer_data[HALF - 1] == ((desc_t *)second->next)->dst_end);
+    CHECK(second == ((desc_t *)second->next)->next);
+}
+
+// Short bursts, as from a shell, are readable as soon as the bridge next
+// reads, with no idle interrupt to make them so, whole and in order across
+// many trips round the ring, and with an interrupt only every half ring
+static void test_bursts(bool late_reload)
+{
+    uint32_t burst;
+    uint32_t i;
+
+    srand(1);
+    start(late_reload);
+    for (burst = 0; (burst < 20000) && !failed; burst++) {
+        uint32_t n = 1 + rand() % ((rand() % 8) ? 16 : RING - 1);
+
+        for (i = 0; i < n; i++) {
+            line_byte();
+            // The DMA interrupt is sometimes late, but not a half ring late
+            if (rand() % 8 == 0) {
+                take_interrupts();
+            }
+        }
+        if (rand() % 2) {
+            take_interrupts();
+        }
+        cdc_drain();
+        failed |= !CHECK_EQUAL(hw.received, cdc.read);
+    }
+    printf("bursts%s: %u bytes, %u DMA interrupts, %u with the reload pending\n",
+           late_reload ? " (late reload)" : "", (unsigned)hw.received,
+           (unsigned)hw.dma_irqs, (unsigned)hw.reloads_seen_late);
+    CHECK_EQUAL(0, cdc.markers);
+    CHECK(hw.received > 20 * RING);
+    CHECK(hw.dma_irqs <= hw.received / HALF);
+    CHECK(hw.dma_irqs + 1 >= hw.received / HALF);
+    CHECK(!late_reload || hw.reloads_seen_late);
+}
+
+// A target logging faster than the host reads, with the reader stalling
+// now and then: every byte is read in order or dropped from the front,
+// each gap is marked once, and received == read + dropped
+static void test_slow_reader(bool late_reload)
+{
+    uint32_t stall = 0;
+    uint32_t iter;
+    uint32_t i;
+
+    srand(2);
+    start(late_reload);
+    for (iter = 0; (iter < 200000) && !failed; iter++) {
+        uint32_t n = rand() % 48;
+
+        for (i = 0; i < n; i++) {
+            line_byte();
+        }
+        if (rand() % 4) {
+            take_interrupts();
+        }
+        // Reads the size of whatever the CDC send buffer has free, and
+        // sometimes nothing for a long while
+        if (stall) {
+            stall--;
+        } else if (rand() % 256 == 0) {
+            stall = rand() % 100;
+        } else {
+            cdc_read(1 + rand() % ((rand() % 4) ? 64 : 2 * RING));
+        }
+    }
+    take_interrupts();
+    cdc_drain();
+    cdc_drain();
+    printf("slow reader%s: %u bytes, %u read, %u dropped in %u gaps, %u markers\n",
+           late_reload ? " (late reload)" : "", (unsigned)hw.received, (unsigned)cdc.read,
+           (unsigned)cdc.dropped, (unsigned)cdc.gaps, (unsigned)cdc.markers);
+    CHECK_EQUAL(0, cdc.marker_pos);
+    CHECK_EQUAL(cdc.gaps, cdc.markers);
+    CHECK_EQUAL(hw.received, cdc.read + cdc.dropped);
+    CHECK(cdc.gaps > 100);
+    CHECK(cdc.read > hw.received / 2);
+}
+
+// A reset empties the ring and restarts the DMA at its start, so a marker
+// half sent and data from before the reset are both gone
+static void test_reset(void)
+{
+    uint32_t i;
+
+    srand(3);
+    start(false);
+    for (i = 0; i < 3 * RING + 100; i++) {
+        line_byte();
+        take_interrupts();
+    }
+    cdc_read(5);
+    CHECK_EQUAL(5, cdc.marker_pos);
+
+    uart_reset();
+    stopped();
+    CHECK(dma0_regs.CHANNEL[CH].XFERCFG & DMA_CHANNEL_XFERCFG_CFGVALID_MASK);
+    CHECK_EQUAL(HALF - 1, COUNT(dma0_regs.CHANNEL[CH].XFERCFG));
+    memset(&hw, 0, sizeof(hw));
+    memset(&cdc, 0, sizeof(cdc));
+    for (i = 0; i < 100; i++) {
+        line_byte();
+    }
+    cdc_drain();
+    CHECK_EQUAL(100, cdc.read);
+    CHECK_EQUAL(0, cdc.markers);
+}
+
+int main(void)
+{
+    test_bursts(false);
+    test_bursts(true);
+    test_slow_reader(false);
+    test_slow_reader(true);
+    test_reset();
+    return unit_test_result();
+}
@@ -0,0 +1,731 @@
+/**
+ * @file    test_vfs_manager.c
+ * @brief   Host tests for vfs_manager.c behind the USB MSC class
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "unit_test.h"
+#include "util.h"
+#include "rl_usb.h"
+#include "usb_for_lib.h"
+#include "virtual_fs.h"
+#include "vfs_manager.h"
+#include "file_stream.h"
+#include "main_interface.h"
+#include "cmsis_os2.h"
+
+#define SECTOR              VFS_SECTOR_SIZE
+#define IMAGE_MAX           (64 * 1024)
+#define TICK_MS             90          // vfs_mngr_periodic() period in main_interface.c
+#define US_PER_SECTOR       125         // 1 ms for a 4 kB host write
+#define SCSI_READ10         0x28
+#define SCSI_WRITE10        0x2A
+#define SCSI_SYNC_CACHE10   0x35
+
+#ifdef __SANITIZE_THREAD__
+#define BENCH_MB            1
+#else
+#define BENCH_MB            8
+#endif
+#define BENCH_SECTORS       64          // 32 kB commands, as Linux and macOS send
+
+// USB device state owned by usbd_core.c and usb_lib.c in the firmware
+U8 USBD_EP0Buf[64];
+USB_SETUP_PACKET USBD_SetupPacket;
+U32 USBD_EndPointHalt;
+U32 USBD_EndPointStall;
+U8 USBD_HighSpeed;
+const U8 usbd_msc_ep_bulkin = 1;
+const U8 usbd_msc_ep_bulkout = 1;
+const U16 usbd_msc_maxpacketsize[2] = {64, 512};
+static const U8 inquiry_data[36];
+const U8 *usbd_msc_inquiry_data = inquiry_data;
+const U16 USBD_MSC_BulkBufSize = 512;
+U8 USBD_MSC_BulkBuf[512];
+
+// Host side of the bulk endpoints
+static const uint8_t *out_packet;
+static uint32_t out_size;
+static uint8_t *in_data;
+static uint32_t in_size;
+static uint32_t csw_count;
+static uint32_t csw_failed;
+static uint32_t stalls;
+
+// Simulated time, in microseconds
+static uint32_t now_us;
+static uint32_t next_tick_us;
+static uint32_t last_write_us;
+static uint32_t closed_us;
+static uint32_t remount_us;
+static bool image_created;
+static uint32_t other_changes;     // to the drive's own files
+static bool write_lost;
+
+// What the stream was given
+static stream_type_t stream_kind;
+static uint8_t streamed[IMAGE_MAX + 8 * SECTOR];
+static uint32_t streamed_size;
+static uint32_t largest_write;
+static uint32_t stream_writes;
+static bool stream_is_open;
+static bool stream_discard;         // only count what is streamed
+
+// Calls to usbd_msc_read_sect() and usbd_msc_write_sect(), which each
+// blink the LED
+static uint32_t msc_callbacks;
+
+static uint8_t image[IMAGE_MAX];
+static uint8_t shifted[IMAGE_MAX + VFS_CLUSTER_SIZE];
+static uint32_t image_size;
+
+// Filesystem layout read back from the boot sector
+static uint32_t fat_start;
+static uint32_t fat_sectors;
+static uint32_t root_start;
+static uint32_t data_start;
+static uint32_t sectors_per_cluster;
+static uint8_t root[2 * SECTOR];
+
+U32 USBD_ReadEP(U32 EPNum, U8 *pData, U32 cnt)
+{
+    uint32_t size = (out_size < cnt) ? out_size : cnt;
+
+    memcpy(pData, out_packet, size);
+    return size;
+}
+
+U32 USBD_WriteEP(U32 EPNum, U8 *pData, U32 cnt)
+{
+    if (13 == cnt) {
+        csw_count++;
+        csw_failed += (pData[12] != 0);
+    } else if (in_data) {
+        memcpy(in_data + in_size, pData, cnt);
+        in_size += cnt;
+    }
+    return cnt;
+}
+
+void USBD_SetStallEP(U32 EPNum)
+{
+    stalls++;
+}
+
+void main_blink_msc_led(main_led_state_t state)
+{
+    msc_callbacks++;
+}
+
+osThreadId_t osThreadGetId(void)
+{
+    return (osThreadId_t)1;
+}
+
+osMutexId_t osMutexNew(const osMutexAttr_t *attr)
+{
+    return (osMutexId_t)1;
+}
+
+osStatus_t osMutexAcquire(osMutexId_t mutex_id, uint32_t timeout)
+{
+    return osOK;
+}
+
+osStatus_t osMutexRelease(osMutexId_t mutex_id)
+{
+    return osOK;
+}
+
+void vfs_user_build_filesystem(void)
+{
+    vfs_init("DAPLINK    ", 64 * 1024 * 1024);
+}
+
+void vfs_user_file_change_handler(const vfs_filename_t filename, vfs_file_change_t change,
+                                  vfs_file_t file, vfs_file_t new_file_data)
+{
+    if (memcmp(filename, "IMAGE   ", 8) == 0) {
+        image_created |= (VFS_FILE_CREATED == change);
+    } else if (memcmp(filename, "_IMAGE~1", 8) != 0) {
+        other_changes++;
+    }
+}
+
+void vfs_user_disconnecting(void)
+{
+}
+
+// A bin stream has no end of its own; a hex one ends at its end record
+stream_type_t stream_start_identify(const uint8_t *data, uint32_t size)
+{
+    uint32_t sp;
+
+    if (':' == data[0]) {
+        return STREAM_TYPE_HEX;
+    }
+    memcpy(&sp, data, sizeof(sp));
+    return ((sp & 0xFFF00000) == 0x20000000) ? STREAM_TYPE_BIN : STREAM_TYPE_NONE;
+}
+
+stream_type_t stream_type_from_name(const vfs_filename_t filename)
+{
+    if (memcmp(filename + 8, "BIN", 3) == 0) {
+        return STREAM_TYPE_BIN;
+    }
+    if (memcmp(filename + 8, "HEX", 3) == 0) {
+        return STREAM_TYPE_HEX;
+    }
+    return STREAM_TYPE_NONE;
+}
+
+error_t stream_open(stream_type_t stream)
+{
+    CHECK(!stream_is_open);
+    stream_is_open = true;
+    stream_kind = stream;
+    streamed_size = 0;
+    return ERROR_SUCCESS;
+}
+
+error_t stream_write(const uint8_t *data, uint32_t size)
+{
+    static const char end_record[] = ":00000001FF";
+    uint32_t i;
+
+    CHECK(stream_is_open);
+    stream_writes++;
+    if (size > largest_write) {
+        largest_write = size;
+    }
+    if (stream_discard) {
+        streamed_size += size;
+        return ERROR_SUCCESS_DONE_OR_CONTINUE;
+    }
+    if (!CHECK(streamed_size + size <= sizeof(streamed))) {
+        return ERROR_FAILURE;
+    }
+    memcpy(streamed + streamed_size, data, size);
+    streamed_size += size;
+    if (STREAM_TYPE_HEX != stream_kind) {
+        return ERROR_SUCCESS_DONE_OR_CONTINUE;
+    }
+    for (i = 0; i + sizeof(end_record) - 1 <= streamed_size; i++) {
+        if (memcmp(streamed + i, end_record, sizeof(end_record) - 1) == 0) {
+            return ERROR_SUCCESS_DONE;
+        }
+    }
+    return ERROR_SUCCESS;
+}
+
+error_t stream_close(void)
+{
+    CHECK(stream_is_open);
+    stream_is_open = false;
+    closed_us = now_us;
+    return ERROR_SUCCESS;
+}
+
+void stream_set_size_hint(uint32_t size)
+{
+}
+
+// Run the 90 ms tick up to the new time and note when the drive goes away
+static void advance(uint32_t us)
+{
+    now_us += us;
+    while (now_us >= next_tick_us) {
+        bool ready = USBD_MSC_MediaReady;
+
+        vfs_mngr_periodic(TICK_MS);
+        if (ready && !USBD_MSC_MediaReady && (UINT32_MAX == remount_us)) {
+            remount_us = next_tick_us;
+        }
+        next_tick_us += TICK_MS * 1000;
+    }
+}
+
+static void send_cbw(uint8_t opcode, uint32_t lba, uint32_t count)
+{
+    static uint32_t tag;
+    uint8_t cbw[31] = {0x55, 0x53, 0x42, 0x43};
+    uint32_t length = count * SECTOR;
+
+    tag++;
+    memcpy(&cbw[4], &tag, 4);
+    memcpy(&cbw[8], &length, 4);
+    cbw[12] = (SCSI_READ10 == opcode) ? 0x80 : 0;
+    cbw[14] = 10;
+    cbw[15] = opcode;
+    cbw[17] = lba >> 24;
+    cbw[18] = lba >> 16;
+    cbw[19] = lba >> 8;
+    cbw[20] = lba;
+    cbw[22] = count >> 8;
+    cbw[23] = count;
+    out_packet = cbw;
+    out_size = sizeof(cbw);
+    USBD_MSC_EP_BULKOUT_Event(0);
+}
+
+// WRITE(10) of whole sectors, one endpoint packet at a time
+static void host_write(uint32_t lba, const uint8_t *data, uint32_t count)
+{
+    uint32_t packet = usbd_msc_maxpacketsize[USBD_HighSpeed];
+    uint32_t csws = csw_count;
+    uint32_t offset;
+
+    advance(count * US_PER_SECTOR);
+    if (!USBD_MSC_MediaReady) {
+        write_lost = true;
+        return;
+    }
+    send_cbw(SCSI_WRITE10, lba, count);
+    for (offset = 0; offset < count * SECTOR; offset += packet) {
+        out_packet = data + offset;
+        out_size = packet;
+        USBD_MSC_EP_BULKOUT_Event(0);
+    }
+    USBD_MSC_EP_BULKIN_Event(0);
+    CHECK_EQUAL(csws + 1, csw_count);
+    last_write_us = now_us;
+}
+
+// SYNCHRONIZE CACHE(10), as a host sends when it flushes a file
+static void host_sync(void)
+{
+    uint32_t csws = csw_count;
+
+    send_cbw(SCSI_SYNC_CACHE10, 0, 0);
+    USBD_MSC_EP_BULKIN_Event(0);
+    CHECK_EQUAL(csws + 1, csw_count);
+}
+
+static void host_read(uint32_t lba, uint8_t *data, uint32_t count)
+{
+    uint32_t csws = csw_count;
+    uint32_t packets = 0;
+
+    in_data = data;
+    in_size = 0;
+    send_cbw(SCSI_READ10, lba, count);
+    while ((in_size < count * SECTOR) && (packets++ < count * SECTOR)) {
+        USBD_MSC_EP_BULKIN_Event(0);
+    }
+    USBD_MSC_EP_BULKIN_Event(0);
+    USBD_MSC_EP_BULKIN_Event(0);
+    in_data = NULL;
+    CHECK_EQUAL(count * SECTOR, in_size);
+    CHECK_EQUAL(csws + 1, csw_count);
+}
+
+// The root directory is written along with the FAT sector before it, so
+// with a bigger group one request spans two media entries
+static void set_dir_entry(uint32_t slot, const char *name, uint8_t attr, uint16_t cluster, uint32_t size)
+{
+    uint8_t sectors[3 * SECTOR];
+    uint8_t *entry = &root[slot * 32];
+
+    memcpy(entry, name, 11);
+    entry[11] = attr;
+    entry[26] = cluster;
+    entry[27] = cluster >> 8;
+    memcpy(&entry[28], &size, 4);
+    vfs_read(root_start - 1, sectors, 1);
+    memcpy(sectors + SECTOR, root, sizeof(root));
+    host_write(root_start - 1, sectors, 3);
+}
+
+static void set_fat_chain(uint32_t first, uint32_t clusters)
+{
+    uint8_t fat[SECTOR] = {0xF8, 0xFF, 0xFF, 0xFF};
+    uint32_t c;
+
+    for (c = first; c < first + clusters; c++) {
+        uint16_t next = (c == first + clusters - 1) ? 0xFFFF : c + 1;
+
+        fat[c * 2] = next;
+        fat[c * 2 + 1] = next >> 8;
+    }
+    host_write(fat_start, fat, 1);
+    host_write(fat_start + fat_sectors, fat, 1);
+}
+
+// File data from cluster 2 on, 4 kB per command as hosts commonly do
+static void write_data(uint32_t from, uint32_t to)
+{
+    uint32_t offset;
+
+    for (offset = from; offset < to; offset += VFS_CLUSTER_SIZE) {
+        uint32_t size = (to - offset < VFS_CLUSTER_SIZE) ? to - offset : VFS_CLUSTER_SIZE;
+
+        host_write(data_start + offset / SECTOR, image + offset, (size + SECTOR - 1) / SECTOR);
+    }
+}
+
+static void make_image(bool hex, uint32_t size)
+{
+    static const char line[] = ":10000000000102030405060708090A0B0C0D0E0F78\n";
+    static const char end[] = ":00000001FF\n";
+    uint32_t sp = 0x20001000;
+    uint32_t i;
+
+    memset(image, 0, sizeof(image));
+    if (hex) {
+        image_size = 0;
+        while (image_size + 2 * sizeof(line) < size) {
+            memcpy(image + image_size, line, sizeof(line) - 1);
+            image_size += sizeof(line) - 1;
+        }
+        memcpy(image + image_size, end, sizeof(end) - 1);
+        image_size += sizeof(end) - 1;
+    } else {
+        memcpy(image, &sp, sizeof(sp));
+        for (i = 4; i < size; i++) {
+            image[i] = i * 7;
+        }
+        image_size = size;
+    }
+}
+
+// Mount the drive and read its boot sector and root directory through MSC
+static void mount(void)
+{
+    uint8_t boot[SECTOR];
+    uint8_t msc[8 * SECTOR];
+    uint8_t direct[SECTOR];
+    uint32_t sector;
+    uint32_t reserved;
+    uint32_t root_entries;
+
+    now_us = 0;
+    next_tick_us = TICK_MS * 1000;
+    remount_us = UINT32_MAX;
+    image_created = false;
+    other_changes = 0;
+    closed_us = UINT32_MAX;
+    last_write_us = 0;
+    write_lost = false;
+    streamed_size = 0;
+    largest_write = 0;
+    stream_is_open = false;
+    csw_failed = 0;
+    stalls = 0;
+
+    usbd_msc_init();
+    vfs_mngr_init(true);
+    USBD_MSC_EP_BULKIN_Event(0);
+    advance(1000 * 1000);
+    CHECK(USBD_MSC_MediaReady);
+
+    host_read(0, boot, 1);
+    reserved = boot[14] | (boot[15] << 8);
+    root_entries = boot[17] | (boot[18] << 8);
+    fat_start = reserved;
+    fat_sectors = boot[22] | (boot[23] << 8);
+    root_start = fat_start + boot[16] * fat_sectors;
+    data_start = root_start + root_entries * 32 / SECTOR;
+    sectors_per_cluster = boot[13];
+    CHECK_EQUAL(VFS_CLUSTER_SIZE / SECTOR, sectors_per_cluster);
+
+    // Multi-sector reads across the boot sector, FATs and root directory
+    // match the filesystem read sector by sector
+    for (sector = 0; sector < data_start; sector += 8) {
+        uint32_t count = (data_start - sector < 8) ? data_start - sector : 8;
+        uint32_t i;
+
+        host_read(sector, msc, count);
+        for (i = 0; i < count; i++) {
+            vfs_read(sector + i, direct, 1);
+            if (!CHECK(memcmp(msc + i * SECTOR, direct, SECTOR) == 0)) {
+                printf("sector %u\n", (unsigned)(sector + i));
+                return;
+            }
+        }
+    }
+    host_read(root_start, root, 2);
+}
+
+typedef enum {
+    ORDER_WINDOWS,      // entry created and sized first, then data
+    ORDER_LINUX,        // data, then FATs, then the entry
+    ORDER_MACOS,        // empty entries, data, sized entry, AppleDouble file
+    ORDER_SHIFTED,      // as linux, with writes that start in the cluster before the file
+    ORDER_FLUSH,        // appended and sized 4 kB at a time, 100 ms apart
+    ORDER_NO_DIR,       // written into a subdirectory the root never names
+    ORDER_ALIGNED,      // as linux, with an image of whole sectors
+    ORDER_SYNC,         // as aligned, then flushed with SYNCHRONIZE CACHE
+} order_t;
+
+static const char *const order_names[] = {"windows", "linux", "macos", "shifted", "flush", "no dir", "aligned", "sync"};
+
+typedef struct {
+    error_t status;
+    int32_t released_ms;    // stream closed, from the last host write
+    int32_t remount_ms;     // drive ejected, from the last host write
+} result_t;
+
+static result_t replay(order_t order, bool hex)
+{
+    const char *name = hex ? "IMAGE   HEX" : "IMAGE   BIN";
+    uint32_t clusters;
+    uint32_t offset;
+    uint32_t timeout_us;
+    result_t result;
+
+    mount();
+    make_image(hex, (order >= ORDER_ALIGNED) ? 40 * 1024 : 40000);
+    clusters = (image_size + VFS_CLUSTER_SIZE - 1) / VFS_CLUSTER_SIZE;
+
+    switch (order) {
+        case ORDER_WINDOWS:
+            set_dir_entry(1, name, 0x20, 0, 0);
+            set_fat_chain(2, clusters);
+            set_dir_entry(1, name, 0x20, 2, image_size);
+            write_data(0, image_size);
+            set_dir_entry(1, name, 0x20, 2, image_size);
+            break;
+        case ORDER_LINUX:
+            write_data(0, image_size);
+            set_fat_chain(2, clusters);
+            set_dir_entry(1, name, 0x20, 2, image_size);
+            break;
+        case ORDER_MACOS:
+            set_dir_entry(1, name, 0x20, 0, 0);
+            set_dir_entry(2, "_IMAGE~1BIN", 0x22, 0, 0);
+            write_data(0, image_size);
+            set_fat_chain(2, clusters + 1);
+            set_dir_entry(1, name, 0x20, 2, image_size);
+            host_write(data_start + clusters * sectors_per_cluster, image, 1);
+            set_dir_entry(2, "_IMAGE~1BIN", 0x22, 2 + clusters, SECTOR);
+            break;
+        case ORDER_SHIFTED:
+            // Half a cluster of free space, then the file from cluster 3,
+            // so every run the stream sees starts or ends mid cluster
+            memset(shifted, 0, VFS_CLUSTER_SIZE / 2);
+            memcpy(shifted + VFS_CLUSTER_SIZE / 2, image, image_size);
+            for (offset = 0; offset < VFS_CLUSTER_SIZE / 2 + image_size; offset += VFS_CLUSTER_SIZE) {
+                host_write(data_start + sectors_per_cluster / 2 + offset / SECTOR, shifted + offset,
+                           sectors_per_cluster);
+            }
+            set_fat_chain(3, clusters);
+            set_dir_entry(1, name, 0x20, 3, image_size);
+            break;
+        case ORDER_FLUSH:
+            set_dir_entry(1, name, 0x20, 0, 0);
+            for (offset = 0; offset < image_size; offset += VFS_CLUSTER_SIZE) {
+                uint32_t end = (offset + VFS_CLUSTER_SIZE < image_size) ? offset + VFS_CLUSTER_SIZE : image_size;
+
+                write_data(offset, end);
+                set_fat_chain(2, (end + VFS_CLUSTER_SIZE - 1) / VFS_CLUSTER_SIZE);
+                set_dir_entry(1, name, 0x20, 2, end);
+                advance(100 * 1000);
+            }
+            break;
+        case ORDER_NO_DIR:
+            write_data(0, image_size);
+            break;
+        case ORDER_ALIGNED:
+        case ORDER_SYNC:
+            write_data(0, image_size);
+            set_fat_chain(2, clusters);
+            set_dir_entry(1, name, 0x20, 2, image_size);
+            if (ORDER_SYNC == order) {
+                host_sync();
+            }
+            break;
+    }
+
+    timeout_us = last_write_us + 30 * 1000 * 1000;
+    while ((UINT32_MAX == remount_us) && (now_us < timeout_us)) {
+        advance(1000);
+    }
+
+    result.status = vfs_mngr_get_transfer_status();
+    result.released_ms = ((int32_t)closed_us - (int32_t)last_write_us) / 1000;
+    result.remount_ms = ((int32_t)remount_us - (int32_t)last_write_us) / 1000;
+    printf("%-7s %s: largest stream write %4u, target released %+6d ms, remount %+6d ms, status %d\n",
+           order_names[order], hex ? "hex" : "bin", (unsigned)largest_write,
+           (int)result.released_ms, (int)result.remount_ms, (int)result.status);
+
+    // Whatever the order, the whole image reaches the stream once, in
+    // whole groups where the host wrote them, and no host write is refused
+    CHECK(!write_lost);
+    CHECK(!stream_is_open);
+    CHECK(UINT32_MAX != remount_us);
+    CHECK(streamed_size >= image_size);
+    CHECK(memcmp(streamed, image, image_size) == 0);
+    CHECK_EQUAL(USBD_MSC_BlockGroup * SECTOR, largest_write);
+    CHECK_EQUAL(0, csw_failed);
+    CHECK_EQUAL(0, stalls);
+    CHECK_EQUAL(ORDER_NO_DIR != order, image_created);
+    CHECK_EQUAL(0, other_changes);
+    return result;
+}
+
+// A file sized before its data finishes as soon as the data is in: the
+// target is released at the last write and the drive remounts after one
+// idle tick
+static void test_windows_order(void)
+{
+    result_t bin = replay(ORDER_WINDOWS, false);
+    result_t hex = replay(ORDER_WINDOWS, true);
+
+    CHECK_EQUAL(ERROR_SUCCESS, bin.status);
+    CHECK(bin.released_ms <= 0);
+    CHECK(bin.remount_ms <= 2 * TICK_MS);
+    CHECK_EQUAL(ERROR_SUCCESS, hex.status);
+    CHECK(hex.released_ms <= 0);
+    CHECK(hex.remount_ms <= 2 * TICK_MS);
+}
+
+// A size that only arrives after the data: a hex file still finishes on
+// its end record, a bin file on the size, which ends inside a sector
+static void test_late_size_orders(void)
+{
+    order_t order;
+
+    for (order = ORDER_LINUX; order <= ORDER_SHIFTED; order++) {
+        result_t bin = replay(order, false);
+        result_t hex = replay(order, true);
+
+        CHECK_EQUAL(ERROR_SUCCESS, bin.status);
+        CHECK(bin.released_ms <= 0);
+        CHECK(bin.remount_ms <= 2 * TICK_MS);
+        CHECK_EQUAL(ERROR_SUCCESS, hex.status);
+        CHECK(hex.released_ms <= 0);
+        CHECK(hex.remount_ms <= 2 * TICK_MS);
+    }
+}
+
+// Sized after every part, so the size looks reached long before the end.
+// The parts are whole sectors and the transfer only finishes on the last,
+// shorter one.
+static void test_flush_order(void)
+{
+    result_t bin = replay(ORDER_FLUSH, false);
+
+    CHECK_EQUAL(ERROR_SUCCESS, bin.status);
+    CHECK(bin.released_ms >= 0);
+    CHECK(bin.remount_ms <= 2 * TICK_MS);
+}
+
+// A bin file of whole sectors sized after its data could still grow, so
+// it finishes when the host flushes, or failing that once the host is idle
+static void test_aligned_size(void)
+{
+    result_t idle = replay(ORDER_ALIGNED, false);
+    result_t sync = replay(ORDER_SYNC, false);
+
+    CHECK_EQUAL(ERROR_SUCCESS, idle.status);
+    CHECK(idle.remount_ms >= 500);
+    CHECK(idle.remount_ms <= 500 + 2 * TICK_MS);
+    CHECK_EQUAL(ERROR_SUCCESS, sync.status);
+    CHECK(sync.released_ms <= 0);
+    CHECK(sync.remount_ms <= 2 * TICK_MS);
+}
+
+// Without a root entry a hex file still ends at its end record
+static void test_no_dir_entry(void)
+{
+    result_t hex = replay(ORDER_NO_DIR, true);
+
+    CHECK_EQUAL(ERROR_SUCCESS, hex.status);
+    CHECK(hex.released_ms <= 0);
+    CHECK(hex.remount_ms <= 2 * TICK_MS);
+}
+
+static uint64_t wall_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Host time and media callbacks per MB of READ(10) from the data area, and
+// of WRITE(10) of a bin image streamed from the first sector on, in 32 kB
+// commands, best of five. A bigger group takes as many fewer callbacks.
+static void test_throughput(void)
+{
+    static uint8_t data[BENCH_SECTORS * SECTOR];
+    uint64_t best[2] = {UINT64_MAX, UINT64_MAX};
+    uint32_t callbacks[2];
+    uint32_t writes = 0;
+    uint32_t sectors = BENCH_MB * 1024 * 1024 / SECTOR;
+    uint64_t start;
+    uint32_t lba;
+    uint32_t run;
+
+    make_image(false, sizeof(data));
+    for (run = 0; run < 5; run++) {
+        mount();
+        msc_callbacks = 0;
+        start = wall_ns();
+        for (lba = 0; lba < sectors; lba += BENCH_SECTORS) {
+            host_read(data_start + lba, data, BENCH_SECTORS);
+        }
+        best[0] = MIN(best[0], wall_ns() - start);
+        callbacks[0] = msc_callbacks;
+
+        memcpy(data, image, sizeof(data));
+        stream_discard = true;
+        stream_writes = 0;
+        msc_callbacks = 0;
+        start = wall_ns();
+        for (lba = 0; lba < sectors; lba += BENCH_SECTORS) {
+            host_write(data_start + lba, data, BENCH_SECTORS);
+        }
+        best[1] = MIN(best[1], wall_ns() - start);
+        callbacks[1] = msc_callbacks;
+        writes = stream_writes;
+        stream_discard = false;
+        CHECK(!write_lost);
+        CHECK_EQUAL(sectors * SECTOR, streamed_size);
+    }
+    printf("MSC_BLOCK_GROUP %u, %s speed, per MB: read %.2f ms and %u callbacks, "
+           "write %.2f ms, %u callbacks and %u stream writes\n",
+           (unsigned)USBD_MSC_BlockGroup, USBD_HighSpeed ? "high" : "full",
+           best[0] / 1e6 / BENCH_MB, (unsigned)callbacks[0] / BENCH_MB,
+           best[1] / 1e6 / BENCH_MB, (unsigned)callbacks[1] / BENCH_MB,
+           (unsigned)writes / BENCH_MB);
+    CHECK_EQUAL(sectors / USBD_MSC_BlockGroup, callbacks[0]);
+    CHECK_EQUAL(sectors / USBD_MSC_BlockGroup, callbacks[1]);
+    CHECK_EQUAL(sectors / USBD_MSC_BlockGroup, writes);
+}
+
+int main(void)
+{
+    uint32_t speed;
+
+    for (speed = 0; speed < 2; speed++) {
+        USBD_HighSpeed = speed;
+        printf("%s speed packets\n", speed ? "high" : "full");
+        test_windows_order();
+        test_late_size_orders();
+        test_flush_order();
+        test_aligned_size();
+        test_no_dir_entry();
+        test_throughput();
+    }
+    return unit_test_result();
+}
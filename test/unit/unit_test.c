@@ -0,0 +1,91 @@
+/**
+ * @file    unit_test.c
+ * @brief   Checks shared by the host unit tests
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include "unit_test.h"
+#include "settings.h"
+
+// Checks may run on several threads at once in the threaded tests
+static uint32_t checks;
+static uint32_t failures;
+static uint32_t asserts;
+static bool asserts_expected;
+
+bool unit_test_check(bool pass, const char *expr, const char *file, int line)
+{
+    __atomic_fetch_add(&checks, 1, __ATOMIC_RELAXED);
+    if (!pass) {
+        __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+        printf("%s:%d: check failed: %s\n", file, line, expr);
+    }
+    return pass;
+}
+
+bool unit_test_check_equal(uint32_t expected, uint32_t actual, const char *expr, const char *file, int line)
+{
+    __atomic_fetch_add(&checks, 1, __ATOMIC_RELAXED);
+    if (expected != actual) {
+        __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+        printf("%s:%d: check failed: %s is 0x%08x, expected 0x%08x\n",
+               file, line, expr, (unsigned)actual, (unsigned)expected);
+        return false;
+    }
+    return true;
+}
+
+uint32_t unit_test_asserts(void)
+{
+    uint32_t count = asserts;
+
+    asserts = 0;
+    return count;
+}
+
+void unit_test_expect_asserts(bool expect)
+{
+    asserts_expected = expect;
+}
+
+int unit_test_result(void)
+{
+    printf("%u checks, %u failed\n", (unsigned)checks, (unsigned)failures);
+    return (failures == 0) ? 0 : 1;
+}
+
+// util_assert() ends up here through _util_assert() in util.c
+void config_ram_set_assert(const char *file, uint16_t line)
+{
+    asserts++;
+    if (!asserts_expected) {
+        failures++;
+        printf("%s:%u: util_assert failed\n", file, (unsigned)line);
+    }
+}
+
+// Report every assert, not just the first
+bool config_ram_get_assert(char *buf, uint16_t buf_size, uint16_t *line, assert_source_t *source)
+{
+    return false;
+}
+
+void config_ram_clear_assert(void)
+{
+}
@@ -0,0 +1,55 @@
+/**
+ * @file    unit_test.h
+ * @brief   Checks shared by the host unit tests
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2020 Arm Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UNIT_TEST_H
+#define UNIT_TEST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A failed check is reported and the test carries on, so one run shows
+// every failure. main() returns unit_test_result() to let ctest know.
+#define CHECK(expr) \
+    unit_test_check((expr), #expr, __FILE__, __LINE__)
+
+#define CHECK_EQUAL(expected, actual) \
+    unit_test_check_equal((uint32_t)(expected), (uint32_t)(actual), #actual, __FILE__, __LINE__)
+
+bool unit_test_check(bool pass, const char *expr, const char *file, int line);
+bool unit_test_check_equal(uint32_t expected, uint32_t actual, const char *expr, const char *file, int line);
+
+// util_assert() failures count as check failures, unless the test expects
+// them. Returns the number of asserts since the last call.
+uint32_t unit_test_asserts(void);
+void unit_test_expect_asserts(bool expect);
+
+// Print a summary and return the exit code for main()
+int unit_test_result(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
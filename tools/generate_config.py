@@ -32,8 +32,15 @@ CFG_KEY = 0x6b766c64
 # 8  - automation_allowed
 # 8  - overflow_detect
 # 8  - detect_incompatible_target
+# 8  - adaptive_swd_clock
+# 32 - swd_clock_idcode
+# 32 - swd_clock
+# 32 - crc_bootloader_key
+# 32 - crc_bootloader
+# 32 - crc_interface_key
+# 32 - crc_interface
 # 0  - 'end' member omitted
-FORMAT = '<LHBBBB'
+FORMAT = '<LHBBBBBLLLLLL'
 FORMAT_LENGTH = struct.calcsize(FORMAT)
 MINIMUM_ALIGN = 1 << 10  # 1k aligned
 
@@ -42,7 +49,8 @@ def create_hex(filename, addr, auto_rst, automation_allowed,
                overflow_detect, detect_incompatible_target, pad_size):
     intel_hex = IntelHex()
     intel_hex.puts(addr, struct.pack(FORMAT, CFG_KEY, FORMAT_LENGTH, auto_rst,
-                                     automation_allowed, overflow_detect, detect_incompatible_target))
+                                     automation_allowed, overflow_detect, detect_incompatible_target,
+                                     0, 0, 0, 0, 0, 0, 0))
     pad_addr = addr + FORMAT_LENGTH
     pad_byte_count = pad_size - (FORMAT_LENGTH % pad_size)
     pad_data = '\xFF' * pad_byte_count